@@ -2,6 +2,8 @@
 #include <libpq-fe.h>
 #include "src/DatabaseHandler/DatabaseHandler.h"
 #include "src/DbConnection/DbConnection.h"
+#include "src/TableFileReader/TableFileReader.h"
+#include "src/CopyEncoder/CopyEncoder.h"
 
 
 int main() {
@@ -21,10 +23,37 @@ int main() {
 
     const std::string tableName = DatabaseHandler::readTableName();
 
+    // database_handler.enablePlanCapture(100, std::chrono::milliseconds(500), "SQLplans.json");
+    // database_handler.setOutputBackend(OutputBackend::MAPPED);
+    // database_handler.setOutputBackend(OutputBackend::LZ4);
+    // database_handler.setOutputBackend(OutputBackend::PIPE); // Output file: a named pipe or >(zstd -o out.zst)
+    // database_handler.setExportMemoryBudget(64 * 1024 * 1024);
+    // database_handler.setWidthStrategy(WidthStrategy::SERVER_WIDTHS);
+    // database_handler.setExportFormat(ExportFormat::CSV);
+    // database_handler.setExportFormat(ExportFormat::COLUMNAR);
+    // database_handler.setSharding(ShardMode::HASH, 8, "id");
+    // database_handler.setCheckpointing(true);
+    // database_handler.setCopyStreaming(true);
+
     // database_handler.INSERT_SQL_QUERY(tableName);
 
+    // database_handler.BULK_INSERT_SQL_QUERY(tableName, "rows.tsv", "rejected_rows.tsv");
+
+    // CopyBinaryEncoder copyBinaryEncoder{connection};
+    // copyBinaryEncoder.begin(tableName, {"id", "price", "purchase_date"});
+    // copyBinaryEncoder.beginRow();
+    // copyBinaryEncoder.appendInt32(1);
+    // copyBinaryEncoder.appendNumeric(129999, 2);
+    // copyBinaryEncoder.appendDate(std::chrono::sys_days{std::chrono::year{2024} / 4 / 10});
+    // copyBinaryEncoder.endRow();
+    // copyBinaryEncoder.end();
+
+    // database_handler.enableWriteBehind(1000, std::chrono::seconds(1), DurabilityMode::WRITE_BEHIND);
+
     // database_handler.UPDATE_SQL_QUERY(tableName);
 
+    // database_handler.flushWriteBehind();
+
     // database_handler.DELETE_SQL_QUERY(tableName);
 
     // database_handler.CREATE_TABLE_SQL_QUERY(tableName);
@@ -41,11 +70,31 @@ int main() {
 
     // database_handler.EXECUTE_SQL_QUERY();
 
+    // database_handler.IMPORT_BLOB_SQL_QUERY(tableName, "payload.bin");
+
+    // database_handler.EXPORT_BLOB_SQL_QUERY(tableName, "payload.bin");
+
     database_handler.SELECT_ALL_SQL_QUERY(tableName, selectQueryFileNameEnv);
 
+    // database_handler.SELECT_ALL_INCREMENTAL_SQL_QUERY(tableName, selectQueryFileNameEnv, "updated_at");
+
+    // TableFileReader tableFileReader;
+    // tableFileReader.open(selectQueryFileNameEnv);
+    // tableFileReader.buildIndex(tableFileReader.columnNumber("id"), std::string(selectQueryFileNameEnv) + ".id.index");
+    // tableFileReader.openIndex(std::string(selectQueryFileNameEnv) + ".id.index");
+    // std::cout << tableFileReader.row(tableFileReader.find("42").front()) << '\n';
+
     // database_handler.SELECT_COLUMNS_SQL_QUERY(tableName, selectQueryFileNameEnv);
 
     // database_handler.SELECT_ALL_TABLES_SQL_QUERY(selectTablesOutputFileEnv);
 
+    // database_handler.EXPORT_ALL_TABLES_SQL_QUERY(selectQueryFileNameEnv);
+
+    // database_handler.DUMP_DATABASE_SQL_QUERY("staging.dump");
+
+    // database_handler.RESTORE_DATABASE_SQL_QUERY("staging.dump", true);
+
+    // database_handler.dumpPlanStore();
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "AsyncFileWriter.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+
+AsyncFileWriter::AsyncFileWriter(const bool isDirect, const std::size_t bufferSize, const std::size_t buffersCount)
+    : isDirect(isDirect),
+      // Direct I/O writes whole aligned blocks
+      bufferSize((std::max<std::size_t>(bufferSize, 1) + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT *
+                 DIRECT_IO_ALIGNMENT),
+      // Two at least: one being filled, one being written
+      buffersCount(std::max<std::size_t>(buffersCount, 2)) {
+}
+
+int AsyncFileWriter::open(const std::string &filePath) {
+    close();
+
+    if (outputFile.open(filePath, isDirect))
+        return 1;
+
+    // Allocated on the first open, a writer which is never opened costs nothing
+    while (buffers.size() < buffersCount)
+        buffers.push_back(static_cast<char *>(::operator new(bufferSize, std::align_val_t{DIRECT_IO_ALIGNMENT})));
+
+    freeBuffers.clear();
+    filledBuffers.clear();
+    isClosing = false;
+    writeStatus = 0;
+    streamedBytes = 0;
+    checksum = SHA256{};
+    checksumDigest.clear();
+
+    for (std::size_t i = 1; i < buffers.size(); ++i)
+        freeBuffers.push_back(i);
+
+    currentBuffer = 0;
+    setp(buffers[currentBuffer], buffers[currentBuffer] + bufferSize);
+
+    writerThread = std::thread(&AsyncFileWriter::writeBuffers, this);
+    return 0;
+}
+
+int AsyncFileWriter::submitCurrentBuffer() {
+    const std::size_t filledSize = pptr() - pbase();
+
+    std::unique_lock buffersLock{buffersMutex};
+
+    if (filledSize > 0) {
+        filledBuffers.push_back({currentBuffer, filledSize});
+        streamedBytes += filledSize;
+        buffersCondition.notify_all();
+
+        buffersCondition.wait(buffersLock, [this] { return !freeBuffers.empty(); });
+
+        currentBuffer = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+
+    setp(buffers[currentBuffer], buffers[currentBuffer] + bufferSize);
+    return writeStatus;
+}
+
+void AsyncFileWriter::writeBuffers() {
+    std::uint64_t fileOffset = 0;
+
+    while (true) {
+        FilledBuffer filledBuffer{};
+        bool isFailed;
+
+        {
+            std::unique_lock buffersLock{buffersMutex};
+            buffersCondition.wait(buffersLock, [this] { return !filledBuffers.empty() || isClosing; });
+
+            if (filledBuffers.empty())
+                return;
+
+            filledBuffer = filledBuffers.front();
+            filledBuffers.pop_front();
+            isFailed = writeStatus != 0;
+        }
+
+        std::size_t writeSize = filledBuffer.size;
+
+        if (isChecksummed)
+            checksum.update(buffers[filledBuffer.bufferIndex], filledBuffer.size);
+
+        if (isDirect && writeSize % DIRECT_IO_ALIGNMENT != 0) /* Only the last buffer, truncated on close */ {
+            const std::size_t paddedSize = (writeSize + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT *
+                                           DIRECT_IO_ALIGNMENT;
+            std::memset(buffers[filledBuffer.bufferIndex] + writeSize, 0, paddedSize - writeSize);
+            writeSize = paddedSize;
+        }
+
+        // After a failure the buffers are still recycled, so the stream never waits forever
+        const int bufferStatus = !isFailed && outputFile.writeAt(buffers[filledBuffer.bufferIndex], writeSize,
+                                                                 fileOffset);
+        fileOffset += filledBuffer.size;
+
+        std::lock_guard buffersLock{buffersMutex};
+        writeStatus |= bufferStatus;
+        freeBuffers.push_back(filledBuffer.bufferIndex);
+        buffersCondition.notify_all();
+    }
+}
+
+AsyncFileWriter::int_type AsyncFileWriter::overflow(const int_type ch) {
+    if (!outputFile.isOpen() || submitCurrentBuffer())
+        return traits_type::eof();
+
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize AsyncFileWriter::xsputn(const char *data, const std::streamsize size) {
+    std::streamsize copiedSize = 0;
+
+    while (copiedSize < size) {
+        if (pptr() == epptr() && (!outputFile.isOpen() || submitCurrentBuffer()))
+            return copiedSize;
+
+        const std::streamsize chunkSize = std::min<std::streamsize>(size - copiedSize, epptr() - pptr());
+        std::memcpy(pptr(), data + copiedSize, chunkSize);
+
+        // pbump takes an int, a chunk never exceeds the buffer size
+        pbump(static_cast<int>(chunkSize));
+        copiedSize += chunkSize;
+    }
+
+    return copiedSize;
+}
+
+int AsyncFileWriter::close() {
+    if (!outputFile.isOpen())
+        return 0;
+
+    submitCurrentBuffer();
+
+    {
+        std::lock_guard buffersLock{buffersMutex};
+        isClosing = true;
+        buffersCondition.notify_all();
+    }
+    writerThread.join();
+
+    int closeStatus = writeStatus;
+
+    // Cut the zeros padding the last direct I/O block
+    if (isDirect && closeStatus == 0)
+        closeStatus = outputFile.resize(streamedBytes);
+
+    outputFile.close();
+    setp(nullptr, nullptr);
+
+    if (isChecksummed)
+        checksumDigest = checksum.digest();
+
+    if (closeStatus != 0)
+        std::cerr << "Error: Cannot write the output file.\n";
+
+    return closeStatus;
+}
+
+void AsyncFileWriter::enableChecksum() {
+    isChecksummed = true;
+}
+
+std::uint64_t AsyncFileWriter::size() const {
+    return streamedBytes + (pptr() - pbase());
+}
+
+const std::string &AsyncFileWriter::getChecksum() const {
+    return checksumDigest;
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    close();
+
+    for (char *buffer: buffers)
+        ::operator delete(buffer, std::align_val_t{DIRECT_IO_ALIGNMENT});
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "../PositionalFile/PositionalFile.h"
+#include "../SHA256/SHA256.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Stream buffer writing a file from a ring of fixed-size buffers: the stream fills one buffer while a writer
+// thread writes the filled ones, so rendering and disk writes overlap. With direct I/O the buffers are
+// aligned, every write but the last is a whole buffer and the padded last block is truncated on close.
+// Use it through std::ostream stream{&asyncFileWriter};
+class AsyncFileWriter : public std::streambuf {
+    struct FilledBuffer {
+        std::size_t bufferIndex;
+        std::size_t size;
+    };
+
+    PositionalFile outputFile;
+    const bool isDirect;
+    const std::size_t bufferSize;
+    const std::size_t buffersCount;
+
+    std::vector<char *> buffers;
+    std::vector<std::size_t> freeBuffers;
+    std::deque<FilledBuffer> filledBuffers;
+    std::size_t currentBuffer = 0;
+
+    std::mutex buffersMutex;
+    std::condition_variable buffersCondition;
+    std::thread writerThread;
+    bool isClosing = false;
+    int writeStatus = 0;
+
+    // Bytes handed to the stream so far (the file size, without the direct I/O padding)
+    std::uint64_t streamedBytes = 0;
+
+    // SHA-256 of the file contents, updated by the writer thread (opt-in)
+    bool isChecksummed = false;
+    SHA256 checksum;
+    std::string checksumDigest;
+
+    // Hand the current buffer to the writer thread and wait for a free one
+    int submitCurrentBuffer();
+
+    // Writer thread: write the filled buffers in order, one after another
+    void writeBuffers();
+
+protected:
+    int_type overflow(int_type ch) override;
+
+    std::streamsize xsputn(const char *data, std::streamsize size) override;
+
+public:
+    explicit AsyncFileWriter(bool isDirect = false, std::size_t bufferSize = 4 * 1024 * 1024,
+                             std::size_t buffersCount = 4);
+
+    AsyncFileWriter(const AsyncFileWriter &) = delete;
+
+    AsyncFileWriter &operator=(const AsyncFileWriter &) = delete;
+
+    int open(const std::string &filePath);
+
+    // Hash the file contents as the writer thread writes them (call before open)
+    void enableChecksum();
+
+    // Bytes written to the stream since open
+    std::uint64_t size() const;
+
+    // Hex SHA-256 of the file, known after close
+    const std::string &getChecksum() const;
+
+    // Write the rest of the data and wait for the writer thread, non-zero when any write failed
+    int close();
+
+    ~AsyncFileWriter() override;
+};
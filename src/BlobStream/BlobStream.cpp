@@ -0,0 +1,416 @@
+#include "BlobStream.h"
+#include "../ByteOrder/ByteOrder.h"
+#include <libpq/libpq-fs.h>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+
+#define BLOB_CHUNK_SIZE (256 * 1024)
+#define BYTEA_MAX_SIZE 0x3FFFFFFF // 1 GB - 1, the biggest value a single field can hold
+#define COPY_BINARY_SIGNATURE "PGCOPY\n\377\r\n\0"
+#define COPY_BINARY_SIGNATURE_LENGTH 11
+#define BYTEA_UPLOAD_TABLE std::string("blob_stream_upload")
+#define BYTEA_EXPORT_TRANSACTION "BEGIN ISOLATION LEVEL REPEATABLE READ;"
+
+
+
+bool BlobStream::executeCommand(PGconn *connection, const char *command) {
+    PGresult *commandResult = PQexec(connection, command);
+    const bool isSuccessful = PQresultStatus(commandResult) == PGRES_COMMAND_OK;
+
+    if (!isSuccessful)
+        std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+
+    PQclear(commandResult);
+    return isSuccessful;
+}
+
+bool BlobStream::isRowUpdated(PGconn *connection, PGresult *updateResult, const std::string &column) {
+    bool isUpdated = false;
+
+    if (PQresultStatus(updateResult) != PGRES_COMMAND_OK)
+        std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+    else if (std::string(PQcmdTuples(updateResult)) == "0")
+        std::cerr << "BLOB STREAM failed: No row found to store the " << column << " value.\n";
+    else
+        isUpdated = true;
+
+    PQclear(updateResult);
+    return isUpdated;
+}
+
+bool BlobStream::buildReferencedQuery(PGconn *connection, std::string &referencedQuery) {
+    // Every oid or lo column of the user tables, the way vacuumlo looks for references
+    PGresult *columnsResult = PQexec(
+        connection,
+        "SELECT string_agg(format('SELECT 1 FROM %I.%I WHERE %I = $1::oid', n.nspname, c.relname, a.attname), "
+        "' UNION ALL ') "
+        "FROM pg_catalog.pg_attribute a JOIN pg_catalog.pg_class c ON c.oid = a.attrelid "
+        "JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace JOIN pg_catalog.pg_type t ON t.oid = a.atttypid "
+        "WHERE a.attnum > 0 AND NOT a.attisdropped AND c.relkind = 'r' AND t.typname IN ('oid', 'lo') "
+        "AND n.nspname NOT IN ('pg_catalog', 'information_schema') AND n.nspname NOT LIKE 'pg\\_toast%' "
+        "AND n.nspname NOT LIKE 'pg\\_temp%';");
+
+    if (PQresultStatus(columnsResult) != PGRES_TUPLES_OK) {
+        std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(columnsResult);
+        return false;
+    }
+
+    referencedQuery = PQgetisnull(columnsResult, 0, 0)
+                          ? std::string("SELECT false WHERE $1::oid IS NOT NULL;")
+                          : std::string("SELECT EXISTS (") + PQgetvalue(columnsResult, 0, 0) + std::string(");");
+    PQclear(columnsResult);
+    return true;
+}
+
+bool BlobStream::writeLargeObject(PGconn *connection, const Oid largeObjectId, std::ofstream &fileStream,
+                                  const std::string &outputFilePath) {
+    const int largeObjectFd = lo_open(connection, largeObjectId, INV_READ);
+
+    if (largeObjectFd < 0) {
+        std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+        return false;
+    }
+
+    std::vector<char> chunk(BLOB_CHUNK_SIZE);
+    int bytesRead;
+
+    while ((bytesRead = lo_read(connection, largeObjectFd, chunk.data(), chunk.size())) > 0) {
+        if (!fileStream.write(chunk.data(), bytesRead)) {
+            std::cerr << "BLOB STREAM failed: Cannot write " << outputFilePath << ".\n";
+
+            lo_close(connection, largeObjectFd);
+            return false;
+        }
+    }
+
+    lo_close(connection, largeObjectFd);
+
+    if (bytesRead < 0) {
+        std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+        return false;
+    }
+
+    if (!fileStream.flush()) {
+        std::cerr << "BLOB STREAM failed: Cannot write " << outputFilePath << ".\n";
+        return false;
+    }
+
+    return true;
+}
+
+int BlobStream::importLargeObject(PGconn *connection, const std::string &tableName, const std::string &column,
+                                  const std::string &whereColumn, const std::string &whereValue,
+                                  const std::string &inputFilePath) {
+    std::ifstream fileStream{inputFilePath, std::ios::binary};
+
+    if (!fileStream) {
+        std::cerr << "BLOB STREAM failed: Cannot open " << inputFilePath << ".\n";
+        return 1;
+    }
+
+    if (!executeCommand(connection, "BEGIN;"))
+        return 1;
+
+    // The rows are locked until the large objects they referenced are unlinked
+    const std::string previousQuery =
+            std::string("SELECT DISTINCT ") + column + std::string(" FROM ") + tableName +
+            std::string(" WHERE ") + whereColumn + std::string(" = $1 AND ") + column +
+            std::string(" IS NOT NULL FOR UPDATE;");
+
+    const char *previousParamValues[] = {whereValue.c_str()};
+
+    PGresult *previousResult = PQexecParams(
+        connection, previousQuery.c_str(), 1, nullptr, previousParamValues, nullptr, nullptr, 0);
+
+    if (PQresultStatus(previousResult) != PGRES_TUPLES_OK) {
+        std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(previousResult);
+        executeCommand(connection, "ROLLBACK;");
+        return 1;
+    }
+
+    std::vector<Oid> previousLargeObjectIds;
+    for (int i = 0; i < PQntuples(previousResult); ++i)
+        previousLargeObjectIds.push_back(static_cast<Oid>(std::stoul(PQgetvalue(previousResult, i, 0))));
+    PQclear(previousResult);
+
+    const Oid largeObjectId = lo_creat(connection, INV_READ | INV_WRITE);
+    const int largeObjectFd = largeObjectId == InvalidOid ? -1 : lo_open(connection, largeObjectId, INV_WRITE);
+
+    if (largeObjectFd < 0) {
+        std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+        executeCommand(connection, "ROLLBACK;");
+        return 1;
+    }
+
+    std::vector<char> chunk(BLOB_CHUNK_SIZE);
+
+    while (fileStream.read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || fileStream.gcount() > 0) {
+        if (lo_write(connection, largeObjectFd, chunk.data(), fileStream.gcount()) != fileStream.gcount()) {
+            std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+            executeCommand(connection, "ROLLBACK;");
+            return 1;
+        }
+    }
+
+    lo_close(connection, largeObjectFd);
+
+    const std::string updateQuery =
+            std::string("UPDATE ") + tableName + std::string(" SET ") + column +
+            std::string(" = $1 WHERE ") + whereColumn + std::string(" = $2;");
+
+    const std::string largeObjectIdValue = std::to_string(largeObjectId);
+    const char *updateParamValues[] = {largeObjectIdValue.c_str(), whereValue.c_str()};
+
+    PGresult *updateResult = PQexecParams(
+        connection,
+        updateQuery.c_str(),
+        2, // Number of parameters
+        nullptr, // Parameter types (NULL = infer from query)
+        updateParamValues, // Parameter values
+        nullptr, // Parameter lengths (NULL = assume text)
+        nullptr, // Parameter formats (NULL = assume text)
+        0 // Result format: 0 for text, 1 for binary
+    );
+
+    if (!isRowUpdated(connection, updateResult, column)) {
+        executeCommand(connection, "ROLLBACK;"); // Also drops the new large object
+        return 1;
+    }
+
+    // Other rows, of this or another table, may share a previous large object: only unreferenced ones are unlinked
+    std::string referencedQuery;
+
+    if (!previousLargeObjectIds.empty() && !buildReferencedQuery(connection, referencedQuery)) {
+        executeCommand(connection, "ROLLBACK;");
+        return 1;
+    }
+
+    for (const Oid previousLargeObjectId: previousLargeObjectIds) {
+        if (previousLargeObjectId == largeObjectId)
+            continue;
+
+        const std::string previousLargeObjectIdValue = std::to_string(previousLargeObjectId);
+        const char *referencedParamValues[] = {previousLargeObjectIdValue.c_str()};
+
+        PGresult *referencedResult = PQexecParams(
+            connection, referencedQuery.c_str(), 1, nullptr, referencedParamValues, nullptr, nullptr, 0);
+
+        if (PQresultStatus(referencedResult) != PGRES_TUPLES_OK) {
+            std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+
+            PQclear(referencedResult);
+            executeCommand(connection, "ROLLBACK;");
+            return 1;
+        }
+
+        const bool isReferenced = PQgetvalue(referencedResult, 0, 0)[0] == 't';
+        PQclear(referencedResult);
+
+        if (!isReferenced && lo_unlink(connection, previousLargeObjectId) < 0) {
+            std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+            executeCommand(connection, "ROLLBACK;");
+            return 1;
+        }
+    }
+
+    return executeCommand(connection, "COMMIT;") ? 0 : 1;
+}
+
+int BlobStream::exportLargeObject(PGconn *connection, const Oid largeObjectId, const std::string &outputFilePath) {
+    std::ofstream fileStream{outputFilePath, std::ios::binary};
+
+    if (!fileStream) {
+        std::cerr << "BLOB STREAM failed: Cannot open " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    if (!executeCommand(connection, "BEGIN;"))
+        return 1;
+
+    if (!writeLargeObject(connection, largeObjectId, fileStream, outputFilePath)) {
+        executeCommand(connection, "ROLLBACK;");
+        return 1;
+    }
+
+    return executeCommand(connection, "COMMIT;") ? 0 : 1;
+}
+
+int BlobStream::importBytea(PGconn *connection, const std::string &tableName, const std::string &column,
+                            const std::string &whereColumn, const std::string &whereValue,
+                            const std::string &inputFilePath) {
+    std::error_code errorCode;
+    const std::uintmax_t fileSize = std::filesystem::file_size(inputFilePath, errorCode);
+    std::ifstream fileStream{inputFilePath, std::ios::binary};
+
+    if (errorCode || !fileStream) {
+        std::cerr << "BLOB STREAM failed: Cannot open " << inputFilePath << ".\n";
+        return 1;
+    }
+
+    if (fileSize > BYTEA_MAX_SIZE) {
+        std::cerr << "BLOB STREAM failed: " << inputFilePath << " is too big for a BYTEA value, use a large object.\n";
+        return 1;
+    }
+
+    // The file goes through a temporary one-row table, COPY BINARY lets us send the field length up front
+    // and then the payload in chunks
+    const std::string createUploadTableQuery =
+            std::string("CREATE TEMP TABLE ") + BYTEA_UPLOAD_TABLE + std::string(" (data bytea) ON COMMIT DROP;");
+    const std::string copyQuery =
+            std::string("COPY ") + BYTEA_UPLOAD_TABLE + std::string(" (data) FROM STDIN (FORMAT binary);");
+
+    if (!executeCommand(connection, "BEGIN;"))
+        return 1;
+
+    if (!executeCommand(connection, createUploadTableQuery.c_str())) {
+        executeCommand(connection, "ROLLBACK;");
+        return 1;
+    }
+
+    PGresult *copyResult = PQexec(connection, copyQuery.c_str());
+
+    if (PQresultStatus(copyResult) != PGRES_COPY_IN) {
+        std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(copyResult);
+        executeCommand(connection, "ROLLBACK;");
+        return 1;
+    }
+    PQclear(copyResult);
+
+    // Header (signature, flags, extension length) and the tuple's field count and field length
+    std::string copyHeader(COPY_BINARY_SIGNATURE, COPY_BINARY_SIGNATURE_LENGTH);
+    appendBigEndian(copyHeader, 0, 4);
+    appendBigEndian(copyHeader, 0, 4);
+    appendBigEndian(copyHeader, 1, 2);
+    appendBigEndian(copyHeader, static_cast<uint32_t>(fileSize), 4);
+
+    bool isSent = PQputCopyData(connection, copyHeader.data(), static_cast<int>(copyHeader.size())) == 1;
+
+    std::vector<char> chunk(BLOB_CHUNK_SIZE);
+
+    while (isSent && (fileStream.read(chunk.data(), static_cast<std::streamsize>(chunk.size()))
+                      || fileStream.gcount() > 0))
+        isSent = PQputCopyData(connection, chunk.data(), static_cast<int>(fileStream.gcount())) == 1;
+
+    std::string copyTrailer;
+    appendBigEndian(copyTrailer, 0xFFFF, 2);
+
+    if (isSent)
+        isSent = PQputCopyData(connection, copyTrailer.data(), static_cast<int>(copyTrailer.size())) == 1;
+
+    PQputCopyEnd(connection, isSent ? nullptr : "BLOB STREAM aborted");
+
+    bool isCopied = true;
+
+    while ((copyResult = PQgetResult(connection)) != nullptr) {
+        if (PQresultStatus(copyResult) != PGRES_COMMAND_OK) {
+            std::cerr << "BLOB STREAM failed: " << PQresultErrorMessage(copyResult) << std::endl;
+            isCopied = false;
+        }
+        PQclear(copyResult);
+    }
+
+    if (!isSent || !isCopied) {
+        executeCommand(connection, "ROLLBACK;");
+        return 1;
+    }
+
+    const std::string updateQuery =
+            std::string("UPDATE ") + tableName + std::string(" SET ") + column +
+            std::string(" = (SELECT data FROM ") + BYTEA_UPLOAD_TABLE +
+            std::string(") WHERE ") + whereColumn + std::string(" = $1;");
+
+    const char *paramValues[] = {whereValue.c_str()};
+
+    PGresult *updateResult = PQexecParams(
+        connection,
+        updateQuery.c_str(),
+        1, // Number of parameters
+        nullptr, // Parameter types (NULL = infer from query)
+        paramValues, // Parameter values
+        nullptr, // Parameter lengths (NULL = assume text)
+        nullptr, // Parameter formats (NULL = assume text)
+        0 // Result format: 0 for text, 1 for binary
+    );
+
+    if (!isRowUpdated(connection, updateResult, column)) {
+        executeCommand(connection, "ROLLBACK;");
+        return 1;
+    }
+
+    return executeCommand(connection, "COMMIT;") ? 0 : 1;
+}
+
+int BlobStream::exportBytea(PGconn *connection, const std::string &tableName, const std::string &column,
+                            const std::string &whereColumn, const std::string &whereValue,
+                            const std::string &outputFilePath) {
+    std::ofstream fileStream{outputFilePath, std::ios::binary};
+
+    if (!fileStream) {
+        std::cerr << "BLOB STREAM failed: Cannot open " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    // The row is resolved once and read within the same snapshot (not read only: the copy is a large object)
+    if (!executeCommand(connection, BYTEA_EXPORT_TRANSACTION))
+        return 1;
+
+    const std::string rowQuery =
+            std::string("SELECT ctid FROM ") + tableName + std::string(" WHERE ") + whereColumn +
+            std::string(" = $1 AND ") + column + std::string(" IS NOT NULL LIMIT 2;");
+
+    const char *rowParamValues[] = {whereValue.c_str()};
+
+    PGresult *rowResult = PQexecParams(connection, rowQuery.c_str(), 1, nullptr, rowParamValues, nullptr, nullptr, 0);
+
+    if (PQresultStatus(rowResult) != PGRES_TUPLES_OK || PQntuples(rowResult) != 1) {
+        if (PQresultStatus(rowResult) != PGRES_TUPLES_OK)
+            std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+        else if (PQntuples(rowResult) == 0)
+            std::cerr << "BLOB STREAM failed: No " << column << " value found.\n";
+        else
+            std::cerr << "BLOB STREAM failed: More than one row has a " << column << " value WHERE " << whereColumn
+                    << " = " << whereValue << ".\n";
+
+        PQclear(rowResult);
+        executeCommand(connection, "ROLLBACK;");
+        return 1;
+    }
+
+    const std::string rowId = PQgetvalue(rowResult, 0, 0);
+    PQclear(rowResult);
+
+    // Slicing a compressed value decompresses it from the start for every chunk, so the value is detoasted once
+    // into a large object of this transaction (dropped by its ROLLBACK) and streamed from there
+    const std::string copyQuery =
+            std::string("SELECT lo_from_bytea(0, ") + column + std::string(") FROM ") + tableName +
+            std::string(" WHERE ctid = $1::tid;");
+
+    const char *copyParamValues[] = {rowId.c_str()};
+
+    PGresult *copyResult = PQexecParams(
+        connection, copyQuery.c_str(), 1, nullptr, copyParamValues, nullptr, nullptr, 0);
+
+    if (PQresultStatus(copyResult) != PGRES_TUPLES_OK || PQntuples(copyResult) != 1) {
+        std::cerr << "BLOB STREAM failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(copyResult);
+        executeCommand(connection, "ROLLBACK;");
+        return 1;
+    }
+
+    const Oid largeObjectId = static_cast<Oid>(std::stoul(PQgetvalue(copyResult, 0, 0)));
+    PQclear(copyResult);
+
+    const bool isWritten = writeLargeObject(connection, largeObjectId, fileStream, outputFilePath);
+    return executeCommand(connection, "ROLLBACK;") && isWritten ? 0 : 1;
+}
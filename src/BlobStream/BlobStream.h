@@ -0,0 +1,44 @@
+#pragma once
+#include <libpq-fe.h>
+#include <fstream>
+#include <string>
+
+
+// Chunked transfer of binary payloads (BYTEA cells, large objects) between files and the server.
+// The whole blob is never held in memory nor hex-encoded in text mode.
+class BlobStream {
+    // Run a command which is expected to return PGRES_COMMAND_OK
+    static bool executeCommand(PGconn *connection, const char *command);
+
+    // Check (and clear) the result of the UPDATE storing *column*, which has to change at least one row
+    static bool isRowUpdated(PGconn *connection, PGresult *updateResult, const std::string &column);
+
+    // Query telling whether any oid or lo column of a user table still holds the large object $1
+    static bool buildReferencedQuery(PGconn *connection, std::string &referencedQuery);
+
+    // Stream a large object into *fileStream*, within the open transaction
+    static bool writeLargeObject(PGconn *connection, Oid largeObjectId, std::ofstream &fileStream,
+                                 const std::string &outputFilePath);
+
+public:
+    // Stream a file into a new large object referenced by *tableName*.*column* of the rows WHERE *whereColumn* =
+    // *whereValue*, in one transaction which also unlinks the large objects they referenced before (unless another
+    // row still references them)
+    static int importLargeObject(PGconn *connection, const std::string &tableName, const std::string &column,
+                                 const std::string &whereColumn, const std::string &whereValue,
+                                 const std::string &inputFilePath);
+
+    // Stream a large object into a file
+    static int exportLargeObject(PGconn *connection, Oid largeObjectId, const std::string &outputFilePath);
+
+    // Stream a file into *tableName*.*column* of the rows WHERE *whereColumn* = *whereValue* (COPY BINARY)
+    static int importBytea(PGconn *connection, const std::string &tableName, const std::string &column,
+                           const std::string &whereColumn, const std::string &whereValue,
+                           const std::string &inputFilePath);
+
+    // Stream *tableName*.*column* of the only row WHERE *whereColumn* = *whereValue* into a file (through a
+    // temporary large object)
+    static int exportBytea(PGconn *connection, const std::string &tableName, const std::string &column,
+                           const std::string &whereColumn, const std::string &whereValue,
+                           const std::string &outputFilePath);
+};
@@ -0,0 +1,367 @@
+#include "BulkWriter.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+
+#define MAX_QUERY_PARAMETERS 65535
+#define INPUT_SEPARATOR '\t'
+#define NULL_VALUE std::string("\\N")
+#define BULK_SAVEPOINT std::string("bulk_writer")
+// SQLSTATE class 42: syntax errors, undefined tables/columns... no row of the batch would ever succeed
+#define STATEMENT_ERROR_CLASS std::string("42")
+
+
+// Split a line of the input file by the separator
+std::vector<std::string> splitInputLine(const std::string &line);
+
+
+BulkWriter::BulkWriter(PGconn *connection, std::string tableName, std::string rejectFilePath,
+                       const std::size_t batchSize)
+    : connection(connection),
+      tableName(std::move(tableName)),
+      rejectFilePath(std::move(rejectFilePath)),
+      batchSize(std::max<std::size_t>(batchSize, 1)) {
+}
+
+int BulkWriter::writeFile(const std::string &inputFilePath) {
+    std::ifstream inputStream{inputFilePath, std::ios::binary};
+
+    if (!inputStream) {
+        std::cerr << "BULK INSERT failed: Cannot open " << inputFilePath << ".\n";
+        return 1;
+    }
+
+    std::string line;
+
+    if (!std::getline(inputStream, line)) {
+        std::cerr << "BULK INSERT failed: " << inputFilePath << " has no column names line.\n";
+        return 1;
+    }
+
+    inputOffset = line.length() + 1;
+    lineNumber = 1;
+
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+
+    columns = splitInputLine(line);
+
+    if (!checkpointFilePath.empty() && resumeCheckpoint(inputStream, inputFilePath))
+        return 1;
+
+    // A statement cannot carry more parameters than the server accepts
+    const std::size_t rowsPerStatement = std::max<std::size_t>(MAX_QUERY_PARAMETERS / columns.size(), 1);
+    batchSize = std::min(batchSize, rowsPerStatement);
+
+    std::vector<InputRow> batch;
+    batch.reserve(batchSize);
+
+    while (std::getline(inputStream, line)) {
+        ++lineNumber;
+        inputOffset += line.length() + 1;
+
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        if (line.empty())
+            continue;
+
+        InputRow inputRow{lineNumber, line, splitInputLine(line), {}};
+
+        if (inputRow.values.size() != columns.size()) /* Malformed rows never reach the server */ {
+            rejectRow(inputRow, std::string("expected ") + std::to_string(columns.size()) + " values, found " +
+                                std::to_string(inputRow.values.size()));
+            continue;
+        }
+
+        inputRow.nulls.reserve(inputRow.values.size());
+        for (const auto &value: inputRow.values)
+            inputRow.nulls.push_back(value == NULL_VALUE);
+
+        batch.push_back(std::move(inputRow));
+
+        if (batch.size() == batchSize) {
+            if (insertBatch(batch))
+                return 1;
+            batch.clear();
+        }
+    }
+
+    if (!batch.empty() && insertBatch(batch))
+        return 1;
+
+    // The whole input is in, a rerun has nothing to resume
+    if (!checkpointFilePath.empty())
+        std::remove(checkpointFilePath.c_str());
+
+    return 0;
+}
+
+void BulkWriter::enableCheckpoint(const std::string &checkpointFilePath) {
+    this->checkpointFilePath = checkpointFilePath;
+}
+
+int BulkWriter::resumeCheckpoint(std::ifstream &inputStream, const std::string &inputFilePath) {
+    if (checkpoint.load(checkpointFilePath) != 0 || checkpoint.tableName != tableName ||
+        checkpoint.inputFilePath != inputFilePath) /* A fresh start, right after the column names line */ {
+        checkpoint = ImportCheckpoint{};
+        checkpoint.tableName = tableName;
+        checkpoint.inputFilePath = inputFilePath;
+        checkpoint.committed = currentProgress();
+        return checkpoint.save(checkpointFilePath);
+    }
+
+    // The run died between recording a batch and its COMMIT: the server knows whether it committed, unless the
+    // transaction is so old that its status was discarded
+    if (!checkpoint.pendingTransactionId.empty()) {
+        const char *paramValues[] = {checkpoint.pendingTransactionId.c_str()};
+        PGresult *statusResult = PQexecParams(connection, "SELECT txid_status($1::bigint);", 1, nullptr,
+                                              paramValues, nullptr, nullptr, 0);
+
+        const bool isStatusRead = PQresultStatus(statusResult) == PGRES_TUPLES_OK;
+        const std::string transactionStatus = isStatusRead ? PQgetvalue(statusResult, 0, 0) : "";
+        // NULL once the transaction is too old for the server to remember how it ended: retrying cannot tell
+        const bool isStatusForgotten = isStatusRead && PQgetisnull(statusResult, 0, 0);
+        PQclear(statusResult);
+
+        if (isStatusForgotten) {
+            std::cerr << "BULK INSERT failed: The server no longer knows whether the last batch of the previous run "
+                    << "(transaction " << checkpoint.pendingTransactionId << ", lines "
+                    << checkpoint.committed.lineNumber + 1 << " to " << checkpoint.pending.lineNumber
+                    << ") committed. If its rows are in " << tableName << ", copy \"pending\" over \"committed\" in "
+                    << checkpointFilePath << "; either way set \"pendingTransactionId\" to \"\" there, then run "
+                    << "again.\n";
+            return 1;
+        }
+
+        if (transactionStatus != "committed" && transactionStatus != "aborted") {
+            std::cerr << "BULK INSERT failed: The last batch of the previous run (transaction "
+                    << checkpoint.pendingTransactionId << ") is " << (transactionStatus.empty()
+                                                                         ? "of unknown status"
+                                                                         : transactionStatus)
+                    << ", try again once it ended.\n";
+            return 1;
+        }
+
+        if (transactionStatus == "committed")
+            checkpoint.committed = checkpoint.pending;
+
+        checkpoint.pendingTransactionId.clear();
+        if (checkpoint.save(checkpointFilePath))
+            return 1;
+    }
+
+    const ImportProgress &committed = checkpoint.committed;
+
+    inputStream.seekg(static_cast<std::streamoff>(committed.inputOffset));
+    inputOffset = committed.inputOffset;
+    lineNumber = committed.lineNumber;
+    insertedRowsCount = committed.insertedRowsCount;
+    rejectedRowsCount = committed.rejectedRowsCount;
+
+    // Rejects written after the checkpoint come again with their lines
+    std::error_code errorCode;
+    if (std::filesystem::exists(rejectFilePath, errorCode)) {
+        std::filesystem::resize_file(rejectFilePath, committed.rejectFileOffset, errorCode);
+        rejectStream.open(rejectFilePath, std::ios::binary | std::ios::in | std::ios::out);
+        rejectStream.seekp(0, std::ios::end);
+    }
+
+    std::cout << "Resuming the import of " << inputFilePath << " at line " << lineNumber + 1 << " ("
+            << insertedRowsCount << " row(s) inserted before).\n";
+    return 0;
+}
+
+ImportProgress BulkWriter::currentProgress() {
+    ImportProgress progress;
+    progress.inputOffset = inputOffset;
+    progress.lineNumber = lineNumber;
+    progress.insertedRowsCount = insertedRowsCount;
+    progress.rejectedRowsCount = rejectedRowsCount;
+
+    if (rejectStream.is_open()) {
+        rejectStream.flush();
+        progress.rejectFileOffset = static_cast<std::uint64_t>(rejectStream.tellp());
+    }
+
+    return progress;
+}
+
+int BulkWriter::savePendingCheckpoint() {
+    PGresult *transactionResult = PQexec(connection, "SELECT txid_current();");
+
+    if (PQresultStatus(transactionResult) != PGRES_TUPLES_OK) {
+        std::cerr << "BULK INSERT failed: " << PQerrorMessage(connection) << std::endl;
+        PQclear(transactionResult);
+        return 1;
+    }
+
+    checkpoint.pendingTransactionId = PQgetvalue(transactionResult, 0, 0);
+    checkpoint.pending = currentProgress();
+    PQclear(transactionResult);
+
+    return checkpoint.save(checkpointFilePath);
+}
+
+int BulkWriter::saveCommittedCheckpoint() {
+    checkpoint.committed = checkpoint.pending;
+    checkpoint.pendingTransactionId.clear();
+    return checkpoint.save(checkpointFilePath);
+}
+
+int BulkWriter::insertBatch(const std::vector<InputRow> &rows) {
+    if (!executeCommand("BEGIN;"))
+        return 1;
+
+    if (insertIsolated(rows, 0, rows.size()) || (!checkpointFilePath.empty() && savePendingCheckpoint())) {
+        executeCommand("ROLLBACK;");
+        return 1;
+    }
+
+    if (!executeCommand("COMMIT;"))
+        return 1;
+
+    return checkpointFilePath.empty() ? 0 : saveCommittedCheckpoint();
+}
+
+int BulkWriter::insertIsolated(const std::vector<InputRow> &rows, const std::size_t begin, const std::size_t end) {
+    const std::string savepointQuery = std::string("SAVEPOINT ") + BULK_SAVEPOINT + std::string(";");
+    const std::string releaseQuery = std::string("RELEASE SAVEPOINT ") + BULK_SAVEPOINT + std::string(";");
+    const std::string rollbackQuery =
+            std::string("ROLLBACK TO SAVEPOINT ") + BULK_SAVEPOINT + std::string("; ") + releaseQuery;
+
+    if (!executeCommand(savepointQuery.c_str()))
+        return 1;
+
+    std::string errorMessage;
+    bool isRowError;
+
+    if (insertRows(rows, begin, end, errorMessage, isRowError)) {
+        insertedRowsCount += end - begin;
+        return executeCommand(releaseQuery.c_str()) ? 0 : 1;
+    }
+
+    // Broken statement or lost connection: nothing can be isolated
+    if (!isRowError || PQstatus(connection) != CONNECTION_OK || !executeCommand(rollbackQuery.c_str())) {
+        std::cerr << "BULK INSERT failed: " << errorMessage << std::endl;
+        return 1;
+    }
+
+    if (end - begin == 1) {
+        rejectRow(rows[begin], errorMessage);
+        return 0;
+    }
+
+    const std::size_t middle = begin + (end - begin) / 2;
+
+    if (insertIsolated(rows, begin, middle))
+        return 1;
+
+    return insertIsolated(rows, middle, end);
+}
+
+bool BulkWriter::insertRows(const std::vector<InputRow> &rows, const std::size_t begin, const std::size_t end,
+                            std::string &errorMessage, bool &isRowError) const {
+    std::stringstream insertQueryStream{}; // Start to build the query
+    insertQueryStream << "INSERT INTO " << tableName << " (";
+
+    for (std::size_t i = 0; i < columns.size(); i++) {
+        insertQueryStream << columns[i];
+        if (i < columns.size() - 1)
+            insertQueryStream << ", ";
+    }
+    insertQueryStream << ") VALUES ";
+
+    std::vector<const char *> paramValues;
+    paramValues.reserve((end - begin) * columns.size());
+
+    for (std::size_t i = begin; i < end; i++) /* Add placeholders for the dynamic data to the query */ {
+        insertQueryStream << (i > begin ? ", (" : "(");
+
+        for (std::size_t j = 0; j < columns.size(); j++) {
+            paramValues.push_back(rows[i].nulls[j] ? nullptr : rows[i].values[j].c_str());
+
+            insertQueryStream << '$' << paramValues.size();
+            if (j < columns.size() - 1)
+                insertQueryStream << ", ";
+        }
+        insertQueryStream << ')';
+    }
+    insertQueryStream << ';';
+
+    PGresult *insertResult = PQexecParams(
+        connection,
+        insertQueryStream.str().c_str(),
+        static_cast<int>(paramValues.size()),
+        nullptr,
+        paramValues.data(),
+        nullptr,
+        nullptr,
+        0
+    );
+
+    const bool isInserted = PQresultStatus(insertResult) == PGRES_COMMAND_OK;
+
+    if (!isInserted) {
+        const char *primaryMessage = PQresultErrorField(insertResult, PG_DIAG_MESSAGE_PRIMARY);
+        const char *sqlState = PQresultErrorField(insertResult, PG_DIAG_SQLSTATE);
+
+        errorMessage = primaryMessage != nullptr ? primaryMessage : PQerrorMessage(connection);
+        isRowError = sqlState != nullptr && std::string(sqlState).rfind(STATEMENT_ERROR_CLASS, 0) != 0;
+    }
+
+    PQclear(insertResult);
+    return isInserted;
+}
+
+void BulkWriter::rejectRow(const InputRow &row, const std::string &errorMessage) {
+    if (!rejectStream.is_open())
+        rejectStream.open(rejectFilePath, std::ios::binary);
+
+    std::string singleLineMessage = errorMessage;
+    std::replace(singleLineMessage.begin(), singleLineMessage.end(), '\n', ' ');
+    std::replace(singleLineMessage.begin(), singleLineMessage.end(), INPUT_SEPARATOR, ' ');
+
+    // line number, error, original line
+    rejectStream << row.lineNumber << INPUT_SEPARATOR << singleLineMessage << INPUT_SEPARATOR << row.line << '\n';
+    ++rejectedRowsCount;
+}
+
+bool BulkWriter::executeCommand(const char *command) const {
+    PGresult *commandResult = PQexec(connection, command);
+    const bool isSuccessful = PQresultStatus(commandResult) == PGRES_COMMAND_OK;
+
+    if (!isSuccessful)
+        std::cerr << "BULK INSERT failed: " << PQerrorMessage(connection) << std::endl;
+
+    PQclear(commandResult);
+    return isSuccessful;
+}
+
+std::size_t BulkWriter::getInsertedRowsCount() const {
+    return insertedRowsCount;
+}
+
+std::size_t BulkWriter::getRejectedRowsCount() const {
+    return rejectedRowsCount;
+}
+
+
+std::vector<std::string> splitInputLine(const std::string &line) {
+    std::vector<std::string> values;
+    std::string::size_type start = 0;
+
+    while (true) {
+        const std::string::size_type separatorPosition = line.find(INPUT_SEPARATOR, start);
+
+        if (separatorPosition == std::string::npos) {
+            values.push_back(line.substr(start));
+            return values;
+        }
+
+        values.push_back(line.substr(start, separatorPosition - start));
+        start = separatorPosition + 1;
+    }
+}
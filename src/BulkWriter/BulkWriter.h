@@ -0,0 +1,78 @@
+#pragma once
+#include "../Checkpoint/Checkpoint.h"
+#include <libpq-fe.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// Inserts a tab separated file (first line: column names, \N: NULL) in multi-row batches. A failing batch is
+// bisected under savepoints until the offending rows are isolated; they go to a reject file with their error
+// message while every other row is committed.
+class BulkWriter {
+    // One line of the input file
+    struct InputRow {
+        std::size_t lineNumber;
+        std::string line;
+        std::vector<std::string> values;
+        std::vector<bool> nulls;
+    };
+
+    PGconn *connection;
+    std::string tableName;
+    std::string rejectFilePath;
+    std::size_t batchSize;
+    std::vector<std::string> columns;
+    std::ofstream rejectStream;
+    std::size_t insertedRowsCount = 0;
+    std::size_t rejectedRowsCount = 0;
+
+    // Position in the input after the last line read
+    std::uint64_t inputOffset = 0;
+    std::size_t lineNumber = 0;
+
+    // Opt-in checkpoint of the committed batches (no checkpoint file: not resumable)
+    std::string checkpointFilePath;
+    ImportCheckpoint checkpoint;
+
+    // Continue where the checkpoint of an earlier run of the same input ended, after settling its pending batch
+    int resumeCheckpoint(std::ifstream &inputStream, const std::string &inputFilePath);
+
+    // Progress up to the last line read
+    ImportProgress currentProgress();
+
+    // Record the batch of the open transaction as pending (before COMMIT) or as committed (after it)
+    int savePendingCheckpoint();
+
+    int saveCommittedCheckpoint();
+
+    // Insert rows [begin, end) under a savepoint, splitting them in halves on failure
+    int insertIsolated(const std::vector<InputRow> &rows, std::size_t begin, std::size_t end);
+
+    // One multi-row INSERT of rows [begin, end), *errorMessage* is set on failure and *isRowError* tells
+    // whether the data caused it (and not e.g. a missing table or column)
+    bool insertRows(const std::vector<InputRow> &rows, std::size_t begin, std::size_t end,
+                    std::string &errorMessage, bool &isRowError) const;
+
+    // Insert one batch in its own transaction
+    int insertBatch(const std::vector<InputRow> &rows);
+
+    // Write a row which cannot be inserted to the reject file
+    void rejectRow(const InputRow &row, const std::string &errorMessage);
+
+    // Run a command which is expected to return PGRES_COMMAND_OK
+    bool executeCommand(const char *command) const;
+
+public:
+    BulkWriter(PGconn *connection, std::string tableName, std::string rejectFilePath, std::size_t batchSize);
+
+    // Make writeFile resumable: every committed batch is recorded in *checkpointFilePath*, a later writeFile of
+    // the same input and table continues after the last one (the rejects of the lost work are cut as well)
+    void enableCheckpoint(const std::string &checkpointFilePath);
+
+    int writeFile(const std::string &inputFilePath);
+
+    std::size_t getInsertedRowsCount() const;
+
+    std::size_t getRejectedRowsCount() const;
+};
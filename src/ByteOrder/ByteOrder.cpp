@@ -0,0 +1,30 @@
+#include "ByteOrder.h"
+
+
+void appendLittleEndian(std::string &destination, const std::uint64_t value, const int bytes) {
+    for (int i = 0; i < bytes; ++i)
+        destination.push_back(static_cast<char>(value >> 8 * i & 0xFF));
+}
+
+std::uint64_t readLittleEndian(const char *data, const int bytes) {
+    std::uint64_t value = 0;
+
+    for (int i = bytes - 1; i >= 0; --i)
+        value = value << 8 | static_cast<unsigned char>(data[i]);
+
+    return value;
+}
+
+void appendBigEndian(std::string &destination, const std::uint64_t value, const int bytes) {
+    for (int i = bytes - 1; i >= 0; --i)
+        destination.push_back(static_cast<char>(value >> 8 * i & 0xFF));
+}
+
+std::uint64_t readBigEndian(const char *data, const int bytes) {
+    std::uint64_t value = 0;
+
+    for (int i = 0; i < bytes; ++i)
+        value = value << 8 | static_cast<unsigned char>(data[i]);
+
+    return value;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+
+// Fixed-size integers of the binary formats: the files written here (seek tables, columnar footers, archives,
+// indexes) are little-endian, PostgreSQL's binary COPY and results big-endian (network byte order)
+
+// Append the *bytes* low bytes of *value*, least significant first
+void appendLittleEndian(std::string &destination, std::uint64_t value, int bytes);
+
+// Unsigned little-endian integer of *bytes* bytes
+std::uint64_t readLittleEndian(const char *data, int bytes);
+
+// Append the *bytes* low bytes of *value*, most significant first
+void appendBigEndian(std::string &destination, std::uint64_t value, int bytes);
+
+// Unsigned big-endian integer of *bytes* bytes
+std::uint64_t readBigEndian(const char *data, int bytes);
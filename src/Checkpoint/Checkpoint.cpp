@@ -0,0 +1,219 @@
+#include "Checkpoint.h"
+#include "../Json/Json.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#define TEMPORARY_FILE_SUFFIX std::string(".tmp")
+
+
+// Read and parse a checkpoint file, false when it is missing or malformed
+bool readCheckpointFile(const std::string &filePath, JsonValue &state);
+
+// JSON members of the progress of an import (without braces)
+std::string importProgressMembers(const ImportProgress &progress);
+
+ImportProgress readImportProgress(const JsonValue *progressValue);
+
+// Flush the contents of a written file to the disk
+bool syncFile(const std::string &filePath);
+
+// Flush the entries of a directory to the disk, so that a rename in it survives a crash
+bool syncDirectory(const std::string &directoryPath);
+
+
+int ExportCheckpoint::load(const std::string &filePath) {
+    JsonValue state;
+
+    if (!readCheckpointFile(filePath, state))
+        return 1;
+
+    tableName = state.getString("tableName");
+    formatName = state.getString("format");
+    outputOffset = static_cast<std::uint64_t>(state.getNumber("outputOffset"));
+    rowsCount = static_cast<std::uint64_t>(state.getNumber("rowsCount"));
+    tailChecksum = state.getString("tailChecksum");
+
+    lastKey.clear();
+    if (const JsonValue *lastKeyValue = state.get("lastKey"); lastKeyValue != nullptr) {
+        for (const JsonValue &keyValue: lastKeyValue->elements)
+            lastKey.push_back(keyValue.string);
+    }
+
+    columnWidths.clear();
+    if (const JsonValue *widthsValue = state.get("columnWidths"); widthsValue != nullptr) {
+        for (const JsonValue &widthValue: widthsValue->elements)
+            columnWidths.push_back(static_cast<std::string::size_type>(widthValue.number));
+    }
+
+    return 0;
+}
+
+int ExportCheckpoint::save(const std::string &filePath) const {
+    std::ostringstream stateStream;
+
+    stateStream << "{\"tableName\": " << JsonValue::quote(tableName)
+            << ", \"format\": " << JsonValue::quote(formatName)
+            << ", \"outputOffset\": " << outputOffset
+            << ", \"rowsCount\": " << rowsCount
+            << ", \"tailChecksum\": " << JsonValue::quote(tailChecksum)
+            << ", \"lastKey\": [";
+
+    for (std::size_t i = 0; i < lastKey.size(); ++i)
+        stateStream << (i > 0 ? ", " : "") << JsonValue::quote(lastKey[i]);
+
+    stateStream << "], \"columnWidths\": [";
+
+    for (std::size_t i = 0; i < columnWidths.size(); ++i)
+        stateStream << (i > 0 ? ", " : "") << columnWidths[i];
+
+    stateStream << "]}\n";
+
+    return replaceFile(filePath, stateStream.str());
+}
+
+int ImportCheckpoint::load(const std::string &filePath) {
+    JsonValue state;
+
+    if (!readCheckpointFile(filePath, state))
+        return 1;
+
+    tableName = state.getString("tableName");
+    inputFilePath = state.getString("inputFilePath");
+    committed = readImportProgress(state.get("committed"));
+    pending = readImportProgress(state.get("pending"));
+    pendingTransactionId = state.getString("pendingTransactionId");
+    return 0;
+}
+
+int ImportCheckpoint::save(const std::string &filePath) const {
+    std::ostringstream stateStream;
+
+    stateStream << "{\"tableName\": " << JsonValue::quote(tableName)
+            << ", \"inputFilePath\": " << JsonValue::quote(inputFilePath)
+            << ", \"committed\": {" << importProgressMembers(committed) << "}"
+            << ", \"pending\": {" << importProgressMembers(pending) << "}"
+            << ", \"pendingTransactionId\": " << JsonValue::quote(pendingTransactionId) << "}\n";
+
+    return replaceFile(filePath, stateStream.str());
+}
+
+
+int replaceFile(const std::string &filePath, const std::string &contents) {
+    const std::string temporaryFilePath = filePath + TEMPORARY_FILE_SUFFIX;
+
+    std::ofstream fileStream{temporaryFilePath, std::ios::binary};
+    fileStream.write(contents.data(), static_cast<std::streamsize>(contents.length()));
+    fileStream.close();
+
+    // The contents must be on the disk before the rename is, else a crash may leave an empty file behind the name
+    const bool isWritten = fileStream && syncFile(temporaryFilePath);
+
+    std::error_code errorCode;
+    if (isWritten)
+        std::filesystem::rename(temporaryFilePath, filePath, errorCode);
+
+    if (!isWritten || errorCode) {
+        std::cerr << "Error: Cannot write " << filePath << ".\n";
+        std::remove(temporaryFilePath.c_str());
+        return 1;
+    }
+
+    const std::filesystem::path directoryPath = std::filesystem::path{filePath}.parent_path();
+    if (!syncDirectory(directoryPath.empty() ? "." : directoryPath.string())) {
+        std::cerr << "Error: Cannot flush the directory of " << filePath << ".\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+bool readCheckpointFile(const std::string &filePath, JsonValue &state) {
+    std::ifstream checkpointStream{filePath, std::ios::binary};
+
+    if (!checkpointStream)
+        return false;
+
+    const std::string contents{std::istreambuf_iterator<char>(checkpointStream), std::istreambuf_iterator<char>()};
+
+    if (!JsonValue::parse(contents, state) || state.type != JsonValue::Type::OBJECT) {
+        std::cerr << "Error: The checkpoint " << filePath << " cannot be read, starting over.\n";
+        return false;
+    }
+
+    return true;
+}
+
+std::string importProgressMembers(const ImportProgress &progress) {
+    std::ostringstream progressStream;
+
+    progressStream << "\"inputOffset\": " << progress.inputOffset
+            << ", \"lineNumber\": " << progress.lineNumber
+            << ", \"insertedRowsCount\": " << progress.insertedRowsCount
+            << ", \"rejectedRowsCount\": " << progress.rejectedRowsCount
+            << ", \"rejectFileOffset\": " << progress.rejectFileOffset;
+
+    return progressStream.str();
+}
+
+ImportProgress readImportProgress(const JsonValue *progressValue) {
+    ImportProgress progress;
+
+    if (progressValue == nullptr)
+        return progress;
+
+    progress.inputOffset = static_cast<std::uint64_t>(progressValue->getNumber("inputOffset"));
+    progress.lineNumber = static_cast<std::uint64_t>(progressValue->getNumber("lineNumber"));
+    progress.insertedRowsCount = static_cast<std::uint64_t>(progressValue->getNumber("insertedRowsCount"));
+    progress.rejectedRowsCount = static_cast<std::uint64_t>(progressValue->getNumber("rejectedRowsCount"));
+    progress.rejectFileOffset = static_cast<std::uint64_t>(progressValue->getNumber("rejectFileOffset"));
+    return progress;
+}
+
+bool syncFile(const std::string &filePath) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(filePath.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    const bool isSynced = FlushFileBuffers(handle) != 0;
+    CloseHandle(handle);
+#else
+    const int fileDescriptor = ::open(filePath.c_str(), O_RDONLY);
+    if (fileDescriptor < 0)
+        return false;
+
+    const bool isSynced = fsync(fileDescriptor) == 0;
+    ::close(fileDescriptor);
+#endif
+
+    return isSynced;
+}
+
+bool syncDirectory(const std::string &directoryPath) {
+#ifdef _WIN32
+    (void) directoryPath; /* Directories cannot be flushed, NTFS journals the rename itself */
+    return true;
+#else
+    const int directoryDescriptor = ::open(directoryPath.c_str(), O_RDONLY);
+    if (directoryDescriptor < 0)
+        return false;
+
+    const bool isSynced = fsync(directoryDescriptor) == 0;
+    ::close(directoryDescriptor);
+
+    return isSynced;
+#endif
+}
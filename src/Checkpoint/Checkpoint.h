@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// State files of resumable exports and imports: small JSON documents, replaced atomically (written aside and
+// renamed) after every batch, so a run dying at any point leaves the last complete checkpoint behind.
+
+
+// Progress of a resumable export, paged by primary key
+struct ExportCheckpoint {
+    std::string tableName;
+    std::string formatName;
+    std::vector<std::string> lastKey; // Key values of the last exported row, empty before the first page
+    std::uint64_t outputOffset = 0; // Bytes of the output holding the head and the exported rows
+    std::uint64_t rowsCount = 0;
+    std::string tailChecksum; // SHA-256 of the output bytes right before outputOffset
+    std::vector<std::string::size_type> columnWidths; // Padded formats, the rest of the rows is rendered with them
+
+    // Non-zero when there is no checkpoint (or it cannot be read)
+    int load(const std::string &filePath);
+
+    int save(const std::string &filePath) const;
+};
+
+
+// Position in a bulk import input with what happened up to there
+struct ImportProgress {
+    std::uint64_t inputOffset = 0;
+    std::uint64_t lineNumber = 0;
+    std::uint64_t insertedRowsCount = 0;
+    std::uint64_t rejectedRowsCount = 0;
+    std::uint64_t rejectFileOffset = 0;
+};
+
+// Progress of a resumable bulk import. A batch is recorded as pending with its transaction id before its COMMIT
+// and as committed after it; a run dying in between asks the server (txid_status) whether the batch made it.
+struct ImportCheckpoint {
+    std::string tableName;
+    std::string inputFilePath;
+    ImportProgress committed;
+    ImportProgress pending;
+    std::string pendingTransactionId; // Empty when no batch is pending
+
+    int load(const std::string &filePath);
+
+    int save(const std::string &filePath) const;
+};
+
+
+// Write the whole file aside, flush it and rename it over the old one: neither a failed write nor a crash leaves
+// half a file behind
+int replaceFile(const std::string &filePath, const std::string &contents);
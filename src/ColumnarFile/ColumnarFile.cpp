@@ -0,0 +1,567 @@
+#include "ColumnarFile.h"
+#include "../ByteOrder/ByteOrder.h"
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+
+#define COLUMNAR_MAGIC "PGCOLMN1"
+#define COLUMNAR_MAGIC_LENGTH 8
+#define COLUMNAR_VERSION 1
+#define BUFFER_ALIGNMENT 8
+#define BOOL_OID 16
+#define BYTEA_OID 17
+#define NAME_OID 19
+#define INT8_OID 20
+#define INT2_OID 21
+#define INT4_OID 23
+#define TEXT_OID 25
+#define JSON_OID 114
+#define FLOAT4_OID 700
+#define FLOAT8_OID 701
+#define BPCHAR_OID 1042
+#define VARCHAR_OID 1043
+#define DATE_OID 1082
+#define TIMESTAMP_OID 1114
+#define TIMESTAMPTZ_OID 1184
+// PostgreSQL counts dates and timestamps from 2000-01-01
+#define POSTGRES_EPOCH_DAYS 10957
+#define POSTGRES_EPOCH_MICROSECONDS 946684800000000LL
+
+
+// Kind of a binary format column of *typeOid* (UTF8 for the types sent as text)
+ColumnKind binaryColumnKind(Oid typeOid);
+
+// Bytes per value of the fixed width kinds, 0 for UTF8 and BINARY
+std::size_t fixedWidth(ColumnKind kind);
+
+// Read a little-endian integer of *bytes* bytes, false when the data ends before it
+bool readLittleEndian(const char *&position, const char *end, int bytes, std::uint64_t &value);
+
+
+ColumnarWriter::ColumnarWriter(const std::size_t rowGroupSize): rowGroupSize(std::max<std::size_t>(rowGroupSize, 1)) {
+}
+
+bool ColumnarWriter::isBinarySupported(const Oid typeOid) {
+    switch (typeOid) {
+        case BOOL_OID:
+        case BYTEA_OID:
+        case NAME_OID:
+        case INT8_OID:
+        case INT2_OID:
+        case INT4_OID:
+        case TEXT_OID:
+        case JSON_OID:
+        case FLOAT4_OID:
+        case FLOAT8_OID:
+        case BPCHAR_OID:
+        case VARCHAR_OID:
+        case DATE_OID:
+        case TIMESTAMP_OID:
+        case TIMESTAMPTZ_OID:
+            return true;
+        default:
+            return false;
+    }
+}
+
+int ColumnarWriter::open(const std::string &filePath, const PGresult *queryResult) {
+    columns.clear();
+    rowGroups.clear();
+
+    for (int i = 0; i < PQnfields(queryResult); ++i) {
+        const bool isBinary = PQfformat(queryResult, i) == 1;
+
+        if (isBinary && !isBinarySupported(PQftype(queryResult, i))) {
+            std::cerr << "COLUMNAR EXPORT failed: Column " << PQfname(queryResult, i)
+                    << " has to be sent as text.\n";
+            return 1;
+        }
+
+        columns.push_back({
+            PQfname(queryResult, i), PQftype(queryResult, i),
+            isBinary ? binaryColumnKind(PQftype(queryResult, i)) : ColumnKind::UTF8
+        });
+    }
+
+    fileStream.open(filePath, std::ios::binary);
+    fileStream.write(COLUMNAR_MAGIC, COLUMNAR_MAGIC_LENGTH);
+    fileOffset = COLUMNAR_MAGIC_LENGTH;
+
+    if (!fileStream) {
+        std::cerr << "COLUMNAR EXPORT failed: Cannot write " << filePath << ".\n";
+        return 1;
+    }
+
+    resetBuilders();
+    return 0;
+}
+
+void ColumnarWriter::resetBuilders() {
+    columnBuilders.assign(columns.size(), ColumnBuilder{});
+
+    for (std::size_t j = 0; j < columns.size(); ++j) {
+        if (fixedWidth(columns[j].kind) == 0)
+            columnBuilders[j].offsets.push_back(0);
+    }
+
+    groupRowsCount = 0;
+}
+
+int ColumnarWriter::appendRows(const PGresult *batch) {
+    for (int i = 0; i < PQntuples(batch); ++i) {
+        for (std::size_t j = 0; j < columns.size(); ++j) {
+            const int column = static_cast<int>(j);
+
+            if (appendCheckedValue(j, PQgetvalue(batch, i, column), PQgetlength(batch, i, column),
+                                   PQgetisnull(batch, i, column) != 0))
+                return 1;
+        }
+
+        if (++groupRowsCount == rowGroupSize && writeRowGroup())
+            return 1;
+    }
+
+    return 0;
+}
+
+int ColumnarWriter::appendRows(const CopyBatch &batch) {
+    for (std::size_t i = 0; i < batch.rowsCount; ++i) {
+        const char *const *values = batch.rowValues(i);
+        const int *lengths = batch.rowLengths(i);
+        const int *nulls = batch.rowNulls(i);
+
+        for (std::size_t j = 0; j < columns.size(); ++j) {
+            if (appendCheckedValue(j, values[j], lengths[j], nulls[j] != 0))
+                return 1;
+        }
+
+        if (++groupRowsCount == rowGroupSize && writeRowGroup())
+            return 1;
+    }
+
+    return 0;
+}
+
+int ColumnarWriter::appendCheckedValue(const std::size_t column, const char *value, const int length,
+                                       const bool isNull) {
+    if (!isNull && fixedWidth(columns[column].kind) != 0
+        && static_cast<std::size_t>(length) != fixedWidth(columns[column].kind)) {
+        std::cerr << "COLUMNAR EXPORT failed: Unexpected binary value in column " << columns[column].name << ".\n";
+        return 1;
+    }
+
+    appendValue(column, value, length, isNull);
+    return 0;
+}
+
+void ColumnarWriter::appendValue(const std::size_t column, const char *value, const int length, const bool isNull) {
+    ColumnBuilder &columnBuilder = columnBuilders[column];
+    ColumnChunk &columnChunk = columnBuilder.columnChunk;
+    const ColumnKind kind = columns[column].kind;
+
+    if (groupRowsCount % 8 == 0)
+        columnBuilder.validity.push_back(0);
+
+    if (isNull) {
+        ++columnChunk.nullCount;
+
+        // NULLs keep their slot, zeroed (or an empty range of bytes)
+        if (fixedWidth(kind) != 0)
+            columnBuilder.values.append(fixedWidth(kind), '\0');
+        else
+            columnBuilder.offsets.push_back(static_cast<std::int64_t>(columnBuilder.values.length()));
+        return;
+    }
+
+    columnBuilder.validity.back() |= static_cast<std::uint8_t>(1u << (groupRowsCount % 8));
+
+    std::int64_t integerValue = 0;
+    double realValue = 0;
+    bool isInteger = true;
+
+    switch (kind) {
+        case ColumnKind::BOOLEAN:
+            columnBuilder.values.push_back(value[0] != 0 ? 1 : 0);
+            return;
+        case ColumnKind::INT16:
+            integerValue = static_cast<std::int16_t>(readBigEndian(value, 2));
+            break;
+        case ColumnKind::INT32:
+            integerValue = static_cast<std::int32_t>(readBigEndian(value, 4));
+            break;
+        case ColumnKind::INT64:
+            integerValue = static_cast<std::int64_t>(readBigEndian(value, 8));
+            break;
+        case ColumnKind::DATE32:
+            integerValue = static_cast<std::int32_t>(readBigEndian(value, 4));
+
+            // +-infinity stay at the limits
+            if (integerValue != std::numeric_limits<std::int32_t>::max()
+                && integerValue != std::numeric_limits<std::int32_t>::min())
+                integerValue += POSTGRES_EPOCH_DAYS;
+            break;
+        case ColumnKind::TIMESTAMP64:
+            integerValue = static_cast<std::int64_t>(readBigEndian(value, 8));
+
+            if (integerValue != std::numeric_limits<std::int64_t>::max()
+                && integerValue != std::numeric_limits<std::int64_t>::min())
+                integerValue += POSTGRES_EPOCH_MICROSECONDS;
+            break;
+        case ColumnKind::FLOAT32: {
+            const auto bits = static_cast<std::uint32_t>(readBigEndian(value, 4));
+            float floatValue;
+            std::memcpy(&floatValue, &bits, sizeof(floatValue));
+
+            realValue = floatValue;
+            isInteger = false;
+            break;
+        }
+        case ColumnKind::FLOAT64: {
+            const std::uint64_t bits = readBigEndian(value, 8);
+            std::memcpy(&realValue, &bits, sizeof(realValue));
+
+            isInteger = false;
+            break;
+        }
+        case ColumnKind::UTF8:
+        case ColumnKind::BINARY:
+            columnBuilder.values.append(value, length);
+            columnBuilder.offsets.push_back(static_cast<std::int64_t>(columnBuilder.values.length()));
+            return;
+    }
+
+    // Same bits as the big-endian value, stored least significant byte first
+    appendLittleEndian(columnBuilder.values, readBigEndian(value, length), length);
+
+    if (isInteger) {
+        // The dates and timestamps are stored shifted to the Unix epoch
+        if (kind == ColumnKind::DATE32 || kind == ColumnKind::TIMESTAMP64) {
+            columnBuilder.values.resize(columnBuilder.values.length() - length);
+            appendLittleEndian(columnBuilder.values, static_cast<std::uint64_t>(integerValue), length);
+        }
+
+        columnChunk.minInteger = columnChunk.hasMinMax ? std::min(columnChunk.minInteger, integerValue) : integerValue;
+        columnChunk.maxInteger = columnChunk.hasMinMax ? std::max(columnChunk.maxInteger, integerValue) : integerValue;
+    } else if (realValue == realValue) /* NaN takes no part in the statistics */ {
+        columnChunk.minReal = columnChunk.hasMinMax ? std::min(columnChunk.minReal, realValue) : realValue;
+        columnChunk.maxReal = columnChunk.hasMinMax ? std::max(columnChunk.maxReal, realValue) : realValue;
+    } else {
+        return;
+    }
+
+    columnChunk.hasMinMax = true;
+}
+
+std::uint64_t ColumnarWriter::writeBuffer(const void *data, const std::uint64_t length) {
+    static constexpr char PADDING[BUFFER_ALIGNMENT] = {};
+
+    const std::uint64_t bufferOffset = fileOffset;
+    const std::uint64_t paddingLength = (BUFFER_ALIGNMENT - length % BUFFER_ALIGNMENT) % BUFFER_ALIGNMENT;
+
+    fileStream.write(static_cast<const char *>(data), static_cast<std::streamsize>(length));
+    fileStream.write(PADDING, static_cast<std::streamsize>(paddingLength));
+
+    fileOffset += length + paddingLength;
+    return bufferOffset;
+}
+
+int ColumnarWriter::writeRowGroup() {
+    if (groupRowsCount == 0)
+        return 0;
+
+    RowGroup rowGroup;
+    rowGroup.rowsCount = groupRowsCount;
+
+    for (std::size_t j = 0; j < columns.size(); ++j) {
+        ColumnBuilder &columnBuilder = columnBuilders[j];
+        ColumnChunk columnChunk = columnBuilder.columnChunk;
+
+        columnChunk.validityOffset = writeBuffer(columnBuilder.validity.data(), columnBuilder.validity.size());
+
+        if (fixedWidth(columns[j].kind) == 0) {
+            std::string offsets;
+            offsets.reserve(columnBuilder.offsets.size() * sizeof(std::int64_t));
+
+            for (const std::int64_t offset: columnBuilder.offsets)
+                appendLittleEndian(offsets, static_cast<std::uint64_t>(offset), sizeof(std::int64_t));
+
+            columnChunk.offsetsOffset = writeBuffer(offsets.data(), offsets.length());
+        }
+
+        columnChunk.valuesOffset = writeBuffer(columnBuilder.values.data(), columnBuilder.values.length());
+        columnChunk.valuesLength = columnBuilder.values.length();
+
+        rowGroup.columnChunks.push_back(columnChunk);
+    }
+
+    rowGroups.push_back(std::move(rowGroup));
+    resetBuilders();
+
+    if (!fileStream) {
+        std::cerr << "COLUMNAR EXPORT failed: Cannot write a row group.\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+int ColumnarWriter::close() {
+    if (!fileStream.is_open())
+        return 0;
+
+    if (writeRowGroup())
+        return 1;
+
+    std::string footer;
+    appendLittleEndian(footer, COLUMNAR_VERSION, 4);
+    appendLittleEndian(footer, columns.size(), 4);
+
+    for (const ColumnSchema &column: columns) {
+        appendLittleEndian(footer, static_cast<std::uint8_t>(column.kind), 1);
+        appendLittleEndian(footer, column.typeOid, 4);
+        appendLittleEndian(footer, column.name.length(), 4);
+        footer += column.name;
+    }
+
+    appendLittleEndian(footer, rowGroups.size(), 4);
+
+    for (const RowGroup &rowGroup: rowGroups) {
+        appendLittleEndian(footer, rowGroup.rowsCount, 8);
+
+        for (const ColumnChunk &columnChunk: rowGroup.columnChunks) {
+            std::uint64_t minRealBits, maxRealBits;
+            std::memcpy(&minRealBits, &columnChunk.minReal, sizeof(minRealBits));
+            std::memcpy(&maxRealBits, &columnChunk.maxReal, sizeof(maxRealBits));
+
+            appendLittleEndian(footer, columnChunk.validityOffset, 8);
+            appendLittleEndian(footer, columnChunk.offsetsOffset, 8);
+            appendLittleEndian(footer, columnChunk.valuesOffset, 8);
+            appendLittleEndian(footer, columnChunk.valuesLength, 8);
+            appendLittleEndian(footer, columnChunk.nullCount, 8);
+            appendLittleEndian(footer, columnChunk.hasMinMax, 1);
+            appendLittleEndian(footer, static_cast<std::uint64_t>(columnChunk.minInteger), 8);
+            appendLittleEndian(footer, static_cast<std::uint64_t>(columnChunk.maxInteger), 8);
+            appendLittleEndian(footer, minRealBits, 8);
+            appendLittleEndian(footer, maxRealBits, 8);
+        }
+    }
+
+    // Footer, its length and the magic again: readers start from the end of the file
+    appendLittleEndian(footer, footer.length(), 8);
+    footer += COLUMNAR_MAGIC;
+
+    fileStream.write(footer.data(), static_cast<std::streamsize>(footer.length()));
+    fileStream.close();
+
+    if (!fileStream) {
+        std::cerr << "COLUMNAR EXPORT failed: Cannot write the footer.\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int ColumnarReader::open(const std::string &filePath) {
+    columns.clear();
+    rowGroups.clear();
+
+    if (mappedFile.openReadOnly(filePath))
+        return 1;
+
+    const char *fileData = mappedFile.data();
+    const std::uint64_t fileSize = mappedFile.size();
+
+    if (fileSize < 2 * COLUMNAR_MAGIC_LENGTH + 8
+        || std::memcmp(fileData, COLUMNAR_MAGIC, COLUMNAR_MAGIC_LENGTH) != 0
+        || std::memcmp(fileData + fileSize - COLUMNAR_MAGIC_LENGTH, COLUMNAR_MAGIC, COLUMNAR_MAGIC_LENGTH) != 0) {
+        std::cerr << "Error: " << filePath << " is no columnar export.\n";
+        return 1;
+    }
+
+    const char *footerEnd = fileData + fileSize - COLUMNAR_MAGIC_LENGTH - 8;
+    const char *position = footerEnd;
+    std::uint64_t footerLength = 0;
+    readLittleEndian(position, footerEnd + 8, 8, footerLength);
+
+    bool isValid = footerLength <= static_cast<std::uint64_t>(footerEnd - fileData - COLUMNAR_MAGIC_LENGTH);
+    position = footerEnd - (isValid ? footerLength : 0);
+
+    std::uint64_t version = 0, columnsCount = 0, rowGroupsCount = 0;
+    isValid = isValid && readLittleEndian(position, footerEnd, 4, version) && version == COLUMNAR_VERSION
+              && readLittleEndian(position, footerEnd, 4, columnsCount);
+
+    for (std::uint64_t j = 0; isValid && j < columnsCount; ++j) {
+        std::uint64_t kind = 0, typeOid = 0, nameLength = 0;
+        isValid = readLittleEndian(position, footerEnd, 1, kind) && kind <= static_cast<int>(ColumnKind::BINARY)
+                  && readLittleEndian(position, footerEnd, 4, typeOid)
+                  && readLittleEndian(position, footerEnd, 4, nameLength)
+                  && nameLength <= static_cast<std::uint64_t>(footerEnd - position);
+
+        if (isValid) {
+            columns.push_back({std::string(position, nameLength), static_cast<Oid>(typeOid),
+                               static_cast<ColumnKind>(kind)});
+            position += nameLength;
+        }
+    }
+
+    isValid = isValid && readLittleEndian(position, footerEnd, 4, rowGroupsCount);
+
+    for (std::uint64_t i = 0; isValid && i < rowGroupsCount; ++i) {
+        RowGroup rowGroup;
+        isValid = readLittleEndian(position, footerEnd, 8, rowGroup.rowsCount);
+
+        for (std::uint64_t j = 0; isValid && j < columnsCount; ++j) {
+            ColumnChunk columnChunk;
+            std::uint64_t hasMinMax = 0, minInteger = 0, maxInteger = 0, minRealBits = 0, maxRealBits = 0;
+
+            isValid = readLittleEndian(position, footerEnd, 8, columnChunk.validityOffset)
+                      && readLittleEndian(position, footerEnd, 8, columnChunk.offsetsOffset)
+                      && readLittleEndian(position, footerEnd, 8, columnChunk.valuesOffset)
+                      && readLittleEndian(position, footerEnd, 8, columnChunk.valuesLength)
+                      && readLittleEndian(position, footerEnd, 8, columnChunk.nullCount)
+                      && readLittleEndian(position, footerEnd, 1, hasMinMax)
+                      && readLittleEndian(position, footerEnd, 8, minInteger)
+                      && readLittleEndian(position, footerEnd, 8, maxInteger)
+                      && readLittleEndian(position, footerEnd, 8, minRealBits)
+                      && readLittleEndian(position, footerEnd, 8, maxRealBits);
+
+            columnChunk.hasMinMax = hasMinMax != 0;
+            columnChunk.minInteger = static_cast<std::int64_t>(minInteger);
+            columnChunk.maxInteger = static_cast<std::int64_t>(maxInteger);
+            std::memcpy(&columnChunk.minReal, &minRealBits, sizeof(minRealBits));
+            std::memcpy(&columnChunk.maxReal, &maxRealBits, sizeof(maxRealBits));
+
+            // Every buffer has to lie within the file, compared without sums that could wrap around
+            const std::uint64_t width = fixedWidth(columns[j].kind);
+            const std::uint64_t dataEnd = fileSize - footerLength;
+
+            const auto isWithinData = [dataEnd](const std::uint64_t offset, const std::uint64_t length) {
+                return offset <= dataEnd && length <= dataEnd - offset;
+            };
+
+            isValid = isValid && rowGroup.rowsCount <= dataEnd
+                      && isWithinData(columnChunk.validityOffset, (rowGroup.rowsCount + 7) / 8)
+                      && isWithinData(columnChunk.valuesOffset, columnChunk.valuesLength)
+                      && (width == 0
+                              ? rowGroup.rowsCount < dataEnd / 8
+                                && isWithinData(columnChunk.offsetsOffset, 8 * (rowGroup.rowsCount + 1))
+                              : columnChunk.valuesLength == width * rowGroup.rowsCount);
+
+            rowGroup.columnChunks.push_back(columnChunk);
+        }
+
+        rowGroups.push_back(std::move(rowGroup));
+    }
+
+    if (!isValid) {
+        std::cerr << "Error: The footer of " << filePath << " is damaged.\n";
+        columns.clear();
+        rowGroups.clear();
+        mappedFile.close();
+        return 1;
+    }
+
+    return 0;
+}
+
+const std::vector<ColumnSchema> &ColumnarReader::getColumns() const {
+    return columns;
+}
+
+const std::vector<RowGroup> &ColumnarReader::getRowGroups() const {
+    return rowGroups;
+}
+
+const ColumnChunk &ColumnarReader::columnChunk(const std::size_t rowGroup, const std::size_t column) const {
+    return rowGroups[rowGroup].columnChunks[column];
+}
+
+bool ColumnarReader::isValidRow(const std::size_t rowGroup, const std::size_t column, const std::uint64_t row) const {
+    return rowGroup < rowGroups.size() && column < columns.size() && row < rowGroups[rowGroup].rowsCount;
+}
+
+bool ColumnarReader::isNull(const std::size_t rowGroup, const std::size_t column, const std::uint64_t row) const {
+    if (!isValidRow(rowGroup, column, row))
+        return true;
+
+    const auto validity = reinterpret_cast<const std::uint8_t *>(
+        mappedFile.data() + columnChunk(rowGroup, column).validityOffset);
+
+    return (validity[row / 8] & (1u << (row % 8))) == 0;
+}
+
+std::string_view ColumnarReader::value(const std::size_t rowGroup, const std::size_t column,
+                                       const std::uint64_t row) const {
+    if (!isValidRow(rowGroup, column, row))
+        return {};
+
+    const ColumnChunk &chunk = columnChunk(rowGroup, column);
+    const auto offsets = reinterpret_cast<const std::int64_t *>(mappedFile.data() + chunk.offsetsOffset);
+
+    // Offsets are only trusted within the values buffer
+    if (offsets[row] < 0 || offsets[row] > offsets[row + 1]
+        || static_cast<std::uint64_t>(offsets[row + 1]) > chunk.valuesLength)
+        return {};
+
+    return {mappedFile.data() + chunk.valuesOffset + offsets[row], static_cast<std::size_t>(offsets[row + 1] - offsets[row])};
+}
+
+
+ColumnKind binaryColumnKind(const Oid typeOid) {
+    switch (typeOid) {
+        case BOOL_OID:
+            return ColumnKind::BOOLEAN;
+        case INT2_OID:
+            return ColumnKind::INT16;
+        case INT4_OID:
+            return ColumnKind::INT32;
+        case INT8_OID:
+            return ColumnKind::INT64;
+        case FLOAT4_OID:
+            return ColumnKind::FLOAT32;
+        case FLOAT8_OID:
+            return ColumnKind::FLOAT64;
+        case DATE_OID:
+            return ColumnKind::DATE32;
+        case TIMESTAMP_OID:
+        case TIMESTAMPTZ_OID:
+            return ColumnKind::TIMESTAMP64;
+        case BYTEA_OID:
+            return ColumnKind::BINARY;
+        default:
+            return ColumnKind::UTF8;
+    }
+}
+
+std::size_t fixedWidth(const ColumnKind kind) {
+    switch (kind) {
+        case ColumnKind::BOOLEAN:
+            return 1;
+        case ColumnKind::INT16:
+            return 2;
+        case ColumnKind::INT32:
+        case ColumnKind::FLOAT32:
+        case ColumnKind::DATE32:
+            return 4;
+        case ColumnKind::INT64:
+        case ColumnKind::FLOAT64:
+        case ColumnKind::TIMESTAMP64:
+            return 8;
+        case ColumnKind::UTF8:
+        case ColumnKind::BINARY:
+            break;
+    }
+
+    return 0;
+}
+
+bool readLittleEndian(const char *&position, const char *end, const int bytes, std::uint64_t &value) {
+    if (end - position < bytes)
+        return false;
+
+    value = readLittleEndian(position, bytes);
+    position += bytes;
+    return true;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include "../MappedFile/MappedFile.h"
+#include "../CopyDecoder/CopyDecoder.h"
+#include <libpq-fe.h>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Physical type of a column in a columnar export
+enum class ColumnKind : std::uint8_t {
+    BOOLEAN, // 1 byte per value (0 or 1)
+    INT16,
+    INT32,
+    INT64,
+    FLOAT32,
+    FLOAT64,
+    DATE32, // int32 days since 1970-01-01
+    TIMESTAMP64, // int64 microseconds since 1970-01-01 (timestamptz in UTC)
+    UTF8, // int64 offsets (rows + 1 of them) into the bytes of all values
+    BINARY // Like UTF8, for bytea
+};
+
+struct ColumnSchema {
+    std::string name;
+    Oid typeOid = 0;
+    ColumnKind kind = ColumnKind::UTF8;
+};
+
+// Buffers of one column within one row group (file offsets) and its statistics
+struct ColumnChunk {
+    std::uint64_t validityOffset = 0; // Bitmap, bit i (LSB first) set when row i is not NULL
+    std::uint64_t offsetsOffset = 0; // UTF8 and BINARY only
+    std::uint64_t valuesOffset = 0;
+    std::uint64_t valuesLength = 0;
+    std::uint64_t nullCount = 0;
+
+    // Minimum and maximum of the non-NULL values of the numeric, date and timestamp kinds
+    bool hasMinMax = false;
+    std::int64_t minInteger = 0;
+    std::int64_t maxInteger = 0;
+    double minReal = 0;
+    double maxReal = 0;
+};
+
+struct RowGroup {
+    std::uint64_t rowsCount = 0;
+    std::vector<ColumnChunk> columnChunks;
+};
+
+
+// Writes results column by column: the rows are collected in row groups, every column of a group is written
+// as contiguous little-endian arrays (validity bitmap, offsets, values) aligned to 8 bytes, and a footer with
+// the schema, the buffer offsets and the statistics of every group closes the file.
+// Binary format results are stored typed, the columns of text format results are stored as UTF8.
+class ColumnarWriter {
+    // Values of one column of the row group being collected
+    struct ColumnBuilder {
+        std::vector<std::uint8_t> validity;
+        std::vector<std::int64_t> offsets;
+        std::string values;
+        ColumnChunk columnChunk;
+    };
+
+    std::size_t rowGroupSize;
+    std::ofstream fileStream;
+    std::uint64_t fileOffset = 0;
+
+    std::vector<ColumnSchema> columns;
+    std::vector<RowGroup> rowGroups;
+
+    std::vector<ColumnBuilder> columnBuilders;
+    std::uint64_t groupRowsCount = 0;
+
+    // Start an empty row group
+    void resetBuilders();
+
+    void appendValue(std::size_t column, const char *value, int length, bool isNull);
+
+    // appendValue after checking a binary value has the size of its kind
+    int appendCheckedValue(std::size_t column, const char *value, int length, bool isNull);
+
+    // Write a buffer at the current end of the file, padded to 8 bytes, returns its offset
+    std::uint64_t writeBuffer(const void *data, std::uint64_t length);
+
+    int writeRowGroup();
+
+public:
+    explicit ColumnarWriter(std::size_t rowGroupSize = 65536);
+
+    // Types whose binary representation the writer decodes, the others have to be sent as text
+    static bool isBinarySupported(Oid typeOid);
+
+    // Create the file for the columns of *queryResult* (binary or text format)
+    int open(const std::string &filePath, const PGresult *queryResult);
+
+    // Add the rows of a batch with the columns the file was opened with
+    int appendRows(const PGresult *batch);
+
+    // Add decoded COPY tuples, binary (COPY BINARY) when the file was opened with a binary description
+    int appendRows(const CopyBatch &batch);
+
+    // Write the last row group and the footer
+    int close();
+};
+
+
+// Reads a columnar export through a read-only memory mapping: the values are used where they lie in the file
+class ColumnarReader {
+    MappedFile mappedFile;
+    std::vector<ColumnSchema> columns;
+    std::vector<RowGroup> rowGroups;
+
+    const ColumnChunk &columnChunk(std::size_t rowGroup, std::size_t column) const;
+
+    // Whether *row* of *column* exists in *rowGroup*
+    bool isValidRow(std::size_t rowGroup, std::size_t column, std::uint64_t row) const;
+
+public:
+    int open(const std::string &filePath);
+
+    const std::vector<ColumnSchema> &getColumns() const;
+
+    const std::vector<RowGroup> &getRowGroups() const;
+
+    // Rows outside the file are null (and have an empty value)
+    bool isNull(std::size_t rowGroup, std::size_t column, std::uint64_t row) const;
+
+    // Fixed width values of a row group (bool: std::uint8_t, INT16: std::int16_t ... FLOAT64: double)
+    template<typename T>
+    const T *values(const std::size_t rowGroup, const std::size_t column) const {
+        return reinterpret_cast<const T *>(mappedFile.data() + columnChunk(rowGroup, column).valuesOffset);
+    }
+
+    // UTF8 and BINARY values
+    std::string_view value(std::size_t rowGroup, std::size_t column, std::uint64_t row) const;
+};
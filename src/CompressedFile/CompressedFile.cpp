@@ -0,0 +1,369 @@
+#include "CompressedFile.h"
+#include "../ByteOrder/ByteOrder.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+
+// Seek table frame: an LZ4 skippable frame, with the footer of zstd's seekable format
+#define SKIPPABLE_FRAME_MAGIC 0x184D2A5Eu
+#define SEEKABLE_MAGIC 0x8F92EAB1u
+#define SKIPPABLE_HEADER_SIZE 8
+#define SEEK_ENTRY_SIZE 8
+// Frames count, descriptor and seekable magic
+#define SEEK_TABLE_FOOTER_SIZE 9
+// The seek table keeps 32 bit sizes
+#define MAX_FRAME_SIZE (1024 * 1024 * 1024)
+
+
+
+CompressedFileWriter::CompressedFileWriter(const int compressionLevel, const std::size_t frameSize,
+                                           const unsigned threadsCount)
+    : compressionLevel(compressionLevel),
+      frameSize(std::clamp<std::size_t>(frameSize, 1, MAX_FRAME_SIZE)),
+      threadsCount(std::max(threadsCount, 1u)) {
+}
+
+int CompressedFileWriter::open(const std::string &filePath) {
+    close();
+
+    fileStream.open(filePath, std::ios::binary);
+
+    if (!fileStream) {
+        std::cerr << "Error: Cannot open " << filePath << " for writing.\n";
+        return 1;
+    }
+
+    seekTable.clear();
+    submittedFrames = 0;
+    writtenFrames = 0;
+    isClosing = false;
+    writeStatus = 0;
+
+    inputBuffer.resize(frameSize);
+    setp(inputBuffer.data(), inputBuffer.data() + frameSize);
+
+    for (unsigned i = 0; i < threadsCount; ++i)
+        compressionThreads.emplace_back(&CompressedFileWriter::compressFrames, this);
+
+    return 0;
+}
+
+int CompressedFileWriter::submitInputBuffer() {
+    const std::size_t filledSize = pptr() - pbase();
+
+    std::unique_lock jobsLock{jobsMutex};
+
+    if (filledSize > 0) {
+        // Two frames per thread keep every thread busy while the finished frames wait for their turn
+        jobsCondition.wait(jobsLock, [this] {
+            return submittedFrames - writtenFrames < 2 * threadsCount || writeStatus != 0;
+        });
+
+        inputBuffer.resize(filledSize);
+        pendingJobs.push_back(std::make_unique<CompressionJob>(CompressionJob{submittedFrames++,
+                                                                              std::move(inputBuffer), {}}));
+        jobsCondition.notify_all();
+
+        if (spareInputs.empty()) {
+            inputBuffer = std::string();
+        } else {
+            inputBuffer = std::move(spareInputs.back());
+            spareInputs.pop_back();
+        }
+
+        inputBuffer.resize(frameSize);
+    }
+
+    setp(inputBuffer.data(), inputBuffer.data() + frameSize);
+    return writeStatus;
+}
+
+void CompressedFileWriter::compressFrames() {
+    while (true) {
+        std::unique_ptr<CompressionJob> compressionJob;
+
+        {
+            std::unique_lock jobsLock{jobsMutex};
+            jobsCondition.wait(jobsLock, [this] { return !pendingJobs.empty() || isClosing; });
+
+            if (pendingJobs.empty())
+                return;
+
+            compressionJob = std::move(pendingJobs.front());
+            pendingJobs.pop_front();
+        }
+
+        compressionJob->status = compressFrame(compressionJob->input, compressionLevel, compressionJob->output);
+
+        std::lock_guard jobsLock{jobsMutex};
+        compressedJobs.emplace(compressionJob->sequence, std::move(compressionJob));
+        writeCompressedFrames();
+    }
+}
+
+void CompressedFileWriter::writeCompressedFrames() {
+    // Compressed frames are small next to their input, writing them under the lock keeps the order simple
+    while (!compressedJobs.empty() && compressedJobs.begin()->first == writtenFrames) {
+        std::unique_ptr<CompressionJob> compressionJob = std::move(compressedJobs.begin()->second);
+        compressedJobs.erase(compressedJobs.begin());
+
+        writeStatus |= compressionJob->status;
+
+        // After a failure the frames are still taken off, so the stream never waits forever
+        if (writeStatus == 0) {
+            fileStream.write(compressionJob->output.data(),
+                             static_cast<std::streamsize>(compressionJob->output.length()));
+            seekTable.push_back({static_cast<std::uint32_t>(compressionJob->output.length()),
+                                 static_cast<std::uint32_t>(compressionJob->input.length())});
+
+            if (!fileStream)
+                writeStatus = 1;
+        }
+
+        spareInputs.push_back(std::move(compressionJob->input));
+        ++writtenFrames;
+    }
+
+    jobsCondition.notify_all();
+}
+
+CompressedFileWriter::int_type CompressedFileWriter::overflow(const int_type ch) {
+    if (!fileStream.is_open() || submitInputBuffer())
+        return traits_type::eof();
+
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize CompressedFileWriter::xsputn(const char *data, const std::streamsize size) {
+    std::streamsize copiedSize = 0;
+
+    while (copiedSize < size) {
+        if (pptr() == epptr() && (!fileStream.is_open() || submitInputBuffer()))
+            return copiedSize;
+
+        const std::streamsize chunkSize = std::min<std::streamsize>(size - copiedSize, epptr() - pptr());
+        std::memcpy(pptr(), data + copiedSize, chunkSize);
+
+        // pbump takes an int, a chunk never exceeds the frame size
+        pbump(static_cast<int>(chunkSize));
+        copiedSize += chunkSize;
+    }
+
+    return copiedSize;
+}
+
+int CompressedFileWriter::close() {
+    if (!fileStream.is_open())
+        return 0;
+
+    submitInputBuffer();
+
+    {
+        std::lock_guard jobsLock{jobsMutex};
+        isClosing = true;
+        jobsCondition.notify_all();
+    }
+
+    for (std::thread &compressionThread: compressionThreads)
+        compressionThread.join();
+    compressionThreads.clear();
+
+    int closeStatus = writeStatus;
+
+    if (closeStatus == 0) {
+        std::string seekTableFrame;
+        appendLittleEndian(seekTableFrame, SKIPPABLE_FRAME_MAGIC, 4);
+        appendLittleEndian(seekTableFrame, seekTable.size() * SEEK_ENTRY_SIZE + SEEK_TABLE_FOOTER_SIZE, 4);
+
+        for (const SeekEntry &seekEntry: seekTable) {
+            appendLittleEndian(seekTableFrame, seekEntry.compressedSize, 4);
+            appendLittleEndian(seekTableFrame, seekEntry.decompressedSize, 4);
+        }
+
+        appendLittleEndian(seekTableFrame, seekTable.size(), 4);
+        seekTableFrame.push_back('\0'); // Descriptor: no checksums in the table, LZ4 checks the frames
+        appendLittleEndian(seekTableFrame, SEEKABLE_MAGIC, 4);
+
+        fileStream.write(seekTableFrame.data(), static_cast<std::streamsize>(seekTableFrame.length()));
+    }
+
+    fileStream.close();
+    setp(nullptr, nullptr);
+
+    if (!fileStream)
+        closeStatus = 1;
+
+    if (closeStatus != 0)
+        std::cerr << "Error: Cannot write the compressed output file.\n";
+
+    return closeStatus;
+}
+
+CompressedFileWriter::~CompressedFileWriter() {
+    close();
+}
+
+
+int CompressedFileReader::open(const std::string &filePath) {
+    compressedOffsets.clear();
+    decompressedOffsets.clear();
+
+    fileStream.close();
+    fileStream.open(filePath, std::ios::binary);
+
+    if (!fileStream) {
+        std::cerr << "Error: Cannot open " << filePath << " for reading.\n";
+        return 1;
+    }
+
+    fileStream.seekg(0, std::ios::end);
+    const std::uint64_t fileSize = fileStream.tellg();
+
+    char footer[SEEK_TABLE_FOOTER_SIZE];
+    std::uint64_t framesCount = 0;
+
+    if (fileSize >= SKIPPABLE_HEADER_SIZE + SEEK_TABLE_FOOTER_SIZE) {
+        fileStream.seekg(static_cast<std::streamoff>(fileSize - SEEK_TABLE_FOOTER_SIZE));
+        fileStream.read(footer, SEEK_TABLE_FOOTER_SIZE);
+        framesCount = readLittleEndian(footer, 4);
+    }
+
+    const std::uint64_t seekTableSize = SKIPPABLE_HEADER_SIZE + framesCount * SEEK_ENTRY_SIZE + SEEK_TABLE_FOOTER_SIZE;
+
+    if (!fileStream || fileSize < SKIPPABLE_HEADER_SIZE + SEEK_TABLE_FOOTER_SIZE
+        || readLittleEndian(footer + 5, 4) != SEEKABLE_MAGIC || seekTableSize > fileSize) {
+        std::cerr << "Error: " << filePath << " has no seek table.\n";
+        return 1;
+    }
+
+    std::string seekTableFrame(seekTableSize, '\0');
+    fileStream.seekg(static_cast<std::streamoff>(fileSize - seekTableSize));
+    fileStream.read(seekTableFrame.data(), static_cast<std::streamsize>(seekTableSize));
+
+    compressedOffsets.push_back(0);
+    decompressedOffsets.push_back(0);
+
+    for (std::uint64_t i = 0; i < framesCount; ++i) {
+        const char *seekEntry = seekTableFrame.data() + SKIPPABLE_HEADER_SIZE + i * SEEK_ENTRY_SIZE;
+
+        compressedOffsets.push_back(compressedOffsets.back() + readLittleEndian(seekEntry, 4));
+        decompressedOffsets.push_back(decompressedOffsets.back() + readLittleEndian(seekEntry + 4, 4));
+    }
+
+    // The frames have to fill the file right up to the seek table
+    if (!fileStream || readLittleEndian(seekTableFrame.data(), 4) != SKIPPABLE_FRAME_MAGIC
+        || readLittleEndian(seekTableFrame.data() + 4, 4) != seekTableSize - SKIPPABLE_HEADER_SIZE
+        || compressedOffsets.back() != fileSize - seekTableSize) {
+        std::cerr << "Error: The seek table of " << filePath << " is damaged.\n";
+        compressedOffsets.clear();
+        decompressedOffsets.clear();
+        return 1;
+    }
+
+    return 0;
+}
+
+std::uint64_t CompressedFileReader::size() const {
+    return decompressedOffsets.empty() ? 0 : decompressedOffsets.back();
+}
+
+int CompressedFileReader::read(std::uint64_t offset, std::size_t length, std::string &destination) {
+    if (offset > size() || length > size() - offset) {
+        std::cerr << "Error: The range is beyond the end of the compressed file.\n";
+        return 1;
+    }
+
+    LZ4F_dctx *decompressionContext = nullptr;
+
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&decompressionContext, LZ4F_VERSION))) {
+        std::cerr << "Error: Cannot create an LZ4 decompression context.\n";
+        return 1;
+    }
+
+    // First frame holding the offset
+    std::size_t frameIndex = std::upper_bound(decompressedOffsets.begin(), decompressedOffsets.end(), offset) -
+                             decompressedOffsets.begin() - 1;
+
+    std::string compressed, frame;
+    int readStatus = 0;
+
+    while (length > 0 && readStatus == 0) {
+        compressed.resize(compressedOffsets[frameIndex + 1] - compressedOffsets[frameIndex]);
+        frame.resize(decompressedOffsets[frameIndex + 1] - decompressedOffsets[frameIndex]);
+
+        fileStream.seekg(static_cast<std::streamoff>(compressedOffsets[frameIndex]));
+        fileStream.read(compressed.data(), static_cast<std::streamsize>(compressed.length()));
+
+        readStatus = !fileStream || decompressFrame(decompressionContext, compressed, frame);
+
+        if (readStatus == 0) {
+            const std::uint64_t frameOffset = offset - decompressedOffsets[frameIndex];
+            const std::size_t copiedSize = std::min<std::uint64_t>(length, frame.length() - frameOffset);
+
+            destination.append(frame, frameOffset, copiedSize);
+            offset += copiedSize;
+            length -= copiedSize;
+            ++frameIndex;
+        }
+    }
+
+    LZ4F_freeDecompressionContext(decompressionContext);
+
+    if (readStatus != 0) {
+        std::cerr << "Error: Cannot decompress frame " << frameIndex << ".\n";
+        fileStream.clear();
+    }
+
+    return readStatus;
+}
+
+
+int compressFrame(const std::string &input, const int compressionLevel, std::string &output) {
+    LZ4F_preferences_t preferences = LZ4F_INIT_PREFERENCES;
+    preferences.compressionLevel = compressionLevel;
+    preferences.frameInfo.contentSize = input.length();
+    preferences.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+
+    output.resize(LZ4F_compressFrameBound(input.length(), &preferences));
+
+    const std::size_t compressedSize = LZ4F_compressFrame(output.data(), output.length(), input.data(),
+                                                          input.length(), &preferences);
+
+    if (LZ4F_isError(compressedSize)) {
+        std::cerr << "Error: LZ4 compression failed: " << LZ4F_getErrorName(compressedSize) << ".\n";
+        return 1;
+    }
+
+    output.resize(compressedSize);
+    return 0;
+}
+
+int decompressFrame(LZ4F_dctx *decompressionContext, const std::string &compressed, std::string &frame) {
+    std::size_t compressedPosition = 0, framePosition = 0;
+    std::size_t sizeHint = 1;
+
+    while (sizeHint != 0) {
+        std::size_t frameSize = frame.length() - framePosition;
+        std::size_t compressedSize = compressed.length() - compressedPosition;
+
+        sizeHint = LZ4F_decompress(decompressionContext, frame.data() + framePosition, &frameSize,
+                                   compressed.data() + compressedPosition, &compressedSize, nullptr);
+
+        // A damaged frame either fails or stops making progress
+        if (LZ4F_isError(sizeHint) || (sizeHint != 0 && frameSize == 0 && compressedSize == 0)) {
+            LZ4F_resetDecompressionContext(decompressionContext);
+            return 1;
+        }
+
+        framePosition += frameSize;
+        compressedPosition += compressedSize;
+    }
+
+    return framePosition == frame.length() ? 0 : 1;
+}
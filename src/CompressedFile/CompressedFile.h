@@ -0,0 +1,114 @@
+#pragma once
+#include <lz4frame.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// LZ4 compression levels: 0 is the fast compressor, 3 to 12 the high compression (HC) one
+#define LZ4_FAST_LEVEL 0
+#define LZ4_HIGH_LEVEL 9
+
+
+// Stream buffer writing an LZ4 file as a sequence of independent frames of *frameSize* uncompressed bytes.
+// Worker threads compress the frames, they are written in order. A seek table in a trailing skippable frame
+// (the layout of zstd's seekable format) holds the sizes of every frame, so readers decompress only the frames
+// of the range they need; `lz4 -d` skips the table and restores the whole file.
+// Use it through std::ostream stream{&compressedFileWriter};
+class CompressedFileWriter : public std::streambuf {
+    struct CompressionJob {
+        std::uint64_t sequence;
+        std::string input;
+        std::string output;
+        int status = 0;
+    };
+
+    struct SeekEntry {
+        std::uint32_t compressedSize;
+        std::uint32_t decompressedSize;
+    };
+
+    const int compressionLevel;
+    const std::size_t frameSize;
+    const unsigned threadsCount;
+
+    std::ofstream fileStream;
+    std::string inputBuffer;
+    std::vector<std::string> spareInputs;
+    std::vector<SeekEntry> seekTable;
+
+    std::mutex jobsMutex;
+    std::condition_variable jobsCondition;
+    std::deque<std::unique_ptr<CompressionJob>> pendingJobs;
+    // Compressed frames waiting for the frames before them
+    std::map<std::uint64_t, std::unique_ptr<CompressionJob>> compressedJobs;
+    std::vector<std::thread> compressionThreads;
+    std::uint64_t submittedFrames = 0;
+    std::uint64_t writtenFrames = 0;
+    bool isClosing = false;
+    int writeStatus = 0;
+
+    // Hand the filled input buffer to the compression threads, waits while too many frames are in flight
+    int submitInputBuffer();
+
+    // Compression thread: compress pending frames, write the compressed ones which are next in order
+    void compressFrames();
+
+    // Write the frames of *compressedJobs* which are next in order (called with the jobs mutex held)
+    void writeCompressedFrames();
+
+protected:
+    int_type overflow(int_type ch) override;
+
+    std::streamsize xsputn(const char *data, std::streamsize size) override;
+
+public:
+    explicit CompressedFileWriter(int compressionLevel = LZ4_FAST_LEVEL, std::size_t frameSize = 4 * 1024 * 1024,
+                                  unsigned threadsCount = std::thread::hardware_concurrency());
+
+    CompressedFileWriter(const CompressedFileWriter &) = delete;
+
+    CompressedFileWriter &operator=(const CompressedFileWriter &) = delete;
+
+    int open(const std::string &filePath);
+
+    // Compress the rest of the data and write the seek table, non-zero when any frame failed
+    int close();
+
+    ~CompressedFileWriter() override;
+};
+
+
+// Random access to the decompressed data of a CompressedFileWriter file. Rows of a rendered table start at
+// TableRenderer::headSize() + row * rowSize(), so row ranges are read without decompressing the rest.
+class CompressedFileReader {
+    std::ifstream fileStream;
+    // Start of every frame in the file and in the decompressed data, each with the end as the last entry
+    std::vector<std::uint64_t> compressedOffsets;
+    std::vector<std::uint64_t> decompressedOffsets;
+
+public:
+    // Open the file and read its seek table
+    int open(const std::string &filePath);
+
+    // Decompressed size of the whole file
+    std::uint64_t size() const;
+
+    // Append the decompressed bytes [offset, offset + length) to *destination*
+    int read(std::uint64_t offset, std::size_t length, std::string &destination);
+};
+
+
+// Compress *input* into one LZ4 frame carrying its content size and checksum
+int compressFrame(const std::string &input, int compressionLevel, std::string &output);
+
+// Decompress one whole LZ4 frame into *frame*, which has its decompressed size
+int decompressFrame(LZ4F_dctx *decompressionContext, const std::string &compressed, std::string &frame);
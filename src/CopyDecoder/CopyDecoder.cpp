@@ -0,0 +1,542 @@
+#include "CopyDecoder.h"
+#include "../ByteOrder/ByteOrder.h"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+
+#define COPY_DELIMITER '\t'
+#define COPY_ESCAPE '\\'
+#define COPY_NULL_MARKER 'N'
+#define COPY_BINARY_SIGNATURE "PGCOPY\n\377\r\n\0"
+#define COPY_BINARY_SIGNATURE_LENGTH 11
+// Signature, flags and header extension length
+#define COPY_BINARY_HEADER_LENGTH 19
+// Flags bit telling the tuples start with their OID
+#define COPY_BINARY_OIDS_FLAG (1u << 16)
+
+
+// Value of a hexadecimal digit, -1 for any other character
+int copyHexDigit(char ch);
+
+// Run *copyQuery*, decode every received buffer with *decoder* and hand the rows to *consumer* in batches
+// of *batchRows*, the last batch once the server confirmed the whole COPY
+template<typename Decoder>
+int streamCopyData(PGconn *connection, const std::string &copyQuery, Decoder &decoder, std::size_t batchRows,
+                   const CopyBatchConsumer &consumer);
+
+
+const char *const *CopyBatch::rowValues(const std::size_t row) const {
+    return values.data() + row * columnsCount;
+}
+
+const int *CopyBatch::rowLengths(const std::size_t row) const {
+    return lengths.data() + row * columnsCount;
+}
+
+const int *CopyBatch::rowNulls(const std::size_t row) const {
+    return nulls.data() + row * columnsCount;
+}
+
+std::string_view CopyBatch::cell(const std::size_t row, const std::size_t column) const {
+    const std::size_t index = row * columnsCount + column;
+    return {values[index], static_cast<std::size_t>(lengths[index])};
+}
+
+bool CopyBatch::isNull(const std::size_t row, const std::size_t column) const {
+    return nulls[row * columnsCount + column] != 0;
+}
+
+
+CopyTextDecoder::CopyTextDecoder(const std::size_t columnsCount) {
+    batch.columnsCount = columnsCount;
+}
+
+void CopyTextDecoder::appendCell(char *value, std::size_t length, const bool isEscaped) {
+    if (isEscaped && length == 2 && value[0] == COPY_ESCAPE && value[1] == COPY_NULL_MARKER) {
+        batch.values.push_back("");
+        batch.lengths.push_back(0);
+        batch.nulls.push_back(1);
+        return;
+    }
+
+    if (isEscaped)
+        length = unescapeCopyText(value, length);
+
+    batch.values.push_back(value);
+    batch.lengths.push_back(static_cast<int>(length));
+    batch.nulls.push_back(0);
+}
+
+int CopyTextDecoder::decodeRow(char *row, std::size_t length) {
+    if (length > 0 && row[length - 1] == '\n')
+        --length;
+
+    const std::size_t firstCell = batch.values.size();
+    std::size_t cellsCount = 0;
+    std::size_t cellStart = 0;
+    std::size_t position = 0;
+    bool isEscaped = false;
+
+    // A row of no columns is an empty line
+    const char *rowError = batch.columnsCount == 0 && length > 0 ? "a row of no columns holds data" : nullptr;
+
+    while (rowError == nullptr && batch.columnsCount > 0) {
+        position += findCopyDelimiter(row + position, length - position);
+
+        if (position < length && row[position] == COPY_ESCAPE) /* The escaped character is skipped, tabs included */ {
+            if (position + 1 == length) {
+                rowError = "a row ends with a lone backslash";
+                break;
+            }
+
+            isEscaped = true;
+            position += 2;
+            continue;
+        }
+
+        if (position < length && row[position] == '\n') {
+            rowError = "a row holds an unescaped new line";
+            break;
+        }
+
+        // A tab or the end of the row closes a cell
+        if (++cellsCount > batch.columnsCount) {
+            rowError = "a row has more cells than the result has columns";
+            break;
+        }
+
+        appendCell(row + cellStart, position - cellStart, isEscaped);
+
+        if (position == length)
+            break;
+
+        cellStart = ++position;
+        isEscaped = false;
+    }
+
+    if (rowError == nullptr && cellsCount < batch.columnsCount)
+        rowError = "a row has fewer cells than the result has columns";
+
+    if (rowError != nullptr) {
+        std::cerr << "COPY DECODE failed: " << rowError << ".\n";
+
+        batch.values.resize(firstCell);
+        batch.lengths.resize(firstCell);
+        batch.nulls.resize(firstCell);
+        return 1;
+    }
+
+    ++batch.rowsCount;
+    return 0;
+}
+
+int CopyTextDecoder::decodeCopyData(char *copyData, const int length) {
+    if (decodeRow(copyData, static_cast<std::size_t>(length)) != 0) {
+        PQfreemem(copyData);
+        return 1;
+    }
+
+    copyBuffers.push_back(copyData);
+    return 0;
+}
+
+bool CopyTextDecoder::isFinished() const {
+    return true;
+}
+
+const CopyBatch &CopyTextDecoder::getBatch() const {
+    return batch;
+}
+
+void CopyTextDecoder::clear() {
+    for (char *copyBuffer: copyBuffers)
+        PQfreemem(copyBuffer);
+    copyBuffers.clear();
+
+    batch.values.clear();
+    batch.lengths.clear();
+    batch.nulls.clear();
+    batch.rowsCount = 0;
+}
+
+CopyTextDecoder::~CopyTextDecoder() {
+    clear();
+}
+
+int CopyTextDecoder::streamCopy(PGconn *connection, const std::string &query, const std::size_t columnsCount,
+                                const std::size_t batchRows, const CopyBatchConsumer &consumer) {
+    CopyTextDecoder copyTextDecoder{columnsCount};
+
+    return streamCopyData(connection, std::string("COPY (") + query + std::string(") TO STDOUT;"),
+                          copyTextDecoder, batchRows, consumer);
+}
+
+
+CopyBinaryDecoder::CopyBinaryDecoder(const std::size_t columnsCount) {
+    batch.columnsCount = columnsCount;
+}
+
+int CopyBinaryDecoder::decodeChunk(const char *chunk, const std::size_t length) {
+    const char *position = chunk;
+    const char *end = chunk + length;
+
+    if (!carriedBytes.empty()) /* The unfinished tuple continues in this chunk */ {
+        auto joinedChunk = std::make_unique<std::string>(std::move(carriedBytes));
+        joinedChunk->append(chunk, length);
+        carriedBytes.clear();
+
+        position = joinedChunk->data();
+        end = position + joinedChunk->length();
+        joinedChunks.push_back(std::move(joinedChunk));
+    }
+
+    const char *streamError = nullptr;
+
+    while (position < end && streamError == nullptr) {
+        if (isTrailerRead) {
+            streamError = "data follows the trailer";
+            break;
+        }
+
+        const char *tupleStart = position;
+        const std::size_t firstCell = batch.values.size();
+        bool isComplete = false;
+
+        if (!isHeaderRead) {
+            if (end - position < COPY_BINARY_HEADER_LENGTH) {
+                carriedBytes.assign(tupleStart, end);
+                break;
+            }
+
+            if (std::memcmp(position, COPY_BINARY_SIGNATURE, COPY_BINARY_SIGNATURE_LENGTH) != 0) {
+                streamError = "the stream has no COPY BINARY signature";
+                break;
+            }
+
+            if (readBigEndian(position + COPY_BINARY_SIGNATURE_LENGTH, 4) & COPY_BINARY_OIDS_FLAG) {
+                streamError = "the tuples carry OIDs";
+                break;
+            }
+
+            const std::uint32_t extensionLength = readBigEndian(position + COPY_BINARY_SIGNATURE_LENGTH + 4, 4);
+
+            if (static_cast<std::size_t>(end - position) < COPY_BINARY_HEADER_LENGTH + extensionLength) {
+                carriedBytes.assign(tupleStart, end);
+                break;
+            }
+
+            position += COPY_BINARY_HEADER_LENGTH + extensionLength;
+            isHeaderRead = true;
+            continue;
+        }
+
+        if (end - position >= 2) {
+            const auto fieldsCount = static_cast<std::int16_t>(readBigEndian(position, 2));
+            position += 2;
+
+            if (fieldsCount == -1) {
+                isTrailerRead = true;
+                continue;
+            }
+
+            if (static_cast<std::size_t>(fieldsCount) != batch.columnsCount) {
+                streamError = "a tuple has another number of fields than the result has columns";
+                break;
+            }
+
+            isComplete = true;
+
+            for (std::size_t j = 0; j < batch.columnsCount && isComplete; ++j) {
+                if (end - position < 4) {
+                    isComplete = false;
+                    break;
+                }
+
+                const auto fieldLength = static_cast<std::int32_t>(readBigEndian(position, 4));
+                position += 4;
+
+                if (fieldLength < -1) {
+                    streamError = "a field has a negative length";
+                    break;
+                }
+
+                if (fieldLength == -1) {
+                    batch.values.push_back("");
+                    batch.lengths.push_back(0);
+                    batch.nulls.push_back(1);
+                    continue;
+                }
+
+                if (end - position < fieldLength) {
+                    isComplete = false;
+                    break;
+                }
+
+                batch.values.push_back(position);
+                batch.lengths.push_back(fieldLength);
+                batch.nulls.push_back(0);
+                position += fieldLength;
+            }
+        }
+
+        if (isComplete && streamError == nullptr) {
+            ++batch.rowsCount;
+            continue;
+        }
+
+        // The tuple is decoded again once the rest of it arrived
+        batch.values.resize(firstCell);
+        batch.lengths.resize(firstCell);
+        batch.nulls.resize(firstCell);
+
+        if (streamError == nullptr)
+            carriedBytes.assign(tupleStart, end);
+        break;
+    }
+
+    if (streamError != nullptr) {
+        std::cerr << "COPY DECODE failed: " << streamError << ".\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+int CopyBinaryDecoder::decodeCopyData(char *copyData, const int length) {
+    copyBuffers.push_back(copyData);
+    return decodeChunk(copyData, static_cast<std::size_t>(length));
+}
+
+bool CopyBinaryDecoder::isFinished() const {
+    return isTrailerRead && carriedBytes.empty();
+}
+
+const CopyBatch &CopyBinaryDecoder::getBatch() const {
+    return batch;
+}
+
+void CopyBinaryDecoder::clear() {
+    for (char *copyBuffer: copyBuffers)
+        PQfreemem(copyBuffer);
+    copyBuffers.clear();
+    joinedChunks.clear();
+
+    batch.values.clear();
+    batch.lengths.clear();
+    batch.nulls.clear();
+    batch.rowsCount = 0;
+}
+
+CopyBinaryDecoder::~CopyBinaryDecoder() {
+    clear();
+}
+
+int CopyBinaryDecoder::streamCopy(PGconn *connection, const std::string &query, const std::size_t columnsCount,
+                                  const std::size_t batchRows, const CopyBatchConsumer &consumer) {
+    CopyBinaryDecoder copyBinaryDecoder{columnsCount};
+
+    return streamCopyData(connection,
+                          std::string("COPY (") + query + std::string(") TO STDOUT (FORMAT binary);"),
+                          copyBinaryDecoder, batchRows, consumer);
+}
+
+
+std::size_t unescapeCopyText(char *text, const std::size_t length) {
+    std::size_t readPosition = 0;
+    std::size_t writePosition = 0;
+
+    while (readPosition < length) {
+        // The text between the escapes moves down by the bytes the escapes before it saved
+        const auto escape = static_cast<const char *>(std::memchr(text + readPosition, COPY_ESCAPE,
+                                                                  length - readPosition));
+        const std::size_t plainEnd = escape == nullptr ? length : escape - text;
+
+        std::memmove(text + writePosition, text + readPosition, plainEnd - readPosition);
+        writePosition += plainEnd - readPosition;
+        readPosition = plainEnd;
+
+        if (readPosition == length)
+            break;
+
+        if (++readPosition == length) /* A lone backslash at the end stays */ {
+            text[writePosition++] = COPY_ESCAPE;
+            break;
+        }
+
+        const char ch = text[readPosition++];
+        char decoded = ch;
+
+        switch (ch) {
+            case 'b':
+                decoded = '\b';
+                break;
+            case 'f':
+                decoded = '\f';
+                break;
+            case 'n':
+                decoded = '\n';
+                break;
+            case 'r':
+                decoded = '\r';
+                break;
+            case 't':
+                decoded = '\t';
+                break;
+            case 'v':
+                decoded = '\v';
+                break;
+            case '0':
+            case '1':
+            case '2':
+            case '3':
+            case '4':
+            case '5':
+            case '6':
+            case '7': {
+                int value = ch - '0';
+
+                for (int digits = 1; digits < 3 && readPosition < length
+                                     && text[readPosition] >= '0' && text[readPosition] <= '7'; ++digits)
+                    value = value * 8 + (text[readPosition++] - '0');
+
+                decoded = static_cast<char>(value);
+                break;
+            }
+            case 'x': /* Without a hex digit after it, \x is a plain x */ {
+                int value = -1;
+
+                for (int digits = 0; digits < 2 && readPosition < length && copyHexDigit(text[readPosition]) >= 0;
+                     ++digits)
+                    value = (value < 0 ? 0 : value * 16) + copyHexDigit(text[readPosition++]);
+
+                if (value >= 0)
+                    decoded = static_cast<char>(value);
+                break;
+            }
+            default:
+                break;
+        }
+
+        text[writePosition++] = decoded;
+    }
+
+    return writePosition;
+}
+
+std::size_t findCopyDelimiter(const char *text, const std::size_t length) {
+    std::size_t position = 0;
+
+#if defined(__AVX2__)
+    const __m256i wideTabs = _mm256_set1_epi8(COPY_DELIMITER);
+    const __m256i wideLineEnds = _mm256_set1_epi8('\n');
+    const __m256i wideEscapes = _mm256_set1_epi8(COPY_ESCAPE);
+
+    for (; position + 32 <= length; position += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + position));
+        const __m256i matches = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, wideTabs), _mm256_cmpeq_epi8(block, wideLineEnds)),
+            _mm256_cmpeq_epi8(block, wideEscapes));
+        const auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(matches));
+
+        if (mask != 0)
+            return position + std::countr_zero(mask);
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    const __m128i tabs = _mm_set1_epi8(COPY_DELIMITER);
+    const __m128i lineEnds = _mm_set1_epi8('\n');
+    const __m128i escapes = _mm_set1_epi8(COPY_ESCAPE);
+
+    for (; position + 16 <= length; position += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + position));
+        const __m128i matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, tabs), _mm_cmpeq_epi8(block, lineEnds)),
+                                             _mm_cmpeq_epi8(block, escapes));
+        const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(matches));
+
+        if (mask != 0)
+            return position + std::countr_zero(mask);
+    }
+#endif
+
+    for (; position < length; ++position) {
+        if (text[position] == COPY_DELIMITER || text[position] == '\n' || text[position] == COPY_ESCAPE)
+            return position;
+    }
+
+    return length;
+}
+
+int copyHexDigit(const char ch) {
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+template<typename Decoder>
+int streamCopyData(PGconn *connection, const std::string &copyQuery, Decoder &decoder, const std::size_t batchRows,
+                   const CopyBatchConsumer &consumer) {
+    PGresult *copyResult = PQexec(connection, copyQuery.c_str());
+
+    if (PQresultStatus(copyResult) != PGRES_COPY_OUT) {
+        std::cerr << "COPY STREAM failed: " << PQerrorMessage(connection) << std::endl;
+        PQclear(copyResult);
+        return 1;
+    }
+    PQclear(copyResult);
+
+    int streamStatus = 0;
+    char *copyData = nullptr;
+    int copyLength;
+
+    // Every row has to be read even after a failure, or the connection stays in the COPY state
+    while ((copyLength = PQgetCopyData(connection, &copyData, 0)) > 0) {
+        if (streamStatus != 0) {
+            PQfreemem(copyData);
+            continue;
+        }
+
+        streamStatus = decoder.decodeCopyData(copyData, copyLength);
+
+        if (streamStatus == 0 && decoder.getBatch().rowsCount >= batchRows) {
+            streamStatus = consumer(decoder.getBatch());
+            decoder.clear();
+        }
+    }
+
+    if (copyLength == -2 && streamStatus == 0) {
+        std::cerr << "COPY STREAM failed: " << PQerrorMessage(connection) << std::endl;
+        streamStatus = 1;
+    }
+
+    while (PGresult *endResult = PQgetResult(connection)) {
+        if (PQresultStatus(endResult) != PGRES_COMMAND_OK && streamStatus == 0) {
+            std::cerr << "COPY STREAM failed: " << PQresultErrorMessage(endResult) << std::endl;
+            streamStatus = 1;
+        }
+
+        PQclear(endResult);
+    }
+
+    if (streamStatus == 0 && !decoder.isFinished()) {
+        std::cerr << "COPY DECODE failed: the stream ended inside a row.\n";
+        streamStatus = 1;
+    }
+
+    // The last rows go out once the server confirmed the whole COPY
+    if (streamStatus == 0)
+        streamStatus = consumer(decoder.getBatch());
+
+    return streamStatus;
+}
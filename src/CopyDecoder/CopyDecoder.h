@@ -0,0 +1,125 @@
+#pragma once
+#include <libpq-fe.h>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Rows decoded from COPY ... TO STDOUT, cell after cell in row order (row-major). The values point into the
+// received COPY buffers (text unescaped in place, binary as sent), so they are not NUL-terminated; NULL cells are empty.
+struct CopyBatch {
+    std::size_t columnsCount = 0;
+    std::size_t rowsCount = 0;
+    std::vector<const char *> values;
+    std::vector<int> lengths;
+    std::vector<int> nulls;
+
+    // The cells of one row, *columnsCount* of each
+    const char *const *rowValues(std::size_t row) const;
+
+    const int *rowLengths(std::size_t row) const;
+
+    const int *rowNulls(std::size_t row) const;
+
+    std::string_view cell(std::size_t row, std::size_t column) const;
+
+    bool isNull(std::size_t row, std::size_t column) const;
+};
+
+
+// Receives every batch of decoded rows, returns non-zero to stop the stream. The last batch may have no rows.
+using CopyBatchConsumer = std::function<int(const CopyBatch &batch)>;
+
+
+// Splits COPY text rows into their cells without copying them: tabs, new lines and backslashes are found 32 or 16
+// bytes at a time (AVX2 / SSE2, a byte loop without SIMD), and only the cells holding a backslash are unescaped,
+// in place (an escape never gets longer once decoded).
+class CopyTextDecoder {
+    CopyBatch batch;
+
+    // Buffers of PQgetCopyData the batch points into, freed with it
+    std::vector<char *> copyBuffers;
+
+    // Append one cell of the current row, \N alone is NULL
+    void appendCell(char *value, std::size_t length, bool isEscaped);
+
+public:
+    explicit CopyTextDecoder(std::size_t columnsCount);
+
+    CopyTextDecoder(const CopyTextDecoder &) = delete;
+
+    CopyTextDecoder &operator=(const CopyTextDecoder &) = delete;
+
+    // Split one COPY text row (with or without its new line) into the batch. The row is unescaped in place
+    // and has to stay valid until clear(); a row of another number of cells is rejected.
+    int decodeRow(char *row, std::size_t length);
+
+    // decodeRow on a buffer returned by PQgetCopyData, freed by clear() (or right away when rejected)
+    int decodeCopyData(char *copyData, int length);
+
+    // PQgetCopyData returns text rows whole, a text stream never ends inside one
+    bool isFinished() const;
+
+    const CopyBatch &getBatch() const;
+
+    // Forget the decoded rows and free the buffers they point into
+    void clear();
+
+    ~CopyTextDecoder();
+
+    // Run COPY (*query*) TO STDOUT and hand its rows to *consumer* in batches of *batchRows*. The consumer is
+    // called at least once; after it stops the stream, the remaining rows are read and dropped.
+    static int streamCopy(PGconn *connection, const std::string &query, std::size_t columnsCount,
+                          std::size_t batchRows, const CopyBatchConsumer &consumer);
+};
+
+// Splits a COPY BINARY stream (signature, flags and header extension, then per tuple a 16-bit field count and
+// 32-bit length prefixed fields, -1 for NULL, up to the -1 trailer) into the cells of its tuples: the binary values
+// the server sends, in network byte order, as ColumnarWriter decodes them from binary results. Chunks can end
+// anywhere; an unfinished tuple is carried over and joined with the next chunk, the only bytes ever copied.
+class CopyBinaryDecoder {
+    CopyBatch batch;
+    bool isHeaderRead = false;
+    bool isTrailerRead = false;
+
+    std::vector<char *> copyBuffers;
+    // Unfinished tuple joined with the following chunk, kept while the batch points into it
+    std::vector<std::unique_ptr<std::string>> joinedChunks;
+    std::string carriedBytes;
+
+public:
+    explicit CopyBinaryDecoder(std::size_t columnsCount);
+
+    CopyBinaryDecoder(const CopyBinaryDecoder &) = delete;
+
+    CopyBinaryDecoder &operator=(const CopyBinaryDecoder &) = delete;
+
+    // Decode the whole tuples of the next piece of the stream. The chunk has to stay valid until clear().
+    int decodeChunk(const char *chunk, std::size_t length);
+
+    // decodeChunk on a buffer returned by PQgetCopyData, freed by clear()
+    int decodeCopyData(char *copyData, int length);
+
+    // Whether the trailer closed the stream, without bytes of a tuple left over
+    bool isFinished() const;
+
+    const CopyBatch &getBatch() const;
+
+    void clear();
+
+    ~CopyBinaryDecoder();
+
+    // Run COPY (*query*) TO STDOUT (FORMAT binary) and hand its tuples to *consumer* in batches of *batchRows*
+    static int streamCopy(PGconn *connection, const std::string &query, std::size_t columnsCount,
+                          std::size_t batchRows, const CopyBatchConsumer &consumer);
+};
+
+// Decode the COPY text escapes (\b \f \n \r \t \v, \ooo octal, \xhh hex, \ followed by any other character)
+// of *text* in place, returns the decoded length
+std::size_t unescapeCopyText(char *text, std::size_t length);
+
+// Offset of the first tab, new line or backslash of *text*, *length* when there is none
+std::size_t findCopyDelimiter(const char *text, std::size_t length);
@@ -0,0 +1,265 @@
+#include "CopyEncoder.h"
+#include "../ByteOrder/ByteOrder.h"
+#include <cstring>
+#include <iostream>
+
+
+// The buffer goes to libpq once it holds this many bytes
+#define COPY_SEND_BYTES (1024 * 1024)
+#define COPY_BINARY_SIGNATURE "PGCOPY\n\377\r\n\0"
+#define COPY_BINARY_SIGNATURE_LENGTH 11
+// Days and microseconds from 1970-01-01 to 2000-01-01, the epoch of the binary dates and timestamps
+#define POSTGRES_EPOCH_DAYS 10957
+#define POSTGRES_EPOCH_MICROSECONDS 946684800000000LL
+#define NUMERIC_POSITIVE 0x0000
+#define NUMERIC_NEGATIVE 0x4000
+#define NUMERIC_MAX_SCALE 0x3FFF
+#define UUID_LENGTH 16
+
+
+CopyBinaryEncoder::CopyBinaryEncoder(PGconn *connection): connection(connection) {
+}
+
+int CopyBinaryEncoder::begin(const std::string &tableName, const std::vector<std::string> &columns) {
+    std::string copyQuery = std::string("COPY ") + tableName + std::string(" (");
+
+    for (std::size_t i = 0; i < columns.size(); ++i)
+        copyQuery += (i > 0 ? std::string(", ") : std::string()) + columns[i];
+    copyQuery += ") FROM STDIN (FORMAT binary);";
+
+    PGresult *copyResult = PQexec(connection, copyQuery.c_str());
+    isCopying = PQresultStatus(copyResult) == PGRES_COPY_IN;
+    PQclear(copyResult);
+
+    if (!isCopying) {
+        std::cerr << "COPY BINARY failed: " << PQerrorMessage(connection) << std::endl;
+        return 1;
+    }
+
+    columnsCount = columns.size();
+    rowsCount = 0;
+
+    // Signature, no flags, no header extension
+    sendBuffer.clear();
+    sendBuffer.reserve(2 * COPY_SEND_BYTES);
+    sendBuffer.append(COPY_BINARY_SIGNATURE, COPY_BINARY_SIGNATURE_LENGTH);
+    appendBigEndian(sendBuffer, 0, 4);
+    appendBigEndian(sendBuffer, 0, 4);
+    return 0;
+}
+
+void CopyBinaryEncoder::beginRow() {
+    rowStart = sendBuffer.length();
+    appendBigEndian(sendBuffer, columnsCount, 2);
+    rowFieldsCount = 0;
+}
+
+void CopyBinaryEncoder::appendNull() {
+    appendBigEndian(sendBuffer, 0xFFFFFFFF, 4);
+    ++rowFieldsCount;
+}
+
+void CopyBinaryEncoder::appendBool(const bool value) {
+    const char byte = value ? 1 : 0;
+    appendField(&byte, 1);
+}
+
+void CopyBinaryEncoder::appendInt16(const std::int16_t value) {
+    appendBigEndian(sendBuffer, 2, 4);
+    appendBigEndian(sendBuffer, static_cast<std::uint16_t>(value), 2);
+    ++rowFieldsCount;
+}
+
+void CopyBinaryEncoder::appendInt32(const std::int32_t value) {
+    appendBigEndian(sendBuffer, 4, 4);
+    appendBigEndian(sendBuffer, static_cast<std::uint32_t>(value), 4);
+    ++rowFieldsCount;
+}
+
+void CopyBinaryEncoder::appendInt64(const std::int64_t value) {
+    appendBigEndian(sendBuffer, 8, 4);
+    appendBigEndian(sendBuffer, static_cast<std::uint64_t>(value), 8);
+    ++rowFieldsCount;
+}
+
+void CopyBinaryEncoder::appendFloat32(const float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    appendBigEndian(sendBuffer, 4, 4);
+    appendBigEndian(sendBuffer, bits, 4);
+    ++rowFieldsCount;
+}
+
+void CopyBinaryEncoder::appendFloat64(const double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    appendBigEndian(sendBuffer, 8, 4);
+    appendBigEndian(sendBuffer, bits, 8);
+    ++rowFieldsCount;
+}
+
+int CopyBinaryEncoder::appendNumeric(const std::int64_t unscaledValue, const int scale) {
+    // A clamped scale would store another value, the missing field makes endRow leave the row out
+    if (scale < 0 || scale > NUMERIC_MAX_SCALE) {
+        std::cerr << "COPY BINARY failed: Row " << rowsCount + 1 << " has a numeric scale of " << scale
+                << ", not within 0.." << NUMERIC_MAX_SCALE << ".\n";
+        return 1;
+    }
+
+    const bool isNegative = unscaledValue < 0;
+    const std::uint64_t absoluteValue = isNegative
+                                            ? 0 - static_cast<std::uint64_t>(unscaledValue)
+                                            : static_cast<std::uint64_t>(unscaledValue);
+
+    // Decimal digits with one at least before the point, padded so the point falls between two base 10000 digits
+    std::string decimalDigits = std::to_string(absoluteValue);
+    const auto fractionDigitsCount = static_cast<std::size_t>(scale);
+
+    if (decimalDigits.length() <= fractionDigitsCount)
+        decimalDigits.insert(0, fractionDigitsCount + 1 - decimalDigits.length(), '0');
+
+    const std::size_t integerDigitsCount = decimalDigits.length() - fractionDigitsCount;
+    const std::size_t leadingPadding = (4 - integerDigitsCount % 4) % 4;
+
+    decimalDigits.insert(0, leadingPadding, '0');
+    decimalDigits.append((4 - fractionDigitsCount % 4) % 4, '0');
+
+    const auto baseDigit = [&decimalDigits](const std::size_t index) {
+        const char *digits = decimalDigits.data() + 4 * index;
+        return static_cast<std::uint16_t>((digits[0] - '0') * 1000 + (digits[1] - '0') * 100 +
+                                          (digits[2] - '0') * 10 + (digits[3] - '0'));
+    };
+
+    // Zero base digits at both ends are left out, the weight places the first one kept
+    const std::size_t baseDigitsCount = decimalDigits.length() / 4;
+    std::size_t firstDigit = 0;
+    std::size_t lastDigit = baseDigitsCount;
+
+    while (firstDigit < baseDigitsCount && baseDigit(firstDigit) == 0)
+        ++firstDigit;
+    while (lastDigit > firstDigit && baseDigit(lastDigit - 1) == 0)
+        --lastDigit;
+
+    const std::size_t keptDigitsCount = lastDigit - firstDigit;
+    const long long weight = keptDigitsCount == 0
+                                 ? 0
+                                 : static_cast<long long>((integerDigitsCount + leadingPadding) / 4) - 1 -
+                                   static_cast<long long>(firstDigit);
+
+    appendBigEndian(sendBuffer, 8 + 2 * keptDigitsCount, 4);
+    appendBigEndian(sendBuffer, keptDigitsCount, 2);
+    appendBigEndian(sendBuffer, static_cast<std::uint16_t>(weight), 2);
+    appendBigEndian(sendBuffer, isNegative ? NUMERIC_NEGATIVE : NUMERIC_POSITIVE, 2);
+    appendBigEndian(sendBuffer, static_cast<std::uint16_t>(scale), 2);
+
+    for (std::size_t i = firstDigit; i < lastDigit; ++i)
+        appendBigEndian(sendBuffer, baseDigit(i), 2);
+
+    ++rowFieldsCount;
+    return 0;
+}
+
+void CopyBinaryEncoder::appendDate(const std::chrono::sys_days value) {
+    appendInt32(static_cast<std::int32_t>(value.time_since_epoch().count() - POSTGRES_EPOCH_DAYS));
+}
+
+void CopyBinaryEncoder::appendTimestamp(const CopyTimestamp value) {
+    appendInt64(value.time_since_epoch().count() - POSTGRES_EPOCH_MICROSECONDS);
+}
+
+void CopyBinaryEncoder::appendUuid(const std::uint8_t *bytes) {
+    appendField(bytes, UUID_LENGTH);
+}
+
+void CopyBinaryEncoder::appendBytes(const char *data, const std::size_t length) {
+    appendField(data, length);
+}
+
+void CopyBinaryEncoder::appendText(const std::string_view value) {
+    appendField(value.data(), value.length());
+}
+
+int CopyBinaryEncoder::endRow() {
+    if (rowFieldsCount != columnsCount) {
+        std::cerr << "COPY BINARY failed: Row " << rowsCount + 1 << " has " << rowFieldsCount << " values for "
+                << columnsCount << " columns, it is left out.\n";
+
+        // The partial tuple would make the whole COPY stream malformed
+        sendBuffer.resize(rowStart);
+        rowFieldsCount = 0;
+        return 1;
+    }
+
+    ++rowsCount;
+    return sendBufferData(COPY_SEND_BYTES);
+}
+
+int CopyBinaryEncoder::end() {
+    if (!isCopying)
+        return 1;
+
+    // The trailer: a tuple of -1 fields
+    appendBigEndian(sendBuffer, 0xFFFF, 2);
+
+    if (sendBufferData(0) != 0) {
+        abort("COPY BINARY aborted");
+        return 1;
+    }
+
+    isCopying = false;
+    int copyStatus = PQputCopyEnd(connection, nullptr) == 1 ? 0 : 1;
+
+    while (PGresult *copyResult = PQgetResult(connection)) {
+        if (PQresultStatus(copyResult) != PGRES_COMMAND_OK)
+            copyStatus = 1;
+        PQclear(copyResult);
+    }
+
+    if (copyStatus != 0)
+        std::cerr << "COPY BINARY failed: " << PQerrorMessage(connection) << std::endl;
+
+    return copyStatus;
+}
+
+void CopyBinaryEncoder::abort(const char *errorMessage) {
+    sendBuffer.clear();
+
+    if (!isCopying)
+        return;
+
+    isCopying = false;
+    PQputCopyEnd(connection, errorMessage);
+
+    while (PGresult *copyResult = PQgetResult(connection))
+        PQclear(copyResult);
+}
+
+std::size_t CopyBinaryEncoder::getRowsCount() const {
+    return rowsCount;
+}
+
+CopyBinaryEncoder::~CopyBinaryEncoder() {
+    // A COPY left open would keep the connection busy
+    abort("COPY BINARY not finished");
+}
+
+void CopyBinaryEncoder::appendField(const void *data, const std::size_t length) {
+    appendBigEndian(sendBuffer, length, 4);
+    sendBuffer.append(static_cast<const char *>(data), length);
+    ++rowFieldsCount;
+}
+
+int CopyBinaryEncoder::sendBufferData(const std::size_t minimumSize) {
+    if (sendBuffer.length() < minimumSize || sendBuffer.empty())
+        return 0;
+
+    if (PQputCopyData(connection, sendBuffer.data(), static_cast<int>(sendBuffer.length())) != 1) {
+        std::cerr << "COPY BINARY failed: " << PQerrorMessage(connection) << std::endl;
+        return 1;
+    }
+
+    sendBuffer.clear();
+    return 0;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <libpq-fe.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Microseconds since 1970-01-01 UTC, the client side of timestamp and timestamptz values
+using CopyTimestamp = std::chrono::sys_time<std::chrono::microseconds>;
+
+
+// Loads typed values with COPY ... FROM STDIN (FORMAT binary): every value is encoded in the binary form the
+// server stores (big-endian integers and floats, base 10000 numeric digits, days and microseconds since 2000-01-01),
+// so neither side formats or parses text. Tuples are encoded into one reused buffer, handed to PQputCopyData
+// in large pieces. The values of a row go in column order and have to match the column types exactly
+// (appendInt32 for integer, appendInt64 for bigint...), the server rejects the COPY otherwise.
+class CopyBinaryEncoder {
+    PGconn *connection;
+    std::string sendBuffer;
+    std::size_t columnsCount = 0;
+    std::size_t rowFieldsCount = 0;
+    std::size_t rowStart = 0; // Offset of the current tuple in sendBuffer
+    std::size_t rowsCount = 0;
+    bool isCopying = false;
+
+    // Length prefix and bytes of one field
+    void appendField(const void *data, std::size_t length);
+
+    // Hand the buffer to libpq once it holds at least *minimumSize* bytes
+    int sendBufferData(std::size_t minimumSize);
+
+public:
+    explicit CopyBinaryEncoder(PGconn *connection);
+
+    CopyBinaryEncoder(const CopyBinaryEncoder &) = delete;
+
+    CopyBinaryEncoder &operator=(const CopyBinaryEncoder &) = delete;
+
+    // Start COPY *tableName* (*columns*) FROM STDIN (FORMAT binary) and encode the header
+    int begin(const std::string &tableName, const std::vector<std::string> &columns);
+
+    // Start a tuple, its values follow in column order
+    void beginRow();
+
+    void appendNull();
+
+    void appendBool(bool value);
+
+    void appendInt16(std::int16_t value);
+
+    void appendInt32(std::int32_t value);
+
+    void appendInt64(std::int64_t value);
+
+    void appendFloat32(float value);
+
+    void appendFloat64(double value);
+
+    // numeric from a fixed-point value: *unscaledValue* / 10^*scale* (12345 with scale 2 is 123.45). A scale outside
+    // 0..16383 appends nothing and fails, endRow then leaves the row out
+    int appendNumeric(std::int64_t unscaledValue, int scale);
+
+    void appendDate(std::chrono::sys_days value);
+
+    // timestamp and timestamptz (UTC)
+    void appendTimestamp(CopyTimestamp value);
+
+    // The 16 bytes of a uuid, in their textual order
+    void appendUuid(const std::uint8_t *bytes);
+
+    // bytea
+    void appendBytes(const char *data, std::size_t length);
+
+    // text, varchar, char and json (UTF-8 in the database encoding)
+    void appendText(std::string_view value);
+
+    // Close the tuple (it has to hold a value for every column, else it is left out), sending the buffer once it is
+    // large
+    int endRow();
+
+    // Encode the trailer, send the rest and finish the COPY; the rows are committed with the surrounding transaction
+    int end();
+
+    // Abort the COPY, none of its rows is inserted
+    void abort(const char *errorMessage);
+
+    std::size_t getRowsCount() const;
+
+    ~CopyBinaryEncoder();
+};
@@ -1,16 +1,27 @@
 #include "iostream"
 #include "DatabaseHandler.h"
 #include "../SHA256/SHA256.h"
+#include "../BlobStream/BlobStream.h"
+#include "../TableRenderer/TableRenderer.h"
+#include "../TableExporter/TableExporter.h"
+#include "../BulkWriter/BulkWriter.h"
+#include "../PipeWriter/PipeWriter.h"
+#include "../StreamSink/StreamSink.h"
+#include "../DisplayWidth/DisplayWidth.h"
+#include "../IncrementalExporter/IncrementalExporter.h"
+#include "../ExportScheduler/ExportScheduler.h"
+#include "../DumpArchive/DumpArchive.h"
+#include "../DbConnection/DbConnection.h"
 #include "fstream"
 #include "sstream"
 #include "vector"
 #include "limits"
+#include "thread"
 
 
 #define BETWEEN_ROWS_SEPARATOR '.'
 #define TABLE_ROW_SEPARATOR '-'
 #define TABLE_COL_SEPARATOR '|'
-#define END_OF_COL_SEPARATOR " |"
 #define COMMA_SPACE_SEPARATOR std::string(", ")
 #define ID_COL_NAME std::string("id")
 #define ESCAPE std::string("esc")
@@ -19,19 +30,18 @@
 #define EMPTY_VALUE std::string("N/A")
 #define SELECT_TABLE_NAMES_COL_TITLE std::string("Table Name")
 #define VARCHAR_CODE_VALUE 1043
+#define BYTEA_CODE_VALUE 17
+#define OID_CODE_VALUE 26
+#define CHECKPOINT_FILE_EXTENSION std::string(".checkpoint")
 #define NO_COLUMN_FOUND(colName) (std::string("No column found with name ") + (colName) + std::string(".\n"))
+#define BULK_INSERT_BATCH_SIZE 1000
+// Rendered results at least this big are split between the cores
+#define PARALLEL_RENDER_MIN_BYTES (16 * 1024 * 1024)
+// Spill buffers of a forced SPILL_FILE export without a memory budget
+#define SPILL_DEFAULT_MEMORY_BUDGET (64 * 1024 * 1024)
 #define OPERATION_WAS_SUCCESSFUL(operation) ((operation) + std::string(" operation was successful.\n"))
 
 
-// Repeat character *n* number of times
-std::string repeat(const char &ch, const std::string::size_type &times);
-
-// Adding spaces till the str reaches the size
-std::string addRightPadding(const std::string &valueStr, const std::string::size_type &size);
-
-// Create a whole in between entries row for printing the table
-std::string createBetweenRowsRow(const std::string::size_type *columnWidths, const int &colWidthsSize);
-
 // Join vector by a separator
 std::string join(const std::vector<std::string> &elements, const std::string &separator);
 
@@ -50,7 +60,15 @@ DatabaseHandler::DatabaseHandler(PGconn *connection): connection(connection) {
 
 
 int DatabaseHandler::SELECT_ALL_TABLES_SQL_QUERY(const std::string &outputFileNamePath) const {
-    std::ofstream fileStream{outputFileNamePath};
+    std::ostream &statusOutput = statusStream(outputFileNamePath);
+
+    StreamSink streamSink{outputBackend};
+    std::ostream &fileStream = streamSink.fileStream;
+
+    if (streamSink.open(outputFileNamePath)) {
+        std::cerr << "SELECT ALL TABLES failed: Cannot open " << outputFileNamePath << ".\n";
+        return 1;
+    }
 
     const std::string selectTableNamesQuery
             = "SELECT tablename FROM pg_catalog.pg_tables WHERE schemaname = 'public';";
@@ -63,12 +81,12 @@ int DatabaseHandler::SELECT_ALL_TABLES_SQL_QUERY(const std::string &outputFileNa
         return 1;
     }
 
-    auto biggestCharWidth = SELECT_TABLE_NAMES_COL_TITLE.length() + 1;
+    auto biggestCharWidth = displayWidth(SELECT_TABLE_NAMES_COL_TITLE) + 1;
 
-    // Find the longest str in order to calculate the width of the column
+    // Find the widest str in order to calculate the width of the column
     for (int i = 0; i < PQntuples(queryResult); ++i) {
-        if (const std::string tableName(PQgetvalue(queryResult, i, 0)); tableName.length() > biggestCharWidth)
-            biggestCharWidth = tableName.length();
+        if (const std::string tableName(PQgetvalue(queryResult, i, 0)); displayWidth(tableName) > biggestCharWidth)
+            biggestCharWidth = displayWidth(tableName);
     }
 
     // Table Head
@@ -93,17 +111,203 @@ int DatabaseHandler::SELECT_ALL_TABLES_SQL_QUERY(const std::string &outputFileNa
     // Table Tail
     fileStream << repeat(TABLE_ROW_SEPARATOR, biggestCharWidth + 2) << '\n';
 
-    std::cout << OPERATION_WAS_SUCCESSFUL("SELECT ALL TABLES");
+    if (streamSink.close()) {
+        std::cerr << "SELECT ALL TABLES failed: Cannot write " << outputFileNamePath << ".\n";
+        PQclear(queryResult);
+        return 1;
+    }
+
+    statusOutput << OPERATION_WAS_SUCCESSFUL("SELECT ALL TABLES");
 
     PQclear(queryResult);
     return 0;
 }
 
+int DatabaseHandler::EXPORT_ALL_TABLES_SQL_QUERY(const std::string &outputFilePath) const {
+    ExportScheduler exportScheduler{connection, outputFilePath, exportFormat, outputBackend};
+
+    // The tables and their sizes are read from the snapshot the workers export, so the plan matches their rows
+    const bool isOwnTransaction = PQtransactionStatus(connection) == PQTRANS_IDLE;
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, SNAPSHOT_TRANSACTION));
+
+    int exportStatus = exportScheduler.planTasks();
+
+    if (exportStatus == 0) {
+        std::cout << "EXPORT ALL strategy: " << FormatWriter::formatName(exportFormat) << ", "
+                << exportScheduler.getTablesCount() << " table(s) in " << exportScheduler.getTasksCount()
+                << " task(s).\n";
+
+        exportStatus = exportScheduler.exportAll();
+    }
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, exportStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    if (exportStatus)
+        return 1;
+
+    std::cout << exportScheduler.getStolenTasksCount() << " task(s) stolen by idle workers.\n";
+
+    std::cout << OPERATION_WAS_SUCCESSFUL("EXPORT ALL TABLES");
+    return 0;
+}
+
+int DatabaseHandler::DUMP_DATABASE_SQL_QUERY(const std::string &archiveFilePath) const {
+    DumpArchive dumpArchive{connection, archiveFilePath};
+
+    if (dumpArchive.dump())
+        return 1;
+
+    std::cout << dumpArchive.getTablesCount() << " table(s) dumped in " << dumpArchive.getDataEntriesCount()
+            << " data part(s) to " << archiveFilePath << ".\n";
+
+    std::cout << OPERATION_WAS_SUCCESSFUL("DUMP");
+    return 0;
+}
+
+int DatabaseHandler::RESTORE_DATABASE_SQL_QUERY(const std::string &archiveFilePath, const bool isClean) const {
+    DumpArchive dumpArchive{connection, archiveFilePath};
+
+    if (dumpArchive.restore(isClean))
+        return 1;
+
+    std::cout << dumpArchive.getTablesCount() << " table(s) restored from " << archiveFilePath << ".\n";
+
+    std::cout << OPERATION_WAS_SUCCESSFUL("RESTORE");
+    return 0;
+}
+
 int DatabaseHandler::SELECT_ALL_SQL_QUERY(const std::string &tableName, const std::string &outputFilePath) const {
+    std::ostream &statusOutput = statusStream(outputFilePath);
+
+    if (const std::string settingsConflict = selectSettingsConflict(); !settingsConflict.empty()) {
+        std::cerr << "SELECT failed: " << settingsConflict << ".\n";
+        return 1;
+    }
+
+    // Small tables are fetched at once, big ones are streamed (accounted in the plan store under this query)
+    const std::string exportQuery = std::string("SELECT * FROM ") + tableName;
+    TableEstimate tableEstimate;
+    ExecutionStrategy strategy = ExecutionStrategy::IN_MEMORY;
+
+    if (ExecutionPlanner::estimateTable(connection, tableName, tableEstimate) == 0)
+        strategy = ExecutionPlanner::chooseStrategy(tableEstimate);
+
+    if (exportFormat == ExportFormat::COLUMNAR) /* Typed columns come from binary results, whatever the size */ {
+        statusOutput << "SELECT strategy: " << FormatWriter::formatName(exportFormat) << " (~"
+                << static_cast<long long>(tableEstimate.rows) << " rows).\n";
+
+        if (executeStreamed(exportQuery, [&] {
+            return TableExporter::exportColumnar(connection, exportQuery, outputFilePath);
+        }))
+            return 1;
+
+        statusOutput << OPERATION_WAS_SUCCESSFUL("SELECT");
+        return 0;
+    }
+
+    if (isCheckpointed) /* Key order pages with a checkpoint after each, whatever the size */ {
+        statusOutput << "SELECT strategy: RESUMABLE, " << FormatWriter::formatName(exportFormat) << " (~"
+                << static_cast<long long>(tableEstimate.rows) << " rows).\n";
+
+        if (executeStreamed(exportQuery, [&] {
+            return TableExporter::exportResumable(connection, tableName, exportFormat, outputFilePath);
+        }))
+            return 1;
+
+        statusOutput << OPERATION_WAS_SUCCESSFUL("SELECT");
+        return 0;
+    }
+
+    if (shardMode != ShardMode::NONE) /* Shard files with writer threads of their own, whatever the size */ {
+        statusOutput << "SELECT strategy: SHARDED " << ShardedExporter::modeName(shardMode) << ", "
+                << FormatWriter::formatName(exportFormat) << " (~" << static_cast<long long>(tableEstimate.rows)
+                << " rows).\n";
+
+        ShardedExporter shardedExporter{
+            connection, outputFilePath, exportFormat, shardMode, shardParameter, shardKeyColumn
+        };
+
+        if (executeStreamed(exportQuery, [&] { return shardedExporter.exportQuery(exportQuery); }))
+            return 1;
+
+        statusOutput << shardedExporter.getShardsCount() << " shard(s) listed in "
+                << shardedExporter.getManifestFilePath() << ".\n";
+
+        statusOutput << OPERATION_WAS_SUCCESSFUL("SELECT");
+        return 0;
+    }
+
+    if (isCopyStreamed && strategy != ExecutionStrategy::IN_MEMORY) /* One COPY, rendered from its text rows */ {
+        statusOutput << "SELECT strategy: COPY, " << FormatWriter::formatName(exportFormat) << " (~"
+                << static_cast<long long>(tableEstimate.rows) << " rows, ~"
+                << static_cast<long long>(tableEstimate.bytes()) << " bytes).\n";
+
+        if (executeStreamed(exportQuery, [&] {
+            return TableExporter::exportCopy(connection, exportQuery, exportFormat, outputFilePath, outputBackend);
+        }))
+            return 1;
+
+        statusOutput << OPERATION_WAS_SUCCESSFUL("SELECT");
+        return 0;
+    }
+
+    // Compressed and piped output is one sequential stream, the parallel ranges need positional writes
+    if (strategy == ExecutionStrategy::PARALLEL_RANGE
+        && (outputBackend == OutputBackend::LZ4 || outputBackend == OutputBackend::LZ4_HC
+            || outputBackend == OutputBackend::PIPE))
+        strategy = ExecutionStrategy::CURSOR_BATCH;
+
+    if (strategy != ExecutionStrategy::IN_MEMORY) {
+        const WidthStrategy exportWidthStrategy = widthStrategy == WidthStrategy::AUTO
+                                                      ? ExecutionPlanner::chooseWidthStrategy(
+                                                          tableEstimate, exportMemoryBudget)
+                                                      : widthStrategy;
+
+        statusOutput << "SELECT strategy: " << ExecutionPlanner::strategyName(strategy);
+        if (exportFormat != ExportFormat::TEXT_TABLE)
+            statusOutput << ", " << FormatWriter::formatName(exportFormat);
+        else if (strategy != ExecutionStrategy::PARALLEL_RANGE)
+            statusOutput << ", " << ExecutionPlanner::widthStrategyName(exportWidthStrategy);
+        statusOutput << " (~" << static_cast<long long>(tableEstimate.rows) << " rows, ~"
+                << static_cast<long long>(tableEstimate.bytes()) << " bytes).\n";
+
+        const int exportStatus = executeStreamed(exportQuery, [&] {
+            if (exportFormat != ExportFormat::TEXT_TABLE) /* Streamed as they are, the ranges only help the layout */
+                return TableExporter::exportFormatted(
+                    connection, exportQuery,
+                    strategy == ExecutionStrategy::PARALLEL_RANGE ? ExecutionStrategy::CURSOR_BATCH : strategy,
+                    exportFormat, outputFilePath, outputBackend);
+
+            if (strategy == ExecutionStrategy::PARALLEL_RANGE)
+                return TableExporter::exportParallelRanges(
+                    connection, tableName, tableEstimate.pages, outputFilePath, outputBackend);
+
+            if (exportWidthStrategy == WidthStrategy::SPILL_FILE)
+                return TableExporter::exportSpilled(
+                    connection, exportQuery, strategy, outputFilePath, outputBackend,
+                    exportMemoryBudget > 0 ? exportMemoryBudget : SPILL_DEFAULT_MEMORY_BUDGET);
+
+            if (exportWidthStrategy == WidthStrategy::SERVER_WIDTHS)
+                return TableExporter::exportServerWidths(
+                    connection, exportQuery, strategy, outputFilePath, outputBackend);
+
+            return TableExporter::exportStreamed(connection, exportQuery, strategy, outputFilePath, outputBackend);
+        });
+
+        if (exportStatus)
+            return 1;
+
+        statusOutput << OPERATION_WAS_SUCCESSFUL("SELECT");
+        return 0;
+    }
+
     const std::string selectQuery =
             std::string("SELECT * FROM ") + tableName + std::string(";");
 
-    PGresult *queryResult = PQexec(connection, selectQuery.c_str());
+    PGresult *queryResult = executeQuery(selectQuery);
 
     if (PQresultStatus(queryResult) != PGRES_TUPLES_OK) /* Not successful SQL query */ {
         fprintf(stderr, "%s[%d]: Select failed: %s\n",
@@ -118,6 +322,7 @@ int DatabaseHandler::SELECT_ALL_SQL_QUERY(const std::string &tableName, const st
 }
 
 int DatabaseHandler::SELECT_COLUMNS_SQL_QUERY(const std::string &tableName, const std::string &outputFilePath) const {
+    std::ostream &statusOutput = statusStream(outputFilePath);
     // Make a query to get the column names
     std::string selectQuery =
             std::string("SELECT * FROM ") + tableName + std::string(" LIMIT 1;");
@@ -151,14 +356,15 @@ int DatabaseHandler::SELECT_COLUMNS_SQL_QUERY(const std::string &tableName, cons
             }
         }
         if (!found)
-            std::cout << NO_COLUMN_FOUND(currentSelectedColumn);
+            statusOutput << NO_COLUMN_FOUND(currentSelectedColumn);
     }
 
     selectQuery =
             std::string("SELECT ") + join(selectColumnNames, COMMA_SPACE_SEPARATOR) +
             std::string(" FROM ") + tableName + std::string(";");
 
-    queryResult = PQexec(connection, selectQuery.c_str());
+    PQclear(queryResult);
+    queryResult = executeQuery(selectQuery);
 
     if (PQresultStatus(queryResult) != PGRES_TUPLES_OK) /* Not successful SQL query */ {
         fprintf(stderr, "%s[%d]: Select failed: %s\n",
@@ -259,6 +465,45 @@ int DatabaseHandler::INSERT_SQL_QUERY(const std::string &tableName) const {
     return 0;
 }
 
+int DatabaseHandler::BULK_INSERT_SQL_QUERY(const std::string &tableName, const std::string &inputFilePath,
+                                           const std::string &rejectFilePath) const {
+    BulkWriter bulkWriter{connection, tableName, rejectFilePath, BULK_INSERT_BATCH_SIZE};
+
+    if (isCheckpointed)
+        bulkWriter.enableCheckpoint(inputFilePath + CHECKPOINT_FILE_EXTENSION);
+
+    const int writeStatus = bulkWriter.writeFile(inputFilePath);
+
+    std::cout << bulkWriter.getInsertedRowsCount() << " row(s) inserted, "
+            << bulkWriter.getRejectedRowsCount() << " row(s) rejected";
+    if (bulkWriter.getRejectedRowsCount() > 0)
+        std::cout << " into " << rejectFilePath;
+    std::cout << ".\n";
+
+    if (writeStatus)
+        return 1;
+
+    std::cout << OPERATION_WAS_SUCCESSFUL("BULK INSERT");
+    return 0;
+}
+
+int DatabaseHandler::SELECT_ALL_INCREMENTAL_SQL_QUERY(const std::string &tableName, const std::string &outputFilePath,
+                                                      const std::string &watermarkColumn) const {
+    IncrementalExporter incrementalExporter{connection, tableName, outputFilePath, watermarkColumn};
+
+    if (incrementalExporter.refresh())
+        return 1;
+
+    if (incrementalExporter.isFullRefresh())
+        std::cout << outputFilePath << " rendered in full.\n";
+    else
+        std::cout << incrementalExporter.getPatchedRowsCount() << " row(s) patched, "
+                << incrementalExporter.getAppendedRowsCount() << " row(s) appended.\n";
+
+    std::cout << OPERATION_WAS_SUCCESSFUL("SELECT");
+    return 0;
+}
+
 int DatabaseHandler::UPDATE_SQL_QUERY(const std::string &tableName) const {
     // Make a query to get the column names
     const std::string selectQuery =
@@ -329,21 +574,26 @@ int DatabaseHandler::UPDATE_SQL_QUERY(const std::string &tableName) const {
         return 1;
     }
 
+    if (writeBehindBuffer != nullptr) /* The change reaches the server with the next flush */ {
+        PQclear(queryResult);
+
+        if (writeBehindBuffer->update(tableName, updateWhereColumn, updateWhereValue, updateColumn, updateValue))
+            return 1;
+
+        std::cout << OPERATION_WAS_SUCCESSFUL("UPDATE (buffered)");
+        return 0;
+    }
+
     const std::vector updateValues{updateValue, updateWhereValue};
 
     const std::string updateQuery =
             std::string("UPDATE ") + tableName + std::string(" SET ") + updateColumn +
             std::string(" = $1 WHERE ") + updateWhereColumn + std::string(" = $2;");
 
-    PGresult *updateResult = PQexecParams(
-        connection,
-        updateQuery.c_str(),
+    PGresult *updateResult = executeQuery(
+        updateQuery,
         2, // Number of parameters
-        nullptr, // Parameter types (NULL = infer from query)
-        generateInsertParamValues(updateValues).data(), // Parameter values
-        nullptr, // Parameter lengths (NULL = assume text)
-        nullptr, // Parameter formats (NULL = assume text)
-        0 // Result format: 0 for text, 1 for binary
+        generateInsertParamValues(updateValues).data() // Parameter values
     );
 
     if (PQresultStatus(updateResult) != PGRES_COMMAND_OK) {
@@ -457,6 +707,86 @@ int DatabaseHandler::EXECUTE_SQL_QUERY() const {
     return 0;
 }
 
+int DatabaseHandler::IMPORT_BLOB_SQL_QUERY(const std::string &tableName, const std::string &inputFilePath) const {
+    std::string blobColumn, whereColumn, whereValue;
+    Oid blobType;
+
+    if (readBlobLocation(tableName, blobColumn, blobType, whereColumn, whereValue))
+        return 1;
+
+    if (blobType == BYTEA_CODE_VALUE) {
+        if (BlobStream::importBytea(connection, tableName, blobColumn, whereColumn, whereValue, inputFilePath))
+            return 1;
+
+        std::cout << OPERATION_WAS_SUCCESSFUL("IMPORT BLOB");
+        return 0;
+    }
+
+    // OID column: the file becomes a new large object which the row references instead of its previous one
+    if (BlobStream::importLargeObject(connection, tableName, blobColumn, whereColumn, whereValue, inputFilePath))
+        return 1;
+
+    std::cout << OPERATION_WAS_SUCCESSFUL("IMPORT BLOB");
+    return 0;
+}
+
+int DatabaseHandler::EXPORT_BLOB_SQL_QUERY(const std::string &tableName, const std::string &outputFilePath) const {
+    std::string blobColumn, whereColumn, whereValue;
+    Oid blobType;
+
+    if (readBlobLocation(tableName, blobColumn, blobType, whereColumn, whereValue))
+        return 1;
+
+    if (blobType == BYTEA_CODE_VALUE) {
+        if (BlobStream::exportBytea(connection, tableName, blobColumn, whereColumn, whereValue, outputFilePath))
+            return 1;
+
+        std::cout << OPERATION_WAS_SUCCESSFUL("EXPORT BLOB");
+        return 0;
+    }
+
+    // OID column: read the reference, then stream the large object itself
+    const std::vector selectValues{whereValue};
+
+    const std::string selectQuery =
+            std::string("SELECT ") + blobColumn + std::string(" FROM ") + tableName +
+            std::string(" WHERE ") + whereColumn + std::string(" = $1 LIMIT 1;");
+
+    PGresult *selectResult = PQexecParams(
+        connection,
+        selectQuery.c_str(),
+        1, // Number of parameters
+        nullptr, // Parameter types (NULL = infer from query)
+        generateInsertParamValues(selectValues).data(), // Parameter values
+        nullptr, // Parameter lengths (NULL = assume text)
+        nullptr, // Parameter formats (NULL = assume text)
+        0 // Result format: 0 for text, 1 for binary
+    );
+
+    if (PQresultStatus(selectResult) != PGRES_TUPLES_OK) {
+        std::cerr << "EXPORT BLOB failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(selectResult);
+        return 1;
+    }
+
+    if (PQntuples(selectResult) == 0 || PQgetisnull(selectResult, 0, 0)) {
+        std::cout << "EXPORT BLOB failed: No " << blobColumn << " value found.\n";
+
+        PQclear(selectResult);
+        return 1;
+    }
+
+    const Oid largeObjectId = std::stoul(PQgetvalue(selectResult, 0, 0));
+    PQclear(selectResult);
+
+    if (BlobStream::exportLargeObject(connection, largeObjectId, outputFilePath))
+        return 1;
+
+    std::cout << OPERATION_WAS_SUCCESSFUL("EXPORT BLOB");
+    return 0;
+}
+
 int DatabaseHandler::CREATE_TABLE_SQL_QUERY(const std::string &tableName) const {
     // TODO: Add permissions -> only auth users can create tables
     // if (!validateUserCredentials())
@@ -547,6 +877,102 @@ int DatabaseHandler::DROP_DATABASE_SQL_QUERY(const std::string &databaseName) co
 }
 
 
+void DatabaseHandler::enableWriteBehind(const std::size_t maxBufferedRows,
+                                        const std::chrono::milliseconds flushInterval,
+                                        const DurabilityMode durabilityMode) {
+    // A previously enabled buffer flushes its pending changes when it is replaced
+    writeBehindBuffer = std::make_unique<WriteBehindBuffer>(
+        connection, maxBufferedRows, flushInterval, durabilityMode);
+}
+
+int DatabaseHandler::flushWriteBehind() const {
+    if (writeBehindBuffer == nullptr)
+        return 0;
+
+    if (writeBehindBuffer->flush())
+        return 1;
+
+    std::cout << OPERATION_WAS_SUCCESSFUL("WRITE-BEHIND FLUSH");
+    return 0;
+}
+
+void DatabaseHandler::enablePlanCapture(const std::size_t sampleEvery,
+                                        const std::chrono::milliseconds latencyThreshold,
+                                        const std::string &dumpFilePath) {
+    planStore = std::make_unique<PlanStore>(connection, sampleEvery, latencyThreshold, dumpFilePath);
+}
+
+int DatabaseHandler::dumpPlanStore() const {
+    if (planStore == nullptr)
+        return 0;
+
+    if (planStore->dump())
+        return 1;
+
+    std::cout << OPERATION_WAS_SUCCESSFUL("PLAN STORE DUMP");
+    return 0;
+}
+
+void DatabaseHandler::setOutputBackend(const OutputBackend backend) {
+    outputBackend = backend;
+}
+
+void DatabaseHandler::setExportMemoryBudget(const std::size_t memoryBudget) {
+    exportMemoryBudget = memoryBudget;
+}
+
+void DatabaseHandler::setWidthStrategy(const WidthStrategy strategy) {
+    widthStrategy = strategy;
+}
+
+void DatabaseHandler::setExportFormat(const ExportFormat format) {
+    exportFormat = format;
+}
+
+void DatabaseHandler::setCheckpointing(const bool isEnabled) {
+    isCheckpointed = isEnabled;
+}
+
+void DatabaseHandler::setCopyStreaming(const bool isEnabled) {
+    isCopyStreamed = isEnabled;
+}
+
+void DatabaseHandler::setSharding(const ShardMode mode, const std::size_t parameter, const std::string &keyColumn) {
+    shardMode = mode;
+    shardParameter = parameter;
+    shardKeyColumn = keyColumn;
+}
+
+int DatabaseHandler::executeStreamed(const std::string &query, const std::function<int()> &exporter) const {
+    const auto startTime = std::chrono::steady_clock::now();
+    const int exportStatus = exporter();
+
+    // Like failed queries, failed exports have no plan worth keeping
+    if (planStore != nullptr && exportStatus == 0)
+        planStore->recordExecution(query, std::chrono::duration<double, std::milli>(
+                                       std::chrono::steady_clock::now() - startTime).count());
+
+    return exportStatus;
+}
+
+PGresult *DatabaseHandler::executeQuery(const std::string &query, const int nParams,
+                                        const char *const *paramValues) const {
+    if (planStore != nullptr)
+        return planStore->execute(query, nParams, paramValues);
+
+    return PQexecParams(
+        connection,
+        query.c_str(),
+        nParams, // Number of parameters
+        nullptr, // Parameter types (NULL = infer from query)
+        paramValues, // Parameter values
+        nullptr, // Parameter lengths (NULL = assume text)
+        nullptr, // Parameter formats (NULL = assume text)
+        0 // Result format: 0 for text, 1 for binary
+    );
+}
+
+
 std::string DatabaseHandler::readColumnValue(const Oid &dataType, const std::string &columnName, PGconn *connection) {
     switch (dataType) {
         case 1043: /* VARCHAR */ {
@@ -610,6 +1036,28 @@ std::string DatabaseHandler::readColumnValue(const Oid &dataType, const std::str
 
             return std::to_string(currentValue);
         }
+        case 26: /* OID (large object reference) */ {
+            unsigned long currentValue;
+
+            while (true) {
+                std::cout << "Enter " << columnName << ":";
+                std::cin >> currentValue;
+
+                if (std::cin.fail()) {
+                    std::cin.clear();
+                    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                    std::cout << "Invalid OID value entered.\n";
+                } else {
+                    break;
+                }
+            }
+
+            return std::to_string(currentValue);
+        }
+        case 17: /* BYTEA */ {
+            std::cout << "BYTEA values are streamed from a file with IMPORT BLOB.\n";
+            return EMPTY_VALUE;
+        }
         case 1082: /* DATE */ {
             std::string currentValue;
 
@@ -630,6 +1078,60 @@ std::string DatabaseHandler::readColumnValue(const Oid &dataType, const std::str
     }
 }
 
+int DatabaseHandler::readBlobLocation(const std::string &tableName, std::string &blobColumn, Oid &blobType,
+                                      std::string &whereColumn, std::string &whereValue) const {
+    // Make a query to get the column names
+    const std::string selectQuery =
+            std::string("SELECT * FROM ") + tableName + std::string(" LIMIT 1;");
+
+    PGresult *queryResult = PQexec(connection, selectQuery.c_str());
+
+    if (PQresultStatus(queryResult) != PGRES_TUPLES_OK) /* Not successful SQL query */ {
+        fprintf(stderr, "%s[%d]: Select failed: %s\n",
+                __FILE__, __LINE__, PQresultErrorMessage(queryResult));
+        PQclear(queryResult);
+        return 1;
+    }
+
+    std::cout << "Enter the name of the BYTEA/OID column:"; // Prompt the user to enter the blob column
+    std::cin >> blobColumn;
+
+    const int blobColumnIndex = PQfnumber(queryResult, blobColumn.c_str());
+
+    if (blobColumnIndex < 0) {
+        std::cout << NO_COLUMN_FOUND(blobColumn);
+
+        PQclear(queryResult);
+        return 1;
+    }
+
+    blobType = PQftype(queryResult, blobColumnIndex);
+
+    if (blobType != BYTEA_CODE_VALUE && blobType != OID_CODE_VALUE) {
+        std::cout << "Column " << blobColumn << " is not of type BYTEA or OID.\n";
+
+        PQclear(queryResult);
+        return 1;
+    }
+
+    std::cout << "Enter the name of the column for the WHERE clause:"; // Prompt the user to enter column
+    std::cin >> whereColumn;
+
+    const int whereColumnIndex = PQfnumber(queryResult, whereColumn.c_str());
+
+    if (whereColumnIndex < 0) {
+        std::cout << NO_COLUMN_FOUND(whereColumn);
+
+        PQclear(queryResult);
+        return 1;
+    }
+
+    whereValue = readColumnValue(PQftype(queryResult, whereColumnIndex), whereColumn, connection);
+    PQclear(queryResult);
+
+    return whereValue == EMPTY_VALUE ? 1 : 0;
+}
+
 std::string DatabaseHandler::readDatabaseIdentifier(const std::string &identifierType) {
     std::string identifierName; // (TABLE, COLUMN)
 
@@ -653,63 +1155,71 @@ std::string DatabaseHandler::readTableName() {
     return readDatabaseIdentifier(TABLE);
 }
 
-int DatabaseHandler::fileWriteSelectQueryResult(const std::string &outputFileNameEnv, const PGresult *queryResult) {
-    std::ofstream fileStream{outputFileNameEnv};
-
-    auto *columnWidths = new std::string::size_type[PQnfields(queryResult)]{};
+int DatabaseHandler::fileWriteSelectQueryResult(const std::string &outputFileNameEnv,
+                                                const PGresult *queryResult) const {
+    std::ostream &statusOutput = statusStream(outputFileNameEnv);
+    // Other formats and the compressed and piped backends go through the stream writers
+    if (exportFormat != ExportFormat::TEXT_TABLE || outputBackend == OutputBackend::LZ4 ||
+        outputBackend == OutputBackend::LZ4_HC || outputBackend == OutputBackend::PIPE) {
+        if (TableExporter::writeFormatted(queryResult, exportFormat, outputFileNameEnv, outputBackend))
+            return 1;
 
-    // Calculate the width of every column (Table Col Names)
-    for (int i = 0; i < PQnfields(queryResult); i++) {
-        std::string currentColumnName{PQfname(queryResult, i)};
-        columnWidths[i] = currentColumnName.length();
+        statusOutput << OPERATION_WAS_SUCCESSFUL("SELECT");
+        return 0;
     }
 
-    // Calculate the width of every column (Table Row Cols)
-    for (int i = 0; i < PQntuples(queryResult); i++) {
-        for (int j = 0; j < PQnfields(queryResult); j++) {
-            std::string currentValue{PQgetvalue(queryResult, i, j)};
-            columnWidths[j] = std::max(columnWidths[j], currentValue.length());
-        }
-    }
+    // Calculate the width of every column
+    TableRenderer tableRenderer{queryResult};
+    tableRenderer.observe(queryResult);
 
-    // Calculate the total char number of a row
-    std::string::size_type totalSymbolsSize = 1;
-    for (int i = 0; i < PQnfields(queryResult); i++)
-        totalSymbolsSize += columnWidths[i] + 2;
+    const bool isParallel = std::thread::hardware_concurrency() > 1 &&
+                            tableRenderer.totalSize(PQntuples(queryResult)) >= PARALLEL_RENDER_MIN_BYTES;
+    const unsigned threadsCount = isParallel ? std::thread::hardware_concurrency() : 1;
 
-    // Print the table Head
-    fileStream << repeat(TABLE_ROW_SEPARATOR, totalSymbolsSize) << '\n' << TABLE_COL_SEPARATOR;
+    if (outputBackend == OutputBackend::MAPPED) {
+        if (tableRenderer.writeFileMapped(queryResult, outputFileNameEnv, threadsCount))
+            return 1;
+    } else if (outputBackend == OutputBackend::ASYNC || outputBackend == OutputBackend::ASYNC_DIRECT) {
+        if (tableRenderer.writeFileAsync(queryResult, outputFileNameEnv,
+                                         outputBackend == OutputBackend::ASYNC_DIRECT))
+            return 1;
+    } else if (isParallel) {
+        if (tableRenderer.writeFileParallel(queryResult, outputFileNameEnv, threadsCount))
+            return 1;
+    } else if (tableRenderer.writeFile(queryResult, outputFileNameEnv))
+        return 1;
 
-    // Print the table Column names
-    for (int i = 0; i < PQnfields(queryResult); i++) {
-        std::string currentColumnName{PQfname(queryResult, i)};
-        fileStream << addRightPadding(currentColumnName, columnWidths[i]) << END_OF_COL_SEPARATOR;
-    }
+    statusOutput << OPERATION_WAS_SUCCESSFUL("SELECT");
+    return 0;
+}
 
-    // Print the first in between row
-    fileStream << '\n' << createBetweenRowsRow(columnWidths, PQnfields(queryResult)) << '\n';
+std::string DatabaseHandler::selectSettingsConflict() const {
+    // The columnar, resumable and sharded exports each write their own files, one of them at a time
+    const bool isColumnar = exportFormat == ExportFormat::COLUMNAR;
+    const bool isSharded = shardMode != ShardMode::NONE;
 
-    // Print the Table contents
-    for (int i = 0; i < PQntuples(queryResult); i++) {
-        fileStream << TABLE_COL_SEPARATOR;
-        for (int j = 0; j < PQnfields(queryResult); j++) {
-            std::string currentValue{PQgetvalue(queryResult, i, j)};
-            // Print the current row
-            fileStream << addRightPadding(currentValue, columnWidths[j]) << END_OF_COL_SEPARATOR;
-        }
-        // Print the in between row
-        fileStream << '\n' << createBetweenRowsRow(columnWidths, PQnfields(queryResult)) << '\n';
-    }
+    if (isColumnar && isCheckpointed)
+        return "COLUMNAR exports cannot be checkpointed";
+    if (isColumnar && isSharded)
+        return "COLUMNAR exports cannot be sharded";
+    if (isCheckpointed && isSharded)
+        return "Checkpointed exports cannot be sharded";
 
-    // Print the table tail
-    fileStream << repeat(TABLE_ROW_SEPARATOR, totalSymbolsSize) << '\n';
+    if (!isColumnar && !isCheckpointed && !isSharded)
+        return "";
 
-    std::cout << OPERATION_WAS_SUCCESSFUL("SELECT");
+    const std::string exportName = isColumnar ? "COLUMNAR" : isCheckpointed ? "Checkpointed" : "Sharded";
 
-    delete columnWidths;
+    if (isCopyStreamed)
+        return exportName + std::string(" exports cannot be streamed through COPY");
+    if (outputBackend != OutputBackend::STREAM)
+        return exportName + std::string(" exports write plain files, they need the STREAM output backend");
 
-    fileStream.close();
-    return 0;
+    return "";
+}
+
+std::ostream &DatabaseHandler::statusStream(const std::string &outputFilePath) const {
+    return outputBackend == OutputBackend::PIPE && outputFilePath == STANDARD_OUTPUT_PATH ? std::cerr : std::cout;
 }
 
 bool DatabaseHandler::validateUserCredentials() const {
@@ -743,41 +1253,6 @@ bool DatabaseHandler::validateUserCredentials() const {
     return PQntuples(selectAccountResult); // if there isn't such an entry -> length 0; else 1
 }
 
-std::string repeat(const char &ch, const std::string::size_type &times) {
-    std::stringstream strStream{};
-
-    for (int i = 0; i < times; ++i)
-        strStream << ch;
-
-    return strStream.str();
-}
-
-
-std::string addRightPadding(const std::string &valueStr, const std::string::size_type &size) {
-    if (valueStr.length() == size)
-        return valueStr;
-
-    std::stringstream resultStream{};
-    resultStream << valueStr;
-
-    for (int i = 0; i < size - valueStr.length(); ++i)
-        resultStream << ' ';
-
-    return resultStream.str();
-}
-
-
-std::string createBetweenRowsRow(const std::string::size_type *columnWidths, const int &colWidthsSize) {
-    std::stringstream resultStream{};
-    resultStream << TABLE_COL_SEPARATOR;
-
-    for (int i = 0; i < colWidthsSize; ++i)
-        resultStream << repeat(BETWEEN_ROWS_SEPARATOR, columnWidths[i] + 1) << TABLE_COL_SEPARATOR;
-
-    return resultStream.str();
-}
-
-
 std::string join(const std::vector<std::string> &elements, const std::string &separator) {
     if (elements.empty())
         return "";
@@ -1,16 +1,69 @@
 #pragma once
 #include <libpq-fe.h>
+#include <functional>
+#include <ostream>
 #include <string>
+#include <memory>
+#include "../WriteBehindBuffer/WriteBehindBuffer.h"
+#include "../PlanStore/PlanStore.h"
+#include "../TableRenderer/TableRenderer.h"
+#include "../ExecutionPlanner/ExecutionPlanner.h"
+#include "../FormatWriter/FormatWriter.h"
+#include "../ShardedExporter/ShardedExporter.h"
 
 
 class DatabaseHandler {
     PGconn *connection;
 
+    // Opt-in buffer coalescing the UPDATE_SQL_QUERY changes (nullptr when disabled)
+    std::unique_ptr<WriteBehindBuffer> writeBehindBuffer;
+
+    // Opt-in EXPLAIN capture of sampled or slow queries (nullptr when disabled)
+    std::unique_ptr<PlanStore> planStore;
+
+    // How the SELECT results reach their output files
+    OutputBackend outputBackend = OutputBackend::STREAM;
+
+    // Memory for spooling streamed exports to a spill file (0: no spill file unless SPILL_FILE is forced)
+    std::size_t exportMemoryBudget = 0;
+
+    // How streamed exports learn the column widths (AUTO: the cheapest by the planner's estimates)
+    WidthStrategy widthStrategy = WidthStrategy::AUTO;
+
+    // Layout of the SELECT output files
+    ExportFormat exportFormat = ExportFormat::TEXT_TABLE;
+
+    // Split of SELECT_ALL_SQL_QUERY exports into several files (NONE: one output file)
+    ShardMode shardMode = ShardMode::NONE;
+    std::size_t shardParameter = 0;
+    std::string shardKeyColumn;
+
+    // Exports and bulk imports record their progress in <file>.checkpoint, a rerun continues from it
+    bool isCheckpointed = false;
+    bool isCopyStreamed = false;
+
+    // Execute a query, through the plan store when the capture is enabled
+    PGresult *executeQuery(const std::string &query, int nParams = 0, const char *const *paramValues = nullptr) const;
+
+    // Run *exporter*, which streams *query* itself, and account for it in the plan store like executeQuery
+    int executeStreamed(const std::string &query, const std::function<int()> &exporter) const;
+
     // Read different types of cells, validate and parse them to a str
     static std::string readColumnValue(const Oid &dataType, const std::string &columnName, PGconn *connection);
 
     // Write to a file a SELECT query result
-    static int fileWriteSelectQueryResult(const std::string &outputFileNameEnv, const PGresult *queryResult);
+    int fileWriteSelectQueryResult(const std::string &outputFileNameEnv, const PGresult *queryResult) const;
+
+    // Why the export settings cannot be combined by SELECT_ALL_SQL_QUERY, empty when they can
+    std::string selectSettingsConflict() const;
+
+    // Where the messages of an export to *outputFilePath* go: the standard error when the rows are piped to the
+    // standard output, so they do not end up in the data
+    std::ostream &statusStream(const std::string &outputFilePath) const;
+
+    // Prompt for a BYTEA/OID column and the WHERE clause of the row holding the blob
+    int readBlobLocation(const std::string &tableName, std::string &blobColumn, Oid &blobType,
+                         std::string &whereColumn, std::string &whereValue) const;
 
     // Abstract method for reading table and column names
     static std::string readDatabaseIdentifier(const std::string &identifierType);
@@ -24,15 +77,36 @@ public:
     // SELECT tablename FROM pg_catalog.pg_tables WHERE schemaname = 'public';
     int SELECT_ALL_TABLES_SQL_QUERY(const std::string &outputFileNamePath) const;
 
+    // SELECT * FROM *tableName*; for every table of the public schema, each into its own file named after
+    // *outputFilePath*, on parallel connections sharing one snapshot (big tables are split into page ranges)
+    int EXPORT_ALL_TABLES_SQL_QUERY(const std::string &outputFilePath) const;
+
+    // Schema and rows of the public schema into a compressed archive, read in parallel within one snapshot
+    int DUMP_DATABASE_SQL_QUERY(const std::string &archiveFilePath) const;
+
+    // Tables of an archive loaded with parallel COPY, their indexes and constraints built in parallel afterwards;
+    // *isClean* drops the archived tables and sequences first
+    int RESTORE_DATABASE_SQL_QUERY(const std::string &archiveFilePath, bool isClean = false) const;
+
     // SELECT * FROM *tableName*;
     int SELECT_ALL_SQL_QUERY(const std::string &tableName, const std::string &outputFilePath) const;
 
+    // SELECT * FROM *tableName*; into an output kept up to date between runs: only the rows changed since the
+    // last run (xmin, or a watermark column such as updated_at) are rendered and patched in place
+    int SELECT_ALL_INCREMENTAL_SQL_QUERY(const std::string &tableName, const std::string &outputFilePath,
+                                         const std::string &watermarkColumn = "") const;
+
     // SELECT (*a*,*b*,*c*) FROM *tableName*;
     int SELECT_COLUMNS_SQL_QUERY(const std::string &tableName, const std::string &outputFilePath) const;
 
     // INSERT INTO *tableName* (*a*,*b*,*c*) VALUES (*a.a*,*b.b*,*c.c*);
     int INSERT_SQL_QUERY(const std::string &tableName) const;
 
+    // INSERT INTO *tableName* (*a*,*b*) VALUES (...),(...); for every line of a tab separated file,
+    // rows which cannot be inserted go to the reject file
+    int BULK_INSERT_SQL_QUERY(const std::string &tableName, const std::string &inputFilePath,
+                              const std::string &rejectFilePath) const;
+
     // UPDATE *tableName* SET *a* = ... WHERE *b* = ...;
     int UPDATE_SQL_QUERY(const std::string &tableName) const;
 
@@ -41,6 +115,12 @@ public:
 
     int EXECUTE_SQL_QUERY() const;
 
+    // UPDATE *tableName* SET *blob* = *file contents* WHERE *a* = ...; (streamed in chunks)
+    int IMPORT_BLOB_SQL_QUERY(const std::string &tableName, const std::string &inputFilePath) const;
+
+    // SELECT *blob* FROM *tableName* WHERE *a* = ...; into a file (streamed in chunks)
+    int EXPORT_BLOB_SQL_QUERY(const std::string &tableName, const std::string &outputFilePath) const;
+
     // CREATE TABLE *tableName* (*a..*,*b..*,*c..*);
     int CREATE_TABLE_SQL_QUERY(const std::string &tableName) const;
 
@@ -54,4 +134,44 @@ public:
     int DROP_DATABASE_SQL_QUERY(const std::string &databaseName) const;
 
     static std::string readTableName();
+
+    // Buffer the UPDATE_SQL_QUERY changes and flush them as set-based updates (every *flushInterval*)
+    void enableWriteBehind(std::size_t maxBufferedRows, std::chrono::milliseconds flushInterval,
+                           DurabilityMode durabilityMode);
+
+    // Write the buffered UPDATE_SQL_QUERY changes to the server
+    int flushWriteBehind() const;
+
+    // Capture the plans of every *sampleEvery*-th query and of queries slower than *latencyThreshold*
+    void enablePlanCapture(std::size_t sampleEvery, std::chrono::milliseconds latencyThreshold,
+                           const std::string &dumpFilePath);
+
+    // Write the captured plan statistics to the dump file
+    int dumpPlanStore() const;
+
+    // Write the SELECT results through large writes (default), a memory mapping of the output file,
+    // a writer thread (ASYNC, ASYNC_DIRECT), compression threads (LZ4, LZ4_HC) or into a pipe (PIPE)
+    void setOutputBackend(OutputBackend backend);
+
+    // Read streamed exports from the server once, spooling the rows within *memoryBudget* bytes of memory
+    void setExportMemoryBudget(std::size_t memoryBudget);
+
+    // Force how streamed exports learn the column widths, AUTO lets the cost model decide
+    void setWidthStrategy(WidthStrategy strategy);
+
+    // Write the SELECT results as the text table (default), CSV, TSV, JSON Lines or fixed-width columns
+    void setExportFormat(ExportFormat format);
+
+    // Write SELECT_ALL_SQL_QUERY exports as shard files and a manifest: a shard every *shardParameter* rows (ROWS)
+    // or bytes (BYTES), or *shardParameter* shards by the hash of *keyColumn* (HASH). Plain files only: not with
+    // checkpointing, COPY streaming, the COLUMNAR format nor another output backend than STREAM.
+    void setSharding(ShardMode mode, std::size_t parameter, const std::string &keyColumn = "");
+
+    // Make SELECT_ALL_SQL_QUERY (paged by primary key) and BULK_INSERT_SQL_QUERY resumable: after a failure the
+    // same call continues from the checkpoint next to the output / input file
+    void setCheckpointing(bool isEnabled);
+
+    // Stream the big SELECT_ALL_SQL_QUERY exports as COPY ... TO STDOUT text split on the client,
+    // instead of cursor or single-row results
+    void setCopyStreaming(bool isEnabled);
 };
@@ -2,6 +2,7 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 #define POSTGRE_SQL_PORT std::string("5432")
 #define POSTGRE_SQL_DB_NAME std::string("working_project_db")
@@ -51,6 +52,39 @@ PGconn *DbConnection::getConnection() const {
     return this->connection;
 }
 
+PGconn *DbConnection::cloneConnection(PGconn *connection) {
+    PQconninfoOption *connectionOptions = PQconninfo(connection);
+
+    if (connectionOptions == nullptr)
+        return nullptr;
+
+    std::vector<const char *> keywords;
+    std::vector<const char *> values;
+
+    for (const PQconninfoOption *option = connectionOptions; option->keyword != nullptr; ++option) {
+        if (option->val == nullptr)
+            continue;
+
+        keywords.push_back(option->keyword);
+        values.push_back(option->val);
+    }
+    keywords.push_back(nullptr);
+    values.push_back(nullptr);
+
+    PGconn *clonedConnection = PQconnectdbParams(keywords.data(), values.data(), 0);
+    PQconninfoFree(connectionOptions);
+
+    if (PQstatus(clonedConnection) != CONNECTION_OK) {
+        // Problem with the Connection
+        std::cout << "Connection to Database failed: " << PQerrorMessage(clonedConnection) << '\n';
+        PQfinish(clonedConnection);
+
+        return nullptr;
+    }
+
+    return clonedConnection;
+}
+
 const char *DbConnection::getSelectTablesFilePath() {
     const char *tablesOutputFileEnv = std::getenv(TABLES_OUTPUT_FILE);
 
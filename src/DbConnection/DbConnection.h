@@ -2,6 +2,10 @@
 #include <libpq-fe.h>
 
 
+// Read-only transaction whose reads all see one snapshot, the one exported to (or imported by) parallel workers
+#define SNAPSHOT_TRANSACTION "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY;"
+
+
 class DbConnection {
     PGconn *connection = nullptr;
 
@@ -10,6 +14,9 @@ public:
 
     PGconn *getConnection() const;
 
+    // Open another connection with the same parameters (for parallel workers), PQfinish it after use
+    static PGconn *cloneConnection(PGconn *connection);
+
     // Read from ENV variable the path for the .txt file for displaying the Db tables
     static const char *getSelectTablesFilePath();
 
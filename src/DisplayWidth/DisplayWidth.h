@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+
+// Columns UTF-8 text takes in a monospaced table: East Asian wide and fullwidth characters take two, combining
+// marks and format characters none, everything else one. ASCII bytes (controls included) and bytes which are no
+// valid UTF-8 take one column each, so ASCII text is as wide as it is long.
+std::size_t displayWidth(const char *text, std::size_t length);
+
+std::size_t displayWidth(const std::string &text);
+
+// Bytes of the start of the text taking *width* columns (with the zero width characters right after them),
+// the inverse of displayWidth for finding the cells of a rendered line
+std::size_t bytesOfWidth(const char *text, std::size_t length, std::size_t width);
+
+// Whether the text is plain ASCII (its width is its length), checked 16 or 32 bytes at a time
+bool isAscii(const char *text, std::size_t length);
+
+// Columns of a single code point (0, 1 or 2)
+int codePointWidth(char32_t codePoint);
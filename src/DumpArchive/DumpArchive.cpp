@@ -0,0 +1,749 @@
+#include "DumpArchive.h"
+#include "../ByteOrder/ByteOrder.h"
+#include "../CompressedFile/CompressedFile.h"
+#include "../DbConnection/DbConnection.h"
+#include "../Json/Json.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+
+#define ARCHIVE_MAGIC "PGCPPDMP"
+#define TABLE_OF_CONTENTS_MAGIC "PGCPPTOC"
+#define ARCHIVE_MAGIC_LENGTH 8
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SIZE 12
+#define ARCHIVE_FOOTER_SIZE 32
+// LZ4 expands its input at most about 255 times, a bigger raw size in the archive is damage
+#define LZ4_MAX_EXPANSION 255
+// Uncompressed COPY data per chunk, cut between rows
+#define ARCHIVE_CHUNK_SIZE (4 * 1024 * 1024)
+#define DUMP_MAX_WORKERS 8
+// Foreign keys lock both of their tables, two built at once can deadlock and are run again
+#define DEADLOCK_SQLSTATE "40P01"
+#define DEADLOCK_RETRIES 3
+
+
+// Execute a schema statement, again when it lost a deadlock
+int executeRestoreStatement(PGconn *connection, const std::string &statement);
+
+// Run *itemsCount* items on the worker connections, every worker takes the next item once it is done with one
+int runOnWorkers(std::size_t itemsCount, std::size_t workersCount,
+                 const std::function<int(std::size_t workerNumber, std::size_t itemNumber)> &runItem);
+
+
+DumpArchive::DumpArchive(PGconn *connection, std::string archiveFilePath, const std::size_t workersCount)
+    : connection(connection), archiveFilePath(std::move(archiveFilePath)),
+      workersCount(workersCount > 0
+                       ? workersCount
+                       : std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, DUMP_MAX_WORKERS)) {
+}
+
+const char *DumpArchive::sectionName(const DumpSection section) {
+    switch (section) {
+        case DumpSection::PRE_DATA:
+            return "PRE_DATA";
+        case DumpSection::SEQUENCE_SET:
+            return "SEQUENCE_SET";
+        case DumpSection::POST_DATA:
+            return "POST_DATA";
+        case DumpSection::FOREIGN_KEYS:
+            return "FOREIGN_KEYS";
+    }
+
+    return "UNKNOWN";
+}
+
+int DumpArchive::readSchema() {
+    const auto readCatalog = [this](const char *catalogQuery,
+                                    const std::function<void(const PGresult *, int)> &readRow) {
+        PGresult *catalogResult = PQexec(connection, catalogQuery);
+
+        if (PQresultStatus(catalogResult) != PGRES_TUPLES_OK) {
+            std::cerr << "DUMP failed: " << PQresultErrorMessage(catalogResult) << std::endl;
+
+            PQclear(catalogResult);
+            return 1;
+        }
+
+        for (int i = 0; i < PQntuples(catalogResult); ++i)
+            readRow(catalogResult, i);
+
+        PQclear(catalogResult);
+        return 0;
+    };
+
+    // Identity sequences come with their columns, only their values are restored
+    int schemaStatus = readCatalog(
+        "SELECT s.sequencename, "
+        "format('CREATE SEQUENCE %I AS %s INCREMENT BY %s MINVALUE %s MAXVALUE %s START WITH %s CACHE %s%s;', "
+        "s.sequencename, s.data_type, s.increment_by, s.min_value, s.max_value, s.start_value, s.cache_size, "
+        "CASE WHEN s.cycle THEN ' CYCLE' ELSE '' END), "
+        "format('DROP SEQUENCE IF EXISTS %I CASCADE;', s.sequencename), "
+        "CASE WHEN s.last_value IS NOT NULL "
+        "THEN format('SELECT pg_catalog.setval(%L, %s, true);', quote_ident(s.sequencename), s.last_value) END, "
+        "EXISTS (SELECT 1 FROM pg_catalog.pg_depend d WHERE d.classid = 'pg_catalog.pg_class'::regclass "
+        "AND d.objid = format('%I.%I', s.schemaname, s.sequencename)::regclass AND d.deptype = 'i') "
+        "FROM pg_catalog.pg_sequences s WHERE s.schemaname = 'public' ORDER BY s.sequencename;",
+        [this](const PGresult *catalogResult, const int row) {
+            const std::string sequenceName = PQgetvalue(catalogResult, row, 0);
+
+            if (PQgetvalue(catalogResult, row, 4)[0] != 't')
+                schemaEntries.push_back({
+                    DumpSection::PRE_DATA, "SEQUENCE", sequenceName, "",
+                    PQgetvalue(catalogResult, row, 1), PQgetvalue(catalogResult, row, 2)
+                });
+
+            if (!PQgetisnull(catalogResult, row, 3))
+                schemaEntries.push_back({
+                    DumpSection::SEQUENCE_SET, "SEQUENCE SET", sequenceName, "", PQgetvalue(catalogResult, row, 3), ""
+                });
+        });
+
+    // Bare tables, parents before their partitions; partitions take their columns from the parent
+    if (schemaStatus == 0)
+        schemaStatus = readCatalog(
+            "SELECT c.relname, "
+            "format('CREATE %sTABLE %I %s%s;', CASE WHEN c.relpersistence = 'u' THEN 'UNLOGGED ' ELSE '' END, "
+            "c.relname, CASE WHEN c.relispartition "
+            "THEN format('PARTITION OF %I %s', p.relname, pg_catalog.pg_get_expr(c.relpartbound, c.oid)) "
+            "ELSE format('(%s)', coalesce(table_columns.definitions, '')) END, "
+            "CASE WHEN c.relkind = 'p' THEN ' PARTITION BY ' || pg_catalog.pg_get_partkeydef(c.oid) ELSE '' END), "
+            "format('DROP TABLE IF EXISTS %I CASCADE;', c.relname), "
+            "coalesce(table_columns.names, ''), c.relkind = 'r' "
+            "FROM pg_catalog.pg_class c "
+            "JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace "
+            "LEFT JOIN pg_catalog.pg_inherits i ON i.inhrelid = c.oid AND c.relispartition "
+            "LEFT JOIN pg_catalog.pg_class p ON p.oid = i.inhparent "
+            "LEFT JOIN LATERAL ("
+            "SELECT string_agg(format('%I %s%s%s%s', a.attname, pg_catalog.format_type(a.atttypid, a.atttypmod), "
+            "CASE WHEN a.attcollation <> t.typcollation THEN ' COLLATE ' || a.attcollation::regcollation ELSE '' END, "
+            "CASE WHEN a.attidentity = 'a' THEN ' GENERATED ALWAYS AS IDENTITY' "
+            "WHEN a.attidentity = 'd' THEN ' GENERATED BY DEFAULT AS IDENTITY' "
+            "WHEN a.attgenerated = 's' "
+            "THEN format(' GENERATED ALWAYS AS (%s) STORED', pg_catalog.pg_get_expr(d.adbin, d.adrelid)) "
+            "WHEN d.adbin IS NOT NULL THEN ' DEFAULT ' || pg_catalog.pg_get_expr(d.adbin, d.adrelid) ELSE '' END, "
+            "CASE WHEN a.attnotnull THEN ' NOT NULL' ELSE '' END), ', ' ORDER BY a.attnum) AS definitions, "
+            "string_agg(format('%I', a.attname), ', ' ORDER BY a.attnum) FILTER (WHERE a.attgenerated = '') AS names "
+            "FROM pg_catalog.pg_attribute a "
+            "JOIN pg_catalog.pg_type t ON t.oid = a.atttypid "
+            "LEFT JOIN pg_catalog.pg_attrdef d ON d.adrelid = a.attrelid AND d.adnum = a.attnum "
+            "WHERE a.attrelid = c.oid AND a.attnum > 0 AND NOT a.attisdropped) table_columns ON true "
+            "WHERE n.nspname = 'public' AND c.relkind IN ('r', 'p') "
+            "ORDER BY (SELECT count(*) FROM pg_catalog.pg_partition_ancestors(c.oid)), c.relname;",
+            [this](const PGresult *catalogResult, const int row) {
+                const std::string tableName = PQgetvalue(catalogResult, row, 0);
+
+                schemaEntries.push_back({
+                    DumpSection::PRE_DATA, "TABLE", tableName, tableName,
+                    PQgetvalue(catalogResult, row, 1), PQgetvalue(catalogResult, row, 2)
+                });
+
+                // Partitioned tables hold no rows, their partitions are dumped
+                if (PQgetvalue(catalogResult, row, 4)[0] == 't')
+                    tablesColumns.push_back({tableName, PQgetvalue(catalogResult, row, 3)});
+            });
+
+    // Constraints declared on the table itself, the copies on the partitions come back with the parent's
+    if (schemaStatus == 0)
+        schemaStatus = readCatalog(
+            "SELECT con.conname, c.relname, con.contype = 'f', "
+            "format('ALTER TABLE %I ADD CONSTRAINT %I %s;', c.relname, con.conname, "
+            "pg_catalog.pg_get_constraintdef(con.oid)) "
+            "FROM pg_catalog.pg_constraint con "
+            "JOIN pg_catalog.pg_class c ON c.oid = con.conrelid "
+            "JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace "
+            "WHERE n.nspname = 'public' AND c.relkind IN ('r', 'p') AND con.contype IN ('p', 'u', 'c', 'x', 'f') "
+            "AND con.conislocal AND con.conparentid = 0 ORDER BY c.relname, con.conname;",
+            [this](const PGresult *catalogResult, const int row) {
+                const bool isForeignKey = PQgetvalue(catalogResult, row, 2)[0] == 't';
+
+                schemaEntries.push_back({
+                    isForeignKey ? DumpSection::FOREIGN_KEYS : DumpSection::POST_DATA,
+                    isForeignKey ? "FOREIGN KEY" : "CONSTRAINT", PQgetvalue(catalogResult, row, 0),
+                    PQgetvalue(catalogResult, row, 1), PQgetvalue(catalogResult, row, 3), ""
+                });
+            });
+
+    // Indexes not built by a constraint; an index of a partitioned table is created on its partitions as well
+    if (schemaStatus == 0)
+        schemaStatus = readCatalog(
+            "SELECT ic.relname, c.relname, CASE WHEN ic.relkind = 'I' "
+            "THEN replace(pg_catalog.pg_get_indexdef(i.indexrelid), ' ON ONLY ', ' ON ') "
+            "ELSE pg_catalog.pg_get_indexdef(i.indexrelid) END || ';' "
+            "FROM pg_catalog.pg_index i "
+            "JOIN pg_catalog.pg_class ic ON ic.oid = i.indexrelid "
+            "JOIN pg_catalog.pg_class c ON c.oid = i.indrelid "
+            "JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace "
+            "WHERE n.nspname = 'public' AND c.relkind IN ('r', 'p') "
+            "AND NOT EXISTS (SELECT 1 FROM pg_catalog.pg_constraint con WHERE con.conindid = i.indexrelid "
+            "AND con.conrelid = i.indrelid AND con.contype IN ('p', 'u', 'x')) "
+            "AND NOT EXISTS (SELECT 1 FROM pg_catalog.pg_inherits h WHERE h.inhrelid = i.indexrelid) "
+            "ORDER BY c.relname, ic.relname;",
+            [this](const PGresult *catalogResult, const int row) {
+                schemaEntries.push_back({
+                    DumpSection::POST_DATA, "INDEX", PQgetvalue(catalogResult, row, 0),
+                    PQgetvalue(catalogResult, row, 1), PQgetvalue(catalogResult, row, 2), ""
+                });
+            });
+
+    return schemaStatus;
+}
+
+int DumpArchive::dump() {
+    schemaEntries.clear();
+    tablesColumns.clear();
+    dataEntries.clear();
+
+    if (archiveFile.open(archiveFilePath))
+        return 1;
+
+    std::string archiveHeader{ARCHIVE_MAGIC, ARCHIVE_MAGIC_LENGTH};
+    appendLittleEndian(archiveHeader, ARCHIVE_VERSION, 4);
+    archiveSize = archiveHeader.length();
+
+    int dumpStatus = archiveFile.writeAt(archiveHeader.data(), archiveHeader.length(), 0);
+
+    // The schema and the rows come from the snapshot of this transaction, the workers import it
+    const bool isOwnTransaction = PQtransactionStatus(connection) == PQTRANS_IDLE;
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, SNAPSHOT_TRANSACTION));
+
+    if (dumpStatus == 0)
+        dumpStatus = readSchema();
+
+    ExportScheduler exportScheduler{
+        connection, archiveFilePath, ExportFormat::TEXT_TABLE, OutputBackend::STREAM, workersCount
+    };
+
+    if (dumpStatus == 0)
+        dumpStatus = exportScheduler.planTasks() ||
+                     exportScheduler.runTasks([this](PGconn *workerConnection, const ExportTask &task) {
+                         return dumpTask(workerConnection, task);
+                     });
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, dumpStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    if (dumpStatus == 0)
+        dumpStatus = writeTableOfContents();
+
+    archiveFile.close();
+
+    if (dumpStatus != 0)
+        std::cerr << "DUMP failed: " << archiveFilePath << " is incomplete.\n";
+
+    return dumpStatus;
+}
+
+int DumpArchive::dumpTask(PGconn *workerConnection, const ExportTask &task) {
+    const auto tableColumns = std::find_if(tablesColumns.begin(), tablesColumns.end(),
+                                           [&task](const TableColumns &columns) {
+                                               return columns.tableName == task.tableName;
+                                           });
+
+    if (tableColumns == tablesColumns.end()) {
+        std::cerr << "DUMP failed: No columns read for " << task.tableName << ".\n";
+        return 1;
+    }
+
+    const std::string &columnNames = tableColumns->columnNames;
+
+    DataEntry dataEntry;
+    dataEntry.tableName = task.tableName;
+    dataEntry.partNumber = task.partNumber;
+    dataEntry.copyQuery = std::string("COPY ") + task.quotedTableName +
+                          (columnNames.empty() ? std::string() : std::string(" (") + columnNames + std::string(")")) +
+                          std::string(" FROM STDIN (FORMAT binary);");
+
+    // ONLY: the rows of inheriting tables are dumped with their own table
+    const std::string copyQuery =
+            std::string("COPY (SELECT ") + columnNames + std::string(" FROM ONLY ") + task.quotedTableName +
+            (task.rangeCondition.empty() ? std::string() : std::string(" WHERE ") + task.rangeCondition) +
+            std::string(") TO STDOUT (FORMAT binary);");
+
+    PGresult *copyResult = PQexec(workerConnection, copyQuery.c_str());
+    const bool isCopying = PQresultStatus(copyResult) == PGRES_COPY_OUT;
+    PQclear(copyResult);
+
+    if (!isCopying) {
+        std::cerr << "DUMP failed: " << PQerrorMessage(workerConnection) << std::endl;
+        return 1;
+    }
+
+    std::string chunkInput, compressedChunk;
+    chunkInput.reserve(ARCHIVE_CHUNK_SIZE);
+
+    int dumpStatus = 0;
+    char *copyData = nullptr;
+    int copyLength;
+
+    // Every row has to be read even after a failure, or the connection stays in the COPY state
+    while ((copyLength = PQgetCopyData(workerConnection, &copyData, 0)) > 0) {
+        if (dumpStatus == 0)
+            chunkInput.append(copyData, copyLength);
+        PQfreemem(copyData);
+
+        if (dumpStatus == 0 && chunkInput.length() >= ARCHIVE_CHUNK_SIZE) {
+            dataEntry.rawBytes += chunkInput.length();
+            dumpStatus = appendChunk(chunkInput, compressedChunk, dataEntry.chunks);
+            chunkInput.clear();
+        }
+    }
+
+    if (copyLength == -2)
+        dumpStatus = 1;
+
+    while (PGresult *endResult = PQgetResult(workerConnection)) {
+        if (PQresultStatus(endResult) != PGRES_COMMAND_OK)
+            dumpStatus = 1;
+
+        PQclear(endResult);
+    }
+
+    if (dumpStatus == 0 && !chunkInput.empty()) {
+        dataEntry.rawBytes += chunkInput.length();
+        dumpStatus = appendChunk(chunkInput, compressedChunk, dataEntry.chunks);
+    }
+
+    if (dumpStatus != 0) {
+        std::cerr << "DUMP failed: " << task.tableName << ": " << PQerrorMessage(workerConnection) << std::endl;
+        return 1;
+    }
+
+    std::lock_guard lock{archiveMutex};
+    dataEntries.push_back(std::move(dataEntry));
+    return 0;
+}
+
+int DumpArchive::appendChunk(const std::string &input, std::string &compressedChunk,
+                             std::vector<ArchiveChunk> &chunks) {
+    if (compressFrame(input, LZ4_FAST_LEVEL, compressedChunk))
+        return 1;
+
+    // Only the offset is taken under the mutex, the workers write their chunks at once
+    std::uint64_t chunkOffset;
+    {
+        std::lock_guard lock{archiveMutex};
+        chunkOffset = archiveSize;
+        archiveSize += compressedChunk.length();
+    }
+
+    chunks.push_back({chunkOffset, compressedChunk.length(), input.length()});
+    return archiveFile.writeAt(compressedChunk.data(), compressedChunk.length(), chunkOffset);
+}
+
+int DumpArchive::writeTableOfContents() {
+    std::sort(dataEntries.begin(), dataEntries.end(), [](const DataEntry &left, const DataEntry &right) {
+        return left.tableName != right.tableName ? left.tableName < right.tableName
+                                                 : left.partNumber < right.partNumber;
+    });
+
+    std::string tableOfContents = std::string("{\n  \"format\": \"") + ARCHIVE_MAGIC +
+                                  std::string("\",\n  \"version\": ") + std::to_string(ARCHIVE_VERSION) +
+                                  std::string(",\n  \"serverVersion\": ") +
+                                  std::to_string(PQserverVersion(connection)) + std::string(",\n  \"schema\": [\n");
+
+    for (std::size_t i = 0; i < schemaEntries.size(); ++i) {
+        const SchemaEntry &schemaEntry = schemaEntries[i];
+
+        tableOfContents += "    {\"section\": " + JsonValue::quote(sectionName(schemaEntry.section)) +
+                ", \"kind\": " + JsonValue::quote(schemaEntry.kind) +
+                ", \"name\": " + JsonValue::quote(schemaEntry.name) +
+                ", \"table\": " + JsonValue::quote(schemaEntry.tableName) +
+                ", \"sql\": " + JsonValue::quote(schemaEntry.sql) +
+                ", \"dropSql\": " + JsonValue::quote(schemaEntry.dropSql) + "}" +
+                (i + 1 < schemaEntries.size() ? ",\n" : "\n");
+    }
+
+    tableOfContents += "  ],\n  \"data\": [\n";
+
+    for (std::size_t i = 0; i < dataEntries.size(); ++i) {
+        const DataEntry &dataEntry = dataEntries[i];
+
+        tableOfContents += "    {\"table\": " + JsonValue::quote(dataEntry.tableName) +
+                ", \"part\": " + std::to_string(dataEntry.partNumber) +
+                ", \"copy\": " + JsonValue::quote(dataEntry.copyQuery) +
+                ", \"rawBytes\": " + std::to_string(dataEntry.rawBytes) + ", \"chunks\": [";
+
+        // Chunks as [offset, size, raw size]
+        for (std::size_t j = 0; j < dataEntry.chunks.size(); ++j) {
+            const ArchiveChunk &chunk = dataEntry.chunks[j];
+
+            tableOfContents += (j > 0 ? std::string(", [") : std::string("[")) + std::to_string(chunk.offset) +
+                    ", " + std::to_string(chunk.size) + ", " + std::to_string(chunk.rawSize) + "]";
+        }
+
+        tableOfContents += std::string("]}") + (i + 1 < dataEntries.size() ? ",\n" : "\n");
+    }
+
+    tableOfContents += "  ]\n}\n";
+
+    std::string compressedTableOfContents;
+
+    if (compressFrame(tableOfContents, LZ4_FAST_LEVEL, compressedTableOfContents))
+        return 1;
+
+    std::string archiveFooter;
+    appendLittleEndian(archiveFooter, archiveSize, 8);
+    appendLittleEndian(archiveFooter, compressedTableOfContents.length(), 8);
+    appendLittleEndian(archiveFooter, tableOfContents.length(), 8);
+    archiveFooter.append(TABLE_OF_CONTENTS_MAGIC, ARCHIVE_MAGIC_LENGTH);
+
+    return archiveFile.writeAt(compressedTableOfContents.data(), compressedTableOfContents.length(), archiveSize) ||
+           archiveFile.writeAt(archiveFooter.data(), archiveFooter.length(),
+                               archiveSize + compressedTableOfContents.length());
+}
+
+int DumpArchive::readTableOfContents() {
+    schemaEntries.clear();
+    dataEntries.clear();
+
+    std::ifstream archiveStream{archiveFilePath, std::ios::binary};
+
+    if (!archiveStream) {
+        std::cerr << "Error: Cannot open " << archiveFilePath << " for reading.\n";
+        return 1;
+    }
+
+    archiveStream.seekg(0, std::ios::end);
+    const std::streamoff archiveFileSize = archiveStream.tellg();
+    archiveStream.seekg(0);
+
+    if (archiveFileSize < ARCHIVE_HEADER_SIZE + ARCHIVE_FOOTER_SIZE) {
+        std::cerr << "RESTORE failed: " << archiveFilePath << " is not a complete archive.\n";
+        return 1;
+    }
+
+    char archiveHeader[ARCHIVE_HEADER_SIZE];
+    char archiveFooter[ARCHIVE_FOOTER_SIZE];
+
+    archiveStream.read(archiveHeader, ARCHIVE_HEADER_SIZE);
+    archiveStream.seekg(-ARCHIVE_FOOTER_SIZE, std::ios::end);
+    archiveStream.read(archiveFooter, ARCHIVE_FOOTER_SIZE);
+
+    if (!archiveStream || std::memcmp(archiveHeader, ARCHIVE_MAGIC, ARCHIVE_MAGIC_LENGTH) != 0
+        || readLittleEndian(archiveHeader + ARCHIVE_MAGIC_LENGTH, 4) != ARCHIVE_VERSION
+        || std::memcmp(archiveFooter + 24, TABLE_OF_CONTENTS_MAGIC, ARCHIVE_MAGIC_LENGTH) != 0) {
+        std::cerr << "RESTORE failed: " << archiveFilePath << " is not a complete archive.\n";
+        return 1;
+    }
+
+    // Nothing is allocated before the footer is known to point between the header and itself
+    const std::uint64_t footerStart = static_cast<std::uint64_t>(archiveFileSize) - ARCHIVE_FOOTER_SIZE;
+    const std::uint64_t tableOfContentsOffset = readLittleEndian(archiveFooter, 8);
+    const std::uint64_t tableOfContentsSize = readLittleEndian(archiveFooter + 8, 8);
+    const std::uint64_t tableOfContentsRawSize = readLittleEndian(archiveFooter + 16, 8);
+
+    if (tableOfContentsOffset < ARCHIVE_HEADER_SIZE || tableOfContentsOffset > footerStart
+        || tableOfContentsSize > footerStart - tableOfContentsOffset
+        || tableOfContentsRawSize / LZ4_MAX_EXPANSION > tableOfContentsSize) {
+        std::cerr << "RESTORE failed: The footer of " << archiveFilePath << " is damaged.\n";
+        return 1;
+    }
+
+    std::string compressedTableOfContents(tableOfContentsSize, '\0');
+    std::string tableOfContents(tableOfContentsRawSize, '\0');
+
+    archiveStream.seekg(static_cast<std::streamoff>(tableOfContentsOffset));
+    archiveStream.read(compressedTableOfContents.data(), static_cast<std::streamsize>(compressedTableOfContents.length()));
+
+    LZ4F_dctx *decompressionContext = nullptr;
+    int readStatus = !archiveStream ||
+                     LZ4F_isError(LZ4F_createDecompressionContext(&decompressionContext, LZ4F_VERSION)) ||
+                     decompressFrame(decompressionContext, compressedTableOfContents, tableOfContents);
+    LZ4F_freeDecompressionContext(decompressionContext);
+
+    JsonValue contents;
+
+    if (readStatus != 0 || !JsonValue::parse(tableOfContents, contents) || contents.type != JsonValue::Type::OBJECT
+        || contents.get("schema") == nullptr || contents.get("data") == nullptr) {
+        std::cerr << "RESTORE failed: The table of contents of " << archiveFilePath << " is damaged.\n";
+        return 1;
+    }
+
+    for (const JsonValue &schemaValue: contents.get("schema")->elements) {
+        SchemaEntry &schemaEntry = schemaEntries.emplace_back();
+        const std::string section = schemaValue.getString("section");
+        bool isKnownSection = false;
+
+        for (const DumpSection knownSection: {
+                 DumpSection::PRE_DATA, DumpSection::SEQUENCE_SET, DumpSection::POST_DATA, DumpSection::FOREIGN_KEYS
+             }) {
+            if (section == sectionName(knownSection)) {
+                schemaEntry.section = knownSection;
+                isKnownSection = true;
+            }
+        }
+
+        if (!isKnownSection) {
+            std::cerr << "RESTORE failed: Unknown section " << section << " in " << archiveFilePath << ".\n";
+            return 1;
+        }
+
+        schemaEntry.kind = schemaValue.getString("kind");
+        schemaEntry.name = schemaValue.getString("name");
+        schemaEntry.tableName = schemaValue.getString("table");
+        schemaEntry.sql = schemaValue.getString("sql");
+        schemaEntry.dropSql = schemaValue.getString("dropSql");
+    }
+
+    for (const JsonValue &dataValue: contents.get("data")->elements) {
+        DataEntry &dataEntry = dataEntries.emplace_back();
+        dataEntry.tableName = dataValue.getString("table");
+        dataEntry.partNumber = static_cast<long long>(dataValue.getNumber("part", -1));
+        dataEntry.copyQuery = dataValue.getString("copy");
+        dataEntry.rawBytes = static_cast<std::uint64_t>(dataValue.getNumber("rawBytes"));
+
+        if (const JsonValue *chunksValue = dataValue.get("chunks"))
+            for (const JsonValue &chunkValue: chunksValue->elements) {
+                // Numbers which fit std::uint64_t
+                const bool isChunk = chunkValue.elements.size() == 3
+                                     && std::all_of(chunkValue.elements.begin(), chunkValue.elements.end(),
+                                                    [](const JsonValue &value) {
+                                                        return value.number >= 0 && value.number < 0x1p64;
+                                                    });
+
+                const ArchiveChunk chunk = isChunk
+                                               ? ArchiveChunk{
+                                                   static_cast<std::uint64_t>(chunkValue.elements[0].number),
+                                                   static_cast<std::uint64_t>(chunkValue.elements[1].number),
+                                                   static_cast<std::uint64_t>(chunkValue.elements[2].number)
+                                               }
+                                               : ArchiveChunk{};
+
+                // Chunks lie between the header and the table of contents, their rows go to a single PQputCopyData
+                if (!isChunk || chunk.offset < ARCHIVE_HEADER_SIZE || chunk.offset > tableOfContentsOffset
+                    || chunk.size > tableOfContentsOffset - chunk.offset || chunk.rawSize > INT_MAX
+                    || chunk.rawSize / LZ4_MAX_EXPANSION > chunk.size) {
+                    std::cerr << "RESTORE failed: The table of contents of " << archiveFilePath << " is damaged.\n";
+                    return 1;
+                }
+
+                dataEntry.chunks.push_back(chunk);
+            }
+    }
+
+    return 0;
+}
+
+int DumpArchive::restore(const bool isClean) {
+    if (readTableOfContents())
+        return 1;
+
+    // The tables are created (and dropped first by a clean restore) all or nothing
+    PQclear(PQexec(connection, "BEGIN;"));
+    int restoreStatus = 0;
+
+    if (isClean)
+        for (auto schemaEntry = schemaEntries.rbegin(); schemaEntry != schemaEntries.rend() && restoreStatus == 0;
+             ++schemaEntry)
+            if (schemaEntry->section == DumpSection::PRE_DATA && !schemaEntry->dropSql.empty())
+                restoreStatus = executeRestoreStatement(connection, schemaEntry->dropSql);
+
+    for (const SchemaEntry &schemaEntry: schemaEntries)
+        if (restoreStatus == 0 && schemaEntry.section == DumpSection::PRE_DATA)
+            restoreStatus = executeRestoreStatement(connection, schemaEntry.sql);
+
+    PQclear(PQexec(connection, restoreStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    if (restoreStatus != 0)
+        return 1;
+
+    // Every worker has its connection and reads the archive through its own stream
+    std::vector<PGconn *> workerConnections(workersCount, nullptr);
+    std::vector<std::ifstream> archiveStreams(workersCount);
+
+    for (std::size_t i = 0; i < workersCount && restoreStatus == 0; ++i) {
+        workerConnections[i] = DbConnection::cloneConnection(connection);
+        archiveStreams[i].open(archiveFilePath, std::ios::binary);
+
+        if (workerConnections[i] == nullptr || !archiveStreams[i]) {
+            restoreStatus = 1;
+            continue;
+        }
+
+        // Losing the last commits in a crash only means running the restore again
+        PQclear(PQexec(workerConnections[i], "SET synchronous_commit = off;"));
+    }
+
+    // The data of the biggest tables first, every worker loads one table (or page range) at a time
+    std::vector<const DataEntry *> loadOrder;
+    for (const DataEntry &dataEntry: dataEntries)
+        loadOrder.push_back(&dataEntry);
+
+    std::stable_sort(loadOrder.begin(), loadOrder.end(), [](const DataEntry *left, const DataEntry *right) {
+        return left->rawBytes > right->rawBytes;
+    });
+
+    if (restoreStatus == 0)
+        restoreStatus = runOnWorkers(
+            loadOrder.size(), workersCount,
+            [this, &workerConnections, &archiveStreams, &loadOrder](const std::size_t workerNumber,
+                                                                    const std::size_t itemNumber) {
+                return restoreDataEntry(workerConnections[workerNumber], archiveStreams[workerNumber],
+                                        *loadOrder[itemNumber]);
+            });
+
+    for (const SchemaEntry &schemaEntry: schemaEntries)
+        if (restoreStatus == 0 && schemaEntry.section == DumpSection::SEQUENCE_SET)
+            restoreStatus = executeRestoreStatement(connection, schemaEntry.sql);
+
+    // The indexes and keys are built on the loaded tables, the foreign keys once the keys they reference exist
+    if (restoreStatus == 0)
+        restoreStatus = restoreSection(workerConnections, DumpSection::POST_DATA) ||
+                        restoreSection(workerConnections, DumpSection::FOREIGN_KEYS);
+
+    for (PGconn *workerConnection: workerConnections)
+        if (workerConnection != nullptr)
+            PQfinish(workerConnection);
+
+    return restoreStatus;
+}
+
+int DumpArchive::restoreDataEntry(PGconn *workerConnection, std::ifstream &archiveStream,
+                                  const DataEntry &dataEntry) const {
+    PGresult *copyResult = PQexec(workerConnection, dataEntry.copyQuery.c_str());
+    const bool isCopying = PQresultStatus(copyResult) == PGRES_COPY_IN;
+    PQclear(copyResult);
+
+    if (!isCopying) {
+        std::cerr << "RESTORE failed: " << PQerrorMessage(workerConnection) << std::endl;
+        return 1;
+    }
+
+    LZ4F_dctx *decompressionContext = nullptr;
+    int restoreStatus = LZ4F_isError(LZ4F_createDecompressionContext(&decompressionContext, LZ4F_VERSION)) ? 1 : 0;
+    std::string compressedChunk, rawChunk;
+
+    for (const ArchiveChunk &chunk: dataEntry.chunks) {
+        if (restoreStatus != 0)
+            break;
+
+        compressedChunk.resize(chunk.size);
+        rawChunk.resize(chunk.rawSize);
+
+        archiveStream.seekg(static_cast<std::streamoff>(chunk.offset));
+        archiveStream.read(compressedChunk.data(), static_cast<std::streamsize>(chunk.size));
+
+        if (!archiveStream || decompressFrame(decompressionContext, compressedChunk, rawChunk)) {
+            std::cerr << "RESTORE failed: A chunk of " << dataEntry.tableName << " is damaged.\n";
+            archiveStream.clear();
+            restoreStatus = 1;
+        } else if (PQputCopyData(workerConnection, rawChunk.data(), static_cast<int>(rawChunk.length())) != 1) {
+            restoreStatus = 1;
+        }
+    }
+
+    LZ4F_freeDecompressionContext(decompressionContext);
+
+    // A COPY ended with an error message rolls back all of its rows
+    if (PQputCopyEnd(workerConnection, restoreStatus == 0 ? nullptr : "RESTORE aborted") != 1)
+        restoreStatus = 1;
+
+    while (PGresult *endResult = PQgetResult(workerConnection)) {
+        if (PQresultStatus(endResult) != PGRES_COMMAND_OK)
+            restoreStatus = 1;
+
+        PQclear(endResult);
+    }
+
+    if (restoreStatus != 0)
+        std::cerr << "RESTORE failed: " << dataEntry.tableName << ": " << PQerrorMessage(workerConnection)
+                << std::endl;
+
+    return restoreStatus;
+}
+
+int DumpArchive::restoreSection(const std::vector<PGconn *> &workerConnections, const DumpSection section) const {
+    std::vector<std::pair<std::uint64_t, const std::string *> > statements;
+
+    for (const SchemaEntry &schemaEntry: schemaEntries) {
+        if (schemaEntry.section != section)
+            continue;
+
+        std::uint64_t tableBytes = 0;
+        for (const DataEntry &dataEntry: dataEntries)
+            if (dataEntry.tableName == schemaEntry.tableName)
+                tableBytes += dataEntry.rawBytes;
+
+        statements.emplace_back(tableBytes, &schemaEntry.sql);
+    }
+
+    std::stable_sort(statements.begin(), statements.end(), [](const auto &left, const auto &right) {
+        return left.first > right.first;
+    });
+
+    return runOnWorkers(statements.size(), workerConnections.size(),
+                        [&workerConnections, &statements](const std::size_t workerNumber,
+                                                          const std::size_t itemNumber) {
+                            return executeRestoreStatement(workerConnections[workerNumber],
+                                                           *statements[itemNumber].second);
+                        });
+}
+
+std::size_t DumpArchive::getTablesCount() const {
+    return std::count_if(schemaEntries.begin(), schemaEntries.end(), [](const SchemaEntry &schemaEntry) {
+        return schemaEntry.kind == "TABLE";
+    });
+}
+
+std::size_t DumpArchive::getDataEntriesCount() const {
+    return dataEntries.size();
+}
+
+
+int executeRestoreStatement(PGconn *connection, const std::string &statement) {
+    for (int attempt = 0;; ++attempt) {
+        PGresult *statementResult = PQexec(connection, statement.c_str());
+        const ExecStatusType statementStatus = PQresultStatus(statementResult);
+
+        if (statementStatus == PGRES_COMMAND_OK || statementStatus == PGRES_TUPLES_OK) {
+            PQclear(statementResult);
+            return 0;
+        }
+
+        const char *sqlState = PQresultErrorField(statementResult, PG_DIAG_SQLSTATE);
+
+        if (sqlState == nullptr || std::strcmp(sqlState, DEADLOCK_SQLSTATE) != 0 || attempt >= DEADLOCK_RETRIES) {
+            std::cerr << "RESTORE failed: " << statement << "\n" << PQresultErrorMessage(statementResult) << std::endl;
+
+            PQclear(statementResult);
+            return 1;
+        }
+
+        PQclear(statementResult);
+    }
+}
+
+int runOnWorkers(const std::size_t itemsCount, const std::size_t workersCount,
+                 const std::function<int(std::size_t workerNumber, std::size_t itemNumber)> &runItem) {
+    // A failed item stops the others after their current one
+    std::atomic<std::size_t> nextItem = 0;
+    std::atomic<bool> isFailed = false;
+    std::vector<std::thread> threads;
+
+    for (std::size_t i = 0; i < std::min(workersCount, itemsCount); ++i) {
+        threads.emplace_back([i, itemsCount, &runItem, &nextItem, &isFailed] {
+            while (!isFailed) {
+                const std::size_t itemNumber = nextItem++;
+
+                if (itemNumber >= itemsCount)
+                    break;
+
+                if (runItem(i, itemNumber) != 0)
+                    isFailed = true;
+            }
+        });
+    }
+
+    for (std::thread &thread: threads)
+        thread.join();
+
+    return isFailed ? 1 : 0;
+}
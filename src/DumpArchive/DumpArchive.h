@@ -0,0 +1,106 @@
+#pragma once
+#include <libpq-fe.h>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../ExportScheduler/ExportScheduler.h"
+#include "../PositionalFile/PositionalFile.h"
+
+
+// When a schema statement of the archive is restored
+enum class DumpSection {
+    PRE_DATA, // Sequences and tables (without their indexes and constraints), created in one transaction
+    SEQUENCE_SET, // Current values of the sequences, set after the data
+    POST_DATA, // Indexes, primary keys, unique, check and exclusion constraints, built in parallel
+    FOREIGN_KEYS // Foreign keys, built in parallel once the keys they reference exist
+};
+
+
+// Consistent dump of the public schema into one archive file and its parallel restore.
+// The dump reads the schema from the catalogs and the rows of every table through the ExportScheduler's workers,
+// all within one exported snapshot. Rows travel as COPY BINARY data, cut into chunks compressed as independent
+// LZ4 frames by the workers and written at reserved offsets of the archive. A table of contents (TOC) lists the
+// schema statements by section and the chunks of every table (or page range of a big one).
+// Archive: "PGCPPDMP", version | chunks ... | TOC (LZ4 frame of JSON) | TOC offset, size, raw size, "PGCPPTOC"
+// The restore creates the tables without indexes, loads the chunks with parallel COPY, then builds the indexes and
+// constraints in parallel. Binary COPY data is meant for a server of the same major version, types other than the
+// built-in ones have to exist in the target database already.
+class DumpArchive {
+    struct SchemaEntry {
+        DumpSection section;
+        std::string kind; // SEQUENCE, TABLE, INDEX, CONSTRAINT...
+        std::string name;
+        std::string tableName; // Table of a TABLE, INDEX or CONSTRAINT entry
+        std::string sql;
+        std::string dropSql; // Run in reverse order before the PRE_DATA entries by a clean restore
+    };
+
+    struct ArchiveChunk {
+        std::uint64_t offset;
+        std::uint64_t size; // Compressed
+        std::uint64_t rawSize;
+    };
+
+    struct DataEntry {
+        std::string tableName;
+        long long partNumber = -1;
+        std::string copyQuery; // COPY ... FROM STDIN (FORMAT binary) loading the chunks
+        std::uint64_t rawBytes = 0;
+        std::vector<ArchiveChunk> chunks;
+    };
+
+    struct TableColumns {
+        std::string tableName;
+        std::string columnNames; // Quoted, without the generated columns
+    };
+
+    PGconn *connection;
+    std::string archiveFilePath;
+    std::size_t workersCount;
+
+    std::vector<SchemaEntry> schemaEntries;
+    std::vector<TableColumns> tablesColumns;
+    std::vector<DataEntry> dataEntries;
+
+    // Dump: the chunks are written at offsets reserved under the mutex
+    PositionalFile archiveFile;
+    std::mutex archiveMutex;
+    std::uint64_t archiveSize = 0;
+
+    // Read the schema statements and the columns of every table
+    int readSchema();
+
+    // COPY the rows of *task* into compressed chunks
+    int dumpTask(PGconn *workerConnection, const ExportTask &task);
+
+    // Compress *input* into a chunk of the archive (through the *compressedChunk* buffer)
+    int appendChunk(const std::string &input, std::string &compressedChunk, std::vector<ArchiveChunk> &chunks);
+
+    int writeTableOfContents();
+
+    int readTableOfContents();
+
+    // COPY the chunks of *dataEntry* into its table
+    int restoreDataEntry(PGconn *workerConnection, std::ifstream &archiveStream, const DataEntry &dataEntry) const;
+
+    // Run the statements of *section* in parallel on the worker connections, those of the largest tables first
+    int restoreSection(const std::vector<PGconn *> &workerConnections, DumpSection section) const;
+
+public:
+    // *workersCount* 0: one per hardware thread, at most 8
+    DumpArchive(PGconn *connection, std::string archiveFilePath, std::size_t workersCount = 0);
+
+    static const char *sectionName(DumpSection section);
+
+    // Dump the schema and the rows of every table of the public schema into the archive
+    int dump();
+
+    // Restore the archive into the database of the connection, *isClean* drops its tables and sequences first
+    int restore(bool isClean = false);
+
+    std::size_t getTablesCount() const;
+
+    std::size_t getDataEntriesCount() const;
+};
@@ -0,0 +1,175 @@
+#include "ExecutionPlanner.h"
+#include "../Json/Json.h"
+#include <iostream>
+
+
+// Results up to this size are simply materialized on the client
+#define IN_MEMORY_MAX_BYTES (64.0 * 1024 * 1024)
+// Single-row mode allocates a PGresult per row, it only beats a cursor batch (of 10000 rows) when the rows
+// are so few and wide that one batch would not fit in memory
+#define SINGLE_ROW_MAX_ROWS 10000.0
+// From this size on (1 GB of 8 kB pages) the table is read by parallel connections
+#define PARALLEL_RANGE_MIN_PAGES 131072
+// TID range scans (WHERE ctid >= ... AND ctid < ...) exist since PostgreSQL 14
+#define TID_RANGE_SCAN_SERVER_VERSION 140000
+// Relative costs per byte of the width strategies
+#define HEAP_PAGE_BYTES 8192.0
+#define SCAN_COST_PER_BYTE 1.0 // Server reads the heap (often from its cache)
+#define TRANSFER_COST_PER_BYTE 4.0 // Server sends a result row, libpq receives and parses it
+#define AGGREGATE_COST_PER_BYTE 1.0 // Server formats a value for max(octet_length(...))
+#define SPILL_COST_PER_BYTE 2.0 // Client writes the spill file and reads it back
+
+
+double TableEstimate::bytes() const {
+    return rows * rowWidth;
+}
+
+int ExecutionPlanner::estimateTable(PGconn *connection, const std::string &tableName, TableEstimate &estimate) {
+    const char *paramValues[] = {tableName.c_str()};
+
+    PGresult *classResult = PQexecParams(
+        connection,
+        "SELECT relkind, pg_relation_size(oid) / current_setting('block_size')::int8 "
+        "FROM pg_catalog.pg_class WHERE oid = $1::regclass;",
+        1,
+        nullptr,
+        paramValues,
+        nullptr,
+        nullptr,
+        0
+    );
+
+    if (PQresultStatus(classResult) != PGRES_TUPLES_OK || PQntuples(classResult) == 0) {
+        std::cerr << "ESTIMATE failed: " << PQresultErrorMessage(classResult) << std::endl;
+
+        PQclear(classResult);
+        return 1;
+    }
+
+    const char relationKind = PQgetvalue(classResult, 0, 0)[0];
+    estimate.pages = std::stoll(PQgetvalue(classResult, 0, 1));
+    estimate.isSplittable = (relationKind == 'r' || relationKind == 'm')
+                            && PQserverVersion(connection) >= TID_RANGE_SCAN_SERVER_VERSION;
+    PQclear(classResult);
+
+    // The planner scales reltuples to the current table size, which makes it better than reltuples alone
+    const std::string explainQuery =
+            std::string("EXPLAIN (FORMAT JSON) SELECT * FROM ") + tableName + std::string(";");
+
+    PGresult *explainResult = PQexec(connection, explainQuery.c_str());
+
+    if (PQresultStatus(explainResult) != PGRES_TUPLES_OK || PQntuples(explainResult) == 0) {
+        std::cerr << "ESTIMATE failed: " << PQresultErrorMessage(explainResult) << std::endl;
+
+        PQclear(explainResult);
+        return 1;
+    }
+
+    JsonValue explainOutput;
+    const bool isParsed = JsonValue::parse(PQgetvalue(explainResult, 0, 0), explainOutput);
+    PQclear(explainResult);
+
+    if (!isParsed || explainOutput.type != JsonValue::Type::ARRAY || explainOutput.elements.empty()
+        || explainOutput.elements[0].get("Plan") == nullptr) {
+        std::cerr << "ESTIMATE failed: Unexpected EXPLAIN output.\n";
+        return 1;
+    }
+
+    const JsonValue &plan = *explainOutput.elements[0].get("Plan");
+    estimate.rows = plan.getNumber("Plan Rows");
+    estimate.rowWidth = plan.getNumber("Plan Width");
+
+    return 0;
+}
+
+ExecutionStrategy ExecutionPlanner::chooseStrategy(const TableEstimate &estimate) {
+    if (estimate.bytes() <= IN_MEMORY_MAX_BYTES)
+        return ExecutionStrategy::IN_MEMORY;
+
+    if (estimate.isSplittable && estimate.pages >= PARALLEL_RANGE_MIN_PAGES)
+        return ExecutionStrategy::PARALLEL_RANGE;
+
+    // Few but wide rows: one row per round trip keeps the client memory at a single row
+    if (estimate.rows <= SINGLE_ROW_MAX_ROWS)
+        return ExecutionStrategy::SINGLE_ROW;
+
+    return ExecutionStrategy::CURSOR_BATCH;
+}
+
+const char *ExecutionPlanner::strategyName(const ExecutionStrategy strategy) {
+    switch (strategy) {
+        case ExecutionStrategy::IN_MEMORY:
+            return "IN MEMORY";
+        case ExecutionStrategy::SINGLE_ROW:
+            return "SINGLE ROW";
+        case ExecutionStrategy::CURSOR_BATCH:
+            return "CURSOR BATCH";
+        case ExecutionStrategy::PARALLEL_RANGE:
+            return "PARALLEL RANGE";
+    }
+
+    return "UNKNOWN";
+}
+
+WidthStrategy ExecutionPlanner::chooseWidthStrategy(const TableEstimate &estimate, const std::size_t memoryBudget) {
+    const double scanCost = estimate.pages * HEAP_PAGE_BYTES * SCAN_COST_PER_BYTE;
+    const double transferCost = estimate.bytes() * TRANSFER_COST_PER_BYTE;
+
+    // Both scans send every row
+    const double rescanCost = 2 * (scanCost + transferCost);
+
+    // The widths pass scans again, but sends one row of maximums
+    const double serverWidthsCost = 2 * scanCost + estimate.bytes() * AGGREGATE_COST_PER_BYTE + transferCost;
+
+    if (memoryBudget == 0)
+        return serverWidthsCost < rescanCost ? WidthStrategy::SERVER_WIDTHS : WidthStrategy::RESCAN;
+
+    // One scan, the rows touch the disk only when they outgrow their half of the budget
+    const double spillCost = scanCost + transferCost +
+                             (estimate.bytes() > memoryBudget / 2.0 ? 2 * estimate.bytes() * SPILL_COST_PER_BYTE : 0);
+
+    if (spillCost <= serverWidthsCost && spillCost <= rescanCost)
+        return WidthStrategy::SPILL_FILE;
+
+    return serverWidthsCost < rescanCost ? WidthStrategy::SERVER_WIDTHS : WidthStrategy::RESCAN;
+}
+
+const char *ExecutionPlanner::widthStrategyName(const WidthStrategy strategy) {
+    switch (strategy) {
+        case WidthStrategy::AUTO:
+            return "AUTO";
+        case WidthStrategy::RESCAN:
+            return "RESCAN";
+        case WidthStrategy::SPILL_FILE:
+            return "SPILL FILE";
+        case WidthStrategy::SERVER_WIDTHS:
+            return "SERVER WIDTHS";
+    }
+
+    return "UNKNOWN";
+}
+
+int ExecutionPlanner::readPrimaryKey(PGconn *connection, const std::string &tableName,
+                                     std::vector<std::string> &keyColumnNames) {
+    const char *paramValues[] = {tableName.c_str()};
+    PGresult *keyResult = PQexecParams(
+        connection,
+        "SELECT a.attname FROM pg_catalog.pg_index i "
+        "JOIN pg_catalog.pg_attribute a ON a.attrelid = i.indrelid AND a.attnum = ANY (i.indkey) "
+        "WHERE i.indrelid = $1::regclass AND i.indisprimary "
+        "ORDER BY array_position(i.indkey::int2[], a.attnum);",
+        1, nullptr, paramValues, nullptr, nullptr, 0);
+
+    if (PQresultStatus(keyResult) != PGRES_TUPLES_OK) {
+        std::cerr << "PRIMARY KEY lookup failed: " << PQresultErrorMessage(keyResult) << std::endl;
+        PQclear(keyResult);
+        return 1;
+    }
+
+    keyColumnNames.clear();
+    for (int i = 0; i < PQntuples(keyResult); ++i)
+        keyColumnNames.emplace_back(PQgetvalue(keyResult, i, 0));
+
+    PQclear(keyResult);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <libpq-fe.h>
+#include <string>
+#include <vector>
+
+
+// How a SELECT over a whole table is fetched from the server
+enum class ExecutionStrategy {
+    IN_MEMORY, // PQexec, the whole result is materialized on the client
+    SINGLE_ROW, // PQsetSingleRowMode, one row per PGresult
+    CURSOR_BATCH, // DECLARE CURSOR + FETCH in batches
+    PARALLEL_RANGE // Page (ctid) ranges fetched by parallel connections
+};
+
+// How a streamed export learns the column widths before its first row is written
+enum class WidthStrategy {
+    AUTO, // Chosen by ExecutionPlanner::chooseWidthStrategy
+    RESCAN, // Read the rows twice within one snapshot, first for the widths
+    SPILL_FILE, // Read the rows once, spool them to a spill file for the rendering
+    SERVER_WIDTHS // One aggregate query computes the widths on the server, the rows are rendered as they arrive
+};
+
+// Planner's view of a table before it is read
+struct TableEstimate {
+    double rows = 0; // EXPLAIN "Plan Rows" (scaled to the current table size)
+    double rowWidth = 0; // EXPLAIN "Plan Width", average bytes per row
+    long long pages = 0; // Current number of heap pages
+    bool isSplittable = false; // Heap table on a server with TID range scans (PostgreSQL 14+)
+
+    double bytes() const;
+};
+
+
+class ExecutionPlanner {
+public:
+    // Read pg_class and a cheap EXPLAIN (FORMAT JSON) of SELECT * FROM *tableName*
+    static int estimateTable(PGconn *connection, const std::string &tableName, TableEstimate &estimate);
+
+    // Pick the fetch strategy from the estimated rows and bytes
+    static ExecutionStrategy chooseStrategy(const TableEstimate &estimate);
+
+    static const char *strategyName(ExecutionStrategy strategy);
+
+    // Pick the cheapest way to learn the column widths: a second transfer of the rows, a spill file
+    // (only with a *memoryBudget*) or a second scan aggregated on the server
+    static WidthStrategy chooseWidthStrategy(const TableEstimate &estimate, std::size_t memoryBudget);
+
+    static const char *widthStrategyName(WidthStrategy strategy);
+
+    // Primary key columns of *tableName* in key order, none when it has no primary key
+    static int readPrimaryKey(PGconn *connection, const std::string &tableName,
+                              std::vector<std::string> &keyColumnNames);
+};
@@ -0,0 +1,325 @@
+#include "ExportScheduler.h"
+#include "../DbConnection/DbConnection.h"
+#include "../TableExporter/TableExporter.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+
+#define EXPORT_MAX_WORKERS 8
+// The big tables are split into tasks of about 1 / (workers * TASKS_PER_WORKER) of the total cost
+#define TASKS_PER_WORKER 4
+// Smallest page range a table is split into (8 MB of 8 kB pages)
+#define MIN_RANGE_PAGES 1024
+// Rendering this many rows costs about as much as reading a page
+#define ROWS_PER_PAGE_COST 100.0
+// Opening the file and describing the columns, what an empty table costs
+#define TASK_OVERHEAD_COST 1.0
+#define TID_RANGE_SCAN_SERVER_VERSION 140000
+#define PART_NUMBER_DIGITS 4
+
+
+ExportScheduler::ExportScheduler(PGconn *connection, std::string outputFilePath, const ExportFormat format,
+                                 const OutputBackend outputBackend, const std::size_t workersCount)
+    : connection(connection), outputFilePath(std::move(outputFilePath)), format(format),
+      outputBackend(outputBackend),
+      workersCount(workersCount > 0
+                       ? workersCount
+                       : std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, EXPORT_MAX_WORKERS)) {
+}
+
+std::string ExportScheduler::taskFilePath(const std::string &tableName, const long long partNumber) const {
+    const std::filesystem::path outputPath{outputFilePath};
+
+    std::ostringstream fileNameStream;
+    fileNameStream << outputPath.stem().string() << '.' << tableName;
+    if (partNumber >= 0)
+        fileNameStream << '.' << std::setw(PART_NUMBER_DIGITS) << std::setfill('0') << partNumber;
+    fileNameStream << outputPath.extension().string();
+
+    std::filesystem::path taskPath = outputPath;
+    taskPath.replace_filename(fileNameStream.str());
+    return taskPath.string();
+}
+
+int ExportScheduler::planTasks() {
+    tasks.clear();
+    tablesCount = 0;
+
+    // Ordinary tables only: a partitioned table has no rows of its own, its partitions are exported instead
+    PGresult *tablesResult = PQexec(
+        connection,
+        "SELECT c.relname, format('%I', c.relname), "
+        "pg_relation_size(c.oid) / current_setting('block_size')::int8, c.relpages, c.reltuples "
+        "FROM pg_catalog.pg_class c JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace "
+        "WHERE n.nspname = 'public' AND c.relkind = 'r' ORDER BY c.relname;");
+
+    if (PQresultStatus(tablesResult) != PGRES_TUPLES_OK) {
+        std::cerr << "EXPORT ALL failed: " << PQresultErrorMessage(tablesResult) << std::endl;
+
+        PQclear(tablesResult);
+        return 1;
+    }
+
+    struct TableCost {
+        std::string tableName;
+        std::string quotedName;
+        long long pages;
+        double cost;
+    };
+
+    std::vector<TableCost> tableCosts;
+    double totalCost = 0;
+
+    for (int i = 0; i < PQntuples(tablesResult); ++i) {
+        const long long pages = std::stoll(PQgetvalue(tablesResult, i, 2));
+        const long long statisticsPages = std::stoll(PQgetvalue(tablesResult, i, 3));
+        const double statisticsRows = std::stod(PQgetvalue(tablesResult, i, 4));
+
+        // reltuples scaled to the current size, like the planner does; -1 (never analyzed) leaves only the pages
+        double rows = std::max(statisticsRows, 0.0);
+        if (statisticsPages > 0)
+            rows = rows / static_cast<double>(statisticsPages) * static_cast<double>(pages);
+
+        const double cost = TASK_OVERHEAD_COST + static_cast<double>(pages) + rows / ROWS_PER_PAGE_COST;
+        tableCosts.push_back({PQgetvalue(tablesResult, i, 0), PQgetvalue(tablesResult, i, 1), pages, cost});
+        totalCost += cost;
+    }
+    PQclear(tablesResult);
+
+    tablesCount = tableCosts.size();
+
+    // Tasks small enough for every worker to get several, ranges need TID range scans to read only their pages
+    const double taskCost = totalCost / static_cast<double>(workersCount * TASKS_PER_WORKER);
+    const bool isSplittable = PQserverVersion(connection) >= TID_RANGE_SCAN_SERVER_VERSION;
+
+    for (const TableCost &tableCost: tableCosts) {
+        const long long partsCount = isSplittable
+                                         ? std::min(static_cast<long long>(std::ceil(tableCost.cost / taskCost)),
+                                                    tableCost.pages / MIN_RANGE_PAGES)
+                                         : 1;
+        const std::string tableQuery = std::string("SELECT * FROM ") + tableCost.quotedName;
+
+        if (partsCount <= 1) {
+            tasks.push_back({
+                tableCost.tableName, tableCost.quotedName, "", -1, tableQuery,
+                taskFilePath(tableCost.tableName, -1), tableCost.cost
+            });
+            continue;
+        }
+
+        const long long pagesPerPart = (tableCost.pages + partsCount - 1) / partsCount;
+
+        for (long long i = 0; i < partsCount; ++i) {
+            // The last range is open, the table may have grown since its size was read
+            std::string rangeCondition =
+                    std::string("ctid >= '(") + std::to_string(i * pagesPerPart) + std::string(",0)'::tid");
+            if (i < partsCount - 1)
+                rangeCondition += std::string(" AND ctid < '(") + std::to_string((i + 1) * pagesPerPart) +
+                        std::string(",0)'::tid");
+
+            tasks.push_back({
+                tableCost.tableName, tableCost.quotedName, rangeCondition, i,
+                tableQuery + std::string(" WHERE ") + rangeCondition, taskFilePath(tableCost.tableName, i),
+                tableCost.cost / static_cast<double>(partsCount)
+            });
+        }
+    }
+
+    std::stable_sort(tasks.begin(), tasks.end(), [](const ExportTask &left, const ExportTask &right) {
+        return left.cost > right.cost;
+    });
+
+    return 0;
+}
+
+bool ExportScheduler::takeTask(const std::size_t workerNumber, ExportTask &task, bool &isStolen) {
+    WorkerQueue &ownQueue = *workerQueues[workerNumber];
+
+    {
+        std::lock_guard lock{ownQueue.mutex};
+
+        if (!ownQueue.tasks.empty()) {
+            task = std::move(ownQueue.tasks.front());
+            ownQueue.tasks.pop_front();
+            ownQueue.queuedCost -= task.cost;
+            isStolen = false;
+            return true;
+        }
+    }
+
+    // Tasks are only ever taken out, so once every queue is seen empty the export is over
+    while (true) {
+        WorkerQueue *victimQueue = nullptr;
+        double victimCost = 0;
+
+        for (const std::unique_ptr<WorkerQueue> &workerQueue: workerQueues) {
+            std::lock_guard lock{workerQueue->mutex};
+
+            if (!workerQueue->tasks.empty() && (victimQueue == nullptr || workerQueue->queuedCost > victimCost)) {
+                victimQueue = workerQueue.get();
+                victimCost = workerQueue->queuedCost;
+            }
+        }
+
+        if (victimQueue == nullptr)
+            return false;
+
+        std::lock_guard lock{victimQueue->mutex};
+
+        if (victimQueue->tasks.empty()) /* Emptied in the meantime, look again */
+            continue;
+
+        task = std::move(victimQueue->tasks.front());
+        victimQueue->tasks.pop_front();
+        victimQueue->queuedCost -= task.cost;
+        isStolen = true;
+        return true;
+    }
+}
+
+int ExportScheduler::runTask(PGconn *workerConnection, const ExportTask &task) const {
+    // The worker's transaction is already open, the exporters read within it
+    if (format == ExportFormat::COLUMNAR)
+        return TableExporter::exportColumnar(workerConnection, task.query, task.outputFilePath);
+
+    return TableExporter::exportFormatted(workerConnection, task.query, ExecutionStrategy::CURSOR_BATCH, format,
+                                         task.outputFilePath, outputBackend);
+}
+
+int ExportScheduler::exportAll() {
+    return runTasks([this](PGconn *workerConnection, const ExportTask &task) {
+        return runTask(workerConnection, task);
+    });
+}
+
+int ExportScheduler::runTasks(const ExportTaskRunner &taskRunner) {
+    stolenTasksCount = 0;
+
+    if (tasks.empty())
+        return 0;
+
+    const std::size_t activeWorkersCount = std::min(workersCount, tasks.size());
+
+    // Largest task first to the least loaded queue
+    workerQueues.clear();
+    for (std::size_t i = 0; i < activeWorkersCount; ++i)
+        workerQueues.push_back(std::make_unique<WorkerQueue>());
+
+    for (ExportTask &task: tasks) {
+        WorkerQueue &workerQueue = **std::min_element(
+            workerQueues.begin(), workerQueues.end(),
+            [](const std::unique_ptr<WorkerQueue> &left, const std::unique_ptr<WorkerQueue> &right) {
+                return left->queuedCost < right->queuedCost;
+            });
+
+        workerQueue.queuedCost += task.cost;
+        workerQueue.tasks.push_back(task);
+    }
+
+    // Every worker imports the snapshot of this transaction, so all tables come from the same point in time
+    const bool isOwnTransaction = PQtransactionStatus(connection) == PQTRANS_IDLE;
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, SNAPSHOT_TRANSACTION));
+
+    PGresult *snapshotResult = PQexec(connection, "SELECT pg_export_snapshot();");
+
+    if (PQresultStatus(snapshotResult) != PGRES_TUPLES_OK) {
+        std::cerr << "EXPORT ALL failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(snapshotResult);
+        if (isOwnTransaction)
+            PQclear(PQexec(connection, "ROLLBACK;"));
+        return 1;
+    }
+
+    const std::string importSnapshotQuery =
+            std::string("SET TRANSACTION SNAPSHOT '") + PQgetvalue(snapshotResult, 0, 0) + std::string("';");
+    PQclear(snapshotResult);
+
+    std::vector<PGconn *> workerConnections(activeWorkersCount, nullptr);
+    int exportStatus = 0;
+
+    for (PGconn *&workerConnection: workerConnections) {
+        workerConnection = DbConnection::cloneConnection(connection);
+
+        if (workerConnection == nullptr) {
+            exportStatus = 1;
+            break;
+        }
+
+        PQclear(PQexec(workerConnection, SNAPSHOT_TRANSACTION));
+        PGresult *importResult = PQexec(workerConnection, importSnapshotQuery.c_str());
+
+        if (PQresultStatus(importResult) != PGRES_COMMAND_OK) {
+            std::cerr << "EXPORT ALL failed: " << PQerrorMessage(workerConnection) << std::endl;
+            exportStatus = 1;
+        }
+        PQclear(importResult);
+
+        if (exportStatus != 0)
+            break;
+    }
+
+    if (exportStatus == 0) {
+        // A failed task aborts its worker's transaction, the other workers stop after their current task
+        std::atomic<bool> isFailed = false;
+        std::atomic<std::size_t> stolenCount = 0;
+        std::vector<std::thread> threads;
+
+        for (std::size_t i = 0; i < activeWorkersCount; ++i) {
+            threads.emplace_back([this, i, &taskRunner, &workerConnections, &isFailed, &stolenCount] {
+                ExportTask task;
+                bool isStolen;
+
+                while (!isFailed && takeTask(i, task, isStolen)) {
+                    if (isStolen)
+                        ++stolenCount;
+
+                    if (taskRunner(workerConnections[i], task) != 0) {
+                        std::cerr << "EXPORT ALL failed: Cannot export " << task.tableName << " to "
+                                << task.outputFilePath << ".\n";
+                        isFailed = true;
+                    }
+                }
+            });
+        }
+
+        for (std::thread &thread: threads)
+            thread.join();
+
+        exportStatus = isFailed ? 1 : 0;
+        stolenTasksCount = stolenCount;
+    }
+
+    for (PGconn *workerConnection: workerConnections) {
+        if (workerConnection == nullptr)
+            continue;
+
+        PQclear(PQexec(workerConnection, exportStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+        PQfinish(workerConnection);
+    }
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, exportStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    return exportStatus;
+}
+
+std::size_t ExportScheduler::getTablesCount() const {
+    return tablesCount;
+}
+
+std::size_t ExportScheduler::getTasksCount() const {
+    return tasks.size();
+}
+
+std::size_t ExportScheduler::getStolenTasksCount() const {
+    return stolenTasksCount;
+}
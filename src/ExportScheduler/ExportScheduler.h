@@ -0,0 +1,82 @@
+#pragma once
+#include <libpq-fe.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../FormatWriter/FormatWriter.h"
+#include "../TableRenderer/TableRenderer.h"
+
+
+// One file of an export of every table: a whole table, or a page (ctid) range of a big one
+struct ExportTask {
+    std::string tableName;
+    std::string quotedTableName;
+    std::string rangeCondition; // WHERE condition of the page range, empty for a whole table
+    long long partNumber = -1; // Range number of a split table, -1 for a whole one
+    std::string query;
+    std::string outputFilePath;
+    double cost = 0; // Estimated pages read plus rows rendered, in pages
+};
+
+// Runs one task on a worker connection (within the shared snapshot), non-zero stops the export
+using ExportTaskRunner = std::function<int(PGconn *workerConnection, const ExportTask &task)>;
+
+
+// Exports every table of the public schema, each to its own file, on a pool of worker connections sharing one
+// exported snapshot. The tasks are costed from pg_class (pages, reltuples scaled to the current size) and tables
+// larger than a fraction of the total are split into page ranges, so no single task dominates. The tasks are
+// dealt largest first to the least loaded worker queue; a worker runs its own queue from the largest task down and,
+// once it is empty, steals the largest waiting task of the most loaded queue. The wall time approaches
+// max(biggest task, total / workers). Files are named after the output file: SQLresult.txt -> SQLresult.users.txt,
+// the ranges of a split table SQLresult.orders.0000.txt, SQLresult.orders.0001.txt ... (each a complete file).
+class ExportScheduler {
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<ExportTask> tasks; // Largest first
+        double queuedCost = 0;
+    };
+
+    PGconn *connection;
+    std::string outputFilePath;
+    ExportFormat format;
+    OutputBackend outputBackend;
+    std::size_t workersCount;
+
+    std::vector<ExportTask> tasks;
+    std::vector<std::unique_ptr<WorkerQueue> > workerQueues;
+    std::size_t tablesCount = 0;
+    std::size_t stolenTasksCount = 0;
+
+    // Output file of *tableName*, of its *partNumber*-th range when it is split (-1: whole)
+    std::string taskFilePath(const std::string &tableName, long long partNumber) const;
+
+    // Next task of worker *workerNumber*: the front of its queue, else the front of the most loaded queue
+    bool takeTask(std::size_t workerNumber, ExportTask &task, bool &isStolen);
+
+    int runTask(PGconn *workerConnection, const ExportTask &task) const;
+
+public:
+    // *workersCount* 0: one per hardware thread, at most 8
+    ExportScheduler(PGconn *connection, std::string outputFilePath, ExportFormat format, OutputBackend outputBackend,
+                    std::size_t workersCount = 0);
+
+    // Read the table sizes and build the tasks, the big tables split into page ranges. Run it within the snapshot
+    // transaction the tasks are run in, else tables may change between the plan and the export.
+    int planTasks();
+
+    // Export the planned tasks on the workers within one snapshot
+    int exportAll();
+
+    // Run the planned tasks through *taskRunner* instead: the workers import the snapshot of the transaction open on
+    // the connection (it is left open), else of one of its own
+    int runTasks(const ExportTaskRunner &taskRunner);
+
+    std::size_t getTablesCount() const;
+
+    std::size_t getTasksCount() const;
+
+    std::size_t getStolenTasksCount() const;
+};
@@ -0,0 +1,440 @@
+#include "FormatWriter.h"
+#include "../Json/Json.h"
+#include "../DisplayWidth/DisplayWidth.h"
+#include <algorithm>
+#include <cstring>
+
+
+// Rendered rows are handed to the stream in pieces of about this size
+#define RENDER_CHUNK_BYTES (4 * 1024 * 1024)
+#define CSV_SEPARATOR ','
+#define CSV_QUOTE '"'
+#define CSV_LINE_END "\r\n"
+#define TSV_SEPARATOR '\t'
+#define TSV_NULL_VALUE "\\N"
+#define BOOL_OID 16
+#define INT8_OID 20
+#define INT2_OID 21
+#define INT4_OID 23
+#define OID_OID 26
+#define JSON_OID 114
+#define FLOAT4_OID 700
+#define FLOAT8_OID 701
+#define NUMERIC_OID 1700
+#define JSONB_OID 3802
+
+
+// Whether a numeric column value is a JSON number (not NaN or Infinity)
+bool isJsonNumber(const char *value, std::size_t length);
+
+
+FormatWriter::FormatWriter(const PGresult *queryResult) {
+    for (int i = 0; i < PQnfields(queryResult); ++i) {
+        columnNames.emplace_back(PQfname(queryResult, i));
+        columnTypes.push_back(PQftype(queryResult, i));
+    }
+}
+
+bool FormatWriter::needsWidths(const ExportFormat format) {
+    return format == ExportFormat::TEXT_TABLE || format == ExportFormat::FIXED_WIDTH;
+}
+
+const char *FormatWriter::formatName(const ExportFormat format) {
+    switch (format) {
+        case ExportFormat::TEXT_TABLE:
+            return "TEXT TABLE";
+        case ExportFormat::CSV:
+            return "CSV";
+        case ExportFormat::TSV:
+            return "TSV";
+        case ExportFormat::JSON_LINES:
+            return "JSON LINES";
+        case ExportFormat::FIXED_WIDTH:
+            return "FIXED WIDTH";
+        case ExportFormat::COLUMNAR:
+            return "COLUMNAR";
+    }
+
+    return "UNKNOWN";
+}
+
+std::unique_ptr<FormatWriter> FormatWriter::create(const ExportFormat format, const PGresult *queryResult) {
+    switch (format) {
+        case ExportFormat::CSV:
+            return std::make_unique<CsvWriter>(queryResult);
+        case ExportFormat::TSV:
+            return std::make_unique<TsvWriter>(queryResult);
+        case ExportFormat::JSON_LINES:
+            return std::make_unique<JsonLinesWriter>(queryResult);
+        case ExportFormat::FIXED_WIDTH:
+            return std::make_unique<FixedWidthWriter>(queryResult);
+        case ExportFormat::TEXT_TABLE:
+        case ExportFormat::COLUMNAR:
+            break;
+    }
+
+    return std::make_unique<TableWriter>(queryResult);
+}
+
+void FormatWriter::flushRenderBuffer(std::ostream &stream, const std::size_t minimumSize) {
+    if (renderBuffer.length() < minimumSize || renderBuffer.empty())
+        return;
+
+    stream.write(renderBuffer.data(), static_cast<std::streamsize>(renderBuffer.length()));
+    renderBuffer.clear();
+}
+
+void FormatWriter::appendRow(const PGresult *queryResult, const int row) {
+    const int columnsCount = PQnfields(queryResult);
+
+    rowValues.resize(columnsCount);
+    rowLengths.resize(columnsCount);
+    rowNulls.resize(columnsCount);
+
+    for (int j = 0; j < columnsCount; ++j) {
+        rowValues[j] = PQgetvalue(queryResult, row, j);
+        rowLengths[j] = PQgetlength(queryResult, row, j);
+        rowNulls[j] = PQgetisnull(queryResult, row, j);
+    }
+
+    appendValues(rowValues.data(), rowLengths.data(), rowNulls.data());
+}
+
+void FormatWriter::observe(const PGresult *) {
+}
+
+void FormatWriter::observe(const CopyBatch &) {
+}
+
+std::vector<std::string::size_type> FormatWriter::getColumnWidths() const {
+    return {};
+}
+
+void FormatWriter::widen(const std::vector<std::string::size_type> &) {
+}
+
+bool FormatWriter::fits(const PGresult *) const {
+    return true;
+}
+
+void FormatWriter::writeRows(std::ostream &stream, const PGresult *queryResult) {
+    for (int i = 0; i < PQntuples(queryResult); ++i) {
+        appendRow(queryResult, i);
+        flushRenderBuffer(stream, RENDER_CHUNK_BYTES);
+    }
+
+    flushRenderBuffer(stream);
+}
+
+void FormatWriter::writeRows(std::ostream &stream, const CopyBatch &batch) {
+    for (std::size_t i = 0; i < batch.rowsCount; ++i) {
+        appendValues(batch.rowValues(i), batch.rowLengths(i), batch.rowNulls(i));
+        flushRenderBuffer(stream, RENDER_CHUNK_BYTES);
+    }
+
+    flushRenderBuffer(stream);
+}
+
+void FormatWriter::writeSelectedRows(std::ostream &stream, const PGresult *queryResult,
+                                     const std::span<const int> rows) {
+    for (const int row: rows) {
+        appendRow(queryResult, row);
+        flushRenderBuffer(stream, RENDER_CHUNK_BYTES);
+    }
+
+    flushRenderBuffer(stream);
+}
+
+void FormatWriter::writeTail(std::ostream &) {
+}
+
+
+TableWriter::TableWriter(const PGresult *queryResult): FormatWriter(queryResult), tableRenderer(queryResult) {
+}
+
+std::unique_ptr<FormatWriter> TableWriter::clone() const {
+    return std::make_unique<TableWriter>(*this);
+}
+
+void TableWriter::appendValues(const char *const *values, const int *lengths, const int *) {
+    const std::size_t rowOffset = renderBuffer.length();
+
+    renderBuffer.resize(rowOffset + tableRenderer.renderedSize(values, lengths));
+    tableRenderer.renderRow(values, lengths, renderBuffer.data() + rowOffset);
+}
+
+void TableWriter::observe(const PGresult *queryResult) {
+    tableRenderer.observe(queryResult);
+}
+
+void TableWriter::observe(const CopyBatch &batch) {
+    tableRenderer.observe(batch.values.data(), batch.lengths.data(), batch.rowsCount);
+}
+
+std::vector<std::string::size_type> TableWriter::getColumnWidths() const {
+    return tableRenderer.getColumnWidths();
+}
+
+void TableWriter::widen(const std::vector<std::string::size_type> &valueWidths) {
+    tableRenderer.widen(valueWidths);
+}
+
+bool TableWriter::fits(const PGresult *queryResult) const {
+    return tableRenderer.fits(queryResult);
+}
+
+void TableWriter::writeHead(std::ostream &stream) {
+    tableRenderer.writeHead(stream);
+}
+
+void TableWriter::writeRows(std::ostream &stream, const PGresult *queryResult) {
+    tableRenderer.writeRows(stream, queryResult);
+}
+
+void TableWriter::writeTail(std::ostream &stream) {
+    tableRenderer.writeTail(stream);
+}
+
+
+CsvWriter::CsvWriter(const PGresult *queryResult): FormatWriter(queryResult) {
+}
+
+std::unique_ptr<FormatWriter> CsvWriter::clone() const {
+    return std::make_unique<CsvWriter>(*this);
+}
+
+void CsvWriter::appendField(const char *value, const std::size_t length, const bool isNull) {
+    if (isNull) /* NULL is an empty unquoted field, an empty str is "" (like COPY ... CSV) */
+        return;
+
+    bool isQuoted = length == 0;
+
+    for (std::size_t i = 0; i < length && !isQuoted; ++i)
+        isQuoted = value[i] == CSV_SEPARATOR || value[i] == CSV_QUOTE || value[i] == '\n' || value[i] == '\r';
+
+    if (!isQuoted) {
+        renderBuffer.append(value, length);
+        return;
+    }
+
+    renderBuffer.push_back(CSV_QUOTE);
+
+    // Quotes inside the field are doubled
+    const char *runStart = value;
+    for (const char *quote; (quote = static_cast<const char *>(
+                                 std::memchr(runStart, CSV_QUOTE, value + length - runStart))) != nullptr;) {
+        renderBuffer.append(runStart, quote - runStart + 1).push_back(CSV_QUOTE);
+        runStart = quote + 1;
+    }
+
+    renderBuffer.append(runStart, value + length - runStart).push_back(CSV_QUOTE);
+}
+
+void CsvWriter::writeHead(std::ostream &stream) {
+    for (std::size_t j = 0; j < columnNames.size(); ++j) {
+        if (j > 0)
+            renderBuffer.push_back(CSV_SEPARATOR);
+        appendField(columnNames[j].data(), columnNames[j].length(), false);
+    }
+    renderBuffer += CSV_LINE_END;
+
+    flushRenderBuffer(stream);
+}
+
+void CsvWriter::appendValues(const char *const *values, const int *lengths, const int *nulls) {
+    for (std::size_t j = 0; j < columnNames.size(); ++j) {
+        if (j > 0)
+            renderBuffer.push_back(CSV_SEPARATOR);
+        appendField(values[j], lengths[j], nulls[j]);
+    }
+    renderBuffer += CSV_LINE_END;
+}
+
+
+TsvWriter::TsvWriter(const PGresult *queryResult): FormatWriter(queryResult) {
+}
+
+std::unique_ptr<FormatWriter> TsvWriter::clone() const {
+    return std::make_unique<TsvWriter>(*this);
+}
+
+void TsvWriter::appendField(const char *value, const std::size_t length) {
+    std::size_t plainStart = 0;
+
+    for (std::size_t i = 0; i < length; ++i) {
+        const char ch = value[i];
+
+        if (ch != '\\' && ch != TSV_SEPARATOR && ch != '\n' && ch != '\r')
+            continue;
+
+        renderBuffer.append(value + plainStart, i - plainStart);
+        plainStart = i + 1;
+
+        renderBuffer.push_back('\\');
+        renderBuffer.push_back(ch == TSV_SEPARATOR ? 't' : ch == '\n' ? 'n' : ch == '\r' ? 'r' : '\\');
+    }
+
+    renderBuffer.append(value + plainStart, length - plainStart);
+}
+
+void TsvWriter::writeHead(std::ostream &stream) {
+    for (std::size_t j = 0; j < columnNames.size(); ++j) {
+        if (j > 0)
+            renderBuffer.push_back(TSV_SEPARATOR);
+        appendField(columnNames[j].data(), columnNames[j].length());
+    }
+    renderBuffer.push_back('\n');
+
+    flushRenderBuffer(stream);
+}
+
+void TsvWriter::appendValues(const char *const *values, const int *lengths, const int *nulls) {
+    for (std::size_t j = 0; j < columnNames.size(); ++j) {
+        if (j > 0)
+            renderBuffer.push_back(TSV_SEPARATOR);
+
+        if (nulls[j])
+            renderBuffer += TSV_NULL_VALUE;
+        else
+            appendField(values[j], lengths[j]);
+    }
+    renderBuffer.push_back('\n');
+}
+
+
+JsonLinesWriter::JsonLinesWriter(const PGresult *queryResult): FormatWriter(queryResult) {
+    for (const std::string &columnName: columnNames) {
+        std::string memberPrefix;
+        JsonValue::appendQuoted(memberPrefix, columnName.data(), columnName.length());
+        memberPrefixes.push_back(memberPrefix + ':');
+    }
+}
+
+std::unique_ptr<FormatWriter> JsonLinesWriter::clone() const {
+    return std::make_unique<JsonLinesWriter>(*this);
+}
+
+void JsonLinesWriter::writeHead(std::ostream &) {
+}
+
+void JsonLinesWriter::appendValues(const char *const *values, const int *lengths, const int *nulls) {
+    renderBuffer.push_back('{');
+
+    for (std::size_t j = 0; j < columnNames.size(); ++j) {
+        if (j > 0)
+            renderBuffer.push_back(',');
+        renderBuffer += memberPrefixes[j];
+
+        const char *value = values[j];
+        const std::size_t length = lengths[j];
+
+        if (nulls[j]) {
+            renderBuffer += "null";
+            continue;
+        }
+
+        switch (columnTypes[j]) {
+            case BOOL_OID:
+                renderBuffer += length > 0 && value[0] == 't' ? "true" : "false";
+                break;
+            case JSON_OID:
+            case JSONB_OID:
+                renderBuffer.append(value, length);
+                break;
+            case INT2_OID:
+            case INT4_OID:
+            case INT8_OID:
+            case OID_OID:
+            case FLOAT4_OID:
+            case FLOAT8_OID:
+            case NUMERIC_OID:
+                if (isJsonNumber(value, length)) {
+                    renderBuffer.append(value, length);
+                    break;
+                }
+                [[fallthrough]];
+            default:
+                JsonValue::appendQuoted(renderBuffer, value, length);
+        }
+    }
+
+    renderBuffer += "}\n";
+}
+
+
+FixedWidthWriter::FixedWidthWriter(const PGresult *queryResult): FormatWriter(queryResult) {
+    for (const std::string &columnName: columnNames)
+        columnWidths.push_back(displayWidth(columnName));
+}
+
+std::unique_ptr<FormatWriter> FixedWidthWriter::clone() const {
+    return std::make_unique<FixedWidthWriter>(*this);
+}
+
+void FixedWidthWriter::observe(const PGresult *queryResult) {
+    for (int i = 0; i < PQntuples(queryResult); ++i) {
+        for (int j = 0; j < PQnfields(queryResult); ++j) {
+            columnWidths[j] = std::max(columnWidths[j],
+                                       displayWidth(PQgetvalue(queryResult, i, j), PQgetlength(queryResult, i, j)));
+        }
+    }
+}
+
+void FixedWidthWriter::observe(const CopyBatch &batch) {
+    for (std::size_t i = 0; i < batch.rowsCount; ++i) {
+        const char *const *values = batch.rowValues(i);
+        const int *lengths = batch.rowLengths(i);
+
+        for (std::size_t j = 0; j < columnWidths.size(); ++j)
+            columnWidths[j] = std::max(columnWidths[j], displayWidth(values[j], lengths[j]));
+    }
+}
+
+std::vector<std::string::size_type> FixedWidthWriter::getColumnWidths() const {
+    return columnWidths;
+}
+
+void FixedWidthWriter::widen(const std::vector<std::string::size_type> &valueWidths) {
+    for (std::size_t j = 0; j < columnWidths.size() && j < valueWidths.size(); ++j)
+        columnWidths[j] = std::max(columnWidths[j], valueWidths[j]);
+}
+
+bool FixedWidthWriter::fits(const PGresult *queryResult) const {
+    for (int i = 0; i < PQntuples(queryResult); ++i) {
+        for (int j = 0; j < PQnfields(queryResult); ++j) {
+            if (displayWidth(PQgetvalue(queryResult, i, j), PQgetlength(queryResult, i, j)) > columnWidths[j])
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void FixedWidthWriter::appendField(const char *value, const std::size_t length, const std::size_t column) {
+    if (column > 0)
+        renderBuffer.push_back(' ');
+
+    renderBuffer.append(value, length).append(columnWidths[column] - displayWidth(value, length), ' ');
+}
+
+void FixedWidthWriter::writeHead(std::ostream &stream) {
+    for (std::size_t j = 0; j < columnNames.size(); ++j)
+        appendField(columnNames[j].data(), columnNames[j].length(), j);
+    renderBuffer.push_back('\n');
+
+    flushRenderBuffer(stream);
+}
+
+void FixedWidthWriter::appendValues(const char *const *values, const int *lengths, const int *) {
+    for (std::size_t j = 0; j < columnNames.size(); ++j)
+        appendField(values[j], lengths[j], j);
+    renderBuffer.push_back('\n');
+}
+
+
+bool isJsonNumber(const char *value, const std::size_t length) {
+    const std::size_t digitPosition = length > 0 && value[0] == '-' ? 1 : 0;
+
+    // NaN, Infinity and -Infinity are no JSON numbers
+    return digitPosition < length && value[digitPosition] >= '0' && value[digitPosition] <= '9';
+}
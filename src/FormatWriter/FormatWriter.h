@@ -0,0 +1,191 @@
+#pragma once
+#include "../TableRenderer/TableRenderer.h"
+#include "../CopyDecoder/CopyDecoder.h"
+#include <libpq-fe.h>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+
+// Layout of exported SELECT results
+enum class ExportFormat {
+    TEXT_TABLE, // The padded text table with borders and in between lines
+    CSV, // RFC 4180: comma separated, quoted when needed, CRLF line ends
+    TSV, // Tab separated, PostgreSQL text escapes (\t \n \r \\), NULL as \N
+    JSON_LINES, // One JSON object per row, numbers, booleans and json columns unquoted
+    FIXED_WIDTH, // Columns padded to their widths and separated by a space, no borders (NULL is blank)
+    COLUMNAR // Binary file of typed column arrays (ColumnarFile), not written by a FormatWriter
+};
+
+
+// Writes streamed results (batch after batch, all with the same columns) in one export format.
+// Rows are rendered into one reused buffer, handed to the stream in large writes. The rows come from PGresults
+// or from decoded COPY text (CopyBatch), both rendered from the same value and length arrays.
+class FormatWriter {
+protected:
+    std::vector<std::string> columnNames;
+    std::vector<Oid> columnTypes;
+    std::string renderBuffer;
+
+    // Cells of the result row being rendered
+    std::vector<const char *> rowValues;
+    std::vector<int> rowLengths;
+    std::vector<int> rowNulls;
+
+    explicit FormatWriter(const PGresult *queryResult);
+
+    // Hand the rendered bytes to the stream once there are at least *minimumSize* of them
+    void flushRenderBuffer(std::ostream &stream, std::size_t minimumSize = 0);
+
+    // Render one row of the result into the render buffer
+    void appendRow(const PGresult *queryResult, int row);
+
+    // Render one row given as its cells (one value, length and NULL flag per column)
+    virtual void appendValues(const char *const *values, const int *lengths, const int *nulls) = 0;
+
+public:
+    virtual ~FormatWriter() = default;
+
+    // Formats padding their columns have to observe every row before the first one is written
+    static bool needsWidths(ExportFormat format);
+
+    static const char *formatName(ExportFormat format);
+
+    // Writer of *format* for the columns of *queryResult*
+    static std::unique_ptr<FormatWriter> create(ExportFormat format, const PGresult *queryResult);
+
+    // Writer of the same format and widths, e.g. one per output file of an export split in several
+    virtual std::unique_ptr<FormatWriter> clone() const = 0;
+
+    // Widen the columns to fit the rows of a (partial) result, only used by the padded formats
+    virtual void observe(const PGresult *queryResult);
+
+    virtual void observe(const CopyBatch &batch);
+
+    // Column widths of the padded formats (none for the others), an export can be continued with them later
+    virtual std::vector<std::string::size_type> getColumnWidths() const;
+
+    virtual void widen(const std::vector<std::string::size_type> &valueWidths);
+
+    // Whether every value of the result fits the widths as they are (always without padding)
+    virtual bool fits(const PGresult *queryResult) const;
+
+    virtual void writeHead(std::ostream &stream) = 0;
+
+    virtual void writeRows(std::ostream &stream, const PGresult *queryResult);
+
+    void writeRows(std::ostream &stream, const CopyBatch &batch);
+
+    // Write only the given rows of the result, in the given order
+    void writeSelectedRows(std::ostream &stream, const PGresult *queryResult, std::span<const int> rows);
+
+    virtual void writeTail(std::ostream &stream);
+};
+
+
+class TableWriter : public FormatWriter {
+    TableRenderer tableRenderer;
+
+protected:
+    void appendValues(const char *const *values, const int *lengths, const int *nulls) override;
+
+public:
+    explicit TableWriter(const PGresult *queryResult);
+
+    std::unique_ptr<FormatWriter> clone() const override;
+
+    void observe(const PGresult *queryResult) override;
+
+    void observe(const CopyBatch &batch) override;
+
+    std::vector<std::string::size_type> getColumnWidths() const override;
+
+    void widen(const std::vector<std::string::size_type> &valueWidths) override;
+
+    bool fits(const PGresult *queryResult) const override;
+
+    void writeHead(std::ostream &stream) override;
+
+    using FormatWriter::writeRows;
+
+    void writeRows(std::ostream &stream, const PGresult *queryResult) override;
+
+    void writeTail(std::ostream &stream) override;
+};
+
+
+class CsvWriter : public FormatWriter {
+    // Append a field, quoted when it holds a comma, a quote or a line break (or is an empty non-NULL value)
+    void appendField(const char *value, std::size_t length, bool isNull);
+
+protected:
+    void appendValues(const char *const *values, const int *lengths, const int *nulls) override;
+
+public:
+    explicit CsvWriter(const PGresult *queryResult);
+
+    std::unique_ptr<FormatWriter> clone() const override;
+
+    void writeHead(std::ostream &stream) override;
+};
+
+
+class TsvWriter : public FormatWriter {
+    void appendField(const char *value, std::size_t length);
+
+protected:
+    void appendValues(const char *const *values, const int *lengths, const int *nulls) override;
+
+public:
+    explicit TsvWriter(const PGresult *queryResult);
+
+    std::unique_ptr<FormatWriter> clone() const override;
+
+    void writeHead(std::ostream &stream) override;
+};
+
+
+class JsonLinesWriter : public FormatWriter {
+    // Quoted member names with their colons ("name":), built once
+    std::vector<std::string> memberPrefixes;
+
+protected:
+    void appendValues(const char *const *values, const int *lengths, const int *nulls) override;
+
+public:
+    explicit JsonLinesWriter(const PGresult *queryResult);
+
+    std::unique_ptr<FormatWriter> clone() const override;
+
+    void writeHead(std::ostream &stream) override;
+};
+
+
+class FixedWidthWriter : public FormatWriter {
+    std::vector<std::string::size_type> columnWidths;
+
+    // Append a value padded to the width of its column, a space separates it from the next one
+    void appendField(const char *value, std::size_t length, std::size_t column);
+
+protected:
+    void appendValues(const char *const *values, const int *lengths, const int *nulls) override;
+
+public:
+    explicit FixedWidthWriter(const PGresult *queryResult);
+
+    std::unique_ptr<FormatWriter> clone() const override;
+
+    void observe(const PGresult *queryResult) override;
+
+    void observe(const CopyBatch &batch) override;
+
+    std::vector<std::string::size_type> getColumnWidths() const override;
+
+    void widen(const std::vector<std::string::size_type> &valueWidths) override;
+
+    bool fits(const PGresult *queryResult) const override;
+
+    void writeHead(std::ostream &stream) override;
+};
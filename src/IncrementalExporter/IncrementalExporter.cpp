@@ -0,0 +1,486 @@
+#include "IncrementalExporter.h"
+#include "../ByteOrder/ByteOrder.h"
+#include "../Checkpoint/Checkpoint.h"
+#include "../DbConnection/DbConnection.h"
+#include "../ExecutionPlanner/ExecutionPlanner.h"
+#include "../QueryStream/QueryStream.h"
+#include "../TableRenderer/TableRenderer.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+
+
+#define INCREMENTAL_BATCH_SIZE 10000
+#define INDEX_FILE_EXTENSION std::string(".index")
+#define INDEX_MAGIC std::string("PGINCIX1")
+// Numbers of the index are little-endian 64 bit
+#define INDEX_NUMBER_SIZE 8
+// Transaction ids are 32 bit on the rows, the snapshot xmin carries the wraparound epoch above them
+#define XID_EPOCH_SHIFT 32
+
+
+// Append a length prefixed string to the index data
+void appendIndexString(std::string &indexData, const std::string &value);
+
+// Read a number / what appendIndexString wrote at *position*, false when the data ends before it
+bool readIndexNumber(const std::string &indexData, std::size_t &position, std::uint64_t &value);
+
+bool readIndexString(const std::string &indexData, std::size_t &position, std::string &value);
+
+// Positions of the key columns in a result, false when one is missing
+bool findKeyColumns(const PGresult *queryResult, const std::vector<std::string> &keyColumnNames,
+                    std::vector<int> &keyColumns);
+
+
+IncrementalExporter::IncrementalExporter(PGconn *connection, std::string tableName, std::string outputFilePath,
+                                         std::string watermarkColumn)
+    : connection(connection),
+      tableName(std::move(tableName)),
+      outputFilePath(std::move(outputFilePath)),
+      watermarkColumn(std::move(watermarkColumn)) {
+    indexFilePath = this->outputFilePath + INDEX_FILE_EXTENSION;
+}
+
+int IncrementalExporter::refresh() {
+    patchedRowsCount = 0;
+    appendedRowsCount = 0;
+    isFullExport = false;
+
+    // The watermark, the changed rows and the row count all come from the same snapshot
+    const bool isOwnTransaction = PQtransactionStatus(connection) == PQTRANS_IDLE;
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, SNAPSHOT_TRANSACTION));
+
+    std::string currentWatermark;
+    int refreshStatus = readKeyColumns();
+
+    if (refreshStatus == 0)
+        refreshStatus = readWatermark(currentWatermark);
+
+    bool isFullNeeded = true;
+
+    // Without a primary key the rows cannot be found again, every refresh renders everything
+    if (refreshStatus == 0 && !keyColumnNames.empty() && readIndex() == 0)
+        refreshStatus = refreshInPlace(currentWatermark, isFullNeeded);
+
+    if (refreshStatus == 0 && isFullNeeded) {
+        isFullExport = true;
+        refreshStatus = exportFull();
+    }
+
+    if (refreshStatus == 0) {
+        watermark = currentWatermark;
+
+        if (keyColumnNames.empty())
+            std::remove(indexFilePath.c_str());
+        else
+            refreshStatus = writeIndex();
+    }
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, refreshStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    return refreshStatus;
+}
+
+int IncrementalExporter::readKeyColumns() {
+    keyColumnNames.clear();
+    return ExecutionPlanner::readPrimaryKey(connection, tableName, keyColumnNames);
+}
+
+int IncrementalExporter::readWatermark(std::string &currentWatermark) const {
+    std::string watermarkQuery = "SELECT txid_snapshot_xmin(txid_current_snapshot());";
+
+    if (!watermarkColumn.empty()) {
+        char *columnIdentifier = PQescapeIdentifier(connection, watermarkColumn.c_str(), watermarkColumn.length());
+        watermarkQuery = std::string("SELECT max(") + columnIdentifier + std::string(")::text FROM ") + tableName +
+                         std::string(";");
+        PQfreemem(columnIdentifier);
+    }
+
+    PGresult *watermarkResult = PQexec(connection, watermarkQuery.c_str());
+
+    if (PQresultStatus(watermarkResult) != PGRES_TUPLES_OK || PQntuples(watermarkResult) != 1) {
+        std::cerr << "INCREMENTAL EXPORT failed: " << PQerrorMessage(connection) << std::endl;
+        PQclear(watermarkResult);
+        return 1;
+    }
+
+    // An empty table has no watermark yet (NULL), the next refresh then fetches every row
+    currentWatermark = PQgetvalue(watermarkResult, 0, 0);
+    PQclear(watermarkResult);
+    return 0;
+}
+
+std::string IncrementalExporter::changedRowsQuery() const {
+    const std::string selectQuery = std::string("SELECT * FROM ") + tableName;
+
+    if (watermark.empty())
+        return selectQuery;
+
+    if (watermarkColumn.empty()) {
+        const std::uint64_t watermarkXid = std::stoull(watermark) & 0xFFFFFFFFULL;
+        return selectQuery + std::string(" WHERE xmin::text::bigint >= ") + std::to_string(watermarkXid);
+    }
+
+    char *columnIdentifier = PQescapeIdentifier(connection, watermarkColumn.c_str(), watermarkColumn.length());
+    char *watermarkLiteral = PQescapeLiteral(connection, watermark.c_str(), watermark.length());
+
+    const std::string changedQuery =
+            selectQuery + std::string(" WHERE ") + columnIdentifier + std::string(" >= ") + watermarkLiteral;
+
+    PQfreemem(columnIdentifier);
+    PQfreemem(watermarkLiteral);
+    return changedQuery;
+}
+
+std::string IncrementalExporter::rowKey(const PGresult *queryResult, const int row,
+                                        const std::vector<int> &keyColumns) const {
+    std::string key;
+
+    // Length prefixed values, so no value can pass for two
+    for (const int keyColumn: keyColumns) {
+        key += std::to_string(PQgetlength(queryResult, row, keyColumn));
+        key += ':';
+        key.append(PQgetvalue(queryResult, row, keyColumn), PQgetlength(queryResult, row, keyColumn));
+    }
+
+    return key;
+}
+
+int IncrementalExporter::refreshInPlace(const std::string &currentWatermark, bool &isFullNeeded) {
+    isFullNeeded = true;
+
+    // The xmin of the rows wrapped around since the last export, it no longer orders them
+    if (watermarkColumn.empty() && !watermark.empty() &&
+        std::stoull(watermark) >> XID_EPOCH_SHIFT != std::stoull(currentWatermark) >> XID_EPOCH_SHIFT)
+        return 0;
+
+    std::optional<TableRenderer> tableRenderer;
+    std::vector<int> keyColumns;
+    std::unordered_map<std::string, RowSlot> newRowSlots;
+    std::vector<RowPatch> rowPatches;
+    std::uint64_t appendOffset = tailOffset;
+    std::uint64_t patchesSize = 0;
+    std::size_t changedRowsCount = 0;
+    bool isPatchable = true;
+
+    const int streamStatus = QueryStream::streamCursor(
+        connection, changedRowsQuery(), INCREMENTAL_BATCH_SIZE, [&](const PGresult *batch) {
+            if (!tableRenderer) {
+                tableRenderer.emplace(batch);
+                tableRenderer->widen(columnWidths);
+
+                bool isSameColumns = PQnfields(batch) == static_cast<int>(columnNames.size()) &&
+                                     findKeyColumns(batch, keyColumnNames, keyColumns);
+
+                for (int j = 0; isSameColumns && j < PQnfields(batch); ++j)
+                    isSameColumns = columnNames[j] == PQfname(batch, j);
+
+                if (!isSameColumns) {
+                    isPatchable = false;
+                    return 1;
+                }
+            }
+
+            // A wider column moves every row
+            if (!tableRenderer->fits(batch)) {
+                isPatchable = false;
+                return 1;
+            }
+
+            for (int i = 0; i < PQntuples(batch); ++i) {
+                RowPatch rowPatch{0, std::string(tableRenderer->renderedSize(batch, i, i + 1), '\0')};
+                tableRenderer->renderRows(batch, i, i + 1, rowPatch.renderedRow.data());
+
+                const std::string key = rowKey(batch, i, keyColumns);
+                const auto rowSize = static_cast<std::uint32_t>(rowPatch.renderedRow.length());
+
+                if (const auto rowSlot = rowSlots.find(key); rowSlot != rowSlots.end()) {
+                    // Multi-byte characters can change the size of the row, it no longer fits its slot
+                    if (rowSlot->second.size != rowSize) {
+                        isPatchable = false;
+                        return 1;
+                    }
+
+                    rowPatch.offset = rowSlot->second.offset;
+                } else {
+                    rowPatch.offset = appendOffset;
+                    newRowSlots[key] = {appendOffset, rowSize};
+                    appendOffset += rowSize;
+                }
+
+                patchesSize += rowSize;
+                ++changedRowsCount;
+                rowPatches.push_back(std::move(rowPatch));
+            }
+
+            // Past half of the table, rendering all of it costs about the same
+            if (patchesSize > tailOffset / 2) {
+                isPatchable = false;
+                return 1;
+            }
+
+            return 0;
+        });
+
+    if (!isPatchable)
+        return 0;
+
+    if (streamStatus != 0)
+        return 1;
+
+    // Deleted rows leave no trace past the watermark, only in the row count
+    const std::string countQuery = std::string("SELECT count(*) FROM ") + tableName + std::string(";");
+    PGresult *countResult = PQexec(connection, countQuery.c_str());
+
+    if (PQresultStatus(countResult) != PGRES_TUPLES_OK) {
+        std::cerr << "INCREMENTAL EXPORT failed: " << PQerrorMessage(connection) << std::endl;
+        PQclear(countResult);
+        return 1;
+    }
+
+    const std::uint64_t rowsCount = std::stoull(PQgetvalue(countResult, 0, 0));
+    PQclear(countResult);
+
+    if (rowsCount != rowSlots.size() + newRowSlots.size())
+        return 0;
+
+    std::fstream outputStream{outputFilePath, std::ios::in | std::ios::out | std::ios::binary};
+
+    for (const RowPatch &rowPatch: rowPatches) {
+        outputStream.seekp(static_cast<std::streamoff>(rowPatch.offset));
+        outputStream.write(rowPatch.renderedRow.data(), static_cast<std::streamsize>(rowPatch.renderedRow.length()));
+    }
+
+    // The new rows took the place of the tail, it goes after them
+    outputStream.seekp(static_cast<std::streamoff>(appendOffset));
+    tableRenderer->writeTail(outputStream);
+    outputStream.close();
+
+    if (!outputStream) {
+        std::cerr << "INCREMENTAL EXPORT failed: Cannot write " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    appendedRowsCount = newRowSlots.size();
+    patchedRowsCount = changedRowsCount - appendedRowsCount;
+
+    rowSlots.merge(newRowSlots);
+    tailOffset = appendOffset;
+    isFullNeeded = false;
+    return 0;
+}
+
+int IncrementalExporter::exportFull() {
+    const std::string selectQuery = std::string("SELECT * FROM ") + tableName;
+    std::optional<TableRenderer> tableRenderer;
+    std::vector<int> keyColumns;
+
+    // Pass one: the column widths
+    int exportStatus = QueryStream::streamCursor(connection, selectQuery, INCREMENTAL_BATCH_SIZE,
+                                                 [&](const PGresult *batch) {
+                                                     if (!tableRenderer) {
+                                                         tableRenderer.emplace(batch);
+
+                                                         columnNames.clear();
+                                                         for (int j = 0; j < PQnfields(batch); ++j)
+                                                             columnNames.emplace_back(PQfname(batch, j));
+                                                     }
+
+                                                     tableRenderer->observe(batch);
+                                                     return 0;
+                                                 });
+
+    if (exportStatus != 0)
+        return 1;
+
+    std::ofstream outputStream{outputFilePath, std::ios::binary};
+    tableRenderer->writeHead(outputStream);
+
+    std::uint64_t rowOffset = tableRenderer->headSize();
+    std::vector<char> renderBuffer;
+    rowSlots.clear();
+
+    // Pass two: the rows, each with its place in the output
+    exportStatus = QueryStream::streamCursor(
+        connection, selectQuery, INCREMENTAL_BATCH_SIZE, [&](const PGresult *batch) {
+            if (!keyColumnNames.empty() && keyColumns.empty() && !findKeyColumns(batch, keyColumnNames, keyColumns))
+                return 1;
+
+            renderBuffer.resize(tableRenderer->renderedSize(batch, 0, PQntuples(batch)));
+            char *position = renderBuffer.data();
+
+            for (int i = 0; i < PQntuples(batch); ++i) {
+                char *rowEnd = tableRenderer->renderRows(batch, i, i + 1, position);
+
+                if (!keyColumns.empty())
+                    rowSlots[rowKey(batch, i, keyColumns)] = {
+                        rowOffset + (position - renderBuffer.data()), static_cast<std::uint32_t>(rowEnd - position)
+                    };
+
+                position = rowEnd;
+            }
+
+            outputStream.write(renderBuffer.data(), static_cast<std::streamsize>(renderBuffer.size()));
+            rowOffset += renderBuffer.size();
+            return outputStream ? 0 : 1;
+        });
+
+    tableRenderer->writeTail(outputStream);
+    outputStream.close();
+
+    if (exportStatus != 0 || !outputStream) {
+        std::cerr << "INCREMENTAL EXPORT failed: Cannot write " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    columnWidths = tableRenderer->getColumnWidths();
+    tailOffset = rowOffset;
+    return 0;
+}
+
+int IncrementalExporter::readIndex() {
+    std::ifstream indexStream{indexFilePath, std::ios::binary};
+
+    if (!indexStream)
+        return 1;
+
+    const std::string indexData{std::istreambuf_iterator<char>(indexStream), std::istreambuf_iterator<char>()};
+    std::size_t position = 0;
+
+    std::string indexMagic, indexTableName, indexWatermarkColumn;
+    std::uint64_t columnsCount = 0, rowsCount = 0;
+
+    bool isValid = readIndexString(indexData, position, indexMagic) && indexMagic == INDEX_MAGIC &&
+                   readIndexString(indexData, position, indexTableName) && indexTableName == tableName &&
+                   readIndexString(indexData, position, indexWatermarkColumn) &&
+                   indexWatermarkColumn == watermarkColumn &&
+                   readIndexString(indexData, position, watermark) &&
+                   readIndexNumber(indexData, position, tailOffset) &&
+                   readIndexNumber(indexData, position, columnsCount);
+
+    columnNames.clear();
+    columnWidths.clear();
+    rowSlots.clear();
+
+    for (std::uint64_t j = 0; isValid && j < columnsCount; ++j) {
+        std::string columnName;
+        std::uint64_t columnWidth = 0;
+
+        isValid = readIndexString(indexData, position, columnName) &&
+                  readIndexNumber(indexData, position, columnWidth);
+
+        columnNames.push_back(std::move(columnName));
+        columnWidths.push_back(columnWidth);
+    }
+
+    isValid = isValid && readIndexNumber(indexData, position, rowsCount);
+
+    for (std::uint64_t i = 0; isValid && i < rowsCount; ++i) {
+        std::string key;
+        std::uint64_t offset = 0, size = 0;
+
+        isValid = readIndexString(indexData, position, key) && readIndexNumber(indexData, position, offset) &&
+                  readIndexNumber(indexData, position, size);
+
+        rowSlots[std::move(key)] = {offset, static_cast<std::uint32_t>(size)};
+    }
+
+    // The output has to be the one the index was written for: the rows end where its tail starts
+    std::string::size_type tailSize = 2;
+    for (const auto columnWidth: columnWidths)
+        tailSize += columnWidth + 2;
+
+    std::error_code errorCode;
+    const std::uintmax_t outputSize = std::filesystem::file_size(outputFilePath, errorCode);
+
+    if (!isValid || errorCode || outputSize != tailOffset + tailSize) {
+        std::cout << "The index of " << outputFilePath << " does not match it, rendering it again.\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+int IncrementalExporter::writeIndex() const {
+    std::string indexData;
+    appendIndexString(indexData, INDEX_MAGIC);
+    appendIndexString(indexData, tableName);
+    appendIndexString(indexData, watermarkColumn);
+    appendIndexString(indexData, watermark);
+    appendLittleEndian(indexData, tailOffset, INDEX_NUMBER_SIZE);
+
+    appendLittleEndian(indexData, columnNames.size(), INDEX_NUMBER_SIZE);
+    for (std::size_t j = 0; j < columnNames.size(); ++j) {
+        appendIndexString(indexData, columnNames[j]);
+        appendLittleEndian(indexData, columnWidths[j], INDEX_NUMBER_SIZE);
+    }
+
+    appendLittleEndian(indexData, rowSlots.size(), INDEX_NUMBER_SIZE);
+    for (const auto &[key, rowSlot]: rowSlots) {
+        appendIndexString(indexData, key);
+        appendLittleEndian(indexData, rowSlot.offset, INDEX_NUMBER_SIZE);
+        appendLittleEndian(indexData, rowSlot.size, INDEX_NUMBER_SIZE);
+    }
+
+    return replaceFile(indexFilePath, indexData);
+}
+
+std::size_t IncrementalExporter::getPatchedRowsCount() const {
+    return patchedRowsCount;
+}
+
+std::size_t IncrementalExporter::getAppendedRowsCount() const {
+    return appendedRowsCount;
+}
+
+bool IncrementalExporter::isFullRefresh() const {
+    return isFullExport;
+}
+
+
+void appendIndexString(std::string &indexData, const std::string &value) {
+    appendLittleEndian(indexData, value.length(), INDEX_NUMBER_SIZE);
+    indexData += value;
+}
+
+bool readIndexNumber(const std::string &indexData, std::size_t &position, std::uint64_t &value) {
+    if (indexData.length() - position < INDEX_NUMBER_SIZE)
+        return false;
+
+    value = readLittleEndian(indexData.data() + position, INDEX_NUMBER_SIZE);
+    position += INDEX_NUMBER_SIZE;
+    return true;
+}
+
+bool readIndexString(const std::string &indexData, std::size_t &position, std::string &value) {
+    std::uint64_t length = 0;
+
+    if (!readIndexNumber(indexData, position, length) || indexData.length() - position < length)
+        return false;
+
+    value.assign(indexData, position, length);
+    position += length;
+    return true;
+}
+
+bool findKeyColumns(const PGresult *queryResult, const std::vector<std::string> &keyColumnNames,
+                    std::vector<int> &keyColumns) {
+    keyColumns.clear();
+
+    for (const std::string &keyColumnName: keyColumnNames) {
+        // Quoted, so the name is matched as it is and not folded to lower case
+        const int keyColumn = PQfnumber(queryResult, (std::string("\"") + keyColumnName + std::string("\"")).c_str());
+
+        if (keyColumn < 0)
+            return false;
+
+        keyColumns.push_back(keyColumn);
+    }
+
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <libpq-fe.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// Keeps the rendered SELECT * export of a table up to date between runs. An index file next to the output keeps
+// the watermark of the last run (the snapshot xmin, or the maximum of a watermark column such as updated_at),
+// the column widths and the offset of every row by primary key. A refresh fetches only the rows at or past the
+// watermark, overwrites the slots of the changed ones and appends the new ones before the tail.
+// Everything is rendered again when there is no usable index, a column got wider, rows were deleted
+// (the row count does not add up) or the changed rows are a big part of the table anyway.
+// A watermark column only finds rows whose value was raised by their change.
+class IncrementalExporter {
+    // Place of a rendered row (its line and the in between line after it) in the output
+    struct RowSlot {
+        std::uint64_t offset;
+        std::uint32_t size;
+    };
+
+    // Rendered row waiting for the refresh to be known possible
+    struct RowPatch {
+        std::uint64_t offset;
+        std::string renderedRow;
+    };
+
+    PGconn *connection;
+    std::string tableName;
+    std::string outputFilePath;
+    std::string indexFilePath;
+    std::string watermarkColumn;
+
+    // State of the last export (the index file)
+    std::string watermark;
+    std::vector<std::string> columnNames;
+    std::vector<std::string::size_type> columnWidths;
+    std::unordered_map<std::string, RowSlot> rowSlots;
+    std::uint64_t tailOffset = 0;
+
+    std::vector<std::string> keyColumnNames;
+    std::size_t patchedRowsCount = 0;
+    std::size_t appendedRowsCount = 0;
+    bool isFullExport = false;
+
+    // Primary key columns of the table, none when it has no primary key
+    int readKeyColumns();
+
+    // Watermark of the current snapshot
+    int readWatermark(std::string &currentWatermark) const;
+
+    // SELECT * of the rows changed since the last export
+    std::string changedRowsQuery() const;
+
+    // Key of a result row: its primary key values
+    std::string rowKey(const PGresult *queryResult, int row, const std::vector<int> &keyColumns) const;
+
+    // Patch the output, *isFullNeeded* is set (and nothing written) when it has to be rendered again
+    int refreshInPlace(const std::string &currentWatermark, bool &isFullNeeded);
+
+    // Render the whole table and index every row
+    int exportFull();
+
+    // Read the index of the last export, non-zero when there is none or it does not match the output
+    int readIndex();
+
+    int writeIndex() const;
+
+public:
+    IncrementalExporter(PGconn *connection, std::string tableName, std::string outputFilePath,
+                        std::string watermarkColumn = "");
+
+    // Bring the output up to date with the table (within one snapshot)
+    int refresh();
+
+    std::size_t getPatchedRowsCount() const;
+
+    std::size_t getAppendedRowsCount() const;
+
+    // Whether the last refresh rendered the whole table
+    bool isFullRefresh() const;
+};
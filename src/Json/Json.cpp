@@ -0,0 +1,294 @@
+#include "Json.h"
+#include <cstdlib>
+
+
+// Skip spaces, tabs and new lines
+void skipWhitespace(const std::string &text, std::size_t &position);
+
+// Parse any JSON value starting at *position*
+bool parseValue(const std::string &text, std::size_t &position, JsonValue &result);
+
+// Parse a quoted JSON string starting at *position*
+bool parseString(const std::string &text, std::size_t &position, std::string &result);
+
+// Append a Unicode code point as UTF-8
+void appendUtf8(std::string &buffer, unsigned long codePoint);
+
+
+const JsonValue *JsonValue::get(const std::string &key) const {
+    if (type != Type::OBJECT)
+        return nullptr;
+
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i] == key)
+            return &elements[i];
+    }
+
+    return nullptr;
+}
+
+double JsonValue::getNumber(const std::string &key, const double fallback) const {
+    const JsonValue *member = get(key);
+    return member != nullptr && member->type == Type::NUMBER ? member->number : fallback;
+}
+
+std::string JsonValue::getString(const std::string &key) const {
+    const JsonValue *member = get(key);
+    return member != nullptr && member->type == Type::STRING ? member->string : std::string();
+}
+
+bool JsonValue::parse(const std::string &text, JsonValue &result) {
+    std::size_t position = 0;
+
+    if (!parseValue(text, position, result))
+        return false;
+
+    skipWhitespace(text, position);
+    return position == text.length();
+}
+
+std::string JsonValue::quote(const std::string &value) {
+    std::string quoted;
+    quoted.reserve(value.length() + 2);
+
+    appendQuoted(quoted, value.data(), value.length());
+    return quoted;
+}
+
+void JsonValue::appendQuoted(std::string &destination, const char *value, const std::size_t length) {
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+    destination.push_back('"');
+
+    std::size_t plainStart = 0;
+
+    for (std::size_t i = 0; i < length; ++i) {
+        const char ch = value[i];
+
+        if (ch != '"' && ch != '\\' && static_cast<unsigned char>(ch) >= 0x20)
+            continue;
+
+        // Characters which need no escaping are copied in runs
+        destination.append(value + plainStart, i - plainStart);
+        plainStart = i + 1;
+
+        switch (ch) {
+            case '"': destination += "\\\"";
+                break;
+            case '\\': destination += "\\\\";
+                break;
+            case '\n': destination += "\\n";
+                break;
+            case '\r': destination += "\\r";
+                break;
+            case '\t': destination += "\\t";
+                break;
+            default:
+                destination += "\\u00";
+                destination.push_back(HEX_DIGITS[(ch >> 4) & 0xF]);
+                destination.push_back(HEX_DIGITS[ch & 0xF]);
+        }
+    }
+
+    destination.append(value + plainStart, length - plainStart);
+    destination.push_back('"');
+}
+
+
+void skipWhitespace(const std::string &text, std::size_t &position) {
+    while (position < text.length()
+           && (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' || text[position] == '\r'))
+        ++position;
+}
+
+bool parseValue(const std::string &text, std::size_t &position, JsonValue &result) {
+    skipWhitespace(text, position);
+
+    if (position >= text.length())
+        return false;
+
+    const char ch = text[position];
+
+    if (ch == '{') {
+        result.type = JsonValue::Type::OBJECT;
+        ++position;
+        skipWhitespace(text, position);
+
+        if (position < text.length() && text[position] == '}') {
+            ++position;
+            return true;
+        }
+
+        while (true) {
+            std::string key;
+            JsonValue member;
+
+            skipWhitespace(text, position);
+            if (!parseString(text, position, key))
+                return false;
+
+            skipWhitespace(text, position);
+            if (position >= text.length() || text[position] != ':')
+                return false;
+            ++position;
+
+            if (!parseValue(text, position, member))
+                return false;
+
+            result.keys.push_back(std::move(key));
+            result.elements.push_back(std::move(member));
+
+            skipWhitespace(text, position);
+            if (position >= text.length())
+                return false;
+
+            if (text[position] == ',') {
+                ++position;
+                continue;
+            }
+            if (text[position] == '}') {
+                ++position;
+                return true;
+            }
+            return false;
+        }
+    }
+
+    if (ch == '[') {
+        result.type = JsonValue::Type::ARRAY;
+        ++position;
+        skipWhitespace(text, position);
+
+        if (position < text.length() && text[position] == ']') {
+            ++position;
+            return true;
+        }
+
+        while (true) {
+            JsonValue element;
+
+            if (!parseValue(text, position, element))
+                return false;
+
+            result.elements.push_back(std::move(element));
+
+            skipWhitespace(text, position);
+            if (position >= text.length())
+                return false;
+
+            if (text[position] == ',') {
+                ++position;
+                continue;
+            }
+            if (text[position] == ']') {
+                ++position;
+                return true;
+            }
+            return false;
+        }
+    }
+
+    if (ch == '"') {
+        result.type = JsonValue::Type::STRING;
+        return parseString(text, position, result.string);
+    }
+
+    if (text.compare(position, 4, "true") == 0 || text.compare(position, 5, "false") == 0) {
+        result.type = JsonValue::Type::BOOLEAN;
+        result.boolean = ch == 't';
+        position += result.boolean ? 4 : 5;
+        return true;
+    }
+
+    if (text.compare(position, 4, "null") == 0) {
+        result.type = JsonValue::Type::NUL;
+        position += 4;
+        return true;
+    }
+
+    // Number
+    const char *numberStart = text.c_str() + position;
+    char *numberEnd = nullptr;
+
+    result.type = JsonValue::Type::NUMBER;
+    result.number = std::strtod(numberStart, &numberEnd);
+
+    if (numberEnd == numberStart)
+        return false;
+
+    position += numberEnd - numberStart;
+    return true;
+}
+
+bool parseString(const std::string &text, std::size_t &position, std::string &result) {
+    if (position >= text.length() || text[position] != '"')
+        return false;
+    ++position;
+
+    while (position < text.length()) {
+        const char ch = text[position++];
+
+        if (ch == '"')
+            return true;
+
+        if (ch != '\\') {
+            result.push_back(ch);
+            continue;
+        }
+
+        if (position >= text.length())
+            return false;
+
+        switch (const char escaped = text[position++]) {
+            case 'b': result.push_back('\b');
+                break;
+            case 'f': result.push_back('\f');
+                break;
+            case 'n': result.push_back('\n');
+                break;
+            case 'r': result.push_back('\r');
+                break;
+            case 't': result.push_back('\t');
+                break;
+            case 'u': {
+                if (position + 4 > text.length())
+                    return false;
+
+                unsigned long codePoint = std::strtoul(text.substr(position, 4).c_str(), nullptr, 16);
+                position += 4;
+
+                // Surrogate pair
+                if (codePoint >= 0xD800 && codePoint <= 0xDBFF && position + 6 <= text.length()
+                    && text[position] == '\\' && text[position + 1] == 'u') {
+                    const unsigned long lowSurrogate = std::strtoul(text.substr(position + 2, 4).c_str(), nullptr, 16);
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (lowSurrogate - 0xDC00);
+                    position += 6;
+                }
+
+                appendUtf8(result, codePoint);
+                break;
+            }
+            default: result.push_back(escaped);
+        }
+    }
+
+    return false;
+}
+
+void appendUtf8(std::string &buffer, const unsigned long codePoint) {
+    if (codePoint < 0x80) {
+        buffer.push_back(static_cast<char>(codePoint));
+    } else if (codePoint < 0x800) {
+        buffer.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+        buffer.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        buffer.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+        buffer.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        buffer.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else {
+        buffer.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+        buffer.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+        buffer.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        buffer.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <vector>
+
+
+// Minimal JSON document model, enough for the server's FORMAT JSON outputs (EXPLAIN, catalog queries)
+class JsonValue {
+public:
+    enum class Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type = Type::NUL;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+
+    // ARRAY elements or OBJECT member values
+    std::vector<JsonValue> elements;
+
+    // OBJECT member names, parallel to *elements*
+    std::vector<std::string> keys;
+
+    // Member of an OBJECT by name (nullptr when missing or not an OBJECT)
+    const JsonValue *get(const std::string &key) const;
+
+    // Numeric member of an OBJECT or *fallback* when missing
+    double getNumber(const std::string &key, double fallback = 0) const;
+
+    // String member of an OBJECT or an empty str when missing
+    std::string getString(const std::string &key) const;
+
+    // Parse a whole document, returns false on malformed input
+    static bool parse(const std::string &text, JsonValue &result);
+
+    // Quote and escape a str to be written as a JSON string
+    static std::string quote(const std::string &value);
+
+    // Append *value* quoted and escaped as a JSON string
+    static void appendQuoted(std::string &destination, const char *value, std::size_t length);
+};
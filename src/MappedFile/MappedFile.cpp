@@ -0,0 +1,186 @@
+#include "MappedFile.h"
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+int MappedFile::open(const std::string &filePath, const std::uint64_t size) {
+    close();
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                                CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (handle == INVALID_HANDLE_VALUE) {
+        std::cerr << "Error: Cannot open " << filePath << " for writing.\n";
+        return 1;
+    }
+    fileHandle = handle;
+
+    if (size == 0) /* Nothing to map, an empty mapping is an error on both platforms */
+        return 0;
+
+    // The mapping extends the file to its size
+    mappingHandle = CreateFileMappingA(handle, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                       static_cast<DWORD>(size & 0xFFFFFFFF), nullptr);
+
+    if (mappingHandle != nullptr)
+        mappedData = static_cast<char *>(MapViewOfFile(mappingHandle, FILE_MAP_WRITE, 0, 0, 0));
+#else
+    fileDescriptor = ::open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fileDescriptor < 0) {
+        std::cerr << "Error: Cannot open " << filePath << " for writing.\n";
+        return 1;
+    }
+
+    if (size == 0)
+        return 0;
+
+    // Reserve the blocks up front where the file system supports it, a full disk then fails here
+    // instead of as a SIGBUS in the middle of rendering
+#ifdef __linux__
+    const bool isExtended = posix_fallocate(fileDescriptor, 0, static_cast<off_t>(size)) == 0 ||
+                            ftruncate(fileDescriptor, static_cast<off_t>(size)) == 0;
+#else
+    const bool isExtended = ftruncate(fileDescriptor, static_cast<off_t>(size)) == 0;
+#endif
+
+    if (isExtended) {
+        void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+        mappedData = mapping == MAP_FAILED ? nullptr : static_cast<char *>(mapping);
+    }
+#endif
+
+    if (mappedData == nullptr) {
+        std::cerr << "Error: Cannot map " << size << " bytes of " << filePath << ".\n";
+        close();
+        return 1;
+    }
+
+    mappedSize = size;
+    return 0;
+}
+
+int MappedFile::openReadOnly(const std::string &filePath) {
+    close();
+    isReadOnly = true;
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (handle == INVALID_HANDLE_VALUE) {
+        std::cerr << "Error: Cannot open " << filePath << " for reading.\n";
+        return 1;
+    }
+    fileHandle = handle;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize)) {
+        close();
+        return 1;
+    }
+
+    const auto size = static_cast<std::uint64_t>(fileSize.QuadPart);
+
+    if (size == 0)
+        return 0;
+
+    mappingHandle = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (mappingHandle != nullptr)
+        mappedData = static_cast<char *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+    fileDescriptor = ::open(filePath.c_str(), O_RDONLY);
+
+    if (fileDescriptor < 0) {
+        std::cerr << "Error: Cannot open " << filePath << " for reading.\n";
+        return 1;
+    }
+
+    struct stat fileStatus{};
+    if (fstat(fileDescriptor, &fileStatus) != 0) {
+        close();
+        return 1;
+    }
+
+    const auto size = static_cast<std::uint64_t>(fileStatus.st_size);
+
+    if (size == 0)
+        return 0;
+
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    mappedData = mapping == MAP_FAILED ? nullptr : static_cast<char *>(mapping);
+#endif
+
+    if (mappedData == nullptr) {
+        std::cerr << "Error: Cannot map " << filePath << ".\n";
+        close();
+        return 1;
+    }
+
+    mappedSize = size;
+    return 0;
+}
+
+char *MappedFile::data() const {
+    return mappedData;
+}
+
+std::uint64_t MappedFile::size() const {
+    return mappedSize;
+}
+
+int MappedFile::close() {
+    int closeStatus = 0;
+
+#ifdef _WIN32
+    if (mappedData != nullptr) {
+        if (!isReadOnly && !FlushViewOfFile(mappedData, 0))
+            closeStatus = 1;
+        UnmapViewOfFile(mappedData);
+    }
+
+    if (mappingHandle != nullptr)
+        CloseHandle(mappingHandle);
+
+    if (fileHandle != nullptr)
+        CloseHandle(fileHandle);
+
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (mappedData != nullptr) {
+        if (!isReadOnly && msync(mappedData, mappedSize, MS_SYNC) != 0)
+            closeStatus = 1;
+        munmap(mappedData, mappedSize);
+    }
+
+    if (fileDescriptor >= 0)
+        ::close(fileDescriptor);
+
+    fileDescriptor = -1;
+#endif
+
+    if (closeStatus != 0)
+        std::cerr << "Error: Cannot flush the mapped output file.\n";
+
+    mappedData = nullptr;
+    mappedSize = 0;
+    isReadOnly = false;
+    return closeStatus;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+
+// Output file of a known size mapped into memory, the rendered bytes go straight into the page cache
+// without passing through a stream buffer or a write() call
+class MappedFile {
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+    char *mappedData = nullptr;
+    std::uint64_t mappedSize = 0;
+    bool isReadOnly = false;
+
+public:
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Create (or truncate) the file, extend it to *size* bytes and map all of it for writing
+    int open(const std::string &filePath, std::uint64_t size);
+
+    // Map an existing file for reading, its pages must not be written
+    int openReadOnly(const std::string &filePath);
+
+    char *data() const;
+
+    std::uint64_t size() const;
+
+    // Flush the mapped pages to the file (unless read only) and unmap it
+    int close();
+
+    ~MappedFile();
+};
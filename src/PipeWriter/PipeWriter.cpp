@@ -0,0 +1,242 @@
+#include "PipeWriter.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+
+#define WINDOWS_PIPE_PREFIX "\\\\.\\pipe\\"
+#define WINDOWS_PAGE_SIZE 4096
+// Biggest single write request, larger writes are issued in several calls
+#define MAX_PIPE_WRITE_REQUEST (1024 * 1024 * 1024)
+
+
+PipeWriter::PipeWriter(const std::size_t bufferSize): requestedBufferSize(std::max<std::size_t>(bufferSize, 1)) {
+}
+
+int PipeWriter::open(const std::string &outputPath) {
+    close();
+
+    const bool isStandardOutput = outputPath == STANDARD_OUTPUT_PATH;
+    bufferSize = requestedBufferSize;
+    isSpliced = false;
+
+#ifdef _WIN32
+    const std::size_t pageSize = WINDOWS_PAGE_SIZE;
+
+    if (isStandardOutput) {
+        fileHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+    } else {
+        // Named pipes are opened as they are, files are created
+        const bool isNamedPipe = outputPath.rfind(WINDOWS_PIPE_PREFIX, 0) == 0;
+        HANDLE handle = CreateFileA(outputPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                                    isNamedPipe ? OPEN_EXISTING : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        fileHandle = handle == INVALID_HANDLE_VALUE ? nullptr : handle;
+    }
+
+    isOpen = fileHandle != nullptr && fileHandle != INVALID_HANDLE_VALUE;
+#else
+    const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+
+    fileDescriptor = isStandardOutput ? STDOUT_FILENO : ::open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    isOpen = fileDescriptor >= 0;
+
+#ifdef __linux__
+    struct stat fileStatus{};
+    isSpliced = isOpen && fstat(fileDescriptor, &fileStatus) == 0 && S_ISFIFO(fileStatus.st_mode);
+
+    if (isSpliced) {
+        // Grown to the buffer size where the limit (/proc/sys/fs/pipe-max-size) allows, the buffers take its size
+        fcntl(fileDescriptor, F_SETPIPE_SZ, static_cast<int>(std::min<std::size_t>(bufferSize, 0x7FFFFFFF)));
+        const int pipeSize = fcntl(fileDescriptor, F_GETPIPE_SZ);
+
+        isSpliced = pipeSize > 0;
+        if (isSpliced)
+            bufferSize = static_cast<std::size_t>(pipeSize);
+    }
+#endif
+#endif
+
+    isOwnOutput = isOpen && !isStandardOutput;
+
+    if (!isOpen) {
+        std::cerr << "Error: Cannot open " << outputPath << " for writing.\n";
+        return 1;
+    }
+
+    // Whole pages, so the spliced buffers give the pipe whole pages
+    bufferSize = std::max(bufferSize / pageSize, std::size_t{1}) * pageSize;
+
+    for (char *&buffer: buffers) {
+#ifdef _WIN32
+        buffer = static_cast<char *>(VirtualAlloc(nullptr, bufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+        void *mapping = mmap(nullptr, bufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        buffer = mapping == MAP_FAILED ? nullptr : static_cast<char *>(mapping);
+#endif
+    }
+
+    if (buffers[0] == nullptr || buffers[1] == nullptr) {
+        std::cerr << "Error: Cannot allocate the pipe buffers.\n";
+        close();
+        return 1;
+    }
+
+    currentBuffer = 0;
+    splicedBytes = 0;
+    writeStatus = 0;
+    setp(buffers[currentBuffer], buffers[currentBuffer] + bufferSize);
+    return 0;
+}
+
+int PipeWriter::submitCurrentBuffer() {
+    const std::size_t filledSize = pptr() - pbase();
+
+    if (filledSize > 0) {
+        writeStatus |= writeAll(pbase(), filledSize);
+        currentBuffer ^= 1;
+    }
+
+    setp(buffers[currentBuffer], buffers[currentBuffer] + bufferSize);
+    return writeStatus;
+}
+
+int PipeWriter::writeAll(const char *data, std::size_t size) {
+    while (size > 0) {
+        const std::size_t requestSize = std::min<std::size_t>(size, MAX_PIPE_WRITE_REQUEST);
+
+#ifdef _WIN32
+        DWORD writtenBytes = 0;
+        if (!WriteFile(fileHandle, data, static_cast<DWORD>(requestSize), &writtenBytes, nullptr))
+            writtenBytes = 0;
+
+        if (writtenBytes == 0)
+            return 1;
+#else
+        ssize_t writtenBytes;
+
+#ifdef __linux__
+        if (isSpliced) {
+            iovec ioVector{const_cast<char *>(data), requestSize};
+            writtenBytes = vmsplice(fileDescriptor, &ioVector, 1, 0);
+
+            if (writtenBytes < 0 && errno != EINTR && splicedBytes == 0) /* Refused: plain writes from now on */ {
+                isSpliced = false;
+                continue;
+            }
+
+            if (writtenBytes > 0)
+                splicedBytes += writtenBytes;
+        } else
+#endif
+            writtenBytes = ::write(fileDescriptor, data, requestSize);
+
+        if (writtenBytes < 0 && errno == EINTR)
+            continue;
+
+        if (writtenBytes <= 0)
+            return 1;
+#endif
+
+        data += writtenBytes;
+        size -= writtenBytes;
+    }
+
+    return 0;
+}
+
+PipeWriter::int_type PipeWriter::overflow(const int_type ch) {
+    if (!isOpen || submitCurrentBuffer())
+        return traits_type::eof();
+
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize PipeWriter::xsputn(const char *data, const std::streamsize size) {
+    std::streamsize copiedSize = 0;
+
+    while (copiedSize < size) {
+        if (pptr() == epptr() && (!isOpen || submitCurrentBuffer()))
+            return copiedSize;
+
+        const std::streamsize chunkSize = std::min<std::streamsize>(size - copiedSize, epptr() - pptr());
+        std::memcpy(pptr(), data + copiedSize, chunkSize);
+
+        // pbump takes an int, a chunk never exceeds the buffer size
+        pbump(static_cast<int>(chunkSize));
+        copiedSize += chunkSize;
+    }
+
+    return copiedSize;
+}
+
+bool PipeWriter::isZeroCopy() const {
+    return isSpliced;
+}
+
+int PipeWriter::close() {
+    int closeStatus = 0;
+
+    if (isOpen && buffers[0] != nullptr && buffers[1] != nullptr)
+        closeStatus = submitCurrentBuffer();
+
+    if (isOwnOutput) {
+#ifdef _WIN32
+        CloseHandle(fileHandle);
+#else
+        ::close(fileDescriptor);
+#endif
+    }
+
+#ifdef _WIN32
+    fileHandle = nullptr;
+#else
+    fileDescriptor = -1;
+#endif
+    isOwnOutput = false;
+    isOpen = false;
+    setp(nullptr, nullptr);
+
+    // The pipe can still hold spliced pages: they stay valid once unmapped, a reused buffer would overwrite them
+    releaseBuffers();
+
+    if (closeStatus != 0)
+        std::cerr << "Error: Cannot write the output pipe.\n";
+
+    return closeStatus;
+}
+
+void PipeWriter::releaseBuffers() {
+    for (char *&buffer: buffers) {
+        if (buffer == nullptr)
+            continue;
+
+#ifdef _WIN32
+        VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+        munmap(buffer, bufferSize);
+#endif
+        buffer = nullptr;
+    }
+}
+
+PipeWriter::~PipeWriter() {
+    close();
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <streambuf>
+#include <string>
+
+
+// Output path of the standard output
+#define STANDARD_OUTPUT_PATH "-"
+
+
+// Stream buffer feeding exports to another process through a pipe: standard output ("-"), a named pipe or any
+// other file. On Linux, when the output is a pipe, the filled page-aligned buffers are spliced into it (vmsplice)
+// instead of copied: the reader gets the pages themselves, one memory copy less per byte. A buffer is exactly as
+// big as the pipe, so once the next one is spliced whole the pipe no longer holds its pages and it can be filled
+// again; after close the buffers are unmapped, never reused. Other outputs (and other systems) get plain writes.
+// Use it through std::ostream stream{&pipeWriter};
+class PipeWriter : public std::streambuf {
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+    bool isOwnOutput = false;
+    bool isOpen = false;
+    bool isSpliced = false;
+    std::size_t requestedBufferSize;
+    std::size_t bufferSize = 0;
+
+    // One is filled while the pipe may still hold the pages of the other
+    char *buffers[2] = {};
+    std::size_t currentBuffer = 0;
+    std::uint64_t splicedBytes = 0;
+    int writeStatus = 0;
+
+    // Send the filled part of the current buffer and switch to the other one
+    int submitCurrentBuffer();
+
+    // Splice or write all *size* bytes
+    int writeAll(const char *data, std::size_t size);
+
+    void releaseBuffers();
+
+protected:
+    int_type overflow(int_type ch) override;
+
+    std::streamsize xsputn(const char *data, std::streamsize size) override;
+
+public:
+    explicit PipeWriter(std::size_t bufferSize = 1024 * 1024);
+
+    PipeWriter(const PipeWriter &) = delete;
+
+    PipeWriter &operator=(const PipeWriter &) = delete;
+
+    // Open *outputPath* for writing (STANDARD_OUTPUT_PATH: the standard output, left open on close)
+    int open(const std::string &outputPath);
+
+    // Whether the buffers are spliced into a pipe rather than written
+    bool isZeroCopy() const;
+
+    // Send the rest of the data, non-zero when any write failed
+    int close();
+
+    ~PipeWriter() override;
+};
@@ -0,0 +1,295 @@
+#include "PlanStore.h"
+#include "../SHA256/SHA256.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+
+
+#define FINGERPRINT_LENGTH 16
+#define EXPLAIN_PREFIX std::string("EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) ")
+#define CAPTURE_SAVEPOINT std::string("plan_store_capture")
+
+
+// Whether the character can be a part of an identifier or a $n parameter
+bool isIdentifierChar(char ch);
+
+
+PlanStore::PlanStore(PGconn *connection, const std::size_t sampleEvery,
+                     const std::chrono::milliseconds latencyThreshold, std::string dumpFilePath)
+    : connection(connection),
+      sampleEvery(sampleEvery),
+      latencyThreshold(latencyThreshold),
+      dumpFilePath(std::move(dumpFilePath)) {
+}
+
+PlanStore::~PlanStore() {
+    if (!records.empty())
+        dump();
+}
+
+PGresult *PlanStore::execute(const std::string &query, const int nParams, const char *const *paramValues) {
+    const auto startTime = std::chrono::steady_clock::now();
+
+    PGresult *queryResult = PQexecParams(
+        connection,
+        query.c_str(),
+        nParams, // Number of parameters
+        nullptr, // Parameter types (NULL = infer from query)
+        paramValues, // Parameter values
+        nullptr, // Parameter lengths (NULL = assume text)
+        nullptr, // Parameter formats (NULL = assume text)
+        0 // Result format: 0 for text, 1 for binary
+    );
+
+    const double latencyMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - startTime).count();
+
+    // Failed queries have no plan worth keeping
+    if (const ExecStatusType status = PQresultStatus(queryResult);
+        status != PGRES_TUPLES_OK && status != PGRES_COMMAND_OK)
+        return queryResult;
+
+    recordExecution(query, latencyMs, nParams, paramValues);
+    return queryResult;
+}
+
+void PlanStore::recordExecution(const std::string &query, const double latencyMs, const int nParams,
+                                const char *const *paramValues) {
+    ++executedQueries;
+
+    PlanRecord &record = records[fingerprint(query)];
+
+    if (record.normalizedQuery.empty())
+        record.normalizedQuery = normalizeQuery(query);
+
+    ++record.executions;
+    record.totalLatencyMs += latencyMs;
+    record.maxLatencyMs = std::max(record.maxLatencyMs, latencyMs);
+
+    const bool isSampled = sampleEvery != 0 && executedQueries % sampleEvery == 0;
+
+    if (isSampled || latencyMs >= static_cast<double>(latencyThreshold.count()))
+        capturePlan(query, nParams, paramValues, record);
+}
+
+void PlanStore::capturePlan(const std::string &query, const int nParams, const char *const *paramValues,
+                            PlanRecord &record) {
+    // EXPLAIN ANALYZE really executes the statement, its effects are always rolled back
+    const bool isInTransaction = PQtransactionStatus(connection) != PQTRANS_IDLE;
+
+    const std::string beginQuery = isInTransaction
+                                       ? std::string("SAVEPOINT ") + CAPTURE_SAVEPOINT + std::string(";")
+                                       : std::string("BEGIN;");
+    const std::string rollbackQuery = isInTransaction
+                                          ? std::string("ROLLBACK TO SAVEPOINT ") + CAPTURE_SAVEPOINT +
+                                            std::string("; RELEASE SAVEPOINT ") + CAPTURE_SAVEPOINT + std::string(";")
+                                          : std::string("ROLLBACK;");
+
+    PQclear(PQexec(connection, beginQuery.c_str()));
+
+    PGresult *explainResult = PQexecParams(
+        connection,
+        (EXPLAIN_PREFIX + query).c_str(),
+        nParams,
+        nullptr,
+        paramValues,
+        nullptr,
+        nullptr,
+        0
+    );
+
+    PQclear(PQexec(connection, rollbackQuery.c_str()));
+
+    if (PQresultStatus(explainResult) != PGRES_TUPLES_OK || PQntuples(explainResult) == 0) {
+        std::cerr << "PLAN CAPTURE failed: " << PQresultErrorMessage(explainResult) << std::endl;
+
+        PQclear(explainResult);
+        return;
+    }
+
+    JsonValue explainOutput;
+    const bool isParsed = JsonValue::parse(PQgetvalue(explainResult, 0, 0), explainOutput);
+    PQclear(explainResult);
+
+    // [ { "Plan": {...}, "Planning Time": ..., "Execution Time": ... } ]
+    if (!isParsed || explainOutput.type != JsonValue::Type::ARRAY || explainOutput.elements.empty()
+        || explainOutput.elements[0].get("Plan") == nullptr) {
+        std::cerr << "PLAN CAPTURE failed: Unexpected EXPLAIN output.\n";
+        return;
+    }
+
+    const JsonValue &explainRoot = explainOutput.elements[0];
+    const JsonValue &plan = *explainRoot.get("Plan");
+
+    const std::string shape = planShape(plan);
+    const double estimateError = rowEstimateError(plan);
+
+    ++record.captures;
+    record.maxRowEstimateError = std::max(record.maxRowEstimateError, estimateError);
+
+    // Buffer counters of the top node include all of its children
+    record.sharedHitBlocks += static_cast<long long>(plan.getNumber("Shared Hit Blocks"));
+    record.sharedReadBlocks += static_cast<long long>(plan.getNumber("Shared Read Blocks"));
+    record.sharedDirtiedBlocks += static_cast<long long>(plan.getNumber("Shared Dirtied Blocks"));
+    record.tempBlocks += static_cast<long long>(plan.getNumber("Temp Read Blocks") +
+                                                plan.getNumber("Temp Written Blocks"));
+
+    PlanShapeStats &shapeStats = record.shapes[shape];
+    ++shapeStats.captures;
+    shapeStats.totalExecutionMs += explainRoot.getNumber("Execution Time");
+    shapeStats.maxRowEstimateError = std::max(shapeStats.maxRowEstimateError, estimateError);
+
+    if (!record.lastShape.empty() && record.lastShape != shape)
+        std::cerr << "PLAN CAPTURE: plan changed for query " << fingerprint(query) << ".\n";
+
+    record.lastShape = shape;
+}
+
+std::string PlanStore::planShape(const JsonValue &planNode) {
+    std::string shape = planNode.getString("Node Type");
+
+    if (const std::string relationName = planNode.getString("Relation Name"); !relationName.empty())
+        shape += " on " + relationName;
+
+    if (const JsonValue *childPlans = planNode.get("Plans"); childPlans != nullptr && !childPlans->elements.empty()) {
+        shape += '(';
+
+        for (std::size_t i = 0; i < childPlans->elements.size(); ++i) {
+            if (i > 0)
+                shape += ", ";
+            shape += planShape(childPlans->elements[i]);
+        }
+
+        shape += ')';
+    }
+
+    return shape;
+}
+
+double PlanStore::rowEstimateError(const JsonValue &planNode) {
+    double worstError = 1;
+
+    // Never executed nodes have no actual row count
+    if (planNode.getNumber("Actual Loops") > 0) {
+        const double estimatedRows = std::max(planNode.getNumber("Plan Rows"), 1.0);
+        const double actualRows = std::max(planNode.getNumber("Actual Rows"), 1.0);
+
+        worstError = std::max(estimatedRows / actualRows, actualRows / estimatedRows);
+    }
+
+    if (const JsonValue *childPlans = planNode.get("Plans"); childPlans != nullptr) {
+        for (const JsonValue &childPlan: childPlans->elements)
+            worstError = std::max(worstError, rowEstimateError(childPlan));
+    }
+
+    return worstError;
+}
+
+int PlanStore::dump() const {
+    std::ofstream fileStream{dumpFilePath};
+
+    if (!fileStream) {
+        std::cerr << "PLAN STORE DUMP failed: Cannot open " << dumpFilePath << ".\n";
+        return 1;
+    }
+
+    fileStream << "{\n  \"fingerprints\": [";
+
+    bool isFirstRecord = true;
+
+    for (const auto &[queryFingerprint, record]: records) {
+        fileStream
+                << (isFirstRecord ? "\n" : ",\n")
+                << "    {\n"
+                << "      \"fingerprint\": " << JsonValue::quote(queryFingerprint) << ",\n"
+                << "      \"query\": " << JsonValue::quote(record.normalizedQuery) << ",\n"
+                << "      \"executions\": " << record.executions << ",\n"
+                << "      \"avg_latency_ms\": " << record.totalLatencyMs / static_cast<double>(record.executions) << ",\n"
+                << "      \"max_latency_ms\": " << record.maxLatencyMs << ",\n"
+                << "      \"captures\": " << record.captures << ",\n"
+                << "      \"max_row_estimate_error\": " << record.maxRowEstimateError << ",\n"
+                << "      \"shared_hit_blocks\": " << record.sharedHitBlocks << ",\n"
+                << "      \"shared_read_blocks\": " << record.sharedReadBlocks << ",\n"
+                << "      \"shared_dirtied_blocks\": " << record.sharedDirtiedBlocks << ",\n"
+                << "      \"temp_blocks\": " << record.tempBlocks << ",\n"
+                << "      \"plan_changed\": " << (record.shapes.size() > 1 ? "true" : "false") << ",\n"
+                << "      \"last_shape\": " << JsonValue::quote(record.lastShape) << ",\n"
+                << "      \"shapes\": [";
+
+        bool isFirstShape = true;
+
+        for (const auto &[shape, shapeStats]: record.shapes) {
+            fileStream
+                    << (isFirstShape ? "\n" : ",\n")
+                    << "        {\"shape\": " << JsonValue::quote(shape)
+                    << ", \"captures\": " << shapeStats.captures
+                    << ", \"avg_execution_ms\": " << shapeStats.totalExecutionMs / static_cast<double>(shapeStats.captures)
+                    << ", \"max_row_estimate_error\": " << shapeStats.maxRowEstimateError << '}';
+            isFirstShape = false;
+        }
+
+        fileStream << (record.shapes.empty() ? "]\n" : "\n      ]\n") << "    }";
+        isFirstRecord = false;
+    }
+
+    fileStream << (records.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    return 0;
+}
+
+std::string PlanStore::normalizeQuery(const std::string &query) {
+    std::string normalized;
+    normalized.reserve(query.length());
+
+    for (std::size_t i = 0; i < query.length();) {
+        const char ch = query[i];
+
+        if (std::isspace(static_cast<unsigned char>(ch))) /* Collapse whitespace */ {
+            while (i < query.length() && std::isspace(static_cast<unsigned char>(query[i])))
+                ++i;
+
+            if (!normalized.empty())
+                normalized.push_back(' ');
+            continue;
+        }
+
+        if (ch == '\'') /* String literal, '' is an escaped quote */ {
+            ++i;
+            while (i < query.length()) {
+                if (query[i] == '\'' && (i + 1 >= query.length() || query[i + 1] != '\'')) {
+                    ++i;
+                    break;
+                }
+                i += query[i] == '\'' ? 2 : 1;
+            }
+
+            normalized.push_back('?');
+            continue;
+        }
+
+        if (std::isdigit(static_cast<unsigned char>(ch)) && (normalized.empty() || !isIdentifierChar(normalized.back()))) {
+            while (i < query.length() && (std::isalnum(static_cast<unsigned char>(query[i])) || query[i] == '.'))
+                ++i;
+
+            normalized.push_back('?');
+            continue;
+        }
+
+        normalized.push_back(ch);
+        ++i;
+    }
+
+    while (!normalized.empty() && normalized.back() == ' ')
+        normalized.pop_back();
+
+    return normalized;
+}
+
+std::string PlanStore::fingerprint(const std::string &query) {
+    return SHA256::hash(normalizeQuery(query)).substr(0, FINGERPRINT_LENGTH);
+}
+
+
+bool isIdentifierChar(const char ch) {
+    return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_' || ch == '$';
+}
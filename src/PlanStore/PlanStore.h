@@ -0,0 +1,73 @@
+#pragma once
+#include <libpq-fe.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include "../Json/Json.h"
+
+
+// Captures EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) plans of sampled or slow queries,
+// aggregated per query fingerprint and dumped to a file
+class PlanStore {
+    // Statistics of one plan shape seen for a fingerprint
+    struct PlanShapeStats {
+        std::size_t captures = 0;
+        double totalExecutionMs = 0;
+        double maxRowEstimateError = 1;
+    };
+
+    struct PlanRecord {
+        std::string normalizedQuery;
+        std::size_t executions = 0;
+        std::size_t captures = 0;
+        double totalLatencyMs = 0;
+        double maxLatencyMs = 0;
+        double maxRowEstimateError = 1; // q-error: max(estimated / actual, actual / estimated)
+        long long sharedHitBlocks = 0;
+        long long sharedReadBlocks = 0;
+        long long sharedDirtiedBlocks = 0;
+        long long tempBlocks = 0;
+        std::string lastShape;
+        std::map<std::string, PlanShapeStats> shapes;
+    };
+
+    PGconn *connection;
+    std::size_t sampleEvery;
+    std::chrono::milliseconds latencyThreshold;
+    std::string dumpFilePath;
+    std::size_t executedQueries = 0;
+    std::map<std::string, PlanRecord> records; // Fingerprint -> aggregated plans
+
+    // Re-run the query under EXPLAIN ANALYZE (rolled back) and fold the plan into the record
+    void capturePlan(const std::string &query, int nParams, const char *const *paramValues, PlanRecord &record);
+
+    // Node type and relation of every plan node, nested like the plan tree
+    static std::string planShape(const JsonValue &planNode);
+
+    // Worst row estimate error (q-error) of the plan tree
+    static double rowEstimateError(const JsonValue &planNode);
+
+public:
+    // Capture every *sampleEvery*-th query (0 = none) and every query slower than *latencyThreshold*
+    PlanStore(PGconn *connection, std::size_t sampleEvery, std::chrono::milliseconds latencyThreshold,
+              std::string dumpFilePath);
+
+    // Execute a query (like PQexecParams), capturing its plan when it is sampled or slow
+    PGresult *execute(const std::string &query, int nParams = 0, const char *const *paramValues = nullptr);
+
+    // Account for a query the caller executed itself (streamed through a cursor, COPY...) in *latencyMs*,
+    // capturing its plan when it is sampled or slow
+    void recordExecution(const std::string &query, double latencyMs, int nParams = 0,
+                         const char *const *paramValues = nullptr);
+
+    // Write the per-fingerprint plan statistics to the dump file
+    int dump() const;
+
+    // Query text with literals replaced by '?' and whitespace collapsed
+    static std::string normalizeQuery(const std::string &query);
+
+    // Stable identifier of the normalized query text
+    static std::string fingerprint(const std::string &query);
+
+    ~PlanStore();
+};
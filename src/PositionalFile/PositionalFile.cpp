@@ -0,0 +1,118 @@
+#include "PositionalFile.h"
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+// Biggest single write request, larger writes are issued in several calls
+#define MAX_WRITE_REQUEST (1024 * 1024 * 1024)
+
+
+int PositionalFile::open(const std::string &filePath, const bool isDirect) {
+    close();
+
+#ifdef _WIN32
+    const DWORD flags = isDirect ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH : FILE_ATTRIBUTE_NORMAL;
+
+    HANDLE handle = CreateFileA(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                nullptr, CREATE_ALWAYS, flags, nullptr);
+    fileHandle = handle == INVALID_HANDLE_VALUE ? nullptr : handle;
+
+    if (fileHandle == nullptr && isDirect) /* Direct I/O is only a hint */
+        return open(filePath, false);
+#else
+    int flags = O_RDWR | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (isDirect)
+        flags |= O_DIRECT;
+#endif
+
+    fileDescriptor = ::open(filePath.c_str(), flags, 0644);
+
+    if (fileDescriptor < 0 && isDirect) /* Direct I/O is only a hint, tmpfs and others refuse it */
+        return open(filePath, false);
+#endif
+
+    if (!isOpen()) {
+        std::cerr << "Error: Cannot open " << filePath << " for writing.\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+int PositionalFile::resize(const std::uint64_t size) const {
+#ifdef _WIN32
+    LARGE_INTEGER fileSize;
+    fileSize.QuadPart = static_cast<LONGLONG>(size);
+
+    if (SetFilePointerEx(fileHandle, fileSize, nullptr, FILE_BEGIN) && SetEndOfFile(fileHandle))
+        return 0;
+#else
+    if (ftruncate(fileDescriptor, static_cast<off_t>(size)) == 0)
+        return 0;
+#endif
+
+    std::cerr << "Error: Cannot resize the output file to " << size << " bytes.\n";
+    return 1;
+}
+
+int PositionalFile::writeAt(const char *data, std::size_t size, std::uint64_t offset) const {
+    while (size > 0) {
+        const std::size_t requestSize = size < MAX_WRITE_REQUEST ? size : MAX_WRITE_REQUEST;
+
+#ifdef _WIN32
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD writtenBytes = 0;
+        if (!WriteFile(fileHandle, data, static_cast<DWORD>(requestSize), &writtenBytes, &overlapped))
+            writtenBytes = 0;
+#else
+        const ssize_t writtenBytes = pwrite(fileDescriptor, data, requestSize, static_cast<off_t>(offset));
+#endif
+
+        if (writtenBytes <= 0) {
+            std::cerr << "Error: Cannot write the output file at offset " << offset << ".\n";
+            return 1;
+        }
+
+        data += writtenBytes;
+        size -= writtenBytes;
+        offset += writtenBytes;
+    }
+
+    return 0;
+}
+
+bool PositionalFile::isOpen() const {
+#ifdef _WIN32
+    return fileHandle != nullptr;
+#else
+    return fileDescriptor >= 0;
+#endif
+}
+
+void PositionalFile::close() {
+#ifdef _WIN32
+    if (fileHandle != nullptr)
+        CloseHandle(fileHandle);
+    fileHandle = nullptr;
+#else
+    if (fileDescriptor >= 0)
+        ::close(fileDescriptor);
+    fileDescriptor = -1;
+#endif
+}
+
+PositionalFile::~PositionalFile() {
+    close();
+}
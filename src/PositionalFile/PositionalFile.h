@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+
+// Alignment satisfying direct I/O on the usual sector and page sizes
+#define DIRECT_IO_ALIGNMENT 4096
+
+
+// Output file written at explicit offsets (pwrite / overlapped WriteFile), so several threads can fill
+// their own parts of the same file at once without sharing a file position
+class PositionalFile {
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+
+public:
+    PositionalFile() = default;
+
+    PositionalFile(const PositionalFile &) = delete;
+
+    PositionalFile &operator=(const PositionalFile &) = delete;
+
+    // Create (or truncate) the file. Direct I/O (O_DIRECT / FILE_FLAG_NO_BUFFERING) bypasses the page cache,
+    // every write then has to be aligned in address, size and offset (DIRECT_IO_ALIGNMENT).
+    // File systems refusing direct I/O get a regular file.
+    int open(const std::string &filePath, bool isDirect = false);
+
+    // Set the file size up front, the gaps read as zeros until written
+    int resize(std::uint64_t size) const;
+
+    // Write all *size* bytes at *offset*, safe to call from several threads at once
+    int writeAt(const char *data, std::size_t size, std::uint64_t offset) const;
+
+    bool isOpen() const;
+
+    void close();
+
+    ~PositionalFile();
+};
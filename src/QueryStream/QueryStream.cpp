@@ -0,0 +1,95 @@
+#include "QueryStream.h"
+#include <iostream>
+
+
+#define STREAM_CURSOR_NAME std::string("query_stream_cursor")
+
+
+int QueryStream::streamSingleRow(PGconn *connection, const std::string &query, const BatchConsumer &consumer) {
+    if (!PQsendQuery(connection, query.c_str()) || !PQsetSingleRowMode(connection)) {
+        std::cerr << "STREAM failed: " << PQerrorMessage(connection) << std::endl;
+
+        // Drain whatever was already sent
+        while (PGresult *pendingResult = PQgetResult(connection))
+            PQclear(pendingResult);
+        return 1;
+    }
+
+    int streamStatus = 0;
+
+    // The results have to be read till the end even after a failure, or the connection stays busy
+    while (PGresult *batch = PQgetResult(connection)) {
+        const ExecStatusType batchStatus = PQresultStatus(batch);
+
+        if (batchStatus == PGRES_SINGLE_TUPLE || batchStatus == PGRES_TUPLES_OK) {
+            if (streamStatus == 0)
+                streamStatus = consumer(batch);
+        } else if (streamStatus == 0) {
+            std::cerr << "STREAM failed: " << PQresultErrorMessage(batch) << std::endl;
+            streamStatus = 1;
+        }
+
+        PQclear(batch);
+    }
+
+    return streamStatus;
+}
+
+int QueryStream::streamCursor(PGconn *connection, const std::string &query, const int batchSize,
+                              const BatchConsumer &consumer, const bool isBinary) {
+    // Cursors only live inside a transaction
+    const bool isOwnTransaction = PQtransactionStatus(connection) == PQTRANS_IDLE;
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, "BEGIN;"));
+
+    const std::string declareQuery =
+            std::string("DECLARE ") + STREAM_CURSOR_NAME + (isBinary ? std::string(" BINARY") : std::string()) +
+            std::string(" NO SCROLL CURSOR FOR ") + query;
+    const std::string fetchQuery =
+            std::string("FETCH FORWARD ") + std::to_string(batchSize) + std::string(" FROM ") + STREAM_CURSOR_NAME;
+    const std::string closeQuery =
+            std::string("CLOSE ") + STREAM_CURSOR_NAME + std::string(";");
+
+    PGresult *declareResult = PQexec(connection, declareQuery.c_str());
+
+    if (PQresultStatus(declareResult) != PGRES_COMMAND_OK) {
+        std::cerr << "STREAM failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(declareResult);
+        if (isOwnTransaction)
+            PQclear(PQexec(connection, "ROLLBACK;"));
+        return 1;
+    }
+    PQclear(declareResult);
+
+    int streamStatus = 0;
+
+    while (true) {
+        PGresult *batch = PQexec(connection, fetchQuery.c_str());
+
+        if (PQresultStatus(batch) != PGRES_TUPLES_OK) {
+            std::cerr << "STREAM failed: " << PQerrorMessage(connection) << std::endl;
+
+            PQclear(batch);
+            streamStatus = 1;
+            break;
+        }
+
+        const int batchRows = PQntuples(batch);
+        streamStatus = consumer(batch);
+        PQclear(batch);
+
+        if (streamStatus != 0 || batchRows < batchSize)
+            break;
+    }
+
+    // A failed FETCH aborts the transaction together with the cursor
+    if (PQtransactionStatus(connection) == PQTRANS_INTRANS)
+        PQclear(PQexec(connection, closeQuery.c_str()));
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, streamStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    return streamStatus;
+}
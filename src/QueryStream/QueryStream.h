@@ -0,0 +1,22 @@
+#pragma once
+#include <libpq-fe.h>
+#include <functional>
+#include <string>
+
+
+// Receives every batch of rows of a streamed query, returns non-zero to stop the stream.
+// Each batch carries the column metadata, the last one may have no rows.
+using BatchConsumer = std::function<int(const PGresult *batch)>;
+
+
+// Fetch query results in bounded pieces instead of one materialized PGresult
+class QueryStream {
+public:
+    // One row per batch (PQsetSingleRowMode)
+    static int streamSingleRow(PGconn *connection, const std::string &query, const BatchConsumer &consumer);
+
+    // *batchSize* rows per batch through a server-side cursor (own transaction when none is open),
+    // a BINARY cursor sends the values in their binary representation
+    static int streamCursor(PGconn *connection, const std::string &query, int batchSize,
+                            const BatchConsumer &consumer, bool isBinary = false);
+};
@@ -4,6 +4,8 @@
 #include <vector>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <cstring>
 
 // Rotates bits to the right
 #define ROTRIGHT(a, b) (((a) >> (b)) | ((a) << (32 - (b))))
@@ -36,68 +38,88 @@ uint32_t ep0(uint32_t x) { return ROTRIGHT(x, 2) ^ ROTRIGHT(x, 13) ^ ROTRIGHT(x,
 uint32_t ep1(uint32_t x) { return ROTRIGHT(x, 6) ^ ROTRIGHT(x, 11) ^ ROTRIGHT(x, 25); }
 
 
-// Padding function for SHA-256
-std::vector<uint8_t> SHA256::padMessage(const std::string& input) {
-    std::vector<uint8_t> padded(input.begin(), input.end());
-    uint64_t original_size = input.size() * 8; // Convert bytes to bits
+std::string SHA256::hash(const std::string& input) {
+    // A fresh object per call to avoid state pollution
+    SHA256 sha256;
+    sha256.update(input.data(), input.size());
+    return sha256.digest();
+}
 
-    padded.push_back(0x80); // Append a single '1' bit
+void SHA256::update(const char *data, size_t length) {
+    auto bytes = reinterpret_cast<const uint8_t *>(data);
+    messageLength += length;
 
-    while ((padded.size() + 8) % 64 != 0) {
-        padded.push_back(0x00);
-    }
+    // Fill the unfinished block first, whole blocks are then hashed straight from the data
+    if (blockLength > 0) {
+        const size_t copyLength = std::min(length, 64 - blockLength);
+        std::memcpy(block + blockLength, bytes, copyLength);
+        blockLength += copyLength;
 
-    for (int i = 7; i >= 0; --i) {
-        padded.push_back(original_size >> (i * 8));
+        if (blockLength < 64)
+            return;
+
+        processBlock(block);
+        blockLength = 0;
+        bytes += copyLength;
+        length -= copyLength;
     }
 
-    return padded;
+    for (; length >= 64; bytes += 64, length -= 64)
+        processBlock(bytes);
+
+    std::memcpy(block, bytes, length);
+    blockLength = length;
 }
 
-std::string SHA256::hash(const std::string& input) {
-    // Define hash values inside the function to avoid state pollution
-    uint32_t h[8] = {
-        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
-        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
-    };
+std::string SHA256::digest() {
+    const uint64_t original_size = messageLength * 8; // Convert bytes to bits
 
-    std::vector<uint8_t> padded = padMessage(input);
-    uint32_t w[64];
+    // Append a single '1' bit, zeros up to 8 bytes before a block end and the length in bits
+    uint8_t padding[72] = {0x80};
+    const size_t paddingLength = (blockLength < 56 ? 56 : 120) - blockLength;
 
-    for (size_t i = 0; i < padded.size(); i += 64) {
-        for (int j = 0; j < 16; ++j) {
-            w[j] = (padded[i + j * 4] << 24) | (padded[i + j * 4 + 1] << 16) |
-                   (padded[i + j * 4 + 2] << 8) | (padded[i + j * 4 + 3]);
-        }
-
-        for (int j = 16; j < 64; ++j) {
-            w[j] = sig1(w[j - 2]) + w[j - 7] + sig0(w[j - 15]) + w[j - 16];
-        }
-
-        uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
-        uint32_t e = h[4], f = h[5], g = h[6], h_ = h[7];
-
-        for (int j = 0; j < 64; ++j) {
-            uint32_t temp1 = h_ + ep1(e) + ch(e, f, g) + k[j] + w[j];
-            uint32_t temp2 = ep0(a) + maj(a, b, c);
-
-            h_ = g;
-            g = f;
-            f = e;
-            e = d + temp1;
-            d = c;
-            c = b;
-            b = a;
-            a = temp1 + temp2;
-        }
-
-        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
-        h[4] += e; h[5] += f; h[6] += g; h[7] += h_;
-    }
+    for (int i = 7; i >= 0; --i)
+        padding[paddingLength + 7 - i] = original_size >> (i * 8);
+
+    update(reinterpret_cast<const char *>(padding), paddingLength + 8);
 
     std::stringstream ss;
     for (int i = 0; i < 8; ++i) {
-        ss << std::hex << std::setw(8) << std::setfill('0') << h[i];
+        ss << std::hex << std::setw(8) << std::setfill('0') << state[i];
     }
     return ss.str();
-}
\ No newline at end of file
+}
+
+void SHA256::processBlock(const uint8_t *data) {
+    uint32_t *h = state;
+    uint32_t w[64];
+
+    for (int j = 0; j < 16; ++j) {
+        w[j] = (data[j * 4] << 24) | (data[j * 4 + 1] << 16) |
+               (data[j * 4 + 2] << 8) | (data[j * 4 + 3]);
+    }
+
+    for (int j = 16; j < 64; ++j) {
+        w[j] = sig1(w[j - 2]) + w[j - 7] + sig0(w[j - 15]) + w[j - 16];
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    uint32_t e = h[4], f = h[5], g = h[6], h_ = h[7];
+
+    for (int j = 0; j < 64; ++j) {
+        uint32_t temp1 = h_ + ep1(e) + ch(e, f, g) + k[j] + w[j];
+        uint32_t temp2 = ep0(a) + maj(a, b, c);
+
+        h_ = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += h_;
+}
@@ -1,11 +1,28 @@
 #pragma once
 #include <vector>
 #include <cstdint>
+#include <string>
 
 
 class SHA256 {
-    static std::vector<uint8_t> padMessage(const std::string &input);
+    // State of an incremental hash: the hash values, the bytes of the unfinished block and the message length
+    uint32_t state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    uint8_t block[64] = {};
+    size_t blockLength = 0;
+    uint64_t messageLength = 0;
+
+    // Mix one 64 byte block into the hash values
+    void processBlock(const uint8_t *data);
 
 public:
     static std::string hash(const std::string &input);
+
+    // Hash data arriving in pieces (files, streams): update() with every piece, then digest() once
+    void update(const char *data, size_t length);
+
+    // Hex digest of everything updated so far, the same as hash() of it all at once
+    std::string digest();
 };
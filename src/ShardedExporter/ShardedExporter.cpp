@@ -0,0 +1,319 @@
+#include "ShardedExporter.h"
+#include "../DbConnection/DbConnection.h"
+#include "../Json/Json.h"
+#include "../QueryStream/QueryStream.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+
+#define SHARD_BATCH_SIZE 10000
+#define SHARD_NUMBER_DIGITS 4
+#define MANIFEST_FILE_SUFFIX std::string(".manifest.json")
+// Every shard buffers this much twice over while its writer thread writes (4 buffers)
+#define SHARD_BUFFER_SIZE (1024 * 1024)
+#define SHARD_BUFFERS_COUNT 4
+// HASH shards are all open at once, each with its writer thread and buffers (4 MB)
+#define HASH_MAX_SHARDS 64
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+
+// FNV-1a 64 of a key value, stable between runs and platforms so consumers can find the shard of a key
+std::uint64_t shardHash(const char *value, std::size_t length);
+
+
+ShardedExporter::ShardedExporter(PGconn *connection, std::string outputFilePath, const ExportFormat format,
+                                 const ShardMode shardMode, const std::size_t shardParameter, std::string keyColumn)
+    : connection(connection),
+      outputFilePath(std::move(outputFilePath)),
+      format(format),
+      shardMode(shardMode),
+      shardParameter(std::max<std::size_t>(shardParameter, 1)),
+      keyColumn(std::move(keyColumn)) {
+}
+
+const char *ShardedExporter::modeName(const ShardMode shardMode) {
+    switch (shardMode) {
+        case ShardMode::NONE:
+            return "NONE";
+        case ShardMode::ROWS:
+            return "ROWS";
+        case ShardMode::BYTES:
+            return "BYTES";
+        case ShardMode::HASH:
+            return "HASH";
+    }
+
+    return "UNKNOWN";
+}
+
+std::string ShardedExporter::shardFilePath(const std::size_t shardNumber) const {
+    const std::filesystem::path outputPath{outputFilePath};
+
+    std::ostringstream shardNumberStream;
+    shardNumberStream << std::setw(SHARD_NUMBER_DIGITS) << std::setfill('0') << shardNumber;
+
+    std::filesystem::path shardPath = outputPath;
+    shardPath.replace_filename(outputPath.stem().string() + "." + shardNumberStream.str() +
+                               outputPath.extension().string());
+    return shardPath.string();
+}
+
+std::string ShardedExporter::getManifestFilePath() const {
+    std::filesystem::path manifestPath{outputFilePath};
+    manifestPath.replace_extension(MANIFEST_FILE_SUFFIX);
+    return manifestPath.string();
+}
+
+int ShardedExporter::exportQuery(const std::string &query) {
+    this->query = query;
+    shards.clear();
+    exportedRowsCount = 0;
+
+    if (shardMode == ShardMode::HASH && shardParameter > HASH_MAX_SHARDS) {
+        std::cerr << "SHARDED EXPORT failed: At most " << HASH_MAX_SHARDS << " HASH shards, not " << shardParameter
+                << ".\n";
+        return 1;
+    }
+
+    // A manifest of an earlier run must not list the shards this one is about to overwrite
+    const std::string manifestFilePath = getManifestFilePath();
+    std::error_code errorCode;
+
+    if (std::filesystem::remove(manifestFilePath, errorCode); errorCode) {
+        std::cerr << "SHARDED EXPORT failed: Cannot remove " << manifestFilePath << ".\n";
+        return 1;
+    }
+
+    const bool isTwoPass = FormatWriter::needsWidths(format);
+    const bool isOwnTransaction = isTwoPass && PQtransactionStatus(connection) == PQTRANS_IDLE;
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, SNAPSHOT_TRANSACTION));
+
+    int exportStatus = 0;
+
+    // Pass one (padded formats only): the widths every shard is rendered with
+    if (isTwoPass)
+        exportStatus = QueryStream::streamCursor(connection, query, SHARD_BATCH_SIZE, [this](const PGresult *batch) {
+            if (!formatWriter)
+                formatWriter = FormatWriter::create(format, batch);
+
+            formatWriter->observe(batch);
+            return 0;
+        });
+
+    if (exportStatus == 0)
+        exportStatus = QueryStream::streamCursor(connection, query, SHARD_BATCH_SIZE, [this](const PGresult *batch) {
+            if (!formatWriter)
+                formatWriter = FormatWriter::create(format, batch);
+
+            return writeBatch(batch);
+        });
+
+    // An empty result still gets one shard (its head), every HASH shard exists even without rows
+    if (exportStatus == 0 && shards.empty())
+        exportStatus = openShard();
+
+    for (Shard &shard: shards)
+        exportStatus |= closeShard(shard);
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, exportStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    if (exportStatus != 0) {
+        std::cerr << "SHARDED EXPORT failed: Cannot write the shards of " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    return writeManifest();
+}
+
+int ShardedExporter::openShard() {
+    Shard &shard = shards.emplace_back();
+    shard.filePath = shardFilePath(shards.size() - 1);
+    shard.firstRow = exportedRowsCount;
+    shard.formatWriter = formatWriter->clone();
+
+    shard.asyncFileWriter = std::make_unique<AsyncFileWriter>(false, SHARD_BUFFER_SIZE, SHARD_BUFFERS_COUNT);
+    shard.asyncFileWriter->enableChecksum();
+    shard.fileStream = std::make_unique<std::ostream>(shard.asyncFileWriter.get());
+
+    if (shard.asyncFileWriter->open(shard.filePath))
+        return 1;
+
+    shard.formatWriter->writeHead(*shard.fileStream);
+    return *shard.fileStream ? 0 : 1;
+}
+
+int ShardedExporter::closeShard(Shard &shard) const {
+    if (!shard.asyncFileWriter)
+        return 0;
+
+    shard.formatWriter->writeTail(*shard.fileStream);
+    shard.fileStream->flush();
+
+    const bool isWritten = static_cast<bool>(*shard.fileStream);
+    shard.bytesCount = shard.asyncFileWriter->size();
+
+    const int closeStatus = shard.asyncFileWriter->close();
+    shard.checksum = shard.asyncFileWriter->getChecksum();
+
+    // The buffers and the writer thread go with it, only the open shards hold memory
+    shard.fileStream.reset();
+    shard.asyncFileWriter.reset();
+    shard.formatWriter.reset();
+
+    return closeStatus != 0 || !isWritten;
+}
+
+int ShardedExporter::writeBatch(const PGresult *batch) {
+    const int rowsCount = PQntuples(batch);
+
+    batchRows.resize(rowsCount);
+    std::iota(batchRows.begin(), batchRows.end(), 0);
+
+    if (shardMode == ShardMode::HASH) {
+        if (shards.empty()) {
+            keyColumnNumber = PQfnumber(batch, (std::string("\"") + keyColumn + std::string("\"")).c_str());
+
+            if (keyColumnNumber < 0) {
+                std::cerr << "SHARDED EXPORT failed: The result has no column " << keyColumn << ".\n";
+                return 1;
+            }
+
+            shardRows.assign(shardParameter, {});
+
+            for (std::size_t i = 0; i < shardParameter; ++i) {
+                if (openShard())
+                    return 1;
+            }
+        }
+
+        for (auto &rows: shardRows)
+            rows.clear();
+
+        for (int i = 0; i < rowsCount; ++i) {
+            const std::uint64_t keyHash = PQgetisnull(batch, i, keyColumnNumber)
+                                              ? 0
+                                              : shardHash(PQgetvalue(batch, i, keyColumnNumber),
+                                                          PQgetlength(batch, i, keyColumnNumber));
+            shardRows[keyHash % shardParameter].push_back(i);
+        }
+
+        // The writer threads of all shards write and hash while the next shards are rendered
+        for (std::size_t i = 0; i < shardParameter; ++i) {
+            shards[i].formatWriter->writeSelectedRows(*shards[i].fileStream, batch, shardRows[i]);
+            shards[i].rowsCount += shardRows[i].size();
+
+            if (!*shards[i].fileStream)
+                return 1;
+        }
+
+        exportedRowsCount += rowsCount;
+        return 0;
+    }
+
+    int row = 0;
+
+    while (row < rowsCount) {
+        // The current shard is full: ROWS counts its rows, BYTES its size (the head included)
+        const bool isShardFull = !shards.empty() && shards.back().rowsCount > 0 &&
+                                 (shardMode == ShardMode::BYTES
+                                      ? shards.back().asyncFileWriter->size() >= shardParameter
+                                      : shards.back().rowsCount >= shardParameter);
+
+        if (shards.empty() || isShardFull) {
+            if (!shards.empty() && closeShard(shards.back()))
+                return 1;
+            if (openShard())
+                return 1;
+        }
+
+        Shard &shard = shards.back();
+
+        // ROWS takes as many rows as the shard has room for, BYTES one at a time to check the size after each
+        const int shardRowsCount = shardMode == ShardMode::BYTES
+                                       ? 1
+                                       : static_cast<int>(std::min<std::uint64_t>(
+                                           shardParameter - shard.rowsCount, rowsCount - row));
+
+        shard.formatWriter->writeSelectedRows(*shard.fileStream, batch,
+                                              std::span<const int>(batchRows).subspan(row, shardRowsCount));
+        shard.rowsCount += shardRowsCount;
+        exportedRowsCount += shardRowsCount;
+        row += shardRowsCount;
+
+        if (!*shard.fileStream)
+            return 1;
+    }
+
+    return 0;
+}
+
+int ShardedExporter::writeManifest() const {
+    const std::string manifestFilePath = getManifestFilePath();
+    std::ofstream manifestStream{manifestFilePath, std::ios::binary};
+
+    manifestStream << "{\n"
+            << "  \"query\": " << JsonValue::quote(query) << ",\n"
+            << "  \"format\": " << JsonValue::quote(FormatWriter::formatName(format)) << ",\n"
+            << "  \"mode\": " << JsonValue::quote(modeName(shardMode)) << ",\n";
+
+    if (shardMode == ShardMode::HASH)
+        manifestStream << "  \"keyColumn\": " << JsonValue::quote(keyColumn) << ",\n"
+                << "  \"hash\": \"fnv1a64\",\n";
+    else
+        manifestStream << "  \"shardLimit\": " << shardParameter << ",\n";
+
+    manifestStream << "  \"rowsCount\": " << exportedRowsCount << ",\n"
+            << "  \"shards\": [\n";
+
+    for (std::size_t i = 0; i < shards.size(); ++i) {
+        const Shard &shard = shards[i];
+
+        manifestStream << "    {\"file\": "
+                << JsonValue::quote(std::filesystem::path(shard.filePath).filename().string());
+
+        // HASH shards hold the rows whose key hash modulo the shards count is their number
+        if (shardMode == ShardMode::HASH)
+            manifestStream << ", \"hashBucket\": " << i;
+        else
+            manifestStream << ", \"firstRow\": " << shard.firstRow;
+
+        manifestStream << ", \"rowsCount\": " << shard.rowsCount << ", \"bytes\": " << shard.bytesCount
+                << ", \"sha256\": " << JsonValue::quote(shard.checksum) << "}"
+                << (i + 1 < shards.size() ? ",\n" : "\n");
+    }
+
+    manifestStream << "  ]\n}\n";
+    manifestStream.close();
+
+    if (!manifestStream) {
+        std::cerr << "SHARDED EXPORT failed: Cannot write " << manifestFilePath << ".\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+std::size_t ShardedExporter::getShardsCount() const {
+    return shards.size();
+}
+
+
+std::uint64_t shardHash(const char *value, const std::size_t length) {
+    std::uint64_t hash = FNV_OFFSET_BASIS;
+
+    for (std::size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(value[i]);
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "../AsyncFileWriter/AsyncFileWriter.h"
+#include "../FormatWriter/FormatWriter.h"
+#include <libpq-fe.h>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// How a sharded export splits the rows between its files
+enum class ShardMode {
+    NONE, // One output file
+    ROWS, // A new shard every *shardParameter* rows
+    BYTES, // A new shard once the current one holds *shardParameter* bytes (checked before every row)
+    HASH // *shardParameter* shards (at most 64), a row goes to shard FNV-1a 64(text of the key column) % shards,
+         // NULL to shard 0
+};
+
+
+// Writes an export as several complete files (shards) in one export format, plus a JSON manifest listing every
+// shard with its rows, size and SHA-256. Every shard has its own writer thread (AsyncFileWriter) doing the
+// disk writes and the hashing, so consumers can take the shards in parallel and check them on their own.
+// Padded formats share the widths of the whole result, every shard has the same layout.
+// Shard files are named after the output file: SQLresult.txt -> SQLresult.0000.txt ... SQLresult.manifest.json
+class ShardedExporter {
+    struct Shard {
+        std::string filePath;
+        std::unique_ptr<AsyncFileWriter> asyncFileWriter;
+        std::unique_ptr<std::ostream> fileStream;
+        std::unique_ptr<FormatWriter> formatWriter;
+        std::uint64_t firstRow = 0; // Export order, ROWS and BYTES shards are ranges of it
+        std::uint64_t rowsCount = 0;
+        std::uint64_t bytesCount = 0;
+        std::string checksum;
+    };
+
+    PGconn *connection;
+    std::string outputFilePath;
+    ExportFormat format;
+    ShardMode shardMode;
+    std::size_t shardParameter;
+    std::string keyColumn;
+
+    std::string query;
+    std::vector<Shard> shards;
+    std::unique_ptr<FormatWriter> formatWriter; // Observed once, cloned for every shard
+    int keyColumnNumber = -1;
+    std::uint64_t exportedRowsCount = 0;
+
+    // Row numbers of the current batch (0, 1, 2 ...) and of the rows going to every HASH shard
+    std::vector<int> batchRows;
+    std::vector<std::vector<int> > shardRows;
+
+    std::string shardFilePath(std::size_t shardNumber) const;
+
+    // Add a shard, open its file and write the head
+    int openShard();
+
+    // Write the tail, wait for the writer thread and keep the size and the checksum
+    int closeShard(Shard &shard) const;
+
+    int writeBatch(const PGresult *batch);
+
+    int writeManifest() const;
+
+public:
+    ShardedExporter(PGconn *connection, std::string outputFilePath, ExportFormat format, ShardMode shardMode,
+                    std::size_t shardParameter, std::string keyColumn = "");
+
+    static const char *modeName(ShardMode shardMode);
+
+    // Export *query* into the shards (padded formats read it twice within one snapshot) and write the manifest.
+    // The manifest of an earlier run is removed first, a failed export leaves none.
+    int exportQuery(const std::string &query);
+
+    std::size_t getShardsCount() const;
+
+    std::string getManifestFilePath() const;
+};
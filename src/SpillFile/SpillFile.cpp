@@ -0,0 +1,186 @@
+#include "SpillFile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+
+// Append *value* in 7 bit groups, the high bit marks that another group follows
+void appendVarint(std::string &destination, std::uint64_t value);
+
+// Read a value written by appendVarint, false when the bytes end before it does
+bool readVarint(const char *&position, const char *end, std::uint64_t &value);
+
+
+SpillFile::SpillFile(std::string filePath, const std::size_t bufferLimit)
+    : filePath(std::move(filePath)),
+      bufferLimit(std::max<std::size_t>(bufferLimit, 1)) {
+}
+
+int SpillFile::appendRows(const PGresult *batch) {
+    columnsCount = PQnfields(batch);
+
+    for (int i = 0; i < PQntuples(batch); ++i) {
+        // NULLs are rendered like empty values, so they are spooled as such
+        for (int j = 0; j < columnsCount; ++j) {
+            appendVarint(writeBuffer, PQgetlength(batch, i, j));
+            writeBuffer.append(PQgetvalue(batch, i, j), PQgetlength(batch, i, j));
+        }
+
+        ++rowsCount;
+    }
+
+    if (writeBuffer.length() >= bufferLimit)
+        return spillWriteBuffer();
+
+    return 0;
+}
+
+int SpillFile::spillWriteBuffer() {
+    if (!isSpilled) {
+        fileStream.open(filePath, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+        isSpilled = true;
+    }
+
+    fileStream.write(writeBuffer.data(), static_cast<std::streamsize>(writeBuffer.length()));
+    writeBuffer.clear();
+
+    if (!fileStream) {
+        std::cerr << "Error: Cannot write the spill file " << filePath << ".\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+int SpillFile::rewind() {
+    rowsRead = 0;
+    readPosition = 0;
+    readEnd = 0;
+
+    if (!isSpilled) /* Read straight from the write buffer */ {
+        isReadFinished = true;
+        return 0;
+    }
+
+    if (!writeBuffer.empty() && spillWriteBuffer())
+        return 1;
+
+    writeBuffer.shrink_to_fit();
+
+    fileStream.flush();
+    fileStream.clear();
+    fileStream.seekg(0);
+
+    readBuffer.resize(bufferLimit);
+    isReadFinished = false;
+
+    return fillReadBuffer();
+}
+
+int SpillFile::fillReadBuffer() {
+    const std::size_t unreadSize = readEnd - readPosition;
+
+    std::memmove(readBuffer.data(), readBuffer.data() + readPosition, unreadSize);
+    readPosition = 0;
+    readEnd = unreadSize;
+
+    // A single row bigger than the whole buffer
+    if (readEnd == readBuffer.size())
+        readBuffer.resize(readBuffer.size() * 2);
+
+    fileStream.read(readBuffer.data() + readEnd, static_cast<std::streamsize>(readBuffer.size() - readEnd));
+    readEnd += fileStream.gcount();
+
+    if (fileStream.bad()) {
+        std::cerr << "Error: Cannot read the spill file " << filePath << ".\n";
+        return 1;
+    }
+
+    if (fileStream.gcount() == 0)
+        isReadFinished = true;
+
+    return 0;
+}
+
+int SpillFile::readRow(std::vector<const char *> &values, std::vector<int> &lengths) {
+    values.resize(columnsCount);
+    lengths.resize(columnsCount);
+
+    while (true) {
+        const char *data = isSpilled ? readBuffer.data() : writeBuffer.data();
+        const char *end = data + (isSpilled ? readEnd : writeBuffer.length());
+        const char *position = data + readPosition;
+
+        if (rowsRead == rowsCount)
+            return 0;
+
+        int j = 0;
+
+        for (; j < columnsCount; ++j) {
+            std::uint64_t valueLength;
+
+            if (!readVarint(position, end, valueLength) || valueLength > static_cast<std::uint64_t>(end - position))
+                break;
+
+            values[j] = position;
+            lengths[j] = static_cast<int>(valueLength);
+            position += valueLength;
+        }
+
+        if (j == columnsCount) {
+            readPosition = position - data;
+            ++rowsRead;
+            return 1;
+        }
+
+        // The row goes on after the bytes read so far
+        if (isReadFinished) {
+            std::cerr << "Error: The spill file " << filePath << " ends in the middle of a row.\n";
+            return -1;
+        }
+
+        if (fillReadBuffer())
+            return -1;
+    }
+}
+
+std::uint64_t SpillFile::getRowsCount() const {
+    return rowsCount;
+}
+
+bool SpillFile::isOnDisk() const {
+    return isSpilled;
+}
+
+SpillFile::~SpillFile() {
+    if (!isSpilled)
+        return;
+
+    fileStream.close();
+    std::remove(filePath.c_str());
+}
+
+
+void appendVarint(std::string &destination, std::uint64_t value) {
+    while (value >= 0x80) {
+        destination.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+
+    destination.push_back(static_cast<char>(value));
+}
+
+bool readVarint(const char *&position, const char *end, std::uint64_t &value) {
+    value = 0;
+
+    for (int shift = 0; position < end && shift < 64; shift += 7) {
+        const auto byte = static_cast<unsigned char>(*position++);
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
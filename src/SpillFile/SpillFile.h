@@ -0,0 +1,59 @@
+#pragma once
+#include <libpq-fe.h>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// Rows of streamed results spooled as compact length-prefixed cells (varint length, then the bytes), so a
+// result can be read a second time without asking the server again. The rows stay in memory until they
+// outgrow the buffer limit, only then the spill file is created; reading uses a buffer of the same limit.
+class SpillFile {
+    std::string filePath;
+    std::size_t bufferLimit;
+
+    std::fstream fileStream;
+    bool isSpilled = false;
+
+    std::string writeBuffer;
+    std::uint64_t rowsCount = 0;
+    int columnsCount = 0;
+
+    std::vector<char> readBuffer;
+    std::size_t readPosition = 0;
+    std::size_t readEnd = 0;
+    std::uint64_t rowsRead = 0;
+    bool isReadFinished = false;
+
+    // Append the write buffer to the spill file (created on the first call)
+    int spillWriteBuffer();
+
+    // Read more of the spill file after the unread bytes, growing the buffer when a row does not fit
+    int fillReadBuffer();
+
+public:
+    SpillFile(std::string filePath, std::size_t bufferLimit);
+
+    SpillFile(const SpillFile &) = delete;
+
+    SpillFile &operator=(const SpillFile &) = delete;
+
+    // Spool every row of the batch
+    int appendRows(const PGresult *batch);
+
+    // Switch from appending to reading the rows from the first one
+    int rewind();
+
+    // Read the next row, *values*/*lengths* stay valid until the next call.
+    // Returns 1 for a row, 0 after the last one and -1 on a damaged spill file.
+    int readRow(std::vector<const char *> &values, std::vector<int> &lengths);
+
+    std::uint64_t getRowsCount() const;
+
+    // Whether the rows outgrew the memory and went to the spill file
+    bool isOnDisk() const;
+
+    // Remove the spill file
+    ~SpillFile();
+};
@@ -0,0 +1,45 @@
+#include "StreamSink.h"
+
+
+StreamSink::StreamSink(const OutputBackend outputBackend)
+    : isAsync(outputBackend == OutputBackend::ASYNC || outputBackend == OutputBackend::ASYNC_DIRECT),
+      isCompressed(outputBackend == OutputBackend::LZ4 || outputBackend == OutputBackend::LZ4_HC),
+      isPiped(outputBackend == OutputBackend::PIPE),
+      asyncFileWriter(outputBackend == OutputBackend::ASYNC_DIRECT),
+      compressedFileWriter(outputBackend == OutputBackend::LZ4_HC ? LZ4_HIGH_LEVEL : LZ4_FAST_LEVEL) {
+}
+
+int StreamSink::open(const std::string &outputFilePath) {
+    if (isAsync) {
+        fileStream.rdbuf(&asyncFileWriter);
+        return asyncFileWriter.open(outputFilePath);
+    }
+
+    if (isCompressed) {
+        fileStream.rdbuf(&compressedFileWriter);
+        return compressedFileWriter.open(outputFilePath);
+    }
+
+    if (isPiped) {
+        fileStream.rdbuf(&pipeWriter);
+        return pipeWriter.open(outputFilePath);
+    }
+
+    fileStream.rdbuf(&fileBuffer);
+    return fileBuffer.open(outputFilePath, std::ios::out | std::ios::binary) == nullptr;
+}
+
+int StreamSink::close() {
+    int closeStatus;
+
+    if (isAsync)
+        closeStatus = asyncFileWriter.close();
+    else if (isCompressed)
+        closeStatus = compressedFileWriter.close();
+    else if (isPiped)
+        closeStatus = pipeWriter.close();
+    else
+        closeStatus = fileBuffer.close() == nullptr;
+
+    return closeStatus != 0 || !fileStream;
+}
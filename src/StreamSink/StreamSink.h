@@ -0,0 +1,35 @@
+#pragma once
+#include <fstream>
+#include <ostream>
+#include <string>
+#include "../AsyncFileWriter/AsyncFileWriter.h"
+#include "../CompressedFile/CompressedFile.h"
+#include "../PipeWriter/PipeWriter.h"
+#include "../TableRenderer/TableRenderer.h"
+
+
+// Output file of the stream backends: a plain file buffer (STREAM), a writer thread (ASYNC, ASYNC_DIRECT),
+// compression threads (LZ4, LZ4_HC) or a pipe (PIPE). Write through fileStream between open and close.
+class StreamSink {
+    const bool isAsync;
+    const bool isCompressed;
+    const bool isPiped;
+    std::filebuf fileBuffer;
+    AsyncFileWriter asyncFileWriter;
+    CompressedFileWriter compressedFileWriter;
+    PipeWriter pipeWriter;
+
+public:
+    std::ostream fileStream{nullptr};
+
+    explicit StreamSink(OutputBackend outputBackend);
+
+    StreamSink(const StreamSink &) = delete;
+
+    StreamSink &operator=(const StreamSink &) = delete;
+
+    int open(const std::string &outputFilePath);
+
+    // Non-zero when any write failed
+    int close();
+};
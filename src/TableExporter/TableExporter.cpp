@@ -0,0 +1,952 @@
+#include "TableExporter.h"
+#include "../StreamSink/StreamSink.h"
+#include "../DbConnection/DbConnection.h"
+#include "../SpillFile/SpillFile.h"
+#include "../Checkpoint/Checkpoint.h"
+#include "../SHA256/SHA256.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <thread>
+#include <vector>
+
+
+#define CURSOR_BATCH_SIZE 10000
+#define PARALLEL_EXPORT_MAX_WORKERS 8
+#define SPILL_FILE_EXTENSION std::string(".spill")
+#define EXPORT_QUERY_ALIAS std::string("export_query")
+#define CHECKPOINT_FILE_EXTENSION std::string(".checkpoint")
+#define RESUMABLE_PAGE_SIZE 10000
+// Bytes before the checkpoint offset a resumed export compares with the checkpoint
+#define CHECKPOINT_TAIL_BYTES 4096
+
+
+// One page range of a parallel export and the connection reading it
+struct RangeWorker {
+    PGconn *connection = nullptr;
+    std::string query;
+    std::optional<TableRenderer> tableRenderer;
+    std::string::size_type rowsCount = 0;
+    std::string::size_type outputOffset = 0;
+    // End of the part of the file reserved for the rows counted in pass one
+    std::string::size_type outputEnd = 0;
+    int status = 0;
+};
+
+// SHA-256 of the CHECKPOINT_TAIL_BYTES of the output before *offset* (the write position is kept)
+std::string outputTailChecksum(std::fstream &outputStream, std::uint64_t offset);
+
+
+int TableExporter::streamQuery(PGconn *connection, const std::string &query, const ExecutionStrategy strategy,
+                               const BatchConsumer &consumer) {
+    if (strategy == ExecutionStrategy::SINGLE_ROW)
+        return QueryStream::streamSingleRow(connection, query, consumer);
+
+    return QueryStream::streamCursor(connection, query, CURSOR_BATCH_SIZE, consumer);
+}
+
+int TableExporter::exportStreamed(PGconn *connection, const std::string &query, const ExecutionStrategy strategy,
+                                  const std::string &outputFilePath, const OutputBackend outputBackend) {
+    // Both passes have to see the same rows
+    const bool isOwnTransaction = PQtransactionStatus(connection) == PQTRANS_IDLE;
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, SNAPSHOT_TRANSACTION));
+
+    std::optional<TableRenderer> tableRenderer;
+    std::string::size_type rowsCount = 0;
+
+    // Pass one: the column widths
+    int exportStatus = streamQuery(connection, query, strategy, [&tableRenderer, &rowsCount](const PGresult *batch) {
+        if (!tableRenderer)
+            tableRenderer.emplace(batch);
+
+        tableRenderer->observe(batch);
+        rowsCount += PQntuples(batch);
+        return 0;
+    });
+
+    if (exportStatus == 0 && outputBackend == OutputBackend::MAPPED) {
+        MappedFile outputFile;
+        exportStatus = outputFile.open(outputFilePath, tableRenderer->totalSize(rowsCount));
+
+        if (exportStatus == 0) {
+            char *position = tableRenderer->renderHead(outputFile.data());
+            const char *rowsEnd = position + rowsCount * tableRenderer->rowSize() + tableRenderer->excessBytes();
+
+            // Pass two: the rows themselves, rendered right into the mapping
+            exportStatus = streamQuery(connection, query, strategy,
+                                       [&tableRenderer, &position, rowsEnd](const PGresult *batch) {
+                                           const std::string::size_type batchSize =
+                                                   tableRenderer->renderedSize(batch, 0, PQntuples(batch));
+
+                                           if (batchSize > static_cast<std::string::size_type>(rowsEnd - position))
+                                               return 1;
+
+                                           position = tableRenderer->renderRows(batch, 0, PQntuples(batch), position);
+                                           return 0;
+                                       });
+
+            // The tail goes right after the last row, the file has to be exactly as big as pass one computed
+            if (exportStatus == 0 && position != rowsEnd) {
+                std::cerr << "MAPPED EXPORT failed: The rows of " << query << " changed between the two passes.\n";
+                exportStatus = 1;
+            }
+
+            if (exportStatus == 0)
+                tableRenderer->renderTail(position);
+
+            exportStatus |= outputFile.close();
+        }
+    } else if (exportStatus == 0) {
+        StreamSink streamSink{outputBackend};
+        std::ostream &fileStream = streamSink.fileStream;
+
+        exportStatus = streamSink.open(outputFilePath);
+
+        if (exportStatus == 0)
+            tableRenderer->writeHead(fileStream);
+
+        // Pass two: the rows themselves
+        if (exportStatus == 0)
+            exportStatus = streamQuery(connection, query, strategy, [&tableRenderer, &fileStream](const PGresult *batch) {
+                tableRenderer->writeRows(fileStream, batch);
+                return fileStream ? 0 : 1;
+            });
+
+        if (exportStatus == 0)
+            tableRenderer->writeTail(fileStream);
+
+        exportStatus |= streamSink.close();
+    }
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, exportStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    return exportStatus;
+}
+
+int TableExporter::exportSpilled(PGconn *connection, const std::string &query, const ExecutionStrategy strategy,
+                                 const std::string &outputFilePath, const OutputBackend outputBackend,
+                                 const std::size_t memoryBudget) {
+    // Half for the spooled rows, a quarter for reading them back, a quarter for the rendered rows
+    SpillFile spillFile{outputFilePath + SPILL_FILE_EXTENSION, memoryBudget / 2};
+    std::optional<TableRenderer> tableRenderer;
+
+    // Pass one: the column widths, the rows go to the spill file
+    int exportStatus = streamQuery(connection, query, strategy, [&tableRenderer, &spillFile](const PGresult *batch) {
+        if (!tableRenderer)
+            tableRenderer.emplace(batch);
+
+        tableRenderer->observe(batch);
+        return spillFile.appendRows(batch);
+    });
+
+    if (exportStatus == 0)
+        exportStatus = spillFile.rewind();
+
+    if (exportStatus != 0) {
+        std::cerr << "SPILL EXPORT failed: " << query << " could not be spooled.\n";
+        return 1;
+    }
+
+    const std::string::size_type rowSize = tableRenderer->rowSize();
+
+    MappedFile mappedFile;
+    StreamSink streamSink{outputBackend};
+    std::ostream &fileStream = streamSink.fileStream;
+
+    // The mapping is the render buffer, the other backends get a buffer of at least one row
+    std::vector<char> renderBuffer;
+    char *position = nullptr;
+    const char *renderEnd = nullptr;
+
+    if (outputBackend == OutputBackend::MAPPED) {
+        exportStatus = mappedFile.open(outputFilePath, tableRenderer->totalSize(spillFile.getRowsCount()));
+
+        if (exportStatus == 0) {
+            position = tableRenderer->renderHead(mappedFile.data());
+            renderEnd = position + spillFile.getRowsCount() * rowSize + tableRenderer->excessBytes();
+        }
+    } else {
+        exportStatus = streamSink.open(outputFilePath);
+
+        renderBuffer.resize(std::max(memoryBudget / 4 / rowSize, static_cast<std::size_t>(1)) * rowSize);
+        position = renderBuffer.data();
+        renderEnd = position + renderBuffer.size();
+
+        if (exportStatus == 0)
+            tableRenderer->writeHead(fileStream);
+    }
+
+    // Pass two: render the spooled rows
+    std::vector<const char *> values;
+    std::vector<int> lengths;
+    int readStatus = 0;
+
+    while (exportStatus == 0 && (readStatus = spillFile.readRow(values, lengths)) == 1) {
+        const std::string::size_type renderedRowSize = tableRenderer->renderedSize(values.data(), lengths.data());
+
+        if (static_cast<std::string::size_type>(renderEnd - position) < renderedRowSize) {
+            if (outputBackend == OutputBackend::MAPPED) /* More rows than counted in pass one */ {
+                exportStatus = 1;
+                break;
+            }
+
+            fileStream.write(renderBuffer.data(), position - renderBuffer.data());
+
+            // A row of many multi-byte characters can outgrow the buffer
+            if (renderedRowSize > renderBuffer.size())
+                renderBuffer.resize(renderedRowSize);
+
+            position = renderBuffer.data();
+            renderEnd = position + renderBuffer.size();
+        }
+
+        position = tableRenderer->renderRow(values.data(), lengths.data(), position);
+    }
+
+    if (readStatus < 0)
+        exportStatus = 1;
+
+    if (outputBackend == OutputBackend::MAPPED) {
+        if (exportStatus == 0)
+            tableRenderer->renderTail(position);
+
+        exportStatus |= mappedFile.close();
+    } else {
+        if (exportStatus == 0) {
+            fileStream.write(renderBuffer.data(), position - renderBuffer.data());
+            tableRenderer->writeTail(fileStream);
+        }
+
+        exportStatus |= streamSink.close();
+    }
+
+    if (exportStatus != 0)
+        std::cerr << "SPILL EXPORT failed: Cannot write " << outputFilePath << ".\n";
+
+    return exportStatus;
+}
+
+int TableExporter::exportServerWidths(PGconn *connection, const std::string &query, const ExecutionStrategy strategy,
+                                      const std::string &outputFilePath, const OutputBackend outputBackend) {
+    // The widths have to describe the very rows which are streamed afterwards
+    const bool isOwnTransaction = PQtransactionStatus(connection) == PQTRANS_IDLE;
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, SNAPSHOT_TRANSACTION));
+
+    const std::string describeQuery =
+            std::string("SELECT * FROM (") + query + std::string(") AS ") + EXPORT_QUERY_ALIAS +
+            std::string(" LIMIT 0;");
+
+    PGresult *describeResult = PQexec(connection, describeQuery.c_str());
+
+    if (PQresultStatus(describeResult) != PGRES_TUPLES_OK) {
+        std::cerr << "SERVER WIDTHS EXPORT failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(describeResult);
+        if (isOwnTransaction)
+            PQclear(PQexec(connection, "ROLLBACK;"));
+        return 1;
+    }
+
+    // format('%s', ...) goes through the output function of the type, like the values of the result rows
+    std::string widthsQuery = std::string("SELECT count(*)");
+
+    for (int i = 0; i < PQnfields(describeResult); ++i) {
+        char *columnIdentifier = PQescapeIdentifier(connection, PQfname(describeResult, i),
+                                                    std::strlen(PQfname(describeResult, i)));
+
+        widthsQuery += std::string(", coalesce(max(octet_length(format('%s', ") + EXPORT_QUERY_ALIAS +
+                std::string(".") + columnIdentifier + std::string("))), 0)");
+        PQfreemem(columnIdentifier);
+    }
+
+    const int columnsCount = PQnfields(describeResult);
+
+    // A mapping needs the exact size, which the widths only give for single byte characters
+    if (outputBackend == OutputBackend::MAPPED)
+        widthsQuery += std::string(", bool_and(octet_length(") + EXPORT_QUERY_ALIAS +
+                std::string("::text) = char_length(") + EXPORT_QUERY_ALIAS + std::string("::text))");
+
+    widthsQuery += std::string(" FROM (") + query + std::string(") AS ") + EXPORT_QUERY_ALIAS + std::string(";");
+    PQclear(describeResult);
+
+    PGresult *widthsResult = PQexec(connection, widthsQuery.c_str());
+
+    if (PQresultStatus(widthsResult) != PGRES_TUPLES_OK || PQntuples(widthsResult) != 1) {
+        std::cerr << "SERVER WIDTHS EXPORT failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(widthsResult);
+        if (isOwnTransaction)
+            PQclear(PQexec(connection, "ROLLBACK;"));
+        return 1;
+    }
+
+    const std::string::size_type rowsCount = std::stoull(PQgetvalue(widthsResult, 0, 0));
+    std::vector<std::string::size_type> valueWidths;
+
+    for (int i = 1; i <= columnsCount; ++i)
+        valueWidths.push_back(std::stoull(PQgetvalue(widthsResult, 0, i)));
+
+    // Multi-byte text is streamed instead (the aggregate is NULL for no rows)
+    const OutputBackend rowsBackend =
+            outputBackend == OutputBackend::MAPPED && *PQgetvalue(widthsResult, 0, columnsCount + 1) == 'f'
+                ? OutputBackend::STREAM
+                : outputBackend;
+    PQclear(widthsResult);
+
+    std::optional<TableRenderer> tableRenderer;
+    std::string::size_type renderedRowsCount = 0;
+
+    MappedFile mappedFile;
+    char *position = nullptr;
+
+    StreamSink streamSink{rowsBackend};
+    std::ostream &fileStream = streamSink.fileStream;
+
+    // The only pass: the head is written with the first batch, its rows right after it
+    int exportStatus = streamQuery(connection, query, strategy, [&](const PGresult *batch) {
+        if (!tableRenderer) {
+            tableRenderer.emplace(batch);
+            tableRenderer->widen(valueWidths);
+
+            if (rowsBackend == OutputBackend::MAPPED) {
+                if (mappedFile.open(outputFilePath, tableRenderer->totalSize(rowsCount)))
+                    return 1;
+                position = tableRenderer->renderHead(mappedFile.data());
+            } else {
+                if (streamSink.open(outputFilePath))
+                    return 1;
+                tableRenderer->writeHead(fileStream);
+            }
+        }
+
+        // A row the widths do not cover would break the layout of the table
+        if (renderedRowsCount + PQntuples(batch) > rowsCount || !tableRenderer->fits(batch)) {
+            std::cerr << "SERVER WIDTHS EXPORT failed: The rows do not match the computed widths.\n";
+            return 1;
+        }
+
+        renderedRowsCount += PQntuples(batch);
+
+        if (rowsBackend == OutputBackend::MAPPED) {
+            position = tableRenderer->renderRows(batch, 0, PQntuples(batch), position);
+            return 0;
+        }
+
+        tableRenderer->writeRows(fileStream, batch);
+        return fileStream ? 0 : 1;
+    });
+
+    if (exportStatus == 0 && renderedRowsCount != rowsCount)
+        exportStatus = 1;
+
+    if (rowsBackend == OutputBackend::MAPPED) {
+        if (exportStatus == 0)
+            tableRenderer->renderTail(position);
+
+        exportStatus |= mappedFile.close();
+    } else {
+        if (exportStatus == 0)
+            tableRenderer->writeTail(fileStream);
+
+        exportStatus |= streamSink.close();
+    }
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, exportStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    return exportStatus;
+}
+
+int TableExporter::exportFormatted(PGconn *connection, const std::string &query, const ExecutionStrategy strategy,
+                                   const ExportFormat format, const std::string &outputFilePath,
+                                   const OutputBackend outputBackend) {
+    const bool isTwoPass = FormatWriter::needsWidths(format);
+    const bool isOwnTransaction = isTwoPass && PQtransactionStatus(connection) == PQTRANS_IDLE;
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, SNAPSHOT_TRANSACTION));
+
+    std::unique_ptr<FormatWriter> formatWriter;
+    int exportStatus = 0;
+
+    // Pass one (padded formats only): the column widths
+    if (isTwoPass)
+        exportStatus = streamQuery(connection, query, strategy, [&formatWriter, format](const PGresult *batch) {
+            if (!formatWriter)
+                formatWriter = FormatWriter::create(format, batch);
+
+            formatWriter->observe(batch);
+            return 0;
+        });
+
+    StreamSink streamSink{outputBackend};
+    std::ostream &fileStream = streamSink.fileStream;
+
+    if (exportStatus == 0)
+        exportStatus = streamSink.open(outputFilePath);
+
+    if (exportStatus == 0) {
+        // The head is written with the first batch, single pass formats create their writer from it
+        bool isHeadWritten = false;
+
+        exportStatus = streamQuery(connection, query, strategy, [&](const PGresult *batch) {
+            if (!formatWriter)
+                formatWriter = FormatWriter::create(format, batch);
+
+            if (!isHeadWritten) {
+                formatWriter->writeHead(fileStream);
+                isHeadWritten = true;
+            }
+
+            formatWriter->writeRows(fileStream, batch);
+            return fileStream ? 0 : 1;
+        });
+
+        if (exportStatus == 0)
+            formatWriter->writeTail(fileStream);
+    }
+
+    exportStatus |= streamSink.close();
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, exportStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    if (exportStatus != 0)
+        std::cerr << FormatWriter::formatName(format) << " EXPORT failed: Cannot write " << outputFilePath << ".\n";
+
+    return exportStatus;
+}
+
+int TableExporter::exportCopy(PGconn *connection, const std::string &query, const ExportFormat format,
+                              const std::string &outputFilePath, const OutputBackend outputBackend) {
+    // COPY sends no column metadata, the writer gets it from an empty result of the query
+    const std::string describeQuery =
+            std::string("SELECT * FROM (") + query + std::string(") AS ") + EXPORT_QUERY_ALIAS +
+            std::string(" LIMIT 0;");
+
+    PGresult *describeResult = PQexec(connection, describeQuery.c_str());
+
+    if (PQresultStatus(describeResult) != PGRES_TUPLES_OK) {
+        std::cerr << "COPY EXPORT failed: " << PQerrorMessage(connection) << std::endl;
+        PQclear(describeResult);
+        return 1;
+    }
+
+    const std::unique_ptr<FormatWriter> formatWriter = FormatWriter::create(format, describeResult);
+    const std::size_t columnsCount = PQnfields(describeResult);
+    PQclear(describeResult);
+
+    const bool isTwoPass = FormatWriter::needsWidths(format);
+    const bool isOwnTransaction = isTwoPass && PQtransactionStatus(connection) == PQTRANS_IDLE;
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, SNAPSHOT_TRANSACTION));
+
+    int exportStatus = 0;
+
+    // Pass one (padded formats only): the column widths
+    if (isTwoPass)
+        exportStatus = CopyTextDecoder::streamCopy(connection, query, columnsCount, CURSOR_BATCH_SIZE,
+                                                   [&formatWriter](const CopyBatch &batch) {
+                                                       formatWriter->observe(batch);
+                                                       return 0;
+                                                   });
+
+    StreamSink streamSink{outputBackend};
+    std::ostream &fileStream = streamSink.fileStream;
+
+    if (exportStatus == 0)
+        exportStatus = streamSink.open(outputFilePath);
+
+    if (exportStatus == 0) {
+        formatWriter->writeHead(fileStream);
+
+        exportStatus = CopyTextDecoder::streamCopy(connection, query, columnsCount, CURSOR_BATCH_SIZE,
+                                                   [&formatWriter, &fileStream](const CopyBatch &batch) {
+                                                       formatWriter->writeRows(fileStream, batch);
+                                                       return fileStream ? 0 : 1;
+                                                   });
+
+        if (exportStatus == 0)
+            formatWriter->writeTail(fileStream);
+    }
+
+    exportStatus |= streamSink.close();
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, exportStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    if (exportStatus != 0)
+        std::cerr << FormatWriter::formatName(format) << " EXPORT failed: Cannot write " << outputFilePath << ".\n";
+
+    return exportStatus;
+}
+
+int TableExporter::writeFormatted(const PGresult *queryResult, const ExportFormat format,
+                                  const std::string &outputFilePath, const OutputBackend outputBackend) {
+    if (format == ExportFormat::COLUMNAR) /* Text results only give UTF8 columns */ {
+        ColumnarWriter columnarWriter;
+        int writeStatus = columnarWriter.open(outputFilePath, queryResult);
+
+        if (writeStatus == 0)
+            writeStatus = columnarWriter.appendRows(queryResult);
+
+        return writeStatus | columnarWriter.close();
+    }
+
+    const std::unique_ptr<FormatWriter> formatWriter = FormatWriter::create(format, queryResult);
+    formatWriter->observe(queryResult);
+
+    StreamSink streamSink{outputBackend};
+    int writeStatus = streamSink.open(outputFilePath);
+
+    if (writeStatus == 0) {
+        formatWriter->writeHead(streamSink.fileStream);
+        formatWriter->writeRows(streamSink.fileStream, queryResult);
+        formatWriter->writeTail(streamSink.fileStream);
+    }
+
+    writeStatus |= streamSink.close();
+
+    if (writeStatus != 0)
+        std::cerr << FormatWriter::formatName(format) << " EXPORT failed: Cannot write " << outputFilePath << ".\n";
+
+    return writeStatus;
+}
+
+int TableExporter::exportColumnar(PGconn *connection, const std::string &query, const std::string &outputFilePath) {
+    const std::string describeQuery =
+            std::string("SELECT * FROM (") + query + std::string(") AS ") + EXPORT_QUERY_ALIAS +
+            std::string(" LIMIT 0;");
+
+    PGresult *describeResult = PQexec(connection, describeQuery.c_str());
+
+    if (PQresultStatus(describeResult) != PGRES_TUPLES_OK) {
+        std::cerr << "COLUMNAR EXPORT failed: " << PQerrorMessage(connection) << std::endl;
+        PQclear(describeResult);
+        return 1;
+    }
+
+    // Column list keeping the names, with a text cast where the binary form is not decoded
+    std::string columnsList;
+
+    for (int i = 0; i < PQnfields(describeResult); ++i) {
+        char *columnIdentifier = PQescapeIdentifier(connection, PQfname(describeResult, i),
+                                                    std::strlen(PQfname(describeResult, i)));
+
+        columnsList += std::string(i > 0 ? ", " : "") + EXPORT_QUERY_ALIAS + std::string(".") + columnIdentifier;
+        if (!ColumnarWriter::isBinarySupported(PQftype(describeResult, i)))
+            columnsList += std::string("::text AS ") + columnIdentifier;
+
+        PQfreemem(columnIdentifier);
+    }
+    PQclear(describeResult);
+
+    const std::string columnarQuery =
+            std::string("SELECT ") + columnsList + std::string(" FROM (") + query + std::string(") AS ") +
+            EXPORT_QUERY_ALIAS;
+
+    // The file gets its columns from a binary description, so empty results still have their schema
+    PGresult *columnsResult = PQexecParams(connection, (columnarQuery + std::string(" LIMIT 0;")).c_str(), 0,
+                                           nullptr, nullptr, nullptr, nullptr, 1);
+
+    if (PQresultStatus(columnsResult) != PGRES_TUPLES_OK) {
+        std::cerr << "COLUMNAR EXPORT failed: " << PQerrorMessage(connection) << std::endl;
+        PQclear(columnsResult);
+        return 1;
+    }
+
+    ColumnarWriter columnarWriter;
+    int exportStatus = columnarWriter.open(outputFilePath, columnsResult);
+    const std::size_t columnsCount = PQnfields(columnsResult);
+    PQclear(columnsResult);
+
+    // The tuples arrive as COPY BINARY, decoded into the column buffers straight from the received chunks
+    if (exportStatus == 0)
+        exportStatus = CopyBinaryDecoder::streamCopy(connection, columnarQuery, columnsCount,
+                                                     CURSOR_BATCH_SIZE, [&columnarWriter](const CopyBatch &batch) {
+                                                         return columnarWriter.appendRows(batch);
+                                                     });
+
+    exportStatus |= columnarWriter.close();
+    return exportStatus;
+}
+
+int TableExporter::exportResumable(PGconn *connection, const std::string &tableName, const ExportFormat format,
+                                   const std::string &outputFilePath) {
+    const std::string checkpointFilePath = outputFilePath + CHECKPOINT_FILE_EXTENSION;
+    std::vector<std::string> keyColumnNames;
+
+    if (ExecutionPlanner::readPrimaryKey(connection, tableName, keyColumnNames))
+        return 1;
+
+    if (keyColumnNames.empty()) {
+        std::cerr << "RESUMABLE EXPORT failed: " << tableName << " has no primary key to page by.\n";
+        return 1;
+    }
+
+    // Pages by (key) > (last key) in key order: each one is an index range scan, however far the export got
+    std::string keyList, keyParameters;
+    for (std::size_t i = 0; i < keyColumnNames.size(); ++i) {
+        char *keyIdentifier = PQescapeIdentifier(connection, keyColumnNames[i].c_str(), keyColumnNames[i].length());
+        keyList += (i > 0 ? ", " : "") + std::string(keyIdentifier);
+        keyParameters += (i > 0 ? ", $" : "$") + std::to_string(i + 1);
+        PQfreemem(keyIdentifier);
+    }
+
+    const std::string selectQuery = std::string("SELECT * FROM ") + tableName;
+    const std::string pageOrder = std::string(" ORDER BY ") + keyList + std::string(" LIMIT ") +
+                                  std::to_string(RESUMABLE_PAGE_SIZE) + std::string(";");
+    const std::string firstPageQuery = selectQuery + pageOrder;
+    const std::string nextPageQuery = selectQuery + std::string(" WHERE (") + keyList + std::string(") > (") +
+                                      keyParameters + std::string(")") + pageOrder;
+
+    // One run sees one snapshot, a resumed run continues with the rows as they are then
+    const bool isOwnTransaction = PQtransactionStatus(connection) == PQTRANS_IDLE;
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, SNAPSHOT_TRANSACTION));
+
+    PGresult *describeResult = PQexec(connection, (selectQuery + std::string(" LIMIT 0;")).c_str());
+
+    if (PQresultStatus(describeResult) != PGRES_TUPLES_OK) {
+        std::cerr << "RESUMABLE EXPORT failed: " << PQresultErrorMessage(describeResult) << std::endl;
+        PQclear(describeResult);
+
+        if (isOwnTransaction)
+            PQclear(PQexec(connection, "ROLLBACK;"));
+        return 1;
+    }
+
+    const std::unique_ptr<FormatWriter> formatWriter = FormatWriter::create(format, describeResult);
+
+    std::vector<int> keyColumns;
+    for (const std::string &keyColumnName: keyColumnNames)
+        keyColumns.push_back(PQfnumber(describeResult, (std::string("\"") + keyColumnName + "\"").c_str()));
+
+    PQclear(describeResult);
+
+    ExportCheckpoint checkpoint;
+    std::fstream outputStream;
+    int exportStatus = 0;
+
+    const bool isResumed = checkpoint.load(checkpointFilePath) == 0 && checkpoint.tableName == tableName &&
+                           checkpoint.formatName == FormatWriter::formatName(format) &&
+                           (checkpoint.lastKey.empty() || checkpoint.lastKey.size() == keyColumns.size());
+
+    if (isResumed) /* The output has to end the way the checkpoint saw it, the rest is cut */ {
+        std::error_code errorCode;
+        const std::uintmax_t outputSize = std::filesystem::file_size(outputFilePath, errorCode);
+
+        if (!errorCode && outputSize >= checkpoint.outputOffset)
+            outputStream.open(outputFilePath, std::ios::in | std::ios::out | std::ios::binary);
+
+        if (!outputStream.is_open() ||
+            outputTailChecksum(outputStream, checkpoint.outputOffset) != checkpoint.tailChecksum) {
+            std::cerr << "RESUMABLE EXPORT failed: " << outputFilePath << " does not match its checkpoint, delete "
+                    << checkpointFilePath << " to export it again.\n";
+            exportStatus = 1;
+        } else {
+            outputStream.close();
+            std::filesystem::resize_file(outputFilePath, checkpoint.outputOffset, errorCode);
+            outputStream.open(outputFilePath, std::ios::in | std::ios::out | std::ios::binary);
+            outputStream.seekp(static_cast<std::streamoff>(checkpoint.outputOffset));
+
+            formatWriter->widen(checkpoint.columnWidths);
+
+            std::cout << "Resuming the export of " << tableName << " after " << checkpoint.rowsCount
+                    << " row(s).\n";
+        }
+    } else {
+        checkpoint = ExportCheckpoint{};
+        checkpoint.tableName = tableName;
+        checkpoint.formatName = FormatWriter::formatName(format);
+
+        // Padded formats: the widths of every row, the checkpoint keeps them for the resumed runs
+        if (FormatWriter::needsWidths(format))
+            exportStatus = QueryStream::streamCursor(connection, selectQuery, CURSOR_BATCH_SIZE,
+                                                     [&formatWriter](const PGresult *batch) {
+                                                         formatWriter->observe(batch);
+                                                         return 0;
+                                                     });
+
+        if (exportStatus == 0)
+            outputStream.open(outputFilePath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if (exportStatus == 0 && !outputStream.is_open()) {
+            std::cerr << "RESUMABLE EXPORT failed: Cannot write " << outputFilePath << ".\n";
+            exportStatus = 1;
+        } else if (exportStatus == 0) {
+            formatWriter->writeHead(outputStream);
+            outputStream.flush();
+
+            checkpoint.columnWidths = formatWriter->getColumnWidths();
+            checkpoint.outputOffset = static_cast<std::uint64_t>(outputStream.tellp());
+            checkpoint.tailChecksum = outputTailChecksum(outputStream, checkpoint.outputOffset);
+            exportStatus = !outputStream || checkpoint.save(checkpointFilePath);
+        }
+    }
+
+    while (exportStatus == 0) {
+        std::vector<const char *> paramValues;
+        for (const std::string &keyValue: checkpoint.lastKey)
+            paramValues.push_back(keyValue.c_str());
+
+        PGresult *pageResult = checkpoint.lastKey.empty()
+                                   ? PQexec(connection, firstPageQuery.c_str())
+                                   : PQexecParams(connection, nextPageQuery.c_str(),
+                                                  static_cast<int>(paramValues.size()), nullptr, paramValues.data(),
+                                                  nullptr, nullptr, 0);
+
+        if (PQresultStatus(pageResult) != PGRES_TUPLES_OK) {
+            std::cerr << "RESUMABLE EXPORT failed: " << PQresultErrorMessage(pageResult) << std::endl;
+            PQclear(pageResult);
+            exportStatus = 1;
+            break;
+        }
+
+        const int pageRowsCount = PQntuples(pageResult);
+
+        if (pageRowsCount == 0) {
+            PQclear(pageResult);
+            break;
+        }
+
+        if (!formatWriter->fits(pageResult)) {
+            std::cerr << "RESUMABLE EXPORT failed: Rows of " << tableName << " got wider than the export, delete "
+                    << checkpointFilePath << " to export it again.\n";
+            PQclear(pageResult);
+            exportStatus = 1;
+            break;
+        }
+
+        formatWriter->writeRows(outputStream, pageResult);
+        outputStream.flush();
+
+        // The rows are in the file before the checkpoint says so
+        checkpoint.lastKey.clear();
+        for (const int keyColumn: keyColumns)
+            checkpoint.lastKey.emplace_back(PQgetvalue(pageResult, pageRowsCount - 1, keyColumn));
+
+        checkpoint.rowsCount += pageRowsCount;
+        checkpoint.outputOffset = static_cast<std::uint64_t>(outputStream.tellp());
+        checkpoint.tailChecksum = outputTailChecksum(outputStream, checkpoint.outputOffset);
+        PQclear(pageResult);
+
+        exportStatus = !outputStream || checkpoint.save(checkpointFilePath);
+    }
+
+    if (exportStatus == 0) {
+        formatWriter->writeTail(outputStream);
+        outputStream.close();
+        exportStatus = !outputStream;
+    }
+
+    // A finished export needs no checkpoint, a failed one keeps it for the next run
+    if (exportStatus == 0)
+        std::remove(checkpointFilePath.c_str());
+
+    if (isOwnTransaction)
+        PQclear(PQexec(connection, exportStatus == 0 ? "COMMIT;" : "ROLLBACK;"));
+
+    return exportStatus;
+}
+
+int TableExporter::exportParallelRanges(PGconn *connection, const std::string &tableName,
+                                        const long long tablePages, const std::string &outputFilePath,
+                                        const OutputBackend outputBackend) {
+    const long long workersCount = std::max<long long>(std::min<long long>(
+        {std::thread::hardware_concurrency(), PARALLEL_EXPORT_MAX_WORKERS, tablePages}), 1);
+    const long long pagesPerRange = std::max<long long>((tablePages + workersCount - 1) / workersCount, 1);
+
+    // Every worker imports the snapshot of this transaction, so all ranges come from the same point in time
+    PQclear(PQexec(connection, SNAPSHOT_TRANSACTION));
+
+    PGresult *snapshotResult = PQexec(connection, "SELECT pg_export_snapshot();");
+
+    if (PQresultStatus(snapshotResult) != PGRES_TUPLES_OK) {
+        std::cerr << "PARALLEL EXPORT failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(snapshotResult);
+        PQclear(PQexec(connection, "ROLLBACK;"));
+        return 1;
+    }
+
+    const std::string importSnapshotQuery =
+            std::string("SET TRANSACTION SNAPSHOT '") + PQgetvalue(snapshotResult, 0, 0) + std::string("';");
+    PQclear(snapshotResult);
+
+    std::vector<RangeWorker> rangeWorkers(workersCount);
+    int exportStatus = 0;
+
+    for (long long i = 0; i < workersCount; ++i) {
+        RangeWorker &rangeWorker = rangeWorkers[i];
+
+        // The last range is open, the table may have grown since its size was read
+        rangeWorker.query =
+                std::string("SELECT * FROM ") + tableName +
+                std::string(" WHERE ctid >= '(") + std::to_string(i * pagesPerRange) + std::string(",0)'::tid");
+        if (i < workersCount - 1)
+            rangeWorker.query +=
+                    std::string(" AND ctid < '(") + std::to_string((i + 1) * pagesPerRange) + std::string(",0)'::tid");
+
+        rangeWorker.connection = DbConnection::cloneConnection(connection);
+
+        if (rangeWorker.connection == nullptr) {
+            exportStatus = 1;
+            break;
+        }
+
+        PQclear(PQexec(rangeWorker.connection, SNAPSHOT_TRANSACTION));
+        PGresult *importResult = PQexec(rangeWorker.connection, importSnapshotQuery.c_str());
+
+        if (PQresultStatus(importResult) != PGRES_COMMAND_OK) {
+            std::cerr << "PARALLEL EXPORT failed: " << PQerrorMessage(rangeWorker.connection) << std::endl;
+            exportStatus = 1;
+        }
+        PQclear(importResult);
+
+        if (exportStatus != 0)
+            break;
+    }
+
+    // Pass one: column widths and row count of every range
+    if (exportStatus == 0) {
+        std::vector<std::thread> threads;
+
+        for (RangeWorker &rangeWorker: rangeWorkers) {
+            threads.emplace_back([&rangeWorker] {
+                rangeWorker.status = QueryStream::streamCursor(
+                    rangeWorker.connection, rangeWorker.query, CURSOR_BATCH_SIZE,
+                    [&rangeWorker](const PGresult *batch) {
+                        if (!rangeWorker.tableRenderer)
+                            rangeWorker.tableRenderer.emplace(batch);
+
+                        rangeWorker.tableRenderer->observe(batch);
+                        rangeWorker.rowsCount += PQntuples(batch);
+                        return 0;
+                    });
+            });
+        }
+
+        for (std::thread &thread: threads)
+            thread.join();
+
+        for (const RangeWorker &rangeWorker: rangeWorkers)
+            exportStatus |= rangeWorker.status;
+    }
+
+    if (exportStatus == 0) {
+        TableRenderer tableRenderer = *rangeWorkers[0].tableRenderer;
+
+        for (std::size_t i = 1; i < rangeWorkers.size(); ++i)
+            tableRenderer.merge(*rangeWorkers[i].tableRenderer);
+
+        // Each range knows the size of its rows (and of their multi-byte characters), so where its rows start
+        std::string::size_type outputOffset = tableRenderer.headSize();
+
+        for (RangeWorker &rangeWorker: rangeWorkers) {
+            rangeWorker.outputOffset = outputOffset;
+            outputOffset += rangeWorker.rowsCount * tableRenderer.rowSize() + rangeWorker.tableRenderer->excessBytes();
+            rangeWorker.outputEnd = outputOffset;
+        }
+
+        const std::string::size_type outputSize = outputOffset + tableRenderer.lineWidth() + 1;
+
+        PositionalFile positionalFile;
+        MappedFile mappedFile;
+
+        if (outputBackend == OutputBackend::MAPPED) {
+            exportStatus = mappedFile.open(outputFilePath, outputSize);
+
+            if (exportStatus == 0) {
+                tableRenderer.renderHead(mappedFile.data());
+                tableRenderer.renderTail(mappedFile.data() + outputOffset);
+            }
+        } else {
+            exportStatus = positionalFile.open(outputFilePath) || positionalFile.resize(outputSize) ||
+                           tableRenderer.writeHeadAt(positionalFile) ||
+                           tableRenderer.writeTailAt(positionalFile, outputOffset);
+        }
+
+        if (exportStatus != 0)
+            std::cerr << "PARALLEL EXPORT failed: Cannot write " << outputFilePath << ".\n";
+
+        // Pass two: every range renders its rows into its own part of the file
+        if (exportStatus == 0) {
+            std::vector<std::thread> threads;
+
+            for (RangeWorker &rangeWorker: rangeWorkers) {
+                threads.emplace_back([&rangeWorker, &tableRenderer, &positionalFile, &mappedFile, outputBackend] {
+                    rangeWorker.status = QueryStream::streamCursor(
+                        rangeWorker.connection, rangeWorker.query, CURSOR_BATCH_SIZE,
+                        [&](const PGresult *batch) {
+                            const std::string::size_type batchSize =
+                                    tableRenderer.renderedSize(batch, 0, PQntuples(batch));
+
+                            // Never spill into the part of the next range
+                            if (rangeWorker.outputOffset + batchSize > rangeWorker.outputEnd)
+                                return 1;
+
+                            if (outputBackend == OutputBackend::MAPPED)
+                                tableRenderer.renderRows(batch, 0, PQntuples(batch),
+                                                         mappedFile.data() + rangeWorker.outputOffset);
+                            else if (tableRenderer.writeRowsAt(positionalFile, rangeWorker.outputOffset, batch, 0,
+                                                               PQntuples(batch)))
+                                return 1;
+
+                            rangeWorker.outputOffset += batchSize;
+                            return 0;
+                        });
+                });
+            }
+
+            for (std::thread &thread: threads)
+                thread.join();
+
+            for (const RangeWorker &rangeWorker: rangeWorkers)
+                exportStatus |= rangeWorker.status;
+        }
+
+        if (outputBackend == OutputBackend::MAPPED)
+            exportStatus |= mappedFile.close();
+    }
+
+    for (const RangeWorker &rangeWorker: rangeWorkers) {
+        if (rangeWorker.connection == nullptr)
+            continue;
+
+        PQclear(PQexec(rangeWorker.connection, "COMMIT;"));
+        PQfinish(rangeWorker.connection);
+    }
+
+    PQclear(PQexec(connection, "COMMIT;"));
+
+    if (exportStatus != 0)
+        std::cerr << "PARALLEL EXPORT failed: " << tableName << " could not be exported.\n";
+
+    return exportStatus;
+}
+
+
+std::string outputTailChecksum(std::fstream &outputStream, const std::uint64_t offset) {
+    const std::uint64_t tailLength = std::min<std::uint64_t>(offset, CHECKPOINT_TAIL_BYTES);
+    std::string tailBytes(tailLength, '\0');
+
+    outputStream.seekg(static_cast<std::streamoff>(offset - tailLength));
+    outputStream.read(tailBytes.data(), static_cast<std::streamsize>(tailLength));
+
+    // A short file reads fewer bytes, its checksum cannot match
+    tailBytes.resize(outputStream.gcount());
+    outputStream.clear();
+    outputStream.seekp(static_cast<std::streamoff>(offset));
+    return SHA256::hash(tailBytes);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <libpq-fe.h>
+#include <string>
+#include "../ExecutionPlanner/ExecutionPlanner.h"
+#include "../QueryStream/QueryStream.h"
+#include "../TableRenderer/TableRenderer.h"
+#include "../FormatWriter/FormatWriter.h"
+#include "../ColumnarFile/ColumnarFile.h"
+
+
+// Writes big SELECT results to a file without materializing them on the client. The column widths have to be
+// known before the first row is written, so every export reads its rows twice within one snapshot:
+// first for the widths, then for the rendering.
+class TableExporter {
+    // Fetch *query* with a streaming strategy (SINGLE_ROW or CURSOR_BATCH)
+    static int streamQuery(PGconn *connection, const std::string &query, ExecutionStrategy strategy,
+                           const BatchConsumer &consumer);
+
+public:
+    // Export *query* through single-row or cursor streaming
+    static int exportStreamed(PGconn *connection, const std::string &query, ExecutionStrategy strategy,
+                              const std::string &outputFilePath, OutputBackend outputBackend);
+
+    // Export *query* reading it from the server once: pass one spools the rows to a spill file next to the output
+    // while it collects the widths, pass two renders them from there. Spill and render buffers share
+    // *memoryBudget*, the output is the same as exportStreamed's.
+    static int exportSpilled(PGconn *connection, const std::string &query, ExecutionStrategy strategy,
+                             const std::string &outputFilePath, OutputBackend outputBackend,
+                             std::size_t memoryBudget);
+
+    // Export *query* rendering every row as it arrives: one aggregate query computes the widths on the server
+    // (max(octet_length(format('%s', column))) matches the text the rows are sent in) within the same snapshot.
+    // Byte lengths bound the display widths, so columns of multi-byte text can come out wider than needed.
+    static int exportServerWidths(PGconn *connection, const std::string &query, ExecutionStrategy strategy,
+                                  const std::string &outputFilePath, OutputBackend outputBackend);
+
+    // Export *query* in *format*. Formats without padded columns are written in a single pass,
+    // the others read the rows twice within one snapshot. Output sizes are not known in advance,
+    // so the MAPPED backend writes like STREAM.
+    static int exportFormatted(PGconn *connection, const std::string &query, ExecutionStrategy strategy,
+                               ExportFormat format, const std::string &outputFilePath, OutputBackend outputBackend);
+
+    // Export *query* in *format* through COPY (*query*) TO STDOUT: CopyTextDecoder splits the text rows in the
+    // received buffers and the writer renders them from there, no PGresult is built. COPY sends the values in the
+    // text a SELECT does, so the output matches exportFormatted's; padded formats copy twice within one snapshot.
+    static int exportCopy(PGconn *connection, const std::string &query, ExportFormat format,
+                          const std::string &outputFilePath, OutputBackend outputBackend);
+
+    // Write a materialized result in *format* (COLUMNAR stores its text values as UTF8 columns)
+    static int writeFormatted(const PGresult *queryResult, ExportFormat format, const std::string &outputFilePath,
+                              OutputBackend outputBackend);
+
+    // Export *query* as a columnar file in a single pass over COPY BINARY (CopyBinaryDecoder). Columns of types
+    // the columnar writer cannot decode are cast to text on the server.
+    static int exportColumnar(PGconn *connection, const std::string &query, const std::string &outputFilePath);
+
+    // Export *tableName* in *format* page after page by primary key (keyset pagination), recording the last key
+    // and the output offset in <output>.checkpoint after every page. A rerun after a failure checks the output
+    // against the checkpoint, cuts what was written after it and continues with the next key, so it only reads
+    // the remaining rows. Padded formats keep the widths of the first run: a row widened since then stops it.
+    static int exportResumable(PGconn *connection, const std::string &tableName, ExportFormat format,
+                               const std::string &outputFilePath);
+
+    // Export *tableName* by page (ctid) ranges read by parallel connections sharing one exported snapshot
+    static int exportParallelRanges(PGconn *connection, const std::string &tableName, long long tablePages,
+                                    const std::string &outputFilePath, OutputBackend outputBackend);
+};
@@ -0,0 +1,320 @@
+#include "TableFileReader.h"
+#include "../DisplayWidth/DisplayWidth.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+
+#define BETWEEN_ROWS_SEPARATOR '.'
+#define TABLE_ROW_SEPARATOR '-'
+#define TABLE_COL_SEPARATOR '|'
+#define END_OF_COL_SEPARATOR_LENGTH 2
+#define TABLE_INDEX_MAGIC "PGTBLIX1"
+#define TABLE_INDEX_MAGIC_LENGTH 8
+// Magic, table size, column, numeric flag, rows count: 8 bytes each, the row numbers follow aligned
+#define TABLE_INDEX_HEADER_NUMBERS 5
+
+
+// Value of a cell starting at *cellStart* and taking *width* columns, without its padding
+std::string_view cellValue(const char *cellStart, std::size_t length, std::size_t width, std::size_t &cellLength);
+
+// The whole text is a number (NULL / empty values are none)
+bool parseIndexedNumber(std::string_view value, double &number);
+
+// Order of the indexed values: numbers by value (empty values first), text by bytes
+bool isIndexedValueLess(std::string_view left, std::string_view right, bool isNumeric);
+
+
+int TableFileReader::open(const std::string &filePath) {
+    if (mappedFile.openReadOnly(filePath))
+        return 1;
+
+    const char *data = mappedFile.data();
+    const std::uint64_t fileSize = mappedFile.size();
+
+    columnNames.clear();
+    columnWidths.clear();
+    columnStarts.clear();
+    rowOffsets.clear();
+    indexedRows = nullptr;
+    indexFile.close();
+
+    // Head: border line, column names line, first in between line; the tail is another border line
+    const char *borderEnd = static_cast<const char *>(std::memchr(data, '\n', fileSize));
+    lineWidth = borderEnd != nullptr ? borderEnd - data : 0;
+
+    const char *namesLine = data + lineWidth + 1;
+    const char *namesEnd = lineWidth > 0 && fileSize > 3 * (lineWidth + 1)
+                               ? static_cast<const char *>(std::memchr(namesLine + lineWidth - 1, '\n',
+                                                                       data + fileSize - (namesLine + lineWidth - 1)))
+                               : nullptr;
+
+    if (namesEnd == nullptr || data + fileSize - (namesEnd + 1) < static_cast<std::ptrdiff_t>(2 * (lineWidth + 1)) ||
+        std::any_of(data, borderEnd, [](const char ch) { return ch != TABLE_ROW_SEPARATOR; })) {
+        std::cerr << "Error: " << filePath << " is no rendered table.\n";
+        mappedFile.close();
+        return 1;
+    }
+
+    const std::string betweenRowsLine{namesEnd + 1, lineWidth + 1};
+
+    // |.....|...| - every column separator ends a column of (width + 2) characters
+    std::size_t columnStart = 1;
+    for (std::size_t position = 1; position < lineWidth; ++position) {
+        if (betweenRowsLine[position] != TABLE_COL_SEPARATOR)
+            continue;
+
+        columnStarts.push_back(columnStart);
+        columnWidths.push_back(position - columnStart - 1);
+        columnStart = position + 1;
+    }
+
+    // The names are parsed by display width, they may hold multi-byte characters too
+    const char *namePosition = namesLine + 1;
+    for (const std::size_t columnWidth: columnWidths) {
+        std::size_t cellLength;
+        columnNames.emplace_back(cellValue(namePosition, namesEnd - namePosition, columnWidth, cellLength));
+        namePosition += cellLength + END_OF_COL_SEPARATOR_LENGTH;
+    }
+
+    rowsOffset = namesEnd + 1 + lineWidth + 1 - data;
+    rowStride = 2 * (lineWidth + 1);
+
+    const std::uint64_t tailOffset = fileSize - (lineWidth + 1);
+    const std::uint64_t rowsLength = tailOffset - rowsOffset;
+
+    // ASCII rows all take the stride, the rows of any other table are found one by one
+    if (rowsLength % rowStride == 0 && isAscii(data + rowsOffset, rowsLength)) {
+        rowsCount = rowsLength / rowStride;
+        return 0;
+    }
+
+    if (collectRowOffsets(betweenRowsLine, tailOffset)) {
+        std::cerr << "Error: " << filePath << " is no rendered table.\n";
+        mappedFile.close();
+        return 1;
+    }
+
+    return 0;
+}
+
+int TableFileReader::collectRowOffsets(const std::string &betweenRowsLine, const std::uint64_t tailOffset) {
+    const char *data = mappedFile.data();
+    std::uint64_t rowOffset = rowsOffset;
+
+    while (rowOffset < tailOffset) {
+        rowOffsets.push_back(rowOffset);
+
+        // A row line takes at least the line width; a new line inside a value is no row end unless the in
+        // between line follows it
+        std::uint64_t searchOffset = rowOffset + lineWidth;
+
+        while (true) {
+            const void *lineEnd = searchOffset < tailOffset
+                                      ? std::memchr(data + searchOffset, '\n', tailOffset - searchOffset)
+                                      : nullptr;
+
+            if (lineEnd == nullptr)
+                return 1;
+
+            const std::uint64_t lineEndOffset = static_cast<const char *>(lineEnd) - data;
+
+            if (tailOffset - (lineEndOffset + 1) >= betweenRowsLine.length() &&
+                std::memcmp(data + lineEndOffset + 1, betweenRowsLine.data(), betweenRowsLine.length()) == 0) {
+                rowOffset = lineEndOffset + 1 + betweenRowsLine.length();
+                break;
+            }
+
+            searchOffset = lineEndOffset + 1;
+        }
+    }
+
+    rowsCount = rowOffsets.size();
+    rowOffsets.push_back(tailOffset);
+    return 0;
+}
+
+const std::vector<std::string> &TableFileReader::getColumnNames() const {
+    return columnNames;
+}
+
+int TableFileReader::columnNumber(const std::string &columnName) const {
+    const auto column = std::find(columnNames.begin(), columnNames.end(), columnName);
+    return column == columnNames.end() ? -1 : static_cast<int>(column - columnNames.begin());
+}
+
+std::uint64_t TableFileReader::getRowsCount() const {
+    return rowsCount;
+}
+
+std::string_view TableFileReader::row(const std::uint64_t rowNumber) const {
+    if (rowOffsets.empty())
+        return {mappedFile.data() + rowsOffset + rowNumber * rowStride, lineWidth};
+
+    // Row line, new line, in between line (with its new line)
+    const std::uint64_t rowLength = rowOffsets[rowNumber + 1] - rowOffsets[rowNumber] - (lineWidth + 1) - 1;
+    return {mappedFile.data() + rowOffsets[rowNumber], rowLength};
+}
+
+std::string_view TableFileReader::cell(const std::uint64_t rowNumber, const std::size_t column) const {
+    const std::string_view rowLine = row(rowNumber);
+    std::size_t cellLength;
+
+    if (rowOffsets.empty())
+        return cellValue(rowLine.data() + columnStarts[column], columnWidths[column], columnWidths[column],
+                         cellLength);
+
+    // Multi-byte characters move the cells, the ones before have to be walked
+    std::size_t position = 1;
+    for (std::size_t j = 0; j < column; ++j) {
+        position += bytesOfWidth(rowLine.data() + position, rowLine.length() - position, columnWidths[j]);
+        position += END_OF_COL_SEPARATOR_LENGTH;
+    }
+
+    return cellValue(rowLine.data() + position, rowLine.length() - position, columnWidths[column], cellLength);
+}
+
+int TableFileReader::buildIndex(const std::size_t column, const std::string &indexFilePath) const {
+    if (column >= columnNames.size()) {
+        std::cerr << "Error: The table has no column " << column << ".\n";
+        return 1;
+    }
+
+    std::vector<std::pair<std::string_view, std::uint64_t> > indexedValues;
+    indexedValues.reserve(rowsCount);
+
+    bool isNumeric = rowsCount > 0;
+    double number;
+
+    for (std::uint64_t i = 0; i < rowsCount; ++i) {
+        indexedValues.emplace_back(cell(i, column), i);
+        isNumeric = isNumeric && (indexedValues.back().first.empty() ||
+                                  parseIndexedNumber(indexedValues.back().first, number));
+    }
+
+    std::stable_sort(indexedValues.begin(), indexedValues.end(), [isNumeric](const auto &left, const auto &right) {
+        return isIndexedValueLess(left.first, right.first, isNumeric);
+    });
+
+    // Native byte order: the row numbers are used straight from the mapping
+    std::vector<std::uint64_t> indexData{0, mappedFile.size(), column, isNumeric ? 1ULL : 0ULL, rowsCount};
+    std::memcpy(indexData.data(), TABLE_INDEX_MAGIC, TABLE_INDEX_MAGIC_LENGTH);
+
+    indexData.reserve(indexData.size() + indexedValues.size());
+    for (const auto &indexedValue: indexedValues)
+        indexData.push_back(indexedValue.second);
+
+    std::ofstream indexStream{indexFilePath, std::ios::binary};
+    indexStream.write(reinterpret_cast<const char *>(indexData.data()),
+                      static_cast<std::streamsize>(indexData.size() * sizeof(std::uint64_t)));
+    indexStream.close();
+
+    if (!indexStream) {
+        std::cerr << "Error: Cannot write " << indexFilePath << ".\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+int TableFileReader::openIndex(const std::string &indexFilePath) {
+    indexedRows = nullptr;
+
+    if (indexFile.openReadOnly(indexFilePath))
+        return 1;
+
+    const auto indexData = reinterpret_cast<const std::uint64_t *>(indexFile.data());
+    const std::uint64_t headerSize = TABLE_INDEX_HEADER_NUMBERS * sizeof(std::uint64_t);
+
+    // The index is of this table only while the table keeps its size and rows
+    if (indexFile.size() < headerSize ||
+        std::memcmp(indexFile.data(), TABLE_INDEX_MAGIC, TABLE_INDEX_MAGIC_LENGTH) != 0 ||
+        indexData[1] != mappedFile.size() || indexData[2] >= columnNames.size() || indexData[4] != rowsCount ||
+        indexFile.size() != headerSize + rowsCount * sizeof(std::uint64_t)) {
+        std::cerr << "Error: " << indexFilePath << " is no index of this table.\n";
+        indexFile.close();
+        return 1;
+    }
+
+    indexColumn = indexData[2];
+    isNumericIndex = indexData[3] != 0;
+    indexedRows = indexData + TABLE_INDEX_HEADER_NUMBERS;
+    return 0;
+}
+
+std::size_t TableFileReader::indexBound(const std::string_view value, const bool isUpper) const {
+    std::size_t low = 0, high = rowsCount;
+
+    while (low < high) {
+        const std::size_t middle = low + (high - low) / 2;
+        const std::string_view middleValue = cell(indexedRows[middle], indexColumn);
+
+        const bool isBefore = isUpper
+                                  ? !isIndexedValueLess(value, middleValue, isNumericIndex)
+                                  : isIndexedValueLess(middleValue, value, isNumericIndex);
+
+        if (isBefore)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+std::vector<std::uint64_t> TableFileReader::find(const std::string_view value) const {
+    return findRange(value, value);
+}
+
+std::vector<std::uint64_t> TableFileReader::findRange(const std::string_view lowValue,
+                                                      const std::string_view highValue) const {
+    if (indexedRows == nullptr) {
+        std::cerr << "Error: No index is open.\n";
+        return {};
+    }
+
+    // A numeric index holds no text, looking text up in it finds nothing
+    double number;
+    if (isNumericIndex && (!parseIndexedNumber(lowValue, number) || !parseIndexedNumber(highValue, number)))
+        return {};
+
+    const std::size_t begin = indexBound(lowValue, false);
+    const std::size_t end = std::max(begin, indexBound(highValue, true));
+
+    return {indexedRows + begin, indexedRows + end};
+}
+
+
+std::string_view cellValue(const char *cellStart, const std::size_t length, const std::size_t width,
+                           std::size_t &cellLength) {
+    cellLength = bytesOfWidth(cellStart, length, width);
+
+    std::size_t valueLength = cellLength;
+    while (valueLength > 0 && cellStart[valueLength - 1] == ' ')
+        --valueLength;
+
+    return {cellStart, valueLength};
+}
+
+bool parseIndexedNumber(const std::string_view value, double &number) {
+    const char *valueEnd = value.data() + value.length();
+    const auto [parseEnd, errorCode] = std::from_chars(value.data(), valueEnd, number);
+
+    return !value.empty() && errorCode == std::errc() && parseEnd == valueEnd;
+}
+
+bool isIndexedValueLess(const std::string_view left, const std::string_view right, const bool isNumeric) {
+    if (!isNumeric)
+        return left < right;
+
+    double leftNumber = 0, rightNumber = 0;
+    const bool isLeftNumber = parseIndexedNumber(left, leftNumber);
+    const bool isRightNumber = parseIndexedNumber(right, rightNumber);
+
+    if (isLeftNumber != isRightNumber)
+        return isRightNumber;
+
+    return leftNumber < rightNumber;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "../MappedFile/MappedFile.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Random access to a rendered text table (the SELECT output) through a read-only memory mapping.
+// The head is parsed once: the in between line gives the column widths, so the rows of an ASCII table sit at a
+// fixed stride and row(i) / cell(i, column) are computed, not searched. Tables with multi-byte characters get
+// the offsets of their rows collected by one pass at open.
+// Values are returned as they lie in the file, without their padding (trailing spaces of a value cannot be told
+// from it, NULL reads as an empty value).
+// A sidecar index keeps the row numbers sorted by the values of one column, lookups binary search it in place.
+class TableFileReader {
+    MappedFile mappedFile;
+    MappedFile indexFile;
+
+    std::vector<std::string> columnNames;
+    std::vector<std::size_t> columnWidths;
+    std::vector<std::size_t> columnStarts; // Offset of every cell within an ASCII row line
+
+    std::uint64_t rowsOffset = 0;
+    std::uint64_t lineWidth = 0;
+    std::uint64_t rowStride = 0; // Row line and in between line, with their new lines
+    std::uint64_t rowsCount = 0;
+    std::vector<std::uint64_t> rowOffsets; // Only when the rows hold multi-byte characters
+
+    // Sidecar index: row numbers sorted by the values of *indexColumn*
+    const std::uint64_t *indexedRows = nullptr;
+    std::size_t indexColumn = 0;
+    bool isNumericIndex = false;
+
+    // Collect the offsets of rows of different byte lengths, *tailOffset* is where the last one ends
+    int collectRowOffsets(const std::string &betweenRowsLine, std::uint64_t tailOffset);
+
+    // First indexed position whose value is not less than (or, *isUpper*, greater than) *value*
+    std::size_t indexBound(std::string_view value, bool isUpper) const;
+
+public:
+    // Map the table and parse its head
+    int open(const std::string &filePath);
+
+    const std::vector<std::string> &getColumnNames() const;
+
+    // Position of the column, -1 when there is none of that name
+    int columnNumber(const std::string &columnName) const;
+
+    std::uint64_t getRowsCount() const;
+
+    // Line of the row (without its new line)
+    std::string_view row(std::uint64_t rowNumber) const;
+
+    std::string_view cell(std::uint64_t rowNumber, std::size_t column) const;
+
+    // Write the sidecar index of *column*: numbers when every value of the column is one, text (byte order) else
+    int buildIndex(std::size_t column, const std::string &indexFilePath) const;
+
+    // Map a sidecar index built for this very table
+    int openIndex(const std::string &indexFilePath);
+
+    // Rows (in the order of the index) whose value of the indexed column is *value*, or within [lowValue, highValue]
+    std::vector<std::uint64_t> find(std::string_view value) const;
+
+    std::vector<std::uint64_t> findRange(std::string_view lowValue, std::string_view highValue) const;
+};
@@ -0,0 +1,506 @@
+#include "TableRenderer.h"
+#include "../AsyncFileWriter/AsyncFileWriter.h"
+#include "../DisplayWidth/DisplayWidth.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+
+#define BETWEEN_ROWS_SEPARATOR '.'
+#define TABLE_ROW_SEPARATOR '-'
+#define TABLE_COL_SEPARATOR '|'
+#define END_OF_COL_SEPARATOR " |"
+#define END_OF_COL_SEPARATOR_LENGTH 2
+// Rows are rendered and handed to the stream in pieces of about this size
+#define RENDER_CHUNK_BYTES (4 * 1024 * 1024)
+// Size of a single write() of a fully rendered table
+#define WRITE_CHUNK_BYTES (8 * 1024 * 1024)
+
+
+TableRenderer::TableRenderer(const PGresult *queryResult) {
+    columnNames.reserve(PQnfields(queryResult));
+    columnWidths.reserve(PQnfields(queryResult));
+
+    // Calculate the width of every column (Table Col Names)
+    for (int i = 0; i < PQnfields(queryResult); i++) {
+        columnNames.emplace_back(PQfname(queryResult, i));
+        columnWidths.push_back(displayWidth(columnNames.back()));
+        namesExcessBytes += columnNames.back().length() - columnWidths.back();
+    }
+
+    buildLines();
+}
+
+void TableRenderer::observe(const PGresult *queryResult) {
+    bool isWidened = false;
+
+    // Calculate the width of every column (Table Row Cols)
+    for (int i = 0; i < PQntuples(queryResult); i++) {
+        for (int j = 0; j < PQnfields(queryResult); j++) {
+            const auto valueLength = static_cast<std::string::size_type>(PQgetlength(queryResult, i, j));
+            const std::string::size_type valueWidth = displayWidth(PQgetvalue(queryResult, i, j), valueLength);
+
+            rowsExcessBytes += valueLength - valueWidth;
+
+            if (valueWidth > columnWidths[j]) {
+                columnWidths[j] = valueWidth;
+                isWidened = true;
+            }
+        }
+    }
+
+    if (isWidened)
+        buildLines();
+}
+
+void TableRenderer::observe(const char *const *values, const int *lengths, const std::size_t rowsCount) {
+    bool isWidened = false;
+    const std::size_t cellsCount = rowsCount * columnWidths.size();
+
+    for (std::size_t i = 0; i < cellsCount; i++) {
+        const auto valueLength = static_cast<std::string::size_type>(lengths[i]);
+        const std::string::size_type valueWidth = displayWidth(values[i], valueLength);
+        std::string::size_type &columnWidth = columnWidths[i % columnWidths.size()];
+
+        rowsExcessBytes += valueLength - valueWidth;
+
+        if (valueWidth > columnWidth) {
+            columnWidth = valueWidth;
+            isWidened = true;
+        }
+    }
+
+    if (isWidened)
+        buildLines();
+}
+
+void TableRenderer::merge(const TableRenderer &other) {
+    bool isWidened = false;
+    rowsExcessBytes += other.rowsExcessBytes;
+
+    for (std::size_t i = 0; i < columnWidths.size(); i++) {
+        if (other.columnWidths[i] > columnWidths[i]) {
+            columnWidths[i] = other.columnWidths[i];
+            isWidened = true;
+        }
+    }
+
+    if (isWidened)
+        buildLines();
+}
+
+void TableRenderer::widen(const std::vector<std::string::size_type> &valueWidths) {
+    bool isWidened = false;
+
+    for (std::size_t i = 0; i < columnWidths.size() && i < valueWidths.size(); i++) {
+        if (valueWidths[i] > columnWidths[i]) {
+            columnWidths[i] = valueWidths[i];
+            isWidened = true;
+        }
+    }
+
+    if (isWidened)
+        buildLines();
+}
+
+bool TableRenderer::fits(const PGresult *queryResult) const {
+    for (int i = 0; i < PQntuples(queryResult); i++) {
+        for (int j = 0; j < PQnfields(queryResult); j++) {
+            if (displayWidth(PQgetvalue(queryResult, i, j), PQgetlength(queryResult, i, j)) > columnWidths[j])
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void TableRenderer::buildLines() {
+    const std::string::size_type width = lineWidth();
+
+    borderLine.assign(width, TABLE_ROW_SEPARATOR);
+    borderLine.push_back('\n');
+
+    betweenRowsLine.assign(width, BETWEEN_ROWS_SEPARATOR);
+    betweenRowsLine.push_back('\n');
+
+    // |.....|...| - the column separators sit right after every (width + 1) dots
+    std::string::size_type separatorPosition = 0;
+    betweenRowsLine[separatorPosition] = TABLE_COL_SEPARATOR;
+
+    for (const auto columnWidth: columnWidths) {
+        separatorPosition += columnWidth + 2;
+        betweenRowsLine[separatorPosition] = TABLE_COL_SEPARATOR;
+    }
+
+    // Table head, column names and the first in between line
+    headBlock.resize(headSize());
+
+    char *position = headBlock.data();
+    std::memcpy(position, borderLine.data(), borderLine.length());
+    position += borderLine.length();
+
+    *position++ = TABLE_COL_SEPARATOR;
+
+    for (std::size_t i = 0; i < columnNames.size(); i++) {
+        const std::string::size_type paddingLength = columnWidths[i] - displayWidth(columnNames[i]);
+
+        std::memcpy(position, columnNames[i].data(), columnNames[i].length());
+        std::memset(position + columnNames[i].length(), ' ', paddingLength);
+        position += columnNames[i].length() + paddingLength;
+
+        std::memcpy(position, END_OF_COL_SEPARATOR, END_OF_COL_SEPARATOR_LENGTH);
+        position += END_OF_COL_SEPARATOR_LENGTH;
+    }
+    *position++ = '\n';
+
+    std::memcpy(position, betweenRowsLine.data(), betweenRowsLine.length());
+}
+
+const std::vector<std::string::size_type> &TableRenderer::getColumnWidths() const {
+    return columnWidths;
+}
+
+std::string::size_type TableRenderer::lineWidth() const {
+    // Calculate the total char number of a row
+    std::string::size_type totalSymbolsSize = 1;
+    for (const auto columnWidth: columnWidths)
+        totalSymbolsSize += columnWidth + 2;
+
+    return totalSymbolsSize;
+}
+
+std::string::size_type TableRenderer::rowSize() const {
+    return 2 * (lineWidth() + 1);
+}
+
+std::string::size_type TableRenderer::headSize() const {
+    return 3 * (lineWidth() + 1) + namesExcessBytes;
+}
+
+std::string::size_type TableRenderer::excessBytes() const {
+    return rowsExcessBytes;
+}
+
+std::string::size_type TableRenderer::totalSize(const std::string::size_type rowsCount) const {
+    return headSize() + rowsCount * rowSize() + rowsExcessBytes + lineWidth() + 1;
+}
+
+std::string::size_type TableRenderer::renderedSize(const PGresult *queryResult, const int beginRow,
+                                                   const int endRow) const {
+    std::string::size_type size = static_cast<std::string::size_type>(endRow - beginRow) * rowSize();
+
+    for (int i = beginRow; i < endRow; i++) {
+        for (int j = 0; j < PQnfields(queryResult); j++) {
+            const auto valueLength = static_cast<std::string::size_type>(PQgetlength(queryResult, i, j));
+            size += valueLength - displayWidth(PQgetvalue(queryResult, i, j), valueLength);
+        }
+    }
+
+    return size;
+}
+
+std::string::size_type TableRenderer::renderedSize(const char *const *values, const int *lengths) const {
+    std::string::size_type size = rowSize();
+
+    for (std::size_t j = 0; j < columnWidths.size(); j++)
+        size += lengths[j] - displayWidth(values[j], lengths[j]);
+
+    return size;
+}
+
+char *TableRenderer::renderHead(char *destination) const {
+    std::memcpy(destination, headBlock.data(), headBlock.length());
+    return destination + headBlock.length();
+}
+
+char *TableRenderer::renderRows(const PGresult *queryResult, const int beginRow, const int endRow,
+                                char *destination) const {
+    const int columnsCount = static_cast<int>(columnWidths.size());
+
+    for (int i = beginRow; i < endRow; i++) {
+        *destination++ = TABLE_COL_SEPARATOR;
+
+        for (int j = 0; j < columnsCount; j++) {
+            const char *value = PQgetvalue(queryResult, i, j);
+            const auto valueLength = static_cast<std::string::size_type>(PQgetlength(queryResult, i, j));
+            const std::string::size_type paddingLength = columnWidths[j] - displayWidth(value, valueLength);
+
+            std::memcpy(destination, value, valueLength);
+            std::memset(destination + valueLength, ' ', paddingLength);
+            destination += valueLength + paddingLength;
+
+            std::memcpy(destination, END_OF_COL_SEPARATOR, END_OF_COL_SEPARATOR_LENGTH);
+            destination += END_OF_COL_SEPARATOR_LENGTH;
+        }
+        *destination++ = '\n';
+
+        std::memcpy(destination, betweenRowsLine.data(), betweenRowsLine.length());
+        destination += betweenRowsLine.length();
+    }
+
+    return destination;
+}
+
+char *TableRenderer::renderRow(const char *const *values, const int *lengths, char *destination) const {
+    *destination++ = TABLE_COL_SEPARATOR;
+
+    for (std::size_t j = 0; j < columnWidths.size(); j++) {
+        const auto valueLength = static_cast<std::string::size_type>(lengths[j]);
+        const std::string::size_type paddingLength = columnWidths[j] - displayWidth(values[j], valueLength);
+
+        std::memcpy(destination, values[j], valueLength);
+        std::memset(destination + valueLength, ' ', paddingLength);
+        destination += valueLength + paddingLength;
+
+        std::memcpy(destination, END_OF_COL_SEPARATOR, END_OF_COL_SEPARATOR_LENGTH);
+        destination += END_OF_COL_SEPARATOR_LENGTH;
+    }
+    *destination++ = '\n';
+
+    std::memcpy(destination, betweenRowsLine.data(), betweenRowsLine.length());
+    return destination + betweenRowsLine.length();
+}
+
+char *TableRenderer::renderTail(char *destination) const {
+    std::memcpy(destination, borderLine.data(), borderLine.length());
+    return destination + borderLine.length();
+}
+
+void TableRenderer::writeHead(std::ostream &stream) const {
+    stream.write(headBlock.data(), static_cast<std::streamsize>(headBlock.length()));
+}
+
+void TableRenderer::writeRows(std::ostream &stream, const PGresult *queryResult) const {
+    // Reused across calls (streamed results arrive in many small batches), one per thread
+    thread_local std::vector<char> renderBuffer;
+
+    const int rowsPerChunk = static_cast<int>(std::max<std::string::size_type>(RENDER_CHUNK_BYTES / rowSize(), 1));
+    const int rowsCount = PQntuples(queryResult);
+
+    for (int beginRow = 0; beginRow < rowsCount; beginRow += rowsPerChunk) {
+        const int endRow = std::min(beginRow + rowsPerChunk, rowsCount);
+
+        renderBuffer.resize(renderedSize(queryResult, beginRow, endRow));
+        renderRows(queryResult, beginRow, endRow, renderBuffer.data());
+
+        stream.write(renderBuffer.data(), static_cast<std::streamsize>(renderBuffer.size()));
+    }
+}
+
+void TableRenderer::writeTail(std::ostream &stream) const {
+    stream.write(borderLine.data(), static_cast<std::streamsize>(borderLine.length()));
+}
+
+int TableRenderer::writeHeadAt(const PositionalFile &file) const {
+    return file.writeAt(headBlock.data(), headBlock.length(), 0);
+}
+
+int TableRenderer::writeTailAt(const PositionalFile &file, const std::uint64_t offset) const {
+    return file.writeAt(borderLine.data(), borderLine.length(), offset);
+}
+
+int TableRenderer::writeRowsAt(const PositionalFile &file, std::uint64_t offset, const PGresult *queryResult,
+                               const int beginRow, const int endRow) const {
+    thread_local std::vector<char> renderBuffer;
+
+    const int rowsPerChunk = static_cast<int>(std::max<std::string::size_type>(RENDER_CHUNK_BYTES / rowSize(), 1));
+
+    for (int chunkBeginRow = beginRow; chunkBeginRow < endRow; chunkBeginRow += rowsPerChunk) {
+        const int chunkEndRow = std::min(chunkBeginRow + rowsPerChunk, endRow);
+
+        renderBuffer.resize(renderedSize(queryResult, chunkBeginRow, chunkEndRow));
+        renderRows(queryResult, chunkBeginRow, chunkEndRow, renderBuffer.data());
+
+        if (file.writeAt(renderBuffer.data(), renderBuffer.size(), offset))
+            return 1;
+
+        offset += renderBuffer.size();
+    }
+
+    return 0;
+}
+
+int TableRenderer::writeFile(const PGresult *queryResult, const std::string &outputFilePath) const {
+    const std::string::size_type outputSize = totalSize(PQntuples(queryResult));
+
+    // Not zero initialized, every byte gets rendered
+    const auto outputBuffer = std::make_unique_for_overwrite<char[]>(outputSize);
+
+    char *position = renderHead(outputBuffer.get());
+    position = renderRows(queryResult, 0, PQntuples(queryResult), position);
+    renderTail(position);
+
+    // Unbuffered: the rendered table goes to the OS in large writes without another copy
+    std::ofstream fileStream;
+    fileStream.rdbuf()->pubsetbuf(nullptr, 0);
+    fileStream.open(outputFilePath, std::ios::binary);
+
+    for (std::string::size_type offset = 0; offset < outputSize && fileStream; offset += WRITE_CHUNK_BYTES) {
+        fileStream.write(outputBuffer.get() + offset,
+                         static_cast<std::streamsize>(std::min<std::string::size_type>(
+                             WRITE_CHUNK_BYTES, outputSize - offset)));
+    }
+
+    if (!fileStream) {
+        std::cerr << "SELECT failed: Cannot write " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+int TableRenderer::writeFileParallel(const PGresult *queryResult, const std::string &outputFilePath,
+                                     const unsigned threadsCount) const {
+    const int rowsCount = PQntuples(queryResult);
+    const std::string::size_type outputSize = totalSize(rowsCount);
+
+    PositionalFile outputFile;
+
+    if (outputFile.open(outputFilePath) || outputFile.resize(outputSize) || writeHeadAt(outputFile) ||
+        writeTailAt(outputFile, outputSize - borderLine.length())) {
+        std::cerr << "SELECT failed: Cannot write " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    // Every slice knows where its rows start, no slice waits for another one
+    const int slicesCount = static_cast<int>(std::max(std::min<unsigned>(threadsCount, rowsCount), 1u));
+    const int rowsPerSlice = (rowsCount + slicesCount - 1) / slicesCount;
+    const std::vector<std::uint64_t> offsets = sliceOffsets(queryResult, slicesCount, rowsPerSlice);
+
+    std::vector<int> sliceStatuses(slicesCount, 0);
+    std::vector<std::thread> threads;
+    threads.reserve(slicesCount);
+
+    for (int i = 0; i < slicesCount; ++i) {
+        const int beginRow = std::min(i * rowsPerSlice, rowsCount);
+        const int endRow = std::min(beginRow + rowsPerSlice, rowsCount);
+
+        threads.emplace_back([this, &outputFile, &sliceStatuses, &offsets, queryResult, i, beginRow, endRow] {
+            sliceStatuses[i] = writeRowsAt(outputFile, offsets[i], queryResult, beginRow, endRow);
+        });
+    }
+
+    for (std::thread &thread: threads)
+        thread.join();
+
+    if (std::any_of(sliceStatuses.begin(), sliceStatuses.end(), [](const int status) { return status != 0; })) {
+        std::cerr << "SELECT failed: Cannot write " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+int TableRenderer::writeFileMapped(const PGresult *queryResult, const std::string &outputFilePath,
+                                   const unsigned threadsCount) const {
+    const int rowsCount = PQntuples(queryResult);
+    MappedFile outputFile;
+
+    if (outputFile.open(outputFilePath, totalSize(rowsCount))) {
+        std::cerr << "SELECT failed: Cannot write " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    const int slicesCount = static_cast<int>(std::max(std::min<unsigned>(threadsCount, rowsCount), 1u));
+    const int rowsPerSlice = (rowsCount + slicesCount - 1) / slicesCount;
+    const std::vector<std::uint64_t> offsets = sliceOffsets(queryResult, slicesCount, rowsPerSlice);
+
+    renderHead(outputFile.data());
+    renderTail(outputFile.data() + offsets.back());
+
+    std::vector<std::thread> threads;
+    threads.reserve(slicesCount);
+
+    for (int i = 0; i < slicesCount; ++i) {
+        const int beginRow = std::min(i * rowsPerSlice, rowsCount);
+        const int endRow = std::min(beginRow + rowsPerSlice, rowsCount);
+
+        threads.emplace_back([this, &outputFile, &offsets, queryResult, i, beginRow, endRow] {
+            renderRows(queryResult, beginRow, endRow, outputFile.data() + offsets[i]);
+        });
+    }
+
+    for (std::thread &thread: threads)
+        thread.join();
+
+    if (outputFile.close()) {
+        std::cerr << "SELECT failed: Cannot write " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+std::vector<std::uint64_t> TableRenderer::sliceOffsets(const PGresult *queryResult, const int slicesCount,
+                                                      const int rowsPerSlice) const {
+    const int rowsCount = PQntuples(queryResult);
+    std::vector<std::uint64_t> offsets(slicesCount + 1, 0);
+    std::vector<std::thread> threads;
+
+    // Rows of single byte characters all have the same size, the others are measured by a thread per slice
+    for (int i = 0; i < slicesCount; ++i) {
+        const int beginRow = std::min(i * rowsPerSlice, rowsCount);
+        const int endRow = std::min(beginRow + rowsPerSlice, rowsCount);
+
+        if (rowsExcessBytes == 0)
+            offsets[i + 1] = static_cast<std::uint64_t>(endRow - beginRow) * rowSize();
+        else
+            threads.emplace_back([this, &offsets, queryResult, i, beginRow, endRow] {
+                offsets[i + 1] = renderedSize(queryResult, beginRow, endRow);
+            });
+    }
+
+    for (std::thread &thread: threads)
+        thread.join();
+
+    offsets[0] = headSize();
+
+    for (int i = 0; i < slicesCount; ++i)
+        offsets[i + 1] += offsets[i];
+
+    return offsets;
+}
+
+int TableRenderer::writeFileAsync(const PGresult *queryResult, const std::string &outputFilePath,
+                                  const bool isDirect) const {
+    AsyncFileWriter asyncFileWriter{isDirect};
+
+    if (asyncFileWriter.open(outputFilePath)) {
+        std::cerr << "SELECT failed: Cannot write " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    std::ostream fileStream{&asyncFileWriter};
+    writeHead(fileStream);
+    writeRows(fileStream, queryResult);
+    writeTail(fileStream);
+
+    if (asyncFileWriter.close() || !fileStream) {
+        std::cerr << "SELECT failed: Cannot write " << outputFilePath << ".\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+
+std::string repeat(const char &ch, const std::string::size_type &times) {
+    return std::string(times, ch);
+}
+
+
+std::string addRightPadding(const std::string &valueStr, const std::string::size_type &size) {
+    const std::string::size_type valueWidth = displayWidth(valueStr);
+
+    if (valueWidth >= size)
+        return valueStr;
+
+    std::string paddedStr;
+    paddedStr.reserve(valueStr.length() + size - valueWidth);
+    paddedStr.append(valueStr).append(size - valueWidth, ' ');
+
+    return paddedStr;
+}
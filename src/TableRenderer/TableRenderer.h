@@ -0,0 +1,133 @@
+#pragma once
+#include "../MappedFile/MappedFile.h"
+#include "../PositionalFile/PositionalFile.h"
+#include <libpq-fe.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// Repeat character *n* number of times
+std::string repeat(const char &ch, const std::string::size_type &times);
+
+// Adding spaces till the str reaches the display width *size*
+std::string addRightPadding(const std::string &valueStr, const std::string::size_type &size);
+
+
+// How rendered tables reach the output file
+enum class OutputBackend {
+    STREAM, // Large write() calls (positional writes when several threads render)
+    MAPPED, // Rendered straight into a memory mapping of the output file
+    ASYNC, // Rendered into a ring of buffers written by a writer thread
+    ASYNC_DIRECT, // ASYNC, bypassing the page cache (O_DIRECT) for exports bigger than the memory
+    LZ4, // Compressed into seekable LZ4 frames by worker threads (CompressedFile)
+    LZ4_HC, // LZ4 at the high compression level: slower to write, as fast to read
+    PIPE // Streamed to another process ("-" for the standard output), spliced into pipes on Linux (PipeWriter)
+};
+
+
+// Renders SELECT query results as the padded text table. The column widths can be collected from
+// several partial results (streamed batches, parallel ranges) before any row is written.
+// Widths are display widths (see DisplayWidth), so multi-byte text stays aligned. In bytes, a row is rowSize()
+// plus the excess bytes of its multi-byte characters, so the output size is known before rendering.
+class TableRenderer {
+    std::vector<std::string> columnNames;
+    std::vector<std::string::size_type> columnWidths;
+
+    // Bytes the characters of the column names and of the observed rows take beyond their display width
+    std::string::size_type namesExcessBytes = 0;
+    std::string::size_type rowsExcessBytes = 0;
+
+    // Prebuilt lines (with their new line), rebuilt only when a column gets wider
+    std::string borderLine;
+    std::string betweenRowsLine;
+    std::string headBlock;
+
+    // Rebuild the prebuilt lines after the widths changed
+    void buildLines();
+
+    // Offsets of the rows of *slicesCount* slices of *rowsPerSlice* rows of an observed result,
+    // with the end of the last slice as the last entry
+    std::vector<std::uint64_t> sliceOffsets(const PGresult *queryResult, int slicesCount, int rowsPerSlice) const;
+
+public:
+    // Columns of the result, the widths start at the lengths of the column names
+    explicit TableRenderer(const PGresult *queryResult);
+
+    // Widen the columns to fit the rows of a (partial) result
+    void observe(const PGresult *queryResult);
+
+    // Widen the columns to fit *rowsCount* rows of values laid out row after row (e.g. decoded COPY rows)
+    void observe(const char *const *values, const int *lengths, std::size_t rowsCount);
+
+    // Widen the columns to fit the rows observed by another renderer of the same columns, its rows count as observed
+    void merge(const TableRenderer &other);
+
+    // Widen the columns to fit values of the given lengths (computed elsewhere, e.g. on the server)
+    void widen(const std::vector<std::string::size_type> &valueWidths);
+
+    // Whether every value of the result fits its column as it is now
+    bool fits(const PGresult *queryResult) const;
+
+    // Display widths of the columns
+    const std::vector<std::string::size_type> &getColumnWidths() const;
+
+    // Total char number of a rendered line (without the new line)
+    std::string::size_type lineWidth() const;
+
+    // Bytes a result row of single byte characters takes in the output: its line and the in between line after it
+    std::string::size_type rowSize() const;
+
+    // Bytes before the first result row: table head, column names and the first in between line
+    std::string::size_type headSize() const;
+
+    // Bytes the multi-byte characters of the observed rows take beyond their display width
+    std::string::size_type excessBytes() const;
+
+    // Bytes of the whole rendered table with *rowsCount* rows, all of them observed
+    std::string::size_type totalSize(std::string::size_type rowsCount) const;
+
+    // Exact bytes of the rendered rows [beginRow, endRow), observed or not
+    std::string::size_type renderedSize(const PGresult *queryResult, int beginRow, int endRow) const;
+
+    std::string::size_type renderedSize(const char *const *values, const int *lengths) const;
+
+    // Render into *destination*, each returns the position right after the rendered bytes
+    char *renderHead(char *destination) const;
+
+    char *renderRows(const PGresult *queryResult, int beginRow, int endRow, char *destination) const;
+
+    char *renderRow(const char *const *values, const int *lengths, char *destination) const;
+
+    char *renderTail(char *destination) const;
+
+    void writeHead(std::ostream &stream) const;
+
+    void writeRows(std::ostream &stream, const PGresult *queryResult) const;
+
+    void writeTail(std::ostream &stream) const;
+
+    // Positional writes, the head always goes at the start of the file
+    int writeHeadAt(const PositionalFile &file) const;
+
+    int writeTailAt(const PositionalFile &file, std::uint64_t offset) const;
+
+    // Render the rows [beginRow, endRow) in chunks and write them to the file starting at *offset*
+    int writeRowsAt(const PositionalFile &file, std::uint64_t offset, const PGresult *queryResult, int beginRow,
+                    int endRow) const;
+
+    // Render the whole result into one preallocated buffer and write it to a file in large writes
+    int writeFile(const PGresult *queryResult, const std::string &outputFilePath) const;
+
+    // The parallel and mapped writers take the observed result, the slice offsets come from its excess bytes
+
+    // Split the rows between *threadsCount* threads, each renders its slice and writes it at the slice offset
+    int writeFileParallel(const PGresult *queryResult, const std::string &outputFilePath,
+                          unsigned threadsCount) const;
+
+    // Map the output file at its final size and let *threadsCount* threads render their slices right into it
+    int writeFileMapped(const PGresult *queryResult, const std::string &outputFilePath, unsigned threadsCount) const;
+
+    // Render chunk after chunk while a writer thread writes the previous ones
+    int writeFileAsync(const PGresult *queryResult, const std::string &outputFilePath, bool isDirect) const;
+};
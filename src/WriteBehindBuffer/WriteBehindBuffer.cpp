@@ -0,0 +1,416 @@
+#include "WriteBehindBuffer.h"
+#include "../DbConnection/DbConnection.h"
+#include "../ExecutionPlanner/ExecutionPlanner.h"
+#include <iostream>
+#include <sstream>
+#include <tuple>
+#include <algorithm>
+
+
+// PostgreSQL accepts at most 65535 parameters in a single statement
+#define MAX_QUERY_PARAMETERS 65535
+#define KEY_VALUES_ALIAS std::string("write_behind_key")
+#define SAVEPOINT_QUERY "SAVEPOINT write_behind_group;"
+#define RELEASE_SAVEPOINT_QUERY "RELEASE SAVEPOINT write_behind_group;"
+#define ROLLBACK_TO_SAVEPOINT_QUERY "ROLLBACK TO SAVEPOINT write_behind_group;"
+
+
+// Run a command of the flush transaction, which is expected to return PGRES_COMMAND_OK
+bool executeFlushCommand(PGconn *connection, const char *command);
+
+
+bool WriteBehindBuffer::RowKey::operator<(const RowKey &other) const {
+    return std::tie(tableName, keyColumn, keyValue) < std::tie(other.tableName, other.keyColumn, other.keyValue);
+}
+
+WriteBehindBuffer::WriteBehindBuffer(PGconn *connection, const std::size_t maxBufferedRows,
+                                     const std::chrono::milliseconds flushInterval,
+                                     const DurabilityMode durabilityMode)
+    : connection(DbConnection::cloneConnection(connection)),
+      isOwnConnection(this->connection != nullptr),
+      maxBufferedRows(std::max<std::size_t>(maxBufferedRows, 1)),
+      flushInterval(flushInterval),
+      durabilityMode(durabilityMode),
+      lastFlushTime(std::chrono::steady_clock::now()) {
+    // libpq connections cannot be shared between threads, without one of its own the buffer has no flush thread
+    if (!isOwnConnection) {
+        std::cerr << "WRITE-BEHIND: No connection of its own, the flush interval is checked on updates only.\n";
+        this->connection = connection;
+        return;
+    }
+
+    flushThread = std::thread{&WriteBehindBuffer::runFlushThread, this};
+}
+
+WriteBehindBuffer::~WriteBehindBuffer() {
+    if (flushThread.joinable()) {
+        {
+            std::lock_guard lock{bufferMutex};
+            isStopping = true;
+        }
+        flushCondition.notify_one();
+        flushThread.join();
+    }
+
+    std::set<RowKey> droppedRows;
+
+    if (!pendingUpdates.empty() && flushPending(droppedRows) != 0)
+        std::cerr << "WRITE-BEHIND: " << pendingUpdates.size() << " buffered row(s) could not be written.\n";
+
+    if (isOwnConnection)
+        PQfinish(connection);
+}
+
+void WriteBehindBuffer::runFlushThread() {
+    std::unique_lock lock{bufferMutex};
+
+    while (!flushCondition.wait_until(lock, lastFlushTime + flushInterval, [this] { return isStopping; })) {
+        // An update may have flushed in the meantime and moved the deadline
+        if (std::chrono::steady_clock::now() - lastFlushTime < flushInterval)
+            continue;
+
+        std::set<RowKey> droppedRows;
+        flushPending(droppedRows); // Failures are reported by the flush, the rows of a failed transaction stay
+    }
+}
+
+int WriteBehindBuffer::update(const std::string &tableName, const std::string &keyColumn,
+                              const std::string &keyValue, const std::string &column, const std::string &value) {
+    std::lock_guard lock{bufferMutex};
+
+    const std::map<std::string, std::string> *columnTypes = readColumnTypes(tableName);
+    const std::string *primaryKeyColumn = columnTypes == nullptr ? nullptr : readPrimaryKeyColumn(tableName);
+
+    if (primaryKeyColumn == nullptr)
+        return 1;
+
+    if (!columnTypes->contains(keyColumn) || !columnTypes->contains(column)) {
+        std::cerr << "WRITE-BEHIND failed: No column found with name "
+                << (columnTypes->contains(keyColumn) ? column : keyColumn) << ".\n";
+        return 1;
+    }
+
+    std::set<RowKey> droppedRows;
+
+    // Rows are only coalesced by primary key, another key column may reach a buffered row. Its update is written
+    // at once, after the buffered rows of the table, so the last write still wins.
+    if (keyColumn != *primaryKeyColumn) {
+        const auto tableRows = pendingUpdates.lower_bound(RowKey{tableName, "", ""});
+
+        if (tableRows != pendingUpdates.end() && tableRows->first.tableName == tableName
+            && flushPending(droppedRows) != 0)
+            return 1;
+
+        return updateRow(tableName, keyColumn, keyValue, column, value);
+    }
+
+    // Spellings of the same key ("1", "01", " 1") have to land on the same buffered row
+    RowKey rowKey{tableName, keyColumn, keyValue};
+
+    if (normalizeKeyValue(columnTypes->at(keyColumn), rowKey.keyValue))
+        return 1;
+
+    // Bounded memory: a new row which does not fit forces a flush first. The rows of a failing group are dropped by
+    // it (and reported), only a failed transaction keeps them all buffered
+    if (!pendingUpdates.contains(rowKey) && pendingUpdates.size() >= maxBufferedRows) {
+        if (flushPending(droppedRows) != 0 && pendingUpdates.size() >= maxBufferedRows)
+            return 1;
+    }
+
+    pendingUpdates[rowKey][column] = value; // Last write wins
+
+    if (durabilityMode == DurabilityMode::WRITE_THROUGH
+        || (!isOwnConnection && std::chrono::steady_clock::now() - lastFlushTime >= flushInterval)) {
+        droppedRows.clear();
+
+        // Only this update's own outcome: a failed transaction keeps it buffered, a failed group drops it
+        if (flushPending(droppedRows) != 0)
+            return durabilityMode == DurabilityMode::WRITE_THROUGH ? 1 : 0;
+
+        return droppedRows.contains(rowKey) ? 1 : 0;
+    }
+
+    return 0;
+}
+
+int WriteBehindBuffer::flush() {
+    std::lock_guard lock{bufferMutex};
+    std::set<RowKey> droppedRows;
+
+    if (flushPending(droppedRows) != 0)
+        return 1;
+
+    return droppedRows.empty() ? 0 : 1;
+}
+
+int WriteBehindBuffer::flushPending(std::set<RowKey> &droppedRows) {
+    lastFlushTime = std::chrono::steady_clock::now();
+
+    if (pendingUpdates.empty())
+        return 0;
+
+    // Rows updating the same columns of the same table can share one set-based UPDATE
+    std::map<std::tuple<std::string, std::string, std::vector<std::string> >, std::vector<const PendingRow *> > groups;
+
+    for (const auto &pendingRow: pendingUpdates) {
+        std::vector<std::string> columns;
+        columns.reserve(pendingRow.second.size());
+
+        for (const auto &[column, value]: pendingRow.second)
+            columns.push_back(column);
+
+        groups[{pendingRow.first.tableName, pendingRow.first.keyColumn, columns}].push_back(&pendingRow);
+    }
+
+    const char *beginQuery = durabilityMode == DurabilityMode::WRITE_BEHIND
+                                 ? "BEGIN; SET LOCAL synchronous_commit TO OFF;"
+                                 : "BEGIN;";
+
+    if (!executeFlushCommand(connection, beginQuery))
+        return 1;
+
+    // Every group runs under a savepoint: a group which fails (a dropped column, a value its type rejects...) would
+    // fail again on every retry, so its rows are dropped and the other groups are still written
+    std::set<RowKey> failedRows;
+
+    for (const auto &[groupKey, rows]: groups) {
+        const auto &[tableName, keyColumn, columns] = groupKey;
+
+        if (!executeFlushCommand(connection, SAVEPOINT_QUERY)) {
+            PQclear(PQexec(connection, "ROLLBACK;"));
+            return 1;
+        }
+
+        if (flushGroup(tableName, keyColumn, columns, rows) == 0) {
+            if (!executeFlushCommand(connection, RELEASE_SAVEPOINT_QUERY)) {
+                PQclear(PQexec(connection, "ROLLBACK;"));
+                return 1;
+            }
+            continue;
+        }
+
+        if (!executeFlushCommand(connection, ROLLBACK_TO_SAVEPOINT_QUERY)) {
+            PQclear(PQexec(connection, "ROLLBACK;"));
+            return 1;
+        }
+
+        std::cerr << "WRITE-BEHIND: " << rows.size() << " buffered row(s) of " << tableName
+                << " dropped, their update failed.\n";
+
+        for (const PendingRow *row: rows)
+            failedRows.insert(row->first);
+    }
+
+    // A failed commit keeps everything buffered for a retry
+    if (!executeFlushCommand(connection, "COMMIT;"))
+        return 1;
+
+    pendingUpdates.clear();
+    droppedRows.merge(failedRows);
+    return 0;
+}
+
+int WriteBehindBuffer::setDurabilityMode(const DurabilityMode mode) {
+    std::lock_guard lock{bufferMutex};
+    durabilityMode = mode;
+
+    if (mode != DurabilityMode::WRITE_THROUGH)
+        return 0;
+
+    std::set<RowKey> droppedRows;
+
+    if (flushPending(droppedRows) != 0)
+        return 1;
+
+    return droppedRows.empty() ? 0 : 1;
+}
+
+std::size_t WriteBehindBuffer::bufferedRowsCount() const {
+    std::lock_guard lock{bufferMutex};
+    return pendingUpdates.size();
+}
+
+int WriteBehindBuffer::updateRow(const std::string &tableName, const std::string &keyColumn,
+                                 const std::string &keyValue, const std::string &column, const std::string &value) {
+    const std::map<std::string, std::string> &columnTypes = columnTypesCache.at(tableName);
+
+    const std::string updateQuery =
+            std::string("UPDATE ") + tableName + std::string(" SET ") + column + std::string(" = $1::") +
+            columnTypes.at(column) + std::string(" WHERE ") + keyColumn + std::string(" = $2::") +
+            columnTypes.at(keyColumn) + std::string(";");
+
+    const char *paramValues[] = {value.c_str(), keyValue.c_str()};
+
+    PGresult *updateResult = PQexecParams(
+        connection, updateQuery.c_str(), 2, nullptr, paramValues, nullptr, nullptr, 0);
+    const bool isUpdated = PQresultStatus(updateResult) == PGRES_COMMAND_OK;
+
+    if (!isUpdated)
+        std::cerr << "WRITE-BEHIND failed: " << PQerrorMessage(connection) << std::endl;
+
+    PQclear(updateResult);
+    return isUpdated ? 0 : 1;
+}
+
+int WriteBehindBuffer::normalizeKeyValue(const std::string &keyType, std::string &keyValue) const {
+    const std::string normalizeQuery = std::string("SELECT $1::") + keyType + std::string("::text;");
+    const char *paramValues[] = {keyValue.c_str()};
+
+    PGresult *normalizeResult = PQexecParams(
+        connection, normalizeQuery.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
+
+    if (PQresultStatus(normalizeResult) != PGRES_TUPLES_OK || PQntuples(normalizeResult) != 1) {
+        std::cerr << "WRITE-BEHIND failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(normalizeResult);
+        return 1;
+    }
+
+    keyValue = PQgetvalue(normalizeResult, 0, 0);
+    PQclear(normalizeResult);
+    return 0;
+}
+
+int WriteBehindBuffer::flushGroup(const std::string &tableName, const std::string &keyColumn,
+                                  const std::vector<std::string> &columns,
+                                  const std::vector<const PendingRow *> &rows) {
+    const std::map<std::string, std::string> *columnTypes = readColumnTypes(tableName);
+
+    if (columnTypes == nullptr)
+        return 1;
+
+    if (!columnTypes->contains(keyColumn)) {
+        std::cerr << "WRITE-BEHIND FLUSH failed: No column found with name " << keyColumn << ".\n";
+        return 1;
+    }
+    for (const auto &column: columns) {
+        if (!columnTypes->contains(column)) {
+            std::cerr << "WRITE-BEHIND FLUSH failed: No column found with name " << column << ".\n";
+            return 1;
+        }
+    }
+
+    const std::size_t paramsPerRow = columns.size() + 1;
+    const std::size_t rowsPerStatement = std::max<std::size_t>(MAX_QUERY_PARAMETERS / paramsPerRow, 1);
+
+    for (std::size_t start = 0; start < rows.size(); start += rowsPerStatement) {
+        const std::size_t end = std::min(start + rowsPerStatement, rows.size());
+
+        // UPDATE t SET a = v.a, ... FROM (VALUES ($1::k, $2::a, ...), ...) AS v(key, a, ...) WHERE t.k = v.key;
+        std::stringstream updateQueryStream{};
+        updateQueryStream << "UPDATE " << tableName << " SET ";
+
+        for (std::size_t i = 0; i < columns.size(); i++) {
+            updateQueryStream << columns[i] << " = v." << columns[i];
+            if (i < columns.size() - 1)
+                updateQueryStream << ", ";
+        }
+        updateQueryStream << " FROM (VALUES ";
+
+        std::vector<const char *> paramValues;
+        paramValues.reserve((end - start) * paramsPerRow);
+
+        for (std::size_t i = start; i < end; i++) {
+            if (i > start)
+                updateQueryStream << ", ";
+
+            updateQueryStream << "($" << paramValues.size() + 1 << "::" << columnTypes->at(keyColumn);
+            paramValues.push_back(rows[i]->first.keyValue.c_str());
+
+            for (const auto &column: columns) {
+                updateQueryStream << ", $" << paramValues.size() + 1 << "::" << columnTypes->at(column);
+                paramValues.push_back(rows[i]->second.at(column).c_str());
+            }
+            updateQueryStream << ')';
+        }
+
+        updateQueryStream << ") AS v(" << KEY_VALUES_ALIAS;
+        for (const auto &column: columns)
+            updateQueryStream << ", " << column;
+        updateQueryStream << ") WHERE " << tableName << '.' << keyColumn << " = v." << KEY_VALUES_ALIAS << ';';
+
+        PGresult *updateResult = PQexecParams(
+            connection,
+            updateQueryStream.str().c_str(),
+            static_cast<int>(paramValues.size()),
+            nullptr,
+            paramValues.data(),
+            nullptr,
+            nullptr,
+            0
+        );
+
+        if (PQresultStatus(updateResult) != PGRES_COMMAND_OK) {
+            std::cerr << "WRITE-BEHIND FLUSH failed: " << PQerrorMessage(connection) << std::endl;
+
+            PQclear(updateResult);
+            return 1;
+        }
+        PQclear(updateResult);
+    }
+
+    return 0;
+}
+
+const std::map<std::string, std::string> *WriteBehindBuffer::readColumnTypes(const std::string &tableName) {
+    if (const auto cached = columnTypesCache.find(tableName); cached != columnTypesCache.end())
+        return &cached->second;
+
+    const char *paramValues[] = {tableName.c_str()};
+
+    PGresult *typesResult = PQexecParams(
+        connection,
+        "SELECT attname, format_type(atttypid, atttypmod) FROM pg_catalog.pg_attribute "
+        "WHERE attrelid = $1::regclass AND attnum > 0 AND NOT attisdropped;",
+        1,
+        nullptr,
+        paramValues,
+        nullptr,
+        nullptr,
+        0
+    );
+
+    if (PQresultStatus(typesResult) != PGRES_TUPLES_OK) {
+        std::cerr << "WRITE-BEHIND FLUSH failed: " << PQerrorMessage(connection) << std::endl;
+
+        PQclear(typesResult);
+        return nullptr;
+    }
+
+    std::map<std::string, std::string> &columnTypes = columnTypesCache[tableName];
+
+    for (int i = 0; i < PQntuples(typesResult); i++)
+        columnTypes[PQgetvalue(typesResult, i, 0)] = PQgetvalue(typesResult, i, 1);
+
+    PQclear(typesResult);
+    return &columnTypes;
+}
+
+const std::string *WriteBehindBuffer::readPrimaryKeyColumn(const std::string &tableName) {
+    if (const auto cached = primaryKeyCache.find(tableName); cached != primaryKeyCache.end())
+        return &cached->second;
+
+    std::vector<std::string> keyColumnNames;
+
+    if (ExecutionPlanner::readPrimaryKey(connection, tableName, keyColumnNames))
+        return nullptr;
+
+    std::string &primaryKeyColumn = primaryKeyCache[tableName];
+
+    if (keyColumnNames.size() == 1)
+        primaryKeyColumn = keyColumnNames.front();
+
+    return &primaryKeyColumn;
+}
+
+
+bool executeFlushCommand(PGconn *connection, const char *command) {
+    PGresult *commandResult = PQexec(connection, command);
+    const bool isSuccessful = PQresultStatus(commandResult) == PGRES_COMMAND_OK;
+
+    if (!isSuccessful)
+        std::cerr << "WRITE-BEHIND FLUSH failed: " << PQerrorMessage(connection) << std::endl;
+
+    PQclear(commandResult);
+    return isSuccessful;
+}
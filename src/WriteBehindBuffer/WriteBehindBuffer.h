@@ -0,0 +1,106 @@
+#pragma once
+#include <libpq-fe.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// How the buffered updates reach the server
+enum class DurabilityMode {
+    WRITE_BEHIND, // Coalesce updates, flush them in a transaction with synchronous_commit = off
+    WRITE_THROUGH // Flush every update immediately with a synchronous commit
+};
+
+
+// Buffers the updates of rows keyed by their primary key and flushes their net changes every flushInterval,
+// from a thread of its own on a connection of its own (cloned from the caller's). Updates through another key
+// column (or of a table without a single-column primary key) are written at once, after the buffered rows of
+// their table.
+class WriteBehindBuffer {
+    // Identifies one buffered row: (table, key column, key value as the server prints it)
+    struct RowKey {
+        std::string tableName;
+        std::string keyColumn;
+        std::string keyValue;
+
+        bool operator<(const RowKey &other) const;
+    };
+
+    // Buffered row together with its (column -> last written value) changes
+    using PendingRow = std::pair<const RowKey, std::map<std::string, std::string>>;
+
+    PGconn *connection;
+    bool isOwnConnection; // Cloned for the flush thread, else the caller's and the interval is checked by update()
+    std::size_t maxBufferedRows;
+    std::chrono::milliseconds flushInterval;
+    DurabilityMode durabilityMode;
+    std::chrono::steady_clock::time_point lastFlushTime;
+
+    // Row -> (column -> last written value), merged last-write-wins until the next flush
+    std::map<RowKey, std::map<std::string, std::string>> pendingUpdates;
+
+    // Table -> (column -> SQL type), needed to cast the text parameters of the VALUES list
+    std::map<std::string, std::map<std::string, std::string>> columnTypesCache;
+
+    // Table -> its primary key column, empty when it has none or a composite one
+    std::map<std::string, std::string> primaryKeyCache;
+
+    // Guards the buffer and the connection between the callers and the flush thread
+    mutable std::mutex bufferMutex;
+    std::condition_variable flushCondition;
+    bool isStopping = false;
+    std::thread flushThread;
+
+    // Read (and cache) the SQL types of the columns of a table
+    const std::map<std::string, std::string> *readColumnTypes(const std::string &tableName);
+
+    // Read (and cache) the primary key column of a table
+    const std::string *readPrimaryKeyColumn(const std::string &tableName);
+
+    // Replace *keyValue* by the text the server prints for it as a value of *keyType* ("01" -> "1")
+    int normalizeKeyValue(const std::string &keyType, std::string &keyValue) const;
+
+    // UPDATE a single row at once, outside the buffer
+    int updateRow(const std::string &tableName, const std::string &keyColumn, const std::string &keyValue,
+                  const std::string &column, const std::string &value);
+
+    // Write the buffered rows in one transaction, the rows of a group whose UPDATE fails go to *droppedRows*.
+    // Non-zero when the transaction failed, all rows stay buffered then.
+    int flushPending(std::set<RowKey> &droppedRows);
+
+    // Send one set-based UPDATE for rows sharing the same table, key column and updated columns
+    int flushGroup(const std::string &tableName, const std::string &keyColumn,
+                   const std::vector<std::string> &columns,
+                   const std::vector<const PendingRow *> &rows);
+
+    // Flush thread: flushes every flushInterval until the buffer is destroyed
+    void runFlushThread();
+
+public:
+    WriteBehindBuffer(PGconn *connection, std::size_t maxBufferedRows,
+                      std::chrono::milliseconds flushInterval, DurabilityMode durabilityMode);
+
+    WriteBehindBuffer(const WriteBehindBuffer &) = delete;
+    WriteBehindBuffer &operator=(const WriteBehindBuffer &) = delete;
+
+    // Buffer an UPDATE *tableName* SET *column* = *value* WHERE *keyColumn* = *keyValue*;
+    // Non-zero only when this update is rejected or lost, the dropped rows of other updates are reported apart
+    int update(const std::string &tableName, const std::string &keyColumn, const std::string &keyValue,
+               const std::string &column, const std::string &value);
+
+    // Write all the buffered net changes to the server, the rows of a group whose UPDATE fails are dropped
+    int flush();
+
+    // Switching to WRITE_THROUGH flushes everything that is still buffered
+    int setDurabilityMode(DurabilityMode mode);
+
+    std::size_t bufferedRowsCount() const;
+
+    // Stops the flush thread and flushes what is still buffered
+    ~WriteBehindBuffer();
+};